@@ -0,0 +1,579 @@
+/*
+ * Copyright (c) 2006-2016, openmetaverse.co
+ * All rights reserved.
+ *
+ * - Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * - Neither the name of the openmetaverse.co nor the names
+ *   of its contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+using System;
+using System.Collections.Generic;
+using System.Security.Cryptography;
+using System.Threading;
+using OpenMetaverse;
+using OpenMetaverse.Imaging;
+using NUnit.Framework;
+
+namespace OpenMetaverse.Tests
+{
+    [TestFixture]
+    public class OpenJPEGTests : Assert
+    {
+        /// <summary>
+        /// Builds a deterministic test pattern with gradients, a checkerboard
+        /// and some noise so every subband ends up with coefficients
+        /// </summary>
+        private static ManagedImage CreateTestImage(int width, int height, ManagedImage.ImageChannels channels, int seed)
+        {
+            ManagedImage image = new ManagedImage(width, height, channels);
+            Random rand = new Random(seed);
+
+            for (int y = 0; y < height; y++)
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    int i = y * width + x;
+                    int checker = ((x / 8 + y / 8) % 2) * 40;
+
+                    image.Red[i] = (byte)((x * 255 / width + checker + rand.Next(16)) & 0xFF);
+                    image.Green[i] = (byte)((y * 255 / height + checker + rand.Next(16)) & 0xFF);
+                    image.Blue[i] = (byte)(((x + y) * 127 / (width + height) + checker + rand.Next(16)) & 0xFF);
+                    if (image.Alpha != null)
+                        image.Alpha[i] = (byte)(255 - checker - rand.Next(16));
+                }
+            }
+
+            return image;
+        }
+
+        private static void AssertSameImage(ManagedImage expected, ManagedImage actual, string message)
+        {
+            Assert.IsNotNull(actual, message);
+            Assert.AreEqual(expected.Width, actual.Width, message);
+            Assert.AreEqual(expected.Height, actual.Height, message);
+            Assert.AreEqual(expected.Channels, actual.Channels, message);
+            Assert.AreEqual(expected.Red, actual.Red, message);
+            Assert.AreEqual(expected.Green, actual.Green, message);
+            Assert.AreEqual(expected.Blue, actual.Blue, message);
+            if (expected.Alpha != null)
+                Assert.AreEqual(expected.Alpha, actual.Alpha, message);
+        }
+
+        [Test]
+        public void LosslessRoundTrip()
+        {
+            ManagedImage.ImageChannels[] channelSets = new ManagedImage.ImageChannels[]
+            {
+                ManagedImage.ImageChannels.Color,
+                ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha,
+                ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha | ManagedImage.ImageChannels.Bump
+            };
+
+            foreach (ManagedImage.ImageChannels channels in channelSets)
+            {
+                ManagedImage source = CreateTestImage(96, 40, channels, 10);
+                if (source.Bump != null)
+                {
+                    for (int i = 0; i < source.Bump.Length; i++)
+                        source.Bump[i] = (byte)(i * 7);
+                }
+
+                ManagedImage decoded;
+                Assert.IsTrue(OpenJPEG.DecodeToImage(OpenJPEG.Encode(source, true), out decoded), "Decode failed for " + channels);
+                AssertSameImage(source, decoded, "Lossless round trip differs for " + channels);
+                if (source.Bump != null)
+                    Assert.AreEqual(source.Bump, decoded.Bump, "Bump channel differs");
+            }
+        }
+
+        [Test]
+        public void DecodeHeader()
+        {
+            byte[] encoded = OpenJPEG.Encode(CreateTestImage(256, 128,
+                ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha, 5), false);
+
+            OpenJPEG.J2KHeaderInfo info;
+            Assert.IsTrue(OpenJPEG.DecodeHeader(encoded, out info), "DecodeHeader failed");
+            Assert.AreEqual(256, info.Width);
+            Assert.AreEqual(128, info.Height);
+            Assert.AreEqual(4, info.Components);
+            Assert.AreEqual(5, info.Layers);
+            Assert.AreEqual(6, info.Resolutions);
+
+            // Only the main header is needed, so cut the stream at the first SOT marker
+            int sot = 0;
+            while (sot < encoded.Length - 1 && !(encoded[sot] == 0xFF && encoded[sot + 1] == 0x90))
+                sot++;
+            byte[] header = new byte[sot + 2];
+            Buffer.BlockCopy(encoded, 0, header, 0, header.Length);
+
+            OpenJPEG.J2KHeaderInfo headerOnly;
+            Assert.IsTrue(OpenJPEG.DecodeHeader(header, out headerOnly), "DecodeHeader on a bare main header failed");
+            Assert.AreEqual(info, headerOnly);
+
+            Assert.IsFalse(OpenJPEG.DecodeHeader(new byte[] { 0xFF, 0x4F, 0x00, 0x00 }, out info),
+                "DecodeHeader accepted a stream without SIZ");
+        }
+
+        [Test]
+        public void DecodeLayerBoundaries()
+        {
+            byte[] encoded = OpenJPEG.Encode(CreateTestImage(256, 256,
+                ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha, 6), false);
+
+            OpenJPEG.J2KLayerInfo[] layers;
+            int components;
+            Assert.IsTrue(OpenJPEG.DecodeLayerBoundaries(encoded, out layers, out components), "DecodeLayerBoundaries failed");
+            Assert.AreEqual(4, components);
+            Assert.AreEqual(5, layers.Length);
+
+            for (int i = 0; i < layers.Length; i++)
+            {
+                Assert.Less(layers[i].Start, layers[i].End, "Layer " + i + " is empty");
+                if (i > 0)
+                    Assert.Less(layers[i - 1].End, layers[i].Start, "Layer " + i + " overlaps the previous layer");
+            }
+            Assert.Less(layers[layers.Length - 1].End, encoded.Length);
+
+            // The first layer starts right after the SOD marker of the only tile
+            Assert.AreEqual(0xFF, encoded[layers[0].Start - 2]);
+            Assert.AreEqual(0x93, encoded[layers[0].Start - 1]);
+
+            byte[] lossless = OpenJPEG.Encode(CreateTestImage(64, 64, ManagedImage.ImageChannels.Color, 7), true);
+            Assert.IsTrue(OpenJPEG.DecodeLayerBoundaries(lossless, out layers, out components), "DecodeLayerBoundaries failed on a lossless stream");
+            Assert.AreEqual(3, components);
+            Assert.AreEqual(1, layers.Length);
+        }
+
+        [Test]
+        public void DecodeReduced()
+        {
+            ManagedImage source = CreateTestImage(200, 120, ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha, 8);
+            byte[] encoded = OpenJPEG.Encode(source, true);
+
+            ManagedImage full, reduced;
+            Assert.IsTrue(OpenJPEG.DecodeToImage(encoded, out full), "Full size decode failed");
+            Assert.IsTrue(OpenJPEG.DecodeToImage(encoded, out reduced, 0), "Discard level 0 decode failed");
+            AssertSameImage(full, reduced, "Discard level 0 differs from a full decode");
+
+            // Each discard level halves the size, rounding up
+            for (int discard = 1; discard <= 5; discard++)
+            {
+                Assert.IsTrue(OpenJPEG.DecodeToImage(encoded, out reduced, discard), "Discard level " + discard + " decode failed");
+                Assert.AreEqual((200 + (1 << discard) - 1) >> discard, reduced.Width);
+                Assert.AreEqual((120 + (1 << discard) - 1) >> discard, reduced.Height);
+                Assert.IsNotNull(reduced.Alpha);
+            }
+
+            // The half size image is a low pass of the original, so it stays
+            // close to a box filtered downscale
+            Assert.IsTrue(OpenJPEG.DecodeToImage(encoded, out reduced, 1), "Discard level 1 decode failed");
+            long error = 0;
+            for (int y = 0; y < reduced.Height; y++)
+            {
+                for (int x = 0; x < reduced.Width; x++)
+                {
+                    int i = y * 2 * source.Width + x * 2;
+                    int box = (source.Red[i] + source.Red[i + 1] + source.Red[i + source.Width] + source.Red[i + source.Width + 1] + 2) / 4;
+                    error += Math.Abs(box - reduced.Red[y * reduced.Width + x]);
+                }
+            }
+            Assert.Less((int)(error / (reduced.Width * reduced.Height)), 16, "Half size decode does not resemble the source");
+
+            // The default encoder writes five decomposition levels
+            Assert.IsFalse(OpenJPEG.DecodeToImage(encoded, out reduced, 6), "Discarding every resolution should fail");
+        }
+
+        [Test]
+        public void DecodeReducedWithMct()
+        {
+            // Lossy colour images go through the irreversible MCT, which only
+            // covers the decoded resolution. An odd width keeps its rows unaligned.
+            ManagedImage source = CreateTestImage(203, 117, ManagedImage.ImageChannels.Color, 16);
+            byte[] encoded = OpenJPEG.Encode(source, false);
+
+            for (int discard = 1; discard <= 3; discard++)
+            {
+                ManagedImage reduced;
+                Assert.IsTrue(OpenJPEG.DecodeToImage(encoded, out reduced, discard), "Discard level " + discard + " decode failed");
+                Assert.AreEqual((203 + (1 << discard) - 1) >> discard, reduced.Width);
+                Assert.AreEqual((117 + (1 << discard) - 1) >> discard, reduced.Height);
+
+                // The low pass keeps the average colour, which a wrong inverse MCT would not
+                byte[][] sourceChannels = new byte[][] { source.Red, source.Green, source.Blue };
+                byte[][] reducedChannels = new byte[][] { reduced.Red, reduced.Green, reduced.Blue };
+                for (int c = 0; c < 3; c++)
+                {
+                    long sourceSum = 0, reducedSum = 0;
+                    foreach (byte v in sourceChannels[c])
+                        sourceSum += v;
+                    foreach (byte v in reducedChannels[c])
+                        reducedSum += v;
+                    int sourceMean = (int)(sourceSum / sourceChannels[c].Length);
+                    int reducedMean = (int)(reducedSum / reducedChannels[c].Length);
+                    Assert.Less(Math.Abs(sourceMean - reducedMean), 4, "Channel " + c + " at discard level " + discard + " changed colour");
+                }
+            }
+        }
+
+        [Test]
+        public void DecodeFirstLayers()
+        {
+            byte[] encoded = OpenJPEG.Encode(CreateTestImage(256, 256,
+                ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha, 9), false);
+
+            OpenJPEG.J2KLayerInfo[] layers;
+            int components;
+            Assert.IsTrue(OpenJPEG.DecodeLayerBoundaries(encoded, out layers, out components), "DecodeLayerBoundaries failed");
+
+            ManagedImage full, all;
+            Assert.IsTrue(OpenJPEG.DecodeToImage(encoded, out full), "Full decode failed");
+            Assert.IsTrue(OpenJPEG.DecodeToImage(encoded, out all, 0, layers.Length), "Decode of every layer failed");
+            AssertSameImage(full, all, "Decoding every layer differs from a full decode");
+
+            ManagedImage previous = null;
+            for (int count = 1; count < layers.Length; count++)
+            {
+                ManagedImage partial;
+                Assert.IsTrue(OpenJPEG.DecodeToImage(encoded, out partial, 0, count), "Decode of " + count + " layers failed");
+                Assert.AreEqual(256, partial.Width);
+                if (previous != null)
+                    Assert.AreNotEqual(previous.Red, partial.Red, "Layer " + count + " did not refine the image");
+                previous = partial;
+
+                // A download that stopped right after the last requested layer decodes the same
+                byte[] truncated = new byte[layers[count - 1].End + 1];
+                Buffer.BlockCopy(encoded, 0, truncated, 0, truncated.Length);
+                ManagedImage fromTruncated;
+                Assert.IsTrue(OpenJPEG.DecodeToImage(truncated, out fromTruncated, 0, count), "Decode of " + count + " downloaded layers failed");
+                AssertSameImage(partial, fromTruncated, "Truncated stream with " + count + " layers differs");
+            }
+            Assert.AreNotEqual(previous.Red, full.Red, "The last layer did not refine the image");
+
+            ManagedImage thumbnail;
+            Assert.IsTrue(OpenJPEG.DecodeToImage(encoded, out thumbnail, 2, 1), "Reduced decode of the first layer failed");
+            Assert.AreEqual(64, thumbnail.Width);
+            Assert.AreEqual(64, thumbnail.Height);
+        }
+
+        [Test]
+        public void DecodeToInterleaved()
+        {
+            // An odd width leaves a partial group of pixels at the end of every row
+            byte[][] streams = new byte[][] {
+                OpenJPEG.Encode(CreateTestImage(250, 100, ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha, 4), false),
+                OpenJPEG.Encode(CreateTestImage(67, 33, ManagedImage.ImageChannels.Color, 5), true)
+            };
+
+            foreach (byte[] encoded in streams)
+            {
+                for (int discardLevel = 0; discardLevel <= 2; discardLevel++)
+                {
+                    ManagedImage planar;
+                    Assert.IsTrue(OpenJPEG.DecodeToImage(encoded, out planar, discardLevel, 0), "Planar decode failed");
+
+                    for (int order = 0; order < 2; order++)
+                    {
+                        bool bgra = order == 1;
+                        byte[] pixels;
+                        int width, height;
+                        Assert.IsTrue(OpenJPEG.DecodeToInterleaved(encoded, bgra, discardLevel, 0, out pixels, out width, out height),
+                            "Interleaved decode failed");
+                        Assert.AreEqual(planar.Width, width);
+                        Assert.AreEqual(planar.Height, height);
+                        Assert.AreEqual(width * height * 4, pixels.Length);
+
+                        for (int i = 0; i < width * height; i++)
+                        {
+                            byte a = planar.Alpha != null ? planar.Alpha[i] : (byte)255;
+                            if (pixels[i * 4 + (bgra ? 2 : 0)] != planar.Red[i] || pixels[i * 4 + 1] != planar.Green[i] ||
+                                pixels[i * 4 + (bgra ? 0 : 2)] != planar.Blue[i] || pixels[i * 4 + 3] != a)
+                            {
+                                Assert.Fail("Pixel " + i + " differs from the planar decode at discard level " +
+                                    discardLevel + (bgra ? " (BGRA)" : " (RGBA)"));
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        [Test]
+        public void EncodeFromInterleaved()
+        {
+            ManagedImage.ImageChannels[] channelSets = new ManagedImage.ImageChannels[]
+            {
+                ManagedImage.ImageChannels.Color,
+                ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha
+            };
+
+            foreach (ManagedImage.ImageChannels channels in channelSets)
+            {
+                // An odd width leaves a partial group of pixels at the end of every row
+                ManagedImage source = CreateTestImage(133, 70, channels, 6);
+                bool alpha = source.Alpha != null;
+
+                for (int order = 0; order < 2; order++)
+                {
+                    bool bgra = order == 1;
+                    byte[] pixels = new byte[source.Width * source.Height * 4];
+                    for (int i = 0; i < source.Width * source.Height; i++)
+                    {
+                        pixels[i * 4 + (bgra ? 2 : 0)] = source.Red[i];
+                        pixels[i * 4 + 1] = source.Green[i];
+                        pixels[i * 4 + (bgra ? 0 : 2)] = source.Blue[i];
+                        // must be ignored without alpha
+                        pixels[i * 4 + 3] = alpha ? source.Alpha[i] : (byte)i;
+                    }
+
+                    foreach (bool lossless in new bool[] { true, false })
+                    {
+                        Assert.AreEqual(OpenJPEG.Encode(source, lossless),
+                            OpenJPEG.EncodeFromInterleaved(pixels, source.Width, source.Height, bgra, alpha, lossless),
+                            "Interleaved encode differs for " + channels + (bgra ? " (BGRA)" : " (RGBA)") +
+                            (lossless ? ", lossless" : ", lossy"));
+                    }
+                }
+            }
+        }
+
+        /// <summary>
+        /// Codestreams the encoder produced for the images of EncodeMatchesReferenceCodestreams
+        /// before its MQ coder was rewritten, as SHA-1 digests. Any change to the encoder
+        /// that is meant to be output-neutral must keep these
+        /// </summary>
+        private static readonly string[] ReferenceCodestreams = new string[]
+        {
+            "a46398f90be5b9a86d94de282ac1a15126a73ceb", "0d5a7adcef497ad1c700e10f2dc0d552e70d4d42",
+            "f3775eb117b09a2ce1a2353286b53e3eb036bea8", "cc3fd36f9e7b1594b9cc0be766484d9496a69495",
+            "a238d1cb6369f96458052c1f35e5f2f14262ca0f", "c34a66f0478bf06e9f6c96f6d3c359327501ebaf",
+            "73dddcbb14d55ef0afd83d6edf1a047319def140", "b17b5d0c6750a0f4db3c36aac67f2d019bbd27c3",
+            "ed8a29e382a89d87059c7eb0cd21308ad484227e", "c4e4d7cfc4508916ad3598a18fe7bbf6b727a0ae",
+        };
+
+        [Test]
+        public void EncodeMatchesReferenceCodestreams()
+        {
+            ManagedImage.ImageChannels color = ManagedImage.ImageChannels.Color;
+            ManagedImage.ImageChannels alpha = ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha;
+            ManagedImage[] images = new ManagedImage[]
+            {
+                CreateTestImage(256, 256, color, 11),
+                CreateTestImage(128, 96, alpha, 12),
+                CreateTestImage(33, 517, color, 13),
+                CreateTestImage(200, 150, alpha | ManagedImage.ImageChannels.Bump, 14),
+                CreateTestImage(16, 16, color, 15),
+            };
+            images[3].Bump = (byte[])images[3].Red.Clone();
+
+            using (SHA1 sha1 = SHA1.Create())
+            {
+                for (int i = 0; i < images.Length; i++)
+                {
+                    for (int lossless = 0; lossless < 2; lossless++)
+                    {
+                        byte[] encoded = OpenJPEG.Encode(images[i], lossless != 0);
+                        string digest = BitConverter.ToString(sha1.ComputeHash(encoded)).Replace("-", "").ToLowerInvariant();
+                        Assert.AreEqual(ReferenceCodestreams[i * 2 + lossless], digest,
+                            "Image " + i + (lossless != 0 ? " lossless" : " lossy") + " (" + encoded.Length + " bytes)");
+                    }
+                }
+            }
+        }
+
+        [Test]
+        public void DecodeBatch()
+        {
+            List<byte[]> streams = new List<byte[]>();
+            for (int i = 0; i < 12; i++)
+            {
+                ManagedImage.ImageChannels channels = ManagedImage.ImageChannels.Color;
+                if (i % 2 == 0)
+                    channels |= ManagedImage.ImageChannels.Alpha;
+                streams.Add(OpenJPEG.Encode(CreateTestImage(64 + i * 16, 128 - i * 4, channels, 20 + i), i % 3 == 0));
+            }
+
+            // A stream cut inside the main header fails on its own
+            byte[] broken = new byte[40];
+            Buffer.BlockCopy(streams[0], 0, broken, 0, broken.Length);
+            streams.Insert(5, broken);
+
+            ManagedImage[] images;
+            Assert.IsFalse(OpenJPEG.DecodeToImages(streams.ToArray(), out images, 0, 4), "A broken stream was not reported");
+            Assert.AreEqual(streams.Count, images.Length);
+
+            for (int i = 0; i < streams.Count; i++)
+            {
+                ManagedImage expected;
+                if (!OpenJPEG.DecodeToImage(streams[i], out expected))
+                {
+                    Assert.IsNull(images[i], "Image " + i + " should have failed");
+                    continue;
+                }
+                AssertSameImage(expected, images[i], "Batch decode of image " + i + " differs");
+            }
+            Assert.IsNull(images[5]);
+
+            ManagedImage[] reduced;
+            streams.RemoveAt(5);
+            Assert.IsTrue(OpenJPEG.DecodeToImages(streams.ToArray(), out reduced, 1, 0), "Reduced batch decode failed");
+            Assert.AreEqual(32, reduced[0].Width);
+
+            Assert.IsTrue(OpenJPEG.DecodeToImages(new byte[0][], out images, 0, 0), "Empty batch failed");
+            Assert.AreEqual(0, images.Length);
+        }
+
+        [Test]
+        public void ReusedDecoderMatchesFreshDecodes()
+        {
+            // Same sized images reuse the kept tiles, the others make the
+            // decoder grow or shrink them in between
+            byte[][] streams = new byte[][] {
+                OpenJPEG.Encode(CreateTestImage(128, 128, ManagedImage.ImageChannels.Color, 30), false),
+                OpenJPEG.Encode(CreateTestImage(128, 128, ManagedImage.ImageChannels.Color, 31), false),
+                OpenJPEG.Encode(CreateTestImage(300, 200, ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha, 32), false),
+                OpenJPEG.Encode(CreateTestImage(37, 19, ManagedImage.ImageChannels.Color, 33), true),
+                OpenJPEG.Encode(CreateTestImage(128, 128, ManagedImage.ImageChannels.Color, 34), true)
+            };
+            byte[] broken = new byte[streams[2].Length / 2];
+            Buffer.BlockCopy(streams[2], 0, broken, 0, broken.Length);
+
+            OpenJPEG.Decoder decoder = new OpenJPEG.Decoder();
+            for (int pass = 0; pass < 2; pass++)
+            {
+                for (int i = 0; i < streams.Length; i++)
+                {
+                    int discardLevel = (i + pass) % 3;
+                    int maxLayers = pass;
+                    string what = "image " + i + " pass " + pass;
+
+                    ManagedImage expected, actual;
+                    Assert.IsTrue(OpenJPEG.DecodeToImage(streams[i], out expected, discardLevel, maxLayers), "Fresh decode of " + what + " failed");
+                    Assert.IsTrue(decoder.DecodeToImage(streams[i], out actual, discardLevel, maxLayers), "Reused decode of " + what + " failed");
+                    AssertSameImage(expected, actual, "Reused decode of " + what + " differs");
+
+                    byte[] expectedPixels, actualPixels;
+                    int width, height;
+                    Assert.IsTrue(OpenJPEG.DecodeToInterleaved(streams[i], true, discardLevel, maxLayers, out expectedPixels, out width, out height));
+                    Assert.IsTrue(decoder.DecodeToInterleaved(streams[i], true, discardLevel, maxLayers, out actualPixels, out width, out height),
+                        "Reused interleaved decode of " + what + " failed");
+                    Assert.AreEqual(expectedPixels, actualPixels, "Reused interleaved decode of " + what + " differs");
+
+                    // A failed decode leaves the decoder usable
+                    ManagedImage ignored;
+                    Assert.IsFalse(decoder.DecodeToImage(new byte[40], out ignored, 0, 0), "Garbage decoded");
+                }
+                ManagedImage partial;
+                decoder.DecodeToImage(broken, out partial, 0, 0);
+            }
+
+            decoder.Dispose();
+            decoder.Dispose();
+            ManagedImage disposed;
+            try
+            {
+                decoder.DecodeToImage(streams[0], out disposed, 0, 0);
+                Assert.Fail("A disposed decoder decoded");
+            }
+            catch (ObjectDisposedException) { }
+        }
+
+        [Test]
+        public void ConcurrentDecodeIsBitExact()
+        {
+            List<byte[]> streams = new List<byte[]>();
+            streams.Add(OpenJPEG.Encode(CreateTestImage(256, 256,
+                ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha, 1), false));
+            streams.Add(OpenJPEG.Encode(CreateTestImage(128, 64,
+                ManagedImage.ImageChannels.Color, 2), false));
+            streams.Add(OpenJPEG.Encode(CreateTestImage(64, 64,
+                ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha, 3), true));
+
+            // Serial reference decodes
+            ManagedImage[] reference = new ManagedImage[streams.Count];
+            for (int i = 0; i < streams.Count; i++)
+                Assert.IsTrue(OpenJPEG.DecodeToImage(streams[i], out reference[i]), "Reference decode " + i + " failed");
+
+            int threadCount = Math.Max(4, Environment.ProcessorCount * 2);
+            const int iterations = 16;
+            Exception[] failures = new Exception[threadCount];
+            Thread[] threads = new Thread[threadCount];
+
+            for (int t = 0; t < threadCount; t++)
+            {
+                int threadIndex = t;
+                threads[t] = new Thread(delegate()
+                {
+                    try
+                    {
+                        for (int j = 0; j < iterations; j++)
+                        {
+                            int k = (threadIndex + j) % streams.Count;
+                            ManagedImage decoded;
+
+                            Assert.IsTrue(OpenJPEG.DecodeToImage(streams[k], out decoded), "Concurrent decode failed");
+                            AssertSameImage(reference[k], decoded, "Concurrent decode of stream " + k + " differs");
+                        }
+                    }
+                    catch (Exception ex)
+                    {
+                        failures[threadIndex] = ex;
+                    }
+                });
+                threads[t].Start();
+            }
+
+            for (int t = 0; t < threadCount; t++)
+                threads[t].Join();
+
+            for (int t = 0; t < threadCount; t++)
+            {
+                if (failures[t] != null)
+                    Assert.Fail("Thread " + t + ": " + failures[t].Message);
+            }
+        }
+
+        [Test]
+        public void ConcurrentEncodeIsDeterministic()
+        {
+            ManagedImage source = CreateTestImage(128, 128,
+                ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha, 4);
+            byte[] reference = OpenJPEG.Encode(source, false);
+
+            int threadCount = Math.Max(4, Environment.ProcessorCount);
+            byte[][] results = new byte[threadCount][];
+            Thread[] threads = new Thread[threadCount];
+
+            for (int t = 0; t < threadCount; t++)
+            {
+                int threadIndex = t;
+                threads[t] = new Thread(delegate() { results[threadIndex] = OpenJPEG.Encode(source, false); });
+                threads[t].Start();
+            }
+
+            for (int t = 0; t < threadCount; t++)
+            {
+                threads[t].Join();
+                Assert.AreEqual(reference, results[t], "Concurrent encode " + t + " produced a different codestream");
+            }
+        }
+    }
+}
@@ -55,6 +55,19 @@ namespace OpenMetaverse.Imaging
             public int End;
         }
 
+        /// <summary>
+        /// Image properties read from the main header of a JPEG2000 stream
+        /// </summary>
+        [StructLayout(LayoutKind.Sequential, Pack = 4)]
+        public struct J2KHeaderInfo
+        {
+            public int Width;
+            public int Height;
+            public int Components;
+            public int Layers;
+            public int Resolutions;
+        }
+
         /// <summary>
         /// This structure is used to marshal both encoded and decoded images.
         /// MUST MATCH THE STRUCT IN dotnet.h!
@@ -75,6 +88,7 @@ namespace OpenMetaverse.Imaging
             public int components;             // component count
             public int packet_count;           // packet count
             public IntPtr packets;             // pointer to the packets array
+            public IntPtr layer_bounds;        // pointer to the J2KLayerInfo array
         }
 
         /// <summary>
@@ -122,16 +136,86 @@ namespace OpenMetaverse.Imaging
         [DllImport("openjpeg-dotnet.dll", CallingConvention = CallingConvention.Cdecl)]
         private static extern bool DotNetEncode(ref MarshalledImage image, bool lossless);
 
+        // encode caller owned planes to jpeg2000
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet.dll", CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        private static extern bool DotNetEncodeFromPlanes(ref MarshalledImage image, IntPtr planes, bool lossless);
+
+        // encode caller owned RGBA or BGRA rows to jpeg2000
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet.dll", CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        private static extern bool DotNetEncodeInterleaved(ref MarshalledImage image, IntPtr input, int stride, bool bgra, bool lossless);
+
         // decode jpeg2000 to raw
         [System.Security.SuppressUnmanagedCodeSecurity]
         [DllImport("openjpeg-dotnet.dll", CallingConvention = CallingConvention.Cdecl)]
         private static extern bool DotNetDecode(ref MarshalledImage image);
 
+        // decode the first layers of jpeg2000, optionally at a reduced resolution, into caller owned planes
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet.dll", CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        private static extern bool DotNetDecodeToPlanes(ref MarshalledImage image, IntPtr planes, int discard_level, int max_layers);
+
+        // decode the first layers of jpeg2000, optionally at a reduced resolution, into caller owned RGBA or BGRA rows
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet.dll", CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        private static extern bool DotNetDecodeInterleaved(ref MarshalledImage image, IntPtr output, int stride, bool bgra, int discard_level, int max_layers);
+
+        // decode many jpeg2000 images to raw on a native thread pool
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet.dll", CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        private static extern bool DotNetDecodeBatch(IntPtr images, int count, IntPtr results, int discard_level, int max_layers, int max_threads);
+
         // decode jpeg2000 to raw, get jpeg2000 file info
         [System.Security.SuppressUnmanagedCodeSecurity]
         [DllImport("openjpeg-dotnet.dll", CallingConvention = CallingConvention.Cdecl)]
         private static extern bool DotNetDecodeWithInfo(ref MarshalledImage image);
 
+        // read the jpeg2000 main header only
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet.dll", CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        private static extern bool DotNetProbe(ref MarshalledImage image);
+
+        // parse the jpeg2000 packet headers only, get the layer boundaries
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet.dll", CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        private static extern bool DotNetDecodeLayerBoundaries(ref MarshalledImage image);
+
+        // create a jpeg2000 decoder that keeps its memory from one image to the next
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern IntPtr DotNetDecoderCreate();
+
+        // destroy a jpeg2000 decoder and the memory it kept
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void DotNetDecoderDestroy(IntPtr decoder);
+
+        // DotNetDecodeToPlanes with a decoder kept by the caller
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet.dll", CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        private static extern bool DotNetDecoderDecodeToPlanes(IntPtr decoder, ref MarshalledImage image, IntPtr planes, int discard_level, int max_layers);
+
+        // DotNetDecodeInterleaved with a decoder kept by the caller
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet.dll", CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        private static extern bool DotNetDecoderDecodeInterleaved(IntPtr decoder, ref MarshalledImage image, IntPtr output, int stride, bool bgra, int discard_level, int max_layers);
+
+        // DotNetProbe with a decoder kept by the caller
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet.dll", CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        private static extern bool DotNetDecoderProbe(IntPtr decoder, ref MarshalledImage image);
+
         // invoke 64 bit openjpeg calls        
         [System.Security.SuppressUnmanagedCodeSecurity]
         [DllImport("openjpeg-dotnet-x86_64.dll", CallingConvention = CallingConvention.Cdecl)]
@@ -152,20 +236,86 @@ namespace OpenMetaverse.Imaging
         [DllImport("openjpeg-dotnet-x86_64.dll", CallingConvention = CallingConvention.Cdecl)]
         private static extern bool DotNetEncode64(ref MarshalledImage image, bool lossless);
 
+        // encode caller owned planes to jpeg2000
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet-x86_64.dll", CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        private static extern bool DotNetEncodeFromPlanes64(ref MarshalledImage image, IntPtr planes, bool lossless);
+
+        // encode caller owned RGBA or BGRA rows to jpeg2000
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet-x86_64.dll", CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        private static extern bool DotNetEncodeInterleaved64(ref MarshalledImage image, IntPtr input, int stride, bool bgra, bool lossless);
+
         // decode jpeg2000 to raw
         [System.Security.SuppressUnmanagedCodeSecurity]
         [DllImport("openjpeg-dotnet-x86_64.dll", CallingConvention = CallingConvention.Cdecl)]
         private static extern bool DotNetDecode64(ref MarshalledImage image);
 
+        // decode the first layers of jpeg2000, optionally at a reduced resolution, into caller owned planes
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet-x86_64.dll", CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        private static extern bool DotNetDecodeToPlanes64(ref MarshalledImage image, IntPtr planes, int discard_level, int max_layers);
+
+        // decode the first layers of jpeg2000, optionally at a reduced resolution, into caller owned RGBA or BGRA rows
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet-x86_64.dll", CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        private static extern bool DotNetDecodeInterleaved64(ref MarshalledImage image, IntPtr output, int stride, bool bgra, int discard_level, int max_layers);
+
+        // decode many jpeg2000 images to raw on a native thread pool
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet-x86_64.dll", CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        private static extern bool DotNetDecodeBatch64(IntPtr images, int count, IntPtr results, int discard_level, int max_layers, int max_threads);
+
         // decode jpeg2000 to raw, get jpeg2000 file info
         [System.Security.SuppressUnmanagedCodeSecurity]
         [DllImport("openjpeg-dotnet-x86_64.dll", CallingConvention = CallingConvention.Cdecl)]
         private static extern bool DotNetDecodeWithInfo64(ref MarshalledImage image);
-        #endregion Unmanaged Function Declarations
 
-        /// <summary>OpenJPEG is not threadsafe, so this object is used to lock
-        /// during calls into unmanaged code</summary>
-        private static object OpenJPEGLock = new object();
+        // read the jpeg2000 main header only
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet-x86_64.dll", CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        private static extern bool DotNetProbe64(ref MarshalledImage image);
+
+        // parse the jpeg2000 packet headers only, get the layer boundaries
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet-x86_64.dll", CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        private static extern bool DotNetDecodeLayerBoundaries64(ref MarshalledImage image);
+
+        // create a jpeg2000 decoder that keeps its memory from one image to the next
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet-x86_64.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern IntPtr DotNetDecoderCreate64();
+
+        // destroy a jpeg2000 decoder and the memory it kept
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet-x86_64.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void DotNetDecoderDestroy64(IntPtr decoder);
+
+        // DotNetDecodeToPlanes with a decoder kept by the caller
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet-x86_64.dll", CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        private static extern bool DotNetDecoderDecodeToPlanes64(IntPtr decoder, ref MarshalledImage image, IntPtr planes, int discard_level, int max_layers);
+
+        // DotNetDecodeInterleaved with a decoder kept by the caller
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet-x86_64.dll", CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        private static extern bool DotNetDecoderDecodeInterleaved64(IntPtr decoder, ref MarshalledImage image, IntPtr output, int stride, bool bgra, int discard_level, int max_layers);
+
+        // DotNetProbe with a decoder kept by the caller
+        [System.Security.SuppressUnmanagedCodeSecurity]
+        [DllImport("openjpeg-dotnet-x86_64.dll", CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.I1)]
+        private static extern bool DotNetDecoderProbe64(IntPtr decoder, ref MarshalledImage image);
+        #endregion Unmanaged Function Declarations
 
         /// <summary>
         /// Encode a <seealso cref="ManagedImage"/> object into a byte array
@@ -173,7 +323,7 @@ namespace OpenMetaverse.Imaging
         /// <param name="image">The <seealso cref="ManagedImage"/> object to encode</param>
         /// <param name="lossless">true to enable lossless conversion, only useful for small images ie: sculptmaps</param>
         /// <returns>A byte array containing the encoded Image object</returns>
-        public static byte[] Encode(ManagedImage image, bool lossless)
+        public unsafe static byte[] Encode(ManagedImage image, bool lossless)
         {
             if ((image.Channels & ManagedImage.ImageChannels.Color) == 0 ||
                 ((image.Channels & ManagedImage.ImageChannels.Bump) != 0 && (image.Channels & ManagedImage.ImageChannels.Alpha) == 0))
@@ -182,48 +332,42 @@ namespace OpenMetaverse.Imaging
             byte[] encoded = null;
             MarshalledImage marshalled = new MarshalledImage();
 
-            // allocate and copy to input buffer
             marshalled.width = image.Width;
             marshalled.height = image.Height;
             marshalled.components = 3;
             if ((image.Channels & ManagedImage.ImageChannels.Alpha) != 0) marshalled.components++;
             if ((image.Channels & ManagedImage.ImageChannels.Bump) != 0) marshalled.components++;
 
-            lock (OpenJPEGLock)
-            {
-
-                bool allocSuccess = (IntPtr.Size == 8) ? DotNetAllocDecoded64(ref marshalled) : DotNetAllocDecoded(ref marshalled);
-
-                if (!allocSuccess)
-                    throw new Exception("DotNetAllocDecoded failed");
+            bool encodeSuccess;
 
-                int n = image.Width * image.Height;
-
-                if ((image.Channels & ManagedImage.ImageChannels.Color) != 0)
-                {
-                    Marshal.Copy(image.Red, 0, marshalled.decoded, n);
-                    Marshal.Copy(image.Green, 0, (IntPtr)(marshalled.decoded.ToInt64() + n), n);
-                    Marshal.Copy(image.Blue, 0, (IntPtr)(marshalled.decoded.ToInt64() + n * 2), n);
-                }
-
-                if ((image.Channels & ManagedImage.ImageChannels.Alpha) != 0) Marshal.Copy(image.Alpha, 0, (IntPtr)(marshalled.decoded.ToInt64() + n * 3), n);
-                if ((image.Channels & ManagedImage.ImageChannels.Bump) != 0) Marshal.Copy(image.Bump, 0, (IntPtr)(marshalled.decoded.ToInt64() + n * 4), n);
+            // The codec reads the channels straight out of the managed arrays
+            fixed (byte* red = image.Red, green = image.Green, blue = image.Blue, alpha = image.Alpha, bump = image.Bump)
+            {
+                byte** planes = stackalloc byte*[5];
+                planes[0] = red;
+                planes[1] = green;
+                planes[2] = blue;
+                planes[3] = alpha;
+                planes[4] = bump;
+
+                // codec will allocate output buffer
+                encodeSuccess = (IntPtr.Size == 8) ?
+                    DotNetEncodeFromPlanes64(ref marshalled, (IntPtr)planes, lossless) :
+                    DotNetEncodeFromPlanes(ref marshalled, (IntPtr)planes, lossless);
+            }
 
-                // codec will allocate output buffer                
-                bool encodeSuccess = (IntPtr.Size == 8) ? DotNetEncode64(ref marshalled, lossless) : DotNetEncode(ref marshalled, lossless);
-                if (!encodeSuccess)
-                    throw new Exception("DotNetEncode failed");
+            if (!encodeSuccess)
+                throw new Exception("DotNetEncode failed");
 
-                // copy output buffer
-                encoded = new byte[marshalled.length];
-                Marshal.Copy(marshalled.encoded, encoded, 0, marshalled.length);
+            // copy output buffer
+            encoded = new byte[marshalled.length];
+            Marshal.Copy(marshalled.encoded, encoded, 0, marshalled.length);
 
-                // free buffers
-                if (IntPtr.Size == 8)
-                    DotNetFree64(ref marshalled);
-                else
-                    DotNetFree(ref marshalled);
-            }
+            // free buffers
+            if (IntPtr.Size == 8)
+                DotNetFree64(ref marshalled);
+            else
+                DotNetFree(ref marshalled);
 
             return encoded;
         }
@@ -238,6 +382,54 @@ namespace OpenMetaverse.Imaging
             return Encode(image, false);
         }
 
+        /// <summary>
+        /// Encode 32 bit pixels into a byte array. The codec reads them
+        /// straight into its tile buffers, so no per channel copy is made
+        /// </summary>
+        /// <param name="pixels">Four bytes per pixel with no padding between rows</param>
+        /// <param name="width">Width of the image</param>
+        /// <param name="height">Height of the image</param>
+        /// <param name="bgra">True for BGRA byte order, false for RGBA</param>
+        /// <param name="alpha">True to encode the alpha channel, false to
+        /// ignore the fourth byte of each pixel</param>
+        /// <param name="lossless">true to enable lossless conversion, only useful for small images ie: sculptmaps</param>
+        /// <returns>A byte array containing the encoded image, the same as
+        /// <seealso cref="Encode(ManagedImage, bool)"/> gives for these channels</returns>
+        public unsafe static byte[] EncodeFromInterleaved(byte[] pixels, int width, int height, bool bgra, bool alpha, bool lossless)
+        {
+            if (width <= 0 || height <= 0 || pixels.Length < width * height * 4)
+                throw new ArgumentException("The pixel array is smaller than the image");
+
+            fixed (byte* ptr = pixels)
+                return EncodeInterleaved((IntPtr)ptr, width, height, width * 4, bgra, alpha ? 4 : 3, lossless);
+        }
+
+        private static byte[] EncodeInterleaved(IntPtr pixels, int width, int height, int stride, bool bgra, int components, bool lossless)
+        {
+            MarshalledImage marshalled = new MarshalledImage();
+            marshalled.width = width;
+            marshalled.height = height;
+            marshalled.components = components;
+
+            // codec will allocate output buffer
+            bool encodeSuccess = (IntPtr.Size == 8) ?
+                DotNetEncodeInterleaved64(ref marshalled, pixels, stride, bgra, lossless) :
+                DotNetEncodeInterleaved(ref marshalled, pixels, stride, bgra, lossless);
+
+            if (!encodeSuccess)
+                throw new Exception("DotNetEncodeInterleaved failed");
+
+            byte[] encoded = new byte[marshalled.length];
+            Marshal.Copy(marshalled.encoded, encoded, 0, marshalled.length);
+
+            if (IntPtr.Size == 8)
+                DotNetFree64(ref marshalled);
+            else
+                DotNetFree(ref marshalled);
+
+            return encoded;
+        }
+
         /// <summary>
         /// Decode JPEG2000 data to an <seealso cref="System.Drawing.Image"/> and
         /// <seealso cref="ManagedImage"/>
@@ -278,232 +470,458 @@ namespace OpenMetaverse.Imaging
         /// <returns></returns>
         public static bool DecodeToImage(byte[] encoded, out ManagedImage managedImage)
         {
-            MarshalledImage marshalled = new MarshalledImage();
+            return DecodeToImage(encoded, out managedImage, 0);
+        }
+
+        /// <summary>
+        /// Decode JPEG2000 data at a reduced resolution. Each discard level
+        /// halves the width and height, and the discarded resolutions are
+        /// skipped by the decoder instead of being downscaled afterwards
+        /// </summary>
+        /// <param name="encoded">JPEG2000 encoded data</param>
+        /// <param name="managedImage">ManagedImage object to decode to</param>
+        /// <param name="discardLevel">Number of resolution levels to discard,
+        /// 0 decodes the full size image. Must be lower than the resolution
+        /// count reported by <seealso cref="DecodeHeader"/></param>
+        /// <returns>True if the decode succeeds, otherwise false</returns>
+        public static bool DecodeToImage(byte[] encoded, out ManagedImage managedImage, int discardLevel)
+        {
+            return DecodeToImage(encoded, out managedImage, discardLevel, 0);
+        }
 
-            // Allocate and copy to input buffer
-            marshalled.length = encoded.Length;
+        /// <summary>
+        /// Decode the first quality layers of JPEG2000 data, optionally at a
+        /// reduced resolution. This is meant for progressive refinement of
+        /// partially downloaded textures: packets of later layers are not
+        /// read, so the data can end right after the last requested layer
+        /// </summary>
+        /// <param name="encoded">JPEG2000 encoded data</param>
+        /// <param name="managedImage">ManagedImage object to decode to</param>
+        /// <param name="discardLevel">Number of resolution levels to discard,
+        /// 0 decodes the full size image</param>
+        /// <param name="maxLayers">Number of quality layers to decode, 0
+        /// decodes all of them</param>
+        /// <returns>True if the decode succeeds, otherwise false</returns>
+        public static bool DecodeToImage(byte[] encoded, out ManagedImage managedImage, int discardLevel, int maxLayers)
+        {
+            return DecodeToImage(IntPtr.Zero, encoded, out managedImage, discardLevel, maxLayers);
+        }
+
+        private unsafe static bool DecodeToImage(IntPtr decoder, byte[] encoded, out ManagedImage managedImage, int discardLevel, int maxLayers)
+        {
+            managedImage = null;
 
-            lock (OpenJPEGLock)
+            // The header gives the size of the planes the codec decodes into
+            J2KHeaderInfo header;
+            if (!DecodeHeader(decoder, encoded, out header) || discardLevel < 0 || discardLevel >= header.Resolutions)
+                return false;
+
+            ManagedImage.ImageChannels channels;
+            switch (header.Components)
             {
-                if (IntPtr.Size == 8)
-                    DotNetAllocEncoded64(ref marshalled);
+                case 1: // Grayscale
+                case 3: // RGB
+                    channels = ManagedImage.ImageChannels.Color;
+                    break;
+                case 2: // Grayscale + alpha
+                case 4: // RGBA
+                    channels = ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha;
+                    break;
+                case 5: // RGBAB
+                    channels = ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha | ManagedImage.ImageChannels.Bump;
+                    break;
+                default:
+                    Logger.Log("Decoded image with unhandled number of components: " + header.Components,
+                        Helpers.LogLevel.Error);
+                    return false;
+            }
+
+            // Each discard level halves the size, rounding up
+            int width = (header.Width + (1 << discardLevel) - 1) >> discardLevel;
+            int height = (header.Height + (1 << discardLevel) - 1) >> discardLevel;
+            ManagedImage image = new ManagedImage(width, height, channels);
+
+            MarshalledImage marshalled = new MarshalledImage();
+            marshalled.width = width;
+            marshalled.height = height;
+            marshalled.components = header.Components;
+            bool decodeSuccess;
+
+            // The codestream is read in place and the codec writes straight
+            // into the channels of the new image, nothing is allocated natively
+            fixed (byte* ptr = encoded, red = image.Red, green = image.Green, blue = image.Blue, alpha = image.Alpha, bump = image.Bump)
+            {
+                byte** planes = stackalloc byte*[5];
+                int count = 0;
+
+                planes[count++] = red;
+                if (header.Components >= 3)
+                {
+                    planes[count++] = green;
+                    planes[count++] = blue;
+                }
+                if (alpha != null) planes[count++] = alpha;
+                if (bump != null) planes[count++] = bump;
+
+                marshalled.encoded = (IntPtr)ptr;
+                marshalled.length = encoded.Length;
+
+                if (decoder != IntPtr.Zero)
+                    decodeSuccess = (IntPtr.Size == 8) ?
+                        DotNetDecoderDecodeToPlanes64(decoder, ref marshalled, (IntPtr)planes, discardLevel, maxLayers) :
+                        DotNetDecoderDecodeToPlanes(decoder, ref marshalled, (IntPtr)planes, discardLevel, maxLayers);
                 else
-                    DotNetAllocEncoded(ref marshalled);
+                    decodeSuccess = (IntPtr.Size == 8) ?
+                        DotNetDecodeToPlanes64(ref marshalled, (IntPtr)planes, discardLevel, maxLayers) :
+                        DotNetDecodeToPlanes(ref marshalled, (IntPtr)planes, discardLevel, maxLayers);
+            }
 
-                Marshal.Copy(encoded, 0, marshalled.encoded, encoded.Length);
+            if (!decodeSuccess)
+                return false;
 
-                // Codec will allocate output buffer
-                if (IntPtr.Size == 8)
-                    DotNetDecode64(ref marshalled);
+            if (header.Components < 3)
+            {
+                int n = width * height;
+                Buffer.BlockCopy(image.Red, 0, image.Green, 0, n);
+                Buffer.BlockCopy(image.Red, 0, image.Blue, 0, n);
+            }
+
+            managedImage = image;
+            return true;
+        }
+
+        /// <summary>
+        /// Decode JPEG2000 data straight to 32 bit pixels, ready to be
+        /// uploaded as a texture. Grayscale is expanded to RGB and images
+        /// without alpha are opaque, a bump channel is not returned
+        /// </summary>
+        /// <param name="encoded">JPEG2000 encoded data, all components must
+        /// be 8 bit unsigned</param>
+        /// <param name="bgra">True for BGRA byte order, false for RGBA</param>
+        /// <param name="discardLevel">Number of highest resolution levels to
+        /// discard, each one halves the width and height</param>
+        /// <param name="maxLayers">Number of quality layers to decode, 0
+        /// decodes all of them</param>
+        /// <param name="pixels">Decoded pixels, four bytes per pixel with no
+        /// padding between rows</param>
+        /// <param name="width">Width of the decoded image</param>
+        /// <param name="height">Height of the decoded image</param>
+        /// <returns>True if the decode was successful, otherwise false</returns>
+        public static bool DecodeToInterleaved(byte[] encoded, bool bgra, int discardLevel, int maxLayers,
+            out byte[] pixels, out int width, out int height)
+        {
+            return DecodeToInterleaved(IntPtr.Zero, encoded, bgra, discardLevel, maxLayers, out pixels, out width, out height);
+        }
+
+        private unsafe static bool DecodeToInterleaved(IntPtr decoder, byte[] encoded, bool bgra, int discardLevel, int maxLayers,
+            out byte[] pixels, out int width, out int height)
+        {
+            pixels = null;
+            width = height = 0;
+
+            J2KHeaderInfo header;
+            if (!DecodeHeader(decoder, encoded, out header) || discardLevel < 0 || discardLevel >= header.Resolutions)
+                return false;
+
+            int w = (header.Width + (1 << discardLevel) - 1) >> discardLevel;
+            int h = (header.Height + (1 << discardLevel) - 1) >> discardLevel;
+            byte[] output = new byte[w * h * 4];
+
+            MarshalledImage marshalled = new MarshalledImage();
+            marshalled.width = w;
+            marshalled.height = h;
+            bool decodeSuccess;
+
+            // Each tile is written to the pinned output as soon as it is
+            // decoded, the component planes are never built
+            fixed (byte* ptr = encoded, outPtr = output)
+            {
+                marshalled.encoded = (IntPtr)ptr;
+                marshalled.length = encoded.Length;
+
+                if (decoder != IntPtr.Zero)
+                    decodeSuccess = (IntPtr.Size == 8) ?
+                        DotNetDecoderDecodeInterleaved64(decoder, ref marshalled, (IntPtr)outPtr, w * 4, bgra, discardLevel, maxLayers) :
+                        DotNetDecoderDecodeInterleaved(decoder, ref marshalled, (IntPtr)outPtr, w * 4, bgra, discardLevel, maxLayers);
                 else
-                    DotNetDecode(ref marshalled);
+                    decodeSuccess = (IntPtr.Size == 8) ?
+                        DotNetDecodeInterleaved64(ref marshalled, (IntPtr)outPtr, w * 4, bgra, discardLevel, maxLayers) :
+                        DotNetDecodeInterleaved(ref marshalled, (IntPtr)outPtr, w * 4, bgra, discardLevel, maxLayers);
+            }
+
+            if (!decodeSuccess)
+                return false;
+
+            pixels = output;
+            width = w;
+            height = h;
+            return true;
+        }
+
+        /// <summary>
+        /// Decode many JPEG2000 images with one call. The images are spread
+        /// over a native thread pool and the call returns once all of them
+        /// are done, so a single caller can keep every core busy
+        /// </summary>
+        /// <param name="encoded">JPEG2000 encoded images</param>
+        /// <param name="managedImages">Decoded images, in the same order.
+        /// An entry is null if that image failed to decode</param>
+        /// <param name="discardLevel">Number of resolution levels to discard
+        /// in every image, 0 decodes them at full size</param>
+        /// <param name="maxThreads">Most threads to decode on, 0 for one per
+        /// processor</param>
+        /// <returns>True if every image decoded, otherwise false</returns>
+        public unsafe static bool DecodeToImages(byte[][] encoded, out ManagedImage[] managedImages, int discardLevel, int maxThreads)
+        {
+            int count = encoded.Length;
+            MarshalledImage[] marshalled = new MarshalledImage[count];
+            bool[] results = new bool[count];
+            GCHandle[] pins = new GCHandle[count];
+            bool decodeSuccess;
+
+            managedImages = new ManagedImage[count];
 
-                int n = marshalled.width * marshalled.height;
+            // The codestreams are read in place, only the decoded planes are
+            // allocated natively
+            try
+            {
+                for (int i = 0; i < count; i++)
+                {
+                    pins[i] = GCHandle.Alloc(encoded[i], GCHandleType.Pinned);
+                    marshalled[i].encoded = pins[i].AddrOfPinnedObject();
+                    marshalled[i].length = encoded[i].Length;
+                }
+
+                fixed (MarshalledImage* images = marshalled)
+                fixed (bool* success = results)
+                {
+                    decodeSuccess = (IntPtr.Size == 8) ?
+                        DotNetDecodeBatch64((IntPtr)images, count, (IntPtr)success, discardLevel, 0, maxThreads) :
+                        DotNetDecodeBatch((IntPtr)images, count, (IntPtr)success, discardLevel, 0, maxThreads);
+                }
+            }
+            finally
+            {
+                for (int i = 0; i < count; i++)
+                {
+                    if (pins[i].IsAllocated)
+                        pins[i].Free();
+                    marshalled[i].encoded = IntPtr.Zero;
+                }
+            }
 
-                switch (marshalled.components)
+            for (int i = 0; i < count; i++)
+            {
+                if (results[i])
                 {
-                    case 1: // Grayscale
-                        managedImage = new ManagedImage(marshalled.width, marshalled.height,
-                            ManagedImage.ImageChannels.Color);
-                        Marshal.Copy(marshalled.decoded, managedImage.Red, 0, n);
-                        Buffer.BlockCopy(managedImage.Red, 0, managedImage.Green, 0, n);
-                        Buffer.BlockCopy(managedImage.Red, 0, managedImage.Blue, 0, n);
-                        break;
-
-                    case 2: // Grayscale + alpha
-                        managedImage = new ManagedImage(marshalled.width, marshalled.height,
-                            ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha);
-                        Marshal.Copy(marshalled.decoded, managedImage.Red, 0, n);
-                        Buffer.BlockCopy(managedImage.Red, 0, managedImage.Green, 0, n);
-                        Buffer.BlockCopy(managedImage.Red, 0, managedImage.Blue, 0, n);
-                        Marshal.Copy((IntPtr)(marshalled.decoded.ToInt64() + (long)n), managedImage.Alpha, 0, n);
-                        break;
-
-                    case 3: // RGB
-                        managedImage = new ManagedImage(marshalled.width, marshalled.height,
-                            ManagedImage.ImageChannels.Color);
-                        Marshal.Copy(marshalled.decoded, managedImage.Red, 0, n);
-                        Marshal.Copy((IntPtr)(marshalled.decoded.ToInt64() + (long)n), managedImage.Green, 0, n);
-                        Marshal.Copy((IntPtr)(marshalled.decoded.ToInt64() + (long)(n * 2)), managedImage.Blue, 0, n);
-                        break;
-
-                    case 4: // RGBA
-                        managedImage = new ManagedImage(marshalled.width, marshalled.height,
-                            ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha);
-                        Marshal.Copy(marshalled.decoded, managedImage.Red, 0, n);
-                        Marshal.Copy((IntPtr)(marshalled.decoded.ToInt64() + (long)n), managedImage.Green, 0, n);
-                        Marshal.Copy((IntPtr)(marshalled.decoded.ToInt64() + (long)(n * 2)), managedImage.Blue, 0, n);
-                        Marshal.Copy((IntPtr)(marshalled.decoded.ToInt64() + (long)(n * 3)), managedImage.Alpha, 0, n);
-                        break;
-
-                    case 5: // RGBAB
-                        managedImage = new ManagedImage(marshalled.width, marshalled.height,
-                            ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha | ManagedImage.ImageChannels.Bump);
-                        Marshal.Copy(marshalled.decoded, managedImage.Red, 0, n);
-                        Marshal.Copy((IntPtr)(marshalled.decoded.ToInt64() + (long)n), managedImage.Green, 0, n);
-                        Marshal.Copy((IntPtr)(marshalled.decoded.ToInt64() + (long)(n * 2)), managedImage.Blue, 0, n);
-                        Marshal.Copy((IntPtr)(marshalled.decoded.ToInt64() + (long)(n * 3)), managedImage.Alpha, 0, n);
-                        Marshal.Copy((IntPtr)(marshalled.decoded.ToInt64() + (long)(n * 4)), managedImage.Bump, 0, n);
-                        break;
-
-                    default:
-                        Logger.Log("Decoded image with unhandled number of components: " + marshalled.components,
-                            Helpers.LogLevel.Error);
-
-                        if (IntPtr.Size == 8)
-                            DotNetFree64(ref marshalled);
-                        else
-                            DotNetFree(ref marshalled);
-
-                        managedImage = null;
-                        return false;
+                    managedImages[i] = CopyDecoded(ref marshalled[i]);
+                    if (managedImages[i] == null)
+                        decodeSuccess = false;
                 }
 
                 if (IntPtr.Size == 8)
-                    DotNetFree64(ref marshalled);
+                    DotNetFree64(ref marshalled[i]);
                 else
-                    DotNetFree(ref marshalled);
+                    DotNetFree(ref marshalled[i]);
             }
 
-            return true;
+            return decodeSuccess;
         }
 
         /// <summary>
-        /// 
+        /// Copy the planes decoded by the codec into a new <seealso cref="ManagedImage"/>
         /// </summary>
-        /// <param name="encoded"></param>
-        /// <param name="layerInfo"></param>
-        /// <param name="components"></param>
-        /// <returns></returns>
-        public static bool DecodeLayerBoundaries(byte[] encoded, out J2KLayerInfo[] layerInfo, out int components)
+        private static ManagedImage CopyDecoded(ref MarshalledImage marshalled)
+        {
+            ManagedImage.ImageChannels channels;
+            switch (marshalled.components)
+            {
+                case 1: // Grayscale
+                case 3: // RGB
+                    channels = ManagedImage.ImageChannels.Color;
+                    break;
+                case 2: // Grayscale + alpha
+                case 4: // RGBA
+                    channels = ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha;
+                    break;
+                case 5: // RGBAB
+                    channels = ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha | ManagedImage.ImageChannels.Bump;
+                    break;
+                default:
+                    Logger.Log("Decoded image with unhandled number of components: " + marshalled.components,
+                        Helpers.LogLevel.Error);
+                    return null;
+            }
+
+            ManagedImage image = new ManagedImage(marshalled.width, marshalled.height, channels);
+            int n = marshalled.width * marshalled.height;
+            int plane = 0;
+
+            Marshal.Copy(marshalled.decoded, image.Red, 0, n);
+            if (marshalled.components >= 3)
+            {
+                Marshal.Copy((IntPtr)(marshalled.decoded.ToInt64() + (long)n * ++plane), image.Green, 0, n);
+                Marshal.Copy((IntPtr)(marshalled.decoded.ToInt64() + (long)n * ++plane), image.Blue, 0, n);
+            }
+            else
+            {
+                Buffer.BlockCopy(image.Red, 0, image.Green, 0, n);
+                Buffer.BlockCopy(image.Red, 0, image.Blue, 0, n);
+            }
+            if (image.Alpha != null)
+                Marshal.Copy((IntPtr)(marshalled.decoded.ToInt64() + (long)n * ++plane), image.Alpha, 0, n);
+            if (image.Bump != null)
+                Marshal.Copy((IntPtr)(marshalled.decoded.ToInt64() + (long)n * ++plane), image.Bump, 0, n);
+
+            return image;
+        }
+
+        /// <summary>
+        /// Find the byte range of every quality layer in a JPEG2000 stream.
+        /// Only the packet headers are parsed, no image data is decoded
+        /// </summary>
+        /// <param name="encoded">JPEG2000 encoded data, must be a single
+        /// tile with LRCP progression</param>
+        /// <param name="layerInfo">Start and end positions of each layer</param>
+        /// <param name="components">Number of components in the image</param>
+        /// <returns>True if the layer boundaries were found, otherwise false</returns>
+        public unsafe static bool DecodeLayerBoundaries(byte[] encoded, out J2KLayerInfo[] layerInfo, out int components)
         {
             bool success = false;
+            bool decodeSuccess;
             layerInfo = null;
             components = 0;
             MarshalledImage marshalled = new MarshalledImage();
 
-            // Allocate and copy to input buffer
-            marshalled.length = encoded.Length;
+            // The stream is parsed in place, only the layer table is allocated natively
+            fixed (byte* ptr = encoded)
+            {
+                marshalled.encoded = (IntPtr)ptr;
+                marshalled.length = encoded.Length;
+
+                decodeSuccess = (IntPtr.Size == 8) ? DotNetDecodeLayerBoundaries64(ref marshalled) : DotNetDecodeLayerBoundaries(ref marshalled);
+            }
+            marshalled.encoded = IntPtr.Zero;
 
-            lock (OpenJPEGLock)
+            if (decodeSuccess)
             {
-                if (IntPtr.Size == 8)
-                    DotNetAllocEncoded64(ref marshalled);
-                else
-                    DotNetAllocEncoded(ref marshalled);
+                components = marshalled.components;
+                layerInfo = new J2KLayerInfo[marshalled.layers];
 
-                Marshal.Copy(encoded, 0, marshalled.encoded, encoded.Length);
+                J2KLayerInfo* bounds = (J2KLayerInfo*)marshalled.layer_bounds;
+                for (int i = 0; i < marshalled.layers; i++)
+                    layerInfo[i] = bounds[i];
 
-                // Run the decode
-                bool decodeSuccess = (IntPtr.Size == 8) ? DotNetDecodeWithInfo64(ref marshalled) : DotNetDecodeWithInfo(ref marshalled);
-                if (decodeSuccess)
+                // Sanity checking
+                if (layerInfo.Length == 0 || layerInfo[layerInfo.Length - 1].End <= encoded.Length - 1)
                 {
-                    components = marshalled.components;
+                    success = true;
 
-                    // Sanity check
-                    if (marshalled.layers * marshalled.resolutions * marshalled.components == marshalled.packet_count)
+                    for (int i = 0; i < layerInfo.Length; i++)
                     {
-                        // Manually marshal the array of opj_packet_info structs
-                        MarshalledPacket[] packets = new MarshalledPacket[marshalled.packet_count];
-                        int offset = 0;
-
-                        for (int i = 0; i < marshalled.packet_count; i++)
+                        if (layerInfo[i].Start >= layerInfo[i].End ||
+                            (i > 0 && layerInfo[i].Start <= layerInfo[i - 1].End))
                         {
-                            MarshalledPacket packet;
-                            packet.start_pos = Marshal.ReadInt32(marshalled.packets, offset);
-                            offset += 4;
-                            packet.end_ph_pos = Marshal.ReadInt32(marshalled.packets, offset);
-                            offset += 4;
-                            packet.end_pos = Marshal.ReadInt32(marshalled.packets, offset);
-                            offset += 4;
-                            //double distortion = (double)Marshal.ReadInt64(marshalled.packets, offset);
-                            offset += 8;
-
-                            packets[i] = packet;
+                            System.Text.StringBuilder output = new System.Text.StringBuilder(
+                                "Inconsistent packet data in JPEG2000 stream:\n");
+                            for (int j = 0; j < layerInfo.Length; j++)
+                                output.AppendFormat("Layer {0}: Start: {1} End: {2}\n", j, layerInfo[j].Start, layerInfo[j].End);
+                            Logger.DebugLog(output.ToString());
+
+                            success = false;
+                            break;
                         }
+                    }
 
-                        layerInfo = new J2KLayerInfo[marshalled.layers];
-
-                        for (int i = 0; i < marshalled.layers; i++)
+                    if (!success)
+                    {
+                        for (int i = 0; i < layerInfo.Length; i++)
                         {
-                            int packetsPerLayer = marshalled.packet_count / marshalled.layers;
-                            MarshalledPacket startPacket = packets[packetsPerLayer * i];
-                            MarshalledPacket endPacket = packets[(packetsPerLayer * (i + 1)) - 1];
-                            layerInfo[i].Start = startPacket.start_pos;
-                            layerInfo[i].End = endPacket.end_pos;
+                            if (i < layerInfo.Length - 1)
+                                layerInfo[i].End = layerInfo[i + 1].Start - 1;
+                            else
+                                layerInfo[i].End = encoded.Length;
                         }
 
-                        // More sanity checking
-                        if (layerInfo.Length == 0 || layerInfo[layerInfo.Length - 1].End <= encoded.Length - 1)
-                        {
-                            success = true;
-
-                            for (int i = 0; i < layerInfo.Length; i++)
-                            {
-                                if (layerInfo[i].Start >= layerInfo[i].End ||
-                                    (i > 0 && layerInfo[i].Start <= layerInfo[i - 1].End))
-                                {
-                                    System.Text.StringBuilder output = new System.Text.StringBuilder(
-                                        "Inconsistent packet data in JPEG2000 stream:\n");
-                                    for (int j = 0; j < layerInfo.Length; j++)
-                                        output.AppendFormat("Layer {0}: Start: {1} End: {2}\n", j, layerInfo[j].Start, layerInfo[j].End);
-                                    Logger.DebugLog(output.ToString());
-
-                                    success = false;
-                                    break;
-                                }
-                            }
+                        Logger.DebugLog("Corrected JPEG2000 packet data");
+                        success = true;
 
-                            if (!success)
+                        for (int i = 0; i < layerInfo.Length; i++)
+                        {
+                            if (layerInfo[i].Start >= layerInfo[i].End ||
+                                (i > 0 && layerInfo[i].Start <= layerInfo[i - 1].End))
                             {
-                                for (int i = 0; i < layerInfo.Length; i++)
-                                {
-                                    if (i < layerInfo.Length - 1)
-                                        layerInfo[i].End = layerInfo[i + 1].Start - 1;
-                                    else
-                                        layerInfo[i].End = marshalled.length;
-                                }
-
-                                Logger.DebugLog("Corrected JPEG2000 packet data");
-                                success = true;
-
-                                for (int i = 0; i < layerInfo.Length; i++)
-                                {
-                                    if (layerInfo[i].Start >= layerInfo[i].End ||
-                                        (i > 0 && layerInfo[i].Start <= layerInfo[i - 1].End))
-                                    {
-                                        System.Text.StringBuilder output = new System.Text.StringBuilder(
-                                            "Still inconsistent packet data in JPEG2000 stream, giving up:\n");
-                                        for (int j = 0; j < layerInfo.Length; j++)
-                                            output.AppendFormat("Layer {0}: Start: {1} End: {2}\n", j, layerInfo[j].Start, layerInfo[j].End);
-                                        Logger.DebugLog(output.ToString());
-
-                                        success = false;
-                                        break;
-                                    }
-                                }
+                                System.Text.StringBuilder output = new System.Text.StringBuilder(
+                                    "Still inconsistent packet data in JPEG2000 stream, giving up:\n");
+                                for (int j = 0; j < layerInfo.Length; j++)
+                                    output.AppendFormat("Layer {0}: Start: {1} End: {2}\n", j, layerInfo[j].Start, layerInfo[j].End);
+                                Logger.DebugLog(output.ToString());
+
+                                success = false;
+                                break;
                             }
                         }
-                        else
-                        {
-                            Logger.Log(String.Format(
-                                "Last packet end in JPEG2000 stream extends beyond the end of the file. filesize={0} layerend={1}",
-                                encoded.Length, layerInfo[layerInfo.Length - 1].End), Helpers.LogLevel.Warning);
-                        }
-                    }
-                    else
-                    {
-                        Logger.Log(String.Format(
-                            "Packet count mismatch in JPEG2000 stream. layers={0} resolutions={1} components={2} packets={3}",
-                            marshalled.layers, marshalled.resolutions, marshalled.components, marshalled.packet_count),
-                            Helpers.LogLevel.Warning);
                     }
                 }
+                else
+                {
+                    Logger.Log(String.Format(
+                        "Last packet end in JPEG2000 stream extends beyond the end of the file. filesize={0} layerend={1}",
+                        encoded.Length, layerInfo[layerInfo.Length - 1].End), Helpers.LogLevel.Warning);
+                }
+            }
 
-                if (IntPtr.Size == 8)
-                    DotNetFree64(ref marshalled);
+            if (IntPtr.Size == 8)
+                DotNetFree64(ref marshalled);
+            else
+                DotNetFree(ref marshalled);
+
+            return success;
+        }
+
+        /// <summary>
+        /// Read the dimensions, component count, layer count and resolution
+        /// count of a JPEG2000 stream from its main header, without decoding
+        /// any image data
+        /// </summary>
+        /// <param name="encoded">JPEG2000 encoded data, only the main header
+        /// needs to be present</param>
+        /// <param name="info">Properties of the encoded image</param>
+        /// <returns>True if a complete main header was found, otherwise false</returns>
+        public static bool DecodeHeader(byte[] encoded, out J2KHeaderInfo info)
+        {
+            return DecodeHeader(IntPtr.Zero, encoded, out info);
+        }
+
+        private unsafe static bool DecodeHeader(IntPtr decoder, byte[] encoded, out J2KHeaderInfo info)
+        {
+            info = new J2KHeaderInfo();
+            if (encoded == null || encoded.Length == 0)
+                return false;
+
+            MarshalledImage marshalled = new MarshalledImage();
+            bool success;
+
+            // The header is read in place, nothing is allocated on the native side
+            fixed (byte* ptr = encoded)
+            {
+                marshalled.encoded = (IntPtr)ptr;
+                marshalled.length = encoded.Length;
+
+                // A kept decoder reads the header without creating a decompressor
+                if (decoder != IntPtr.Zero)
+                    success = (IntPtr.Size == 8) ? DotNetDecoderProbe64(decoder, ref marshalled) : DotNetDecoderProbe(decoder, ref marshalled);
                 else
-                    DotNetFree(ref marshalled);
+                    success = (IntPtr.Size == 8) ? DotNetProbe64(ref marshalled) : DotNetProbe(ref marshalled);
+            }
+
+            if (success)
+            {
+                info.Width = marshalled.width;
+                info.Height = marshalled.height;
+                info.Components = marshalled.components;
+                info.Layers = marshalled.layers;
+                info.Resolutions = marshalled.resolutions;
             }
 
             return success;
@@ -518,35 +936,16 @@ namespace OpenMetaverse.Imaging
         public unsafe static byte[] EncodeFromImage(Bitmap bitmap, bool lossless)
         {
             BitmapData bd;
-            ManagedImage decoded;
 
             int bitmapWidth = bitmap.Width;
             int bitmapHeight = bitmap.Height;
             int pixelCount = bitmapWidth * bitmapHeight;
             int i;
 
-            if ((bitmap.PixelFormat & PixelFormat.Alpha) != 0 || (bitmap.PixelFormat & PixelFormat.PAlpha) != 0)
-            {
-                // Four layers, RGBA
-                decoded = new ManagedImage(bitmapWidth, bitmapHeight,
-                    ManagedImage.ImageChannels.Color | ManagedImage.ImageChannels.Alpha);
-                bd = bitmap.LockBits(new Rectangle(0, 0, bitmapWidth, bitmapHeight),
-                    ImageLockMode.ReadOnly, PixelFormat.Format32bppArgb);
-                byte* pixel = (byte*)bd.Scan0;
-
-                for (i = 0; i < pixelCount; i++)
-                {
-                    // GDI+ gives us BGRA and we need to turn that in to RGBA
-                    decoded.Blue[i] = *(pixel++);
-                    decoded.Green[i] = *(pixel++);
-                    decoded.Red[i] = *(pixel++);
-                    decoded.Alpha[i] = *(pixel++);
-                }
-            }
-            else if (bitmap.PixelFormat == PixelFormat.Format16bppGrayScale)
+            if (bitmap.PixelFormat == PixelFormat.Format16bppGrayScale)
             {
                 // One layer
-                decoded = new ManagedImage(bitmapWidth, bitmapHeight,
+                ManagedImage decoded = new ManagedImage(bitmapWidth, bitmapHeight,
                     ManagedImage.ImageChannels.Color);
                 bd = bitmap.LockBits(new Rectangle(0, 0, bitmapWidth, bitmapHeight),
                     ImageLockMode.ReadOnly, PixelFormat.Format16bppGrayScale);
@@ -563,27 +962,115 @@ namespace OpenMetaverse.Imaging
                     decoded.Blue[i] = val;
                     pixel += 2;
                 }
+
+                bitmap.UnlockBits(bd);
+                return Encode(decoded, lossless);
             }
-            else
+
+            // Three layers, RGB, or four, RGBA. GDI+ gives us BGRA (BGRX
+            // without alpha) rows, which the codec reads as it fills its tile
+            // buffers, with no per channel copy
+            bool alpha = (bitmap.PixelFormat & PixelFormat.Alpha) != 0 || (bitmap.PixelFormat & PixelFormat.PAlpha) != 0;
+            bd = bitmap.LockBits(new Rectangle(0, 0, bitmapWidth, bitmapHeight),
+                ImageLockMode.ReadOnly, alpha ? PixelFormat.Format32bppArgb : PixelFormat.Format32bppRgb);
+            try
             {
-                // Three layers, RGB
-                decoded = new ManagedImage(bitmapWidth, bitmapHeight,
-                    ManagedImage.ImageChannels.Color);
-                bd = bitmap.LockBits(new Rectangle(0, 0, bitmapWidth, bitmapHeight),
-                    ImageLockMode.ReadOnly, PixelFormat.Format24bppRgb);
-                byte* pixel = (byte*)bd.Scan0;
+                return EncodeInterleaved(bd.Scan0, bitmapWidth, bitmapHeight, bd.Stride, true, alpha ? 4 : 3, lossless);
+            }
+            finally
+            {
+                bitmap.UnlockBits(bd);
+            }
+        }
 
-                for (i = 0; i < pixelCount; i++)
-                {
-                    decoded.Blue[i] = *(pixel++);
-                    decoded.Green[i] = *(pixel++);
-                    decoded.Red[i] = *(pixel++);
-                }
+        /// <summary>
+        /// A JPEG2000 decoder kept from one image to the next. The codec keeps
+        /// its tile structures and scratch memory between decodes, so a stream
+        /// of textures of the same size is decoded without allocating them
+        /// again. An instance must not be used by two threads at the same
+        /// time, each decoding thread should have its own
+        /// </summary>
+        public sealed class Decoder : IDisposable
+        {
+            private IntPtr _handle;
+
+            /// <summary>
+            /// Create a decoder, its memory is allocated by the first decode
+            /// </summary>
+            public Decoder()
+            {
+                _handle = (IntPtr.Size == 8) ? DotNetDecoderCreate64() : DotNetDecoderCreate();
+                if (_handle == IntPtr.Zero)
+                    throw new OutOfMemoryException("Failed to create a JPEG2000 decoder");
             }
 
-            bitmap.UnlockBits(bd);
-            byte[] encoded = Encode(decoded, lossless);
-            return encoded;
+            ~Decoder()
+            {
+                Release();
+            }
+
+            /// <summary>
+            /// Decode the first quality layers of JPEG2000 data, as
+            /// <seealso cref="OpenJPEG.DecodeToImage(byte[], out ManagedImage, int, int)"/> does
+            /// </summary>
+            /// <param name="encoded">JPEG2000 encoded data</param>
+            /// <param name="managedImage">ManagedImage object to decode to</param>
+            /// <param name="discardLevel">Number of resolution levels to discard,
+            /// 0 decodes the full size image</param>
+            /// <param name="maxLayers">Number of quality layers to decode, 0
+            /// decodes all of them</param>
+            /// <returns>True if the decode succeeds, otherwise false</returns>
+            public bool DecodeToImage(byte[] encoded, out ManagedImage managedImage, int discardLevel, int maxLayers)
+            {
+                if (_handle == IntPtr.Zero)
+                    throw new ObjectDisposedException("OpenJPEG.Decoder");
+                return OpenJPEG.DecodeToImage(_handle, encoded, out managedImage, discardLevel, maxLayers);
+            }
+
+            /// <summary>
+            /// Decode JPEG2000 data straight to 32 bit pixels, as
+            /// <seealso cref="OpenJPEG.DecodeToInterleaved(byte[], bool, int, int, out byte[], out int, out int)"/> does
+            /// </summary>
+            /// <param name="encoded">JPEG2000 encoded data, all components must
+            /// be 8 bit unsigned</param>
+            /// <param name="bgra">True for BGRA byte order, false for RGBA</param>
+            /// <param name="discardLevel">Number of highest resolution levels to
+            /// discard, each one halves the width and height</param>
+            /// <param name="maxLayers">Number of quality layers to decode, 0
+            /// decodes all of them</param>
+            /// <param name="pixels">Decoded pixels, four bytes per pixel with no
+            /// padding between rows</param>
+            /// <param name="width">Width of the decoded image</param>
+            /// <param name="height">Height of the decoded image</param>
+            /// <returns>True if the decode was successful, otherwise false</returns>
+            public bool DecodeToInterleaved(byte[] encoded, bool bgra, int discardLevel, int maxLayers,
+                out byte[] pixels, out int width, out int height)
+            {
+                if (_handle == IntPtr.Zero)
+                    throw new ObjectDisposedException("OpenJPEG.Decoder");
+                return OpenJPEG.DecodeToInterleaved(_handle, encoded, bgra, discardLevel, maxLayers, out pixels, out width, out height);
+            }
+
+            /// <summary>
+            /// Free the memory kept by the decoder
+            /// </summary>
+            public void Dispose()
+            {
+                Release();
+                GC.SuppressFinalize(this);
+            }
+
+            private void Release()
+            {
+                if (_handle == IntPtr.Zero)
+                    return;
+
+                if (IntPtr.Size == 8)
+                    DotNetDecoderDestroy64(_handle);
+                else
+                    DotNetDecoderDestroy(_handle);
+                _handle = IntPtr.Zero;
+            }
         }
     }
 #endif
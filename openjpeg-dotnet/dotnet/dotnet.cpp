@@ -3,9 +3,15 @@
 #include "dotnet.h"
 extern "C" {
 #include "../libopenjpeg/openjpeg.h"
+#include "../libopenjpeg/thread.h"
 }
 #include <algorithm>
 
+static bool DecodePartial(opj_dinfo_t* dinfo, MarshalledImage* image, int discard_level, int max_layers);
+static bool DecodeToPlanes(opj_dinfo_t* dinfo, MarshalledImage* image, unsigned char** planes, int discard_level, int max_layers);
+static bool DecodeInterleaved(opj_dinfo_t* dinfo, MarshalledImage* image, unsigned char* output, int stride, bool bgra, int discard_level, int max_layers);
+static bool Probe(opj_dinfo_t* dinfo, MarshalledImage* image);
+
 bool DotNetAllocEncoded64(MarshalledImage* image)
 {
 	return DotNetAllocEncoded(image);
@@ -57,6 +63,13 @@ void DotNetFree(MarshalledImage* image)
 {
 	if (image->encoded != 0) delete[] image->encoded;
 	if (image->decoded != 0) delete[] image->decoded;
+	if (image->packets != 0) delete[] image->packets;
+	if (image->layer_bounds != 0) delete[] image->layer_bounds;
+
+	image->encoded = 0;
+	image->decoded = 0;
+	image->packets = 0;
+	image->layer_bounds = 0;
 }
 
 bool DotNetEncode64(MarshalledImage* image, bool lossless)
@@ -66,10 +79,40 @@ bool DotNetEncode64(MarshalledImage* image, bool lossless)
 
 bool DotNetEncode(MarshalledImage* image, bool lossless)
 {
+	if (image->components < 1 || image->components > 5)
+		return false;
+
+	unsigned char* planes[5];
+	int n = image->width * image->height;
+
+	for (int i = 0; i < image->components; i++)
+		planes[i] = image->decoded + i * n;
+
+	return DotNetEncodeFromPlanes(image, planes, lossless);
+}
+
+// Encodes either one plane per component or, when pixels is set, 8 bit
+// interleaved pixels that the codec reads straight into its tile buffers
+static bool EncodeImage(MarshalledImage* image, unsigned char** planes, const unsigned char* pixels, int stride, bool bgra, bool lossless)
+{
+	// Every codec object is local to this call so that concurrent callers
+	// never share state and nothing leaks when encoding fails part way
+	opj_image_t* jp2_image = NULL;
+	opj_cinfo_t* cinfo = NULL;
+	opj_cio_t* cio = NULL;
+	bool success = false;
+
 	try
 	{
+		if (image->components < 1 || image->components > (pixels != NULL ? 4 : 5))
+			throw "unsupported component count";
+		if (pixels != NULL && stride < image->width * 4)
+			throw "input size mismatch";
+
 		opj_cparameters cparameters;
 		opj_set_default_encoder_parameters(&cparameters);
+		// code-blocks are encoded at the same time on the shared pool
+		cparameters.cp_num_threads = 0;
 		cparameters.cp_disto_alloc = 1;
 
 		if (lossless)
@@ -94,6 +137,13 @@ bool DotNetEncode(MarshalledImage* image, bool lossless)
 
 		cparameters.cp_comment = (char*)"";
 
+		if (pixels != NULL)
+		{
+			cparameters.cp_input_format = bgra ? OUTPUT_BGRA : OUTPUT_RGBA;
+			cparameters.cp_input = pixels;
+			cparameters.cp_input_stride = stride;
+		}
+
 		opj_image_comptparm comptparm[5];
 
 		for (int i = 0; i < image->components; i++)
@@ -109,7 +159,11 @@ bool DotNetEncode(MarshalledImage* image, bool lossless)
 			comptparm[i].h = image->height;
 		}
 
-		opj_image_t* jp2_image = opj_image_create(image->components, comptparm, CLRSPC_SRGB);
+		// the interleaved pixels never go through the components
+		if (pixels != NULL)
+			jp2_image = opj_image_create_header(image->components, comptparm, CLRSPC_SRGB);
+		else
+			jp2_image = opj_image_create(image->components, comptparm, CLRSPC_SRGB);
 		if (jp2_image == NULL)
 			throw "opj_image_create failed";
 
@@ -119,33 +173,59 @@ bool DotNetEncode(MarshalledImage* image, bool lossless)
 		jp2_image->y1 = image->height;
 		int n = image->width * image->height;
 		
-		for (int i = 0; i < image->components; i++)
-			std::copy(image->decoded + i * n, image->decoded + (i + 1) * n, jp2_image->comps[i].data);
+		if (pixels == NULL)
+		{
+			for (int i = 0; i < image->components; i++)
+				std::copy(planes[i], planes[i] + n, jp2_image->comps[i].data);
+		}
 		
-		opj_cinfo* cinfo = opj_create_compress(CODEC_J2K);
+		cinfo = opj_create_compress(CODEC_J2K);
 		opj_setup_encoder(cinfo, &cparameters, jp2_image);
-		opj_cio* cio = opj_cio_open((opj_common_ptr)cinfo, NULL, 0);
+		cio = opj_cio_open((opj_common_ptr)cinfo, NULL, 0);
 		if (cio == NULL)
 			throw "opj_cio_open failed";
 
-		if (!opj_encode(cinfo, cio, jp2_image, cparameters.index))
-			return false;
-
-		image->length = cio_tell(cio);
-		image->encoded = new unsigned char[image->length];
-		std::copy(cio->buffer, cio->buffer + image->length, image->encoded);
-		
-		opj_image_destroy(jp2_image);
-		opj_destroy_compress(cinfo);
-		opj_cio_close(cio);
-
-		return true;
+		if (opj_encode(cinfo, cio, jp2_image, cparameters.index))
+		{
+			image->length = cio_tell(cio);
+			image->encoded = new unsigned char[image->length];
+			std::copy(cio->buffer, cio->buffer + image->length, image->encoded);
+			success = true;
+		}
 	}
-
 	catch (...)
 	{
-		return false;
+		success = false;
 	}
+
+	if (cio != NULL) opj_cio_close(cio);
+	if (cinfo != NULL) opj_destroy_compress(cinfo);
+	if (jp2_image != NULL) opj_image_destroy(jp2_image);
+
+	return success;
+}
+
+bool DotNetEncodeFromPlanes64(MarshalledImage* image, unsigned char** planes, bool lossless)
+{
+	return DotNetEncodeFromPlanes(image, planes, lossless);
+}
+
+bool DotNetEncodeFromPlanes(MarshalledImage* image, unsigned char** planes, bool lossless)
+{
+	return EncodeImage(image, planes, NULL, 0, false, lossless);
+}
+
+bool DotNetEncodeInterleaved64(MarshalledImage* image, unsigned char* input, int stride, bool bgra, bool lossless)
+{
+	return DotNetEncodeInterleaved(image, input, stride, bgra, lossless);
+}
+
+bool DotNetEncodeInterleaved(MarshalledImage* image, unsigned char* input, int stride, bool bgra, bool lossless)
+{
+	if (input == NULL)
+		return false;
+
+	return EncodeImage(image, NULL, input, stride, bgra, lossless);
 }
 
 bool DotNetDecode64(MarshalledImage* image)
@@ -156,15 +236,21 @@ bool DotNetDecode64(MarshalledImage* image)
 bool DotNetDecode(MarshalledImage* image)
 {
 	opj_dparameters dparameters;
+	opj_dinfo_t* dinfo = NULL;
+	opj_cio_t* cio = NULL;
+	opj_image_t* jp2_image = NULL;
+	bool success = false;
 	
 	try
 	{
 		opj_set_default_decoder_parameters(&dparameters);
-		opj_dinfo_t* dinfo = opj_create_decompress(CODEC_J2K);
+		// tiles of large images are decoded at the same time on the shared pool
+		dparameters.cp_num_threads = 0;
+		dinfo = opj_create_decompress(CODEC_J2K);
 		opj_setup_decoder(dinfo, &dparameters);
-		opj_cio* cio = opj_cio_open((opj_common_ptr)dinfo, image->encoded, image->length);
+		cio = opj_cio_open((opj_common_ptr)dinfo, image->encoded, image->length);
 
-		opj_image* jp2_image = opj_decode(dinfo, cio); // decode happens here
+		jp2_image = opj_decode(dinfo, cio); // decode happens here
 		if (jp2_image == NULL)
 			throw "opj_decode failed";
 
@@ -177,17 +263,319 @@ bool DotNetDecode(MarshalledImage* image)
 		for (int i = 0; i < image->components; i++)
 			std::copy(jp2_image->comps[i].data, jp2_image->comps[i].data + n, image->decoded + i * n);
 
-		opj_image_destroy(jp2_image);
-		opj_destroy_decompress(dinfo);
-		opj_cio_close(cio);
+		success = true;
+	}
+	catch (...)
+	{
+		success = false;
+	}
+
+	if (jp2_image != NULL) opj_image_destroy(jp2_image);
+	if (dinfo != NULL) opj_destroy_decompress(dinfo);
+	if (cio != NULL) opj_cio_close(cio);
 
-		return true;
+	return success;
+}
+
+bool DotNetDecodeReduced64(MarshalledImage* image, int discard_level)
+{
+	return DotNetDecodeReduced(image, discard_level);
+}
+
+bool DotNetDecodeReduced(MarshalledImage* image, int discard_level)
+{
+	return DotNetDecodePartial(image, discard_level, 0);
+}
+
+bool DotNetDecodePartial64(MarshalledImage* image, int discard_level, int max_layers)
+{
+	return DotNetDecodePartial(image, discard_level, max_layers);
+}
+
+bool DotNetDecodePartial(MarshalledImage* image, int discard_level, int max_layers)
+{
+	opj_dinfo_t* dinfo = opj_create_decompress(CODEC_J2K);
+	bool success = DecodePartial(dinfo, image, discard_level, max_layers);
+	if (dinfo != NULL) opj_destroy_decompress(dinfo);
+	return success;
+}
+
+// the decoders below take the decompressor, so that a long lived one keeps
+// its tile structures and scratch memory from one image to the next
+static bool DecodePartial(opj_dinfo_t* dinfo, MarshalledImage* image, int discard_level, int max_layers)
+{
+	opj_dparameters dparameters;
+	opj_cio_t* cio = NULL;
+	opj_image_t* jp2_image = NULL;
+	bool success = false;
+
+	try
+	{
+		if (dinfo == NULL)
+			throw "no decompressor";
+		if (discard_level < 0 || max_layers < 0)
+			throw "invalid discard level or layer count";
+
+		opj_set_default_decoder_parameters(&dparameters);
+		// tiles of large images are decoded at the same time on the shared pool
+		dparameters.cp_num_threads = 0;
+		// the highest resolutions are neither tier-1 decoded nor transformed
+		dparameters.cp_reduce = discard_level;
+		// packets past the last wanted layer are not read
+		dparameters.cp_layer = max_layers;
+		opj_setup_decoder(dinfo, &dparameters);
+		cio = opj_cio_open((opj_common_ptr)dinfo, image->encoded, image->length);
+
+		jp2_image = opj_decode(dinfo, cio); // decode happens here
+		if (jp2_image == NULL)
+			throw "opj_decode failed";
+
+		// the component size already accounts for the reduce factor
+		image->width = jp2_image->comps[0].w;
+		image->height = jp2_image->comps[0].h;
+		image->components = jp2_image->numcomps;
+		int n = image->width * image->height;
+		image->decoded = new unsigned char[n * image->components];
+
+		for (int i = 0; i < image->components; i++)
+			std::copy(jp2_image->comps[i].data, jp2_image->comps[i].data + n, image->decoded + i * n);
+
+		success = true;
 	}
 	catch (...)
 	{
+		success = false;
+	}
+
+	if (jp2_image != NULL) opj_image_destroy(jp2_image);
+	if (cio != NULL) opj_cio_close(cio);
+
+	return success;
+}
+
+struct DecodeBatchJob
+{
+	MarshalledImage* images;
+	bool* results;
+	int discard_level;
+	int max_layers;
+	// one decompressor per thread, reused for every image of the thread
+	opj_dinfo_t* decoders[OPJ_MAX_THREADS];
+};
+
+static void DecodeBatchItem(void* user_data, int index, int slot)
+{
+	DecodeBatchJob* job = (DecodeBatchJob*)user_data;
+	if (job->decoders[slot] == NULL)
+		job->decoders[slot] = opj_create_decompress(CODEC_J2K);
+	job->results[index] = DecodePartial(job->decoders[slot], &job->images[index], job->discard_level, job->max_layers);
+}
+
+bool DotNetDecodeBatch64(MarshalledImage* images, int count, bool* results, int discard_level, int max_layers, int max_threads)
+{
+	return DotNetDecodeBatch(images, count, results, discard_level, max_layers, max_threads);
+}
+
+bool DotNetDecodeBatch(MarshalledImage* images, int count, bool* results, int discard_level, int max_layers, int max_threads)
+{
+	if (count == 0)
+		return true;
+	if (images == NULL || results == NULL || count < 0)
 		return false;
+
+	// every decoder is independent, the pool only hands out image indices
+	DecodeBatchJob job = { images, results, discard_level, max_layers, { NULL } }; // no decoders yet
+	opj_parallel_for(count, max_threads, DecodeBatchItem, &job);
+	for (int slot = 0; slot < OPJ_MAX_THREADS; slot++)
+	{
+		if (job.decoders[slot] != NULL) opj_destroy_decompress(job.decoders[slot]);
 	}
+
+	return std::find(results, results + count, false) == results + count;
 }
+
+bool DotNetDecodeToPlanes64(MarshalledImage* image, unsigned char** planes, int discard_level, int max_layers)
+{
+	return DotNetDecodeToPlanes(image, planes, discard_level, max_layers);
+}
+
+bool DotNetDecodeToPlanes(MarshalledImage* image, unsigned char** planes, int discard_level, int max_layers)
+{
+	opj_dinfo_t* dinfo = opj_create_decompress(CODEC_J2K);
+	bool success = DecodeToPlanes(dinfo, image, planes, discard_level, max_layers);
+	if (dinfo != NULL) opj_destroy_decompress(dinfo);
+	return success;
+}
+
+static bool DecodeToPlanes(opj_dinfo_t* dinfo, MarshalledImage* image, unsigned char** planes, int discard_level, int max_layers)
+{
+	opj_dparameters dparameters;
+	opj_cio_t* cio = NULL;
+	opj_image_t* jp2_image = NULL;
+	bool success = false;
+
+	try
+	{
+		if (dinfo == NULL)
+			throw "no decompressor";
+		if (discard_level < 0 || max_layers < 0)
+			throw "invalid discard level or layer count";
+
+		opj_set_default_decoder_parameters(&dparameters);
+		// tiles of large images are decoded at the same time on the shared pool
+		dparameters.cp_num_threads = 0;
+		dparameters.cp_reduce = discard_level;
+		dparameters.cp_layer = max_layers;
+		opj_setup_decoder(dinfo, &dparameters);
+		// the codestream is read in place
+		cio = opj_cio_open((opj_common_ptr)dinfo, image->encoded, image->length);
+
+		jp2_image = opj_decode(dinfo, cio); // decode happens here
+		if (jp2_image == NULL)
+			throw "opj_decode failed";
+
+		// the caller sized the planes from the header, anything else would
+		// write out of bounds
+		if (jp2_image->numcomps != image->components)
+			throw "component count mismatch";
+		for (int i = 0; i < image->components; i++)
+		{
+			if (jp2_image->comps[i].w != image->width || jp2_image->comps[i].h != image->height ||
+				jp2_image->comps[i].data == NULL)
+				throw "component size mismatch";
+		}
+
+		int n = image->width * image->height;
+		for (int i = 0; i < image->components; i++)
+			std::copy(jp2_image->comps[i].data, jp2_image->comps[i].data + n, planes[i]);
+
+		success = true;
+	}
+	catch (...)
+	{
+		success = false;
+	}
+
+	if (jp2_image != NULL) opj_image_destroy(jp2_image);
+	if (cio != NULL) opj_cio_close(cio);
+
+	return success;
+}
+
+bool DotNetDecodeInterleaved64(MarshalledImage* image, unsigned char* output, int stride, bool bgra, int discard_level, int max_layers)
+{
+	return DotNetDecodeInterleaved(image, output, stride, bgra, discard_level, max_layers);
+}
+
+bool DotNetDecodeInterleaved(MarshalledImage* image, unsigned char* output, int stride, bool bgra, int discard_level, int max_layers)
+{
+	opj_dinfo_t* dinfo = opj_create_decompress(CODEC_J2K);
+	bool success = DecodeInterleaved(dinfo, image, output, stride, bgra, discard_level, max_layers);
+	if (dinfo != NULL) opj_destroy_decompress(dinfo);
+	return success;
+}
+
+static bool DecodeInterleaved(opj_dinfo_t* dinfo, MarshalledImage* image, unsigned char* output, int stride, bool bgra, int discard_level, int max_layers)
+{
+	opj_dparameters dparameters;
+	opj_cio_t* cio = NULL;
+	opj_image_t* jp2_image = NULL;
+	bool success = false;
+
+	try
+	{
+		if (dinfo == NULL)
+			throw "no decompressor";
+		if (discard_level < 0 || max_layers < 0)
+			throw "invalid discard level or layer count";
+		if (image->width <= 0 || image->height <= 0 || stride < image->width * 4)
+			throw "invalid output size";
+
+		opj_set_default_decoder_parameters(&dparameters);
+		// tiles of large images are decoded at the same time on the shared pool
+		dparameters.cp_num_threads = 0;
+		dparameters.cp_reduce = discard_level;
+		dparameters.cp_layer = max_layers;
+		dparameters.cp_output_format = bgra ? OUTPUT_BGRA : OUTPUT_RGBA;
+		dparameters.cp_output = output;
+		dparameters.cp_output_stride = stride;
+		// the codec checks the image fits before writing the first tile
+		dparameters.cp_output_height = image->height;
+		opj_setup_decoder(dinfo, &dparameters);
+		cio = opj_cio_open((opj_common_ptr)dinfo, image->encoded, image->length);
+
+		jp2_image = opj_decode(dinfo, cio); // decode happens here
+		if (jp2_image == NULL)
+			throw "opj_decode failed";
+		// the caller sized the output from the header, a smaller image
+		// would leave part of it unwritten
+		if (jp2_image->numcomps <= 0 || jp2_image->comps[0].w != image->width || jp2_image->comps[0].h != image->height)
+			throw "output size mismatch";
+
+		image->components = jp2_image->numcomps;
+		success = true;
+	}
+	catch (...)
+	{
+		success = false;
+	}
+
+	if (jp2_image != NULL) opj_image_destroy(jp2_image);
+	if (cio != NULL) opj_cio_close(cio);
+
+	return success;
+}
+
+opj_dinfo_t* DotNetDecoderCreate64()
+{
+	return DotNetDecoderCreate();
+}
+
+opj_dinfo_t* DotNetDecoderCreate()
+{
+	return opj_create_decompress(CODEC_J2K);
+}
+
+void DotNetDecoderDestroy64(opj_dinfo_t* decoder)
+{
+	DotNetDecoderDestroy(decoder);
+}
+
+void DotNetDecoderDestroy(opj_dinfo_t* decoder)
+{
+	if (decoder != NULL) opj_destroy_decompress(decoder);
+}
+
+bool DotNetDecoderDecodePartial64(opj_dinfo_t* decoder, MarshalledImage* image, int discard_level, int max_layers)
+{
+	return DotNetDecoderDecodePartial(decoder, image, discard_level, max_layers);
+}
+
+bool DotNetDecoderDecodePartial(opj_dinfo_t* decoder, MarshalledImage* image, int discard_level, int max_layers)
+{
+	return DecodePartial(decoder, image, discard_level, max_layers);
+}
+
+bool DotNetDecoderDecodeToPlanes64(opj_dinfo_t* decoder, MarshalledImage* image, unsigned char** planes, int discard_level, int max_layers)
+{
+	return DotNetDecoderDecodeToPlanes(decoder, image, planes, discard_level, max_layers);
+}
+
+bool DotNetDecoderDecodeToPlanes(opj_dinfo_t* decoder, MarshalledImage* image, unsigned char** planes, int discard_level, int max_layers)
+{
+	return DecodeToPlanes(decoder, image, planes, discard_level, max_layers);
+}
+
+bool DotNetDecoderDecodeInterleaved64(opj_dinfo_t* decoder, MarshalledImage* image, unsigned char* output, int stride, bool bgra, int discard_level, int max_layers)
+{
+	return DotNetDecoderDecodeInterleaved(decoder, image, output, stride, bgra, discard_level, max_layers);
+}
+
+bool DotNetDecoderDecodeInterleaved(opj_dinfo_t* decoder, MarshalledImage* image, unsigned char* output, int stride, bool bgra, int discard_level, int max_layers)
+{
+	return DecodeInterleaved(decoder, image, output, stride, bgra, discard_level, max_layers);
+}
+
 bool DotNetDecodeWithInfo64(MarshalledImage* image)
 {
 	return DotNetDecodeWithInfo(image);
@@ -197,15 +585,25 @@ bool DotNetDecodeWithInfo(MarshalledImage* image)
 {
 	opj_dparameters dparameters;
 	opj_codestream_info_t info;
+	opj_dinfo_t* dinfo = NULL;
+	opj_cio_t* cio = NULL;
+	opj_image_t* jp2_image = NULL;
+	bool success = false;
+
+	// opj_decode_with_info only fills this in on success
+	info.tile = NULL;
+	info.tw = info.th = 0;
+	info.marker = NULL;
+	info.numdecompos = NULL;
 	
 	try
 	{
 		opj_set_default_decoder_parameters(&dparameters);
-		opj_dinfo_t* dinfo = opj_create_decompress(CODEC_J2K);
+		dinfo = opj_create_decompress(CODEC_J2K);
 		opj_setup_decoder(dinfo, &dparameters);
-		opj_cio* cio = opj_cio_open((opj_common_ptr)dinfo, image->encoded, image->length);
+		cio = opj_cio_open((opj_common_ptr)dinfo, image->encoded, image->length);
 
-		opj_image* jp2_image = opj_decode_with_info(dinfo, cio, &info); // decode happens here
+		jp2_image = opj_decode_with_info(dinfo, cio, &info); // decode happens here
 		if (jp2_image == NULL)
 			throw "opj_decode failed";
 
@@ -223,21 +621,186 @@ bool DotNetDecodeWithInfo(MarshalledImage* image)
 		image->resolutions = max_numdecompos + 1;
 		image->components = info.numcomps;
 		image->packet_count = info.packno;
-		image->packets = info.tile->packet;
+
+		// The codestream info is released below, so hand the caller its own
+		// copy of the packet table. DotNetFree releases it.
+		image->packets = new opj_packet_info_t[info.packno];
+		std::copy(info.tile->packet, info.tile->packet + info.packno, image->packets);
+
 		int n = image->width * image->height;
 		image->decoded = new unsigned char[n * image->components];
 		
 		for (int i = 0; i < image->components; i++)
 			std::copy(jp2_image->comps[i].data, jp2_image->comps[i].data + n, image->decoded + i * n);
 
-		opj_image_destroy(jp2_image);
-		opj_destroy_decompress(dinfo);
-		opj_cio_close(cio);
+		success = true;
+	}
+	catch (...)
+	{
+		success = false;
+	}
 
-		return true;
+	opj_destroy_cstr_info(&info);
+	if (jp2_image != NULL) opj_image_destroy(jp2_image);
+	if (dinfo != NULL) opj_destroy_decompress(dinfo);
+	if (cio != NULL) opj_cio_close(cio);
+
+	return success;
+}
+
+bool DotNetProbe64(MarshalledImage* image)
+{
+	return DotNetProbe(image);
+}
+
+bool DotNetProbe(MarshalledImage* image)
+{
+	opj_dinfo_t* dinfo = opj_create_decompress(CODEC_J2K);
+	bool success = Probe(dinfo, image);
+	if (dinfo != NULL) opj_destroy_decompress(dinfo);
+	return success;
+}
+
+bool DotNetDecoderProbe64(opj_dinfo_t* decoder, MarshalledImage* image)
+{
+	return DotNetDecoderProbe(decoder, image);
+}
+
+bool DotNetDecoderProbe(opj_dinfo_t* decoder, MarshalledImage* image)
+{
+	return Probe(decoder, image);
+}
+
+static bool Probe(opj_dinfo_t* dinfo, MarshalledImage* image)
+{
+	opj_dparameters dparameters;
+	opj_codestream_info_t info;
+	opj_cio_t* cio = NULL;
+	opj_image_t* jp2_image = NULL;
+	bool success = false;
+
+	info.tile = NULL;
+	info.tw = info.th = 0;
+	info.marker = NULL;
+	info.numdecompos = NULL;
+
+	try
+	{
+		if (dinfo == NULL)
+			throw "no decompressor";
+		opj_set_default_decoder_parameters(&dparameters);
+		// stop at the first SOT marker, nothing past the main header is read
+		dparameters.cp_limit_decoding = LIMIT_TO_MAIN_HEADER;
+		opj_setup_decoder(dinfo, &dparameters);
+		cio = opj_cio_open((opj_common_ptr)dinfo, image->encoded, image->length);
+
+		jp2_image = opj_decode_with_info(dinfo, cio, &info);
+		if (jp2_image == NULL)
+			throw "opj_decode failed";
+		// a main header without SIZ or COD is not usable
+		if (jp2_image->numcomps <= 0 || info.numdecompos == NULL)
+			throw "incomplete main header";
+
+		int max_numdecompos = 0;
+		for (int compno = 0; compno < info.numcomps; compno++)
+		{
+			if (max_numdecompos < info.numdecompos[compno])
+				max_numdecompos = info.numdecompos[compno];
+		}
+
+		image->width = jp2_image->x1 - jp2_image->x0;
+		image->height = jp2_image->y1 - jp2_image->y0;
+		image->layers = info.numlayers;
+		image->resolutions = max_numdecompos + 1;
+		image->components = info.numcomps;
+		image->packet_count = 0;
+
+		success = true;
 	}
 	catch (...)
 	{
-		return false;
+		success = false;
+	}
+
+	opj_destroy_cstr_info(&info);
+	if (jp2_image != NULL) opj_image_destroy(jp2_image);
+	if (cio != NULL) opj_cio_close(cio);
+
+	return success;
+}
+
+bool DotNetDecodeLayerBoundaries64(MarshalledImage* image)
+{
+	return DotNetDecodeLayerBoundaries(image);
+}
+
+bool DotNetDecodeLayerBoundaries(MarshalledImage* image)
+{
+	opj_dparameters dparameters;
+	opj_codestream_info_t info;
+	opj_dinfo_t* dinfo = NULL;
+	opj_cio_t* cio = NULL;
+	opj_image_t* jp2_image = NULL;
+	bool success = false;
+
+	info.tile = NULL;
+	info.tw = info.th = 0;
+	info.marker = NULL;
+	info.numdecompos = NULL;
+
+	try
+	{
+		opj_set_default_decoder_parameters(&dparameters);
+		// walk the packet headers to build the index, skipping tier-1, the
+		// wavelet transform and the pixel copies
+		dparameters.cp_limit_decoding = LIMIT_TO_PACKET_HEADERS;
+		dinfo = opj_create_decompress(CODEC_J2K);
+		opj_setup_decoder(dinfo, &dparameters);
+		cio = opj_cio_open((opj_common_ptr)dinfo, image->encoded, image->length);
+
+		jp2_image = opj_decode_with_info(dinfo, cio, &info);
+		if (jp2_image == NULL)
+			throw "opj_decode failed";
+		// layers are only contiguous byte ranges in a single tile, layer
+		// major codestream
+		if (info.tw * info.th != 1 || info.prog != LRCP || info.numlayers <= 0 ||
+			info.packno <= 0 || info.packno % info.numlayers != 0)
+			throw "layer boundaries are not contiguous";
+
+		int max_numdecompos = 0;
+		for (int compno = 0; compno < info.numcomps; compno++)
+		{
+			if (max_numdecompos < info.numdecompos[compno])
+				max_numdecompos = info.numdecompos[compno];
+		}
+
+		image->width = jp2_image->x1 - jp2_image->x0;
+		image->height = jp2_image->y1 - jp2_image->y0;
+		image->layers = info.numlayers;
+		image->resolutions = max_numdecompos + 1;
+		image->components = info.numcomps;
+		image->packet_count = info.packno;
+
+		int packets_per_layer = info.packno / info.numlayers;
+		image->layer_bounds = new MarshalledLayer[info.numlayers];
+
+		for (int i = 0; i < info.numlayers; i++)
+		{
+			image->layer_bounds[i].start = info.tile->packet[packets_per_layer * i].start_pos;
+			image->layer_bounds[i].end = info.tile->packet[packets_per_layer * (i + 1) - 1].end_pos;
+		}
+
+		success = true;
+	}
+	catch (...)
+	{
+		success = false;
 	}
+
+	opj_destroy_cstr_info(&info);
+	if (jp2_image != NULL) opj_image_destroy(jp2_image);
+	if (dinfo != NULL) opj_destroy_decompress(dinfo);
+	if (cio != NULL) opj_cio_close(cio);
+
+	return success;
 }
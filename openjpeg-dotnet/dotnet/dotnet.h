@@ -4,6 +4,12 @@
 
 #include "../libopenjpeg/openjpeg.h"
 
+struct MarshalledLayer
+{
+	int start;
+	int end;
+};
+
 struct MarshalledImage
 {
 	unsigned char* encoded;
@@ -18,6 +24,7 @@ struct MarshalledImage
 	int components;
 	int packet_count;
 	opj_packet_info_t* packets;
+	MarshalledLayer* layer_bounds;
 };
 
 #ifdef WIN32
@@ -29,14 +36,66 @@ struct MarshalledImage
 // uncompresed images are raw RGBA 8bit/channel
 DLLEXPORT bool DotNetEncode(MarshalledImage* image, bool lossless);
 DLLEXPORT bool DotNetDecode(MarshalledImage* image);
+// decodes at 1/2^discard_level of the full size, width and height are set to
+// the reduced dimensions; fails if the codestream has too few resolutions
+DLLEXPORT bool DotNetDecodeReduced(MarshalledImage* image, int discard_level);
+// as DotNetDecodeReduced, and only the first max_layers quality layers are
+// read (0 reads them all); the stream may be cut after the last of them
+DLLEXPORT bool DotNetDecodePartial(MarshalledImage* image, int discard_level, int max_layers);
+// decodes count images as DotNetDecodePartial would, spread over a native
+// thread pool of at most max_threads threads (0 for one per processor);
+// results[i] tells if images[i] decoded, true is returned if they all did
+DLLEXPORT bool DotNetDecodeBatch(MarshalledImage* images, int count, bool* results, int discard_level, int max_layers, int max_threads);
 DLLEXPORT bool DotNetDecodeWithInfo(MarshalledImage* image);
+// reads the main header only and fills in width, height, components, layers
+// and resolutions; no tile or pixel memory is allocated
+DLLEXPORT bool DotNetProbe(MarshalledImage* image);
+// parses the packet headers only and fills in layer_bounds with the byte range
+// of each quality layer; requires a single tile LRCP codestream
+DLLEXPORT bool DotNetDecodeLayerBoundaries(MarshalledImage* image);
+// zero-copy variants: encoded points at the caller's codestream and planes at
+// one caller owned width * height buffer per component. Decoding fails unless
+// width, height and components match the decoded image exactly
+DLLEXPORT bool DotNetDecodeToPlanes(MarshalledImage* image, unsigned char** planes, int discard_level, int max_layers);
+DLLEXPORT bool DotNetEncodeFromPlanes(MarshalledImage* image, unsigned char** planes, bool lossless);
+// encodes 1 to 4 components read straight from 8 bit RGBA or BGRA pixel
+// rows of stride bytes; one component is read from red, two from red and alpha
+DLLEXPORT bool DotNetEncodeInterleaved(MarshalledImage* image, unsigned char* input, int stride, bool bgra, bool lossless);
+// decodes straight to 8 bit RGBA or BGRA rows of stride bytes; width and height
+// must be the (reduced) image size. Gray is expanded and a missing alpha is 255
+DLLEXPORT bool DotNetDecodeInterleaved(MarshalledImage* image, unsigned char* output, int stride, bool bgra, int discard_level, int max_layers);
+// a decoder kept by the caller decodes one image after the other as the
+// functions above do, reusing its tile structures and scratch memory so that
+// images of the same size allocate almost nothing; one thread at a time
+DLLEXPORT opj_dinfo_t* DotNetDecoderCreate();
+DLLEXPORT void DotNetDecoderDestroy(opj_dinfo_t* decoder);
+DLLEXPORT bool DotNetDecoderDecodePartial(opj_dinfo_t* decoder, MarshalledImage* image, int discard_level, int max_layers);
+DLLEXPORT bool DotNetDecoderDecodeToPlanes(opj_dinfo_t* decoder, MarshalledImage* image, unsigned char** planes, int discard_level, int max_layers);
+DLLEXPORT bool DotNetDecoderDecodeInterleaved(opj_dinfo_t* decoder, MarshalledImage* image, unsigned char* output, int stride, bool bgra, int discard_level, int max_layers);
+// DotNetProbe reading the main header with a decoder kept by the caller
+DLLEXPORT bool DotNetDecoderProbe(opj_dinfo_t* decoder, MarshalledImage* image);
 DLLEXPORT bool DotNetAllocEncoded(MarshalledImage* image);
 DLLEXPORT bool DotNetAllocDecoded(MarshalledImage* image);
 DLLEXPORT void DotNetFree(MarshalledImage* image);
 
 DLLEXPORT bool DotNetEncode64(MarshalledImage* image, bool lossless);
 DLLEXPORT bool DotNetDecode64(MarshalledImage* image);
+DLLEXPORT bool DotNetDecodeReduced64(MarshalledImage* image, int discard_level);
+DLLEXPORT bool DotNetDecodePartial64(MarshalledImage* image, int discard_level, int max_layers);
+DLLEXPORT bool DotNetDecodeBatch64(MarshalledImage* images, int count, bool* results, int discard_level, int max_layers, int max_threads);
 DLLEXPORT bool DotNetDecodeWithInfo64(MarshalledImage* image);
+DLLEXPORT bool DotNetProbe64(MarshalledImage* image);
+DLLEXPORT bool DotNetDecodeLayerBoundaries64(MarshalledImage* image);
+DLLEXPORT bool DotNetDecodeToPlanes64(MarshalledImage* image, unsigned char** planes, int discard_level, int max_layers);
+DLLEXPORT bool DotNetEncodeFromPlanes64(MarshalledImage* image, unsigned char** planes, bool lossless);
+DLLEXPORT bool DotNetEncodeInterleaved64(MarshalledImage* image, unsigned char* input, int stride, bool bgra, bool lossless);
+DLLEXPORT bool DotNetDecodeInterleaved64(MarshalledImage* image, unsigned char* output, int stride, bool bgra, int discard_level, int max_layers);
+DLLEXPORT opj_dinfo_t* DotNetDecoderCreate64();
+DLLEXPORT void DotNetDecoderDestroy64(opj_dinfo_t* decoder);
+DLLEXPORT bool DotNetDecoderDecodePartial64(opj_dinfo_t* decoder, MarshalledImage* image, int discard_level, int max_layers);
+DLLEXPORT bool DotNetDecoderDecodeToPlanes64(opj_dinfo_t* decoder, MarshalledImage* image, unsigned char** planes, int discard_level, int max_layers);
+DLLEXPORT bool DotNetDecoderDecodeInterleaved64(opj_dinfo_t* decoder, MarshalledImage* image, unsigned char* output, int stride, bool bgra, int discard_level, int max_layers);
+DLLEXPORT bool DotNetDecoderProbe64(opj_dinfo_t* decoder, MarshalledImage* image);
 DLLEXPORT bool DotNetAllocEncoded64(MarshalledImage* image);
 DLLEXPORT bool DotNetAllocDecoded64(MarshalledImage* image);
 DLLEXPORT void DotNetFree64(MarshalledImage* image);
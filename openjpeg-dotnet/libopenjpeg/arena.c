@@ -0,0 +1,169 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "opj_includes.h"
+
+/** @defgroup ARENA ARENA - Implementation of a bump allocator */
+/*@{*/
+
+/** Alignment of the memory handed out */
+#define OPJ_ARENA_ALIGN 16
+/** Smallest block taken from opj_malloc */
+#define OPJ_ARENA_MIN_BLOCK (16 * 1024)
+
+struct opj_arena_block {
+	/** next block, filled before this one */
+	opj_arena_block_t *next;
+	/** bytes this block hands out */
+	size_t size;
+};
+
+/** Size of the block header, rounded up so that the memory after it stays aligned */
+#define OPJ_ARENA_HEADER ((sizeof(opj_arena_block_t) + OPJ_ARENA_ALIGN - 1) & ~(size_t) (OPJ_ARENA_ALIGN - 1))
+
+/** @name Local static functions */
+/*@{*/
+
+/**
+Start a new block large enough for an allocation
+@param arena Arena to grow
+@param size Aligned size of the allocation
+@return Returns the new first block, or NULL if there is insufficient memory available
+*/
+static opj_arena_block_t* opj_arena_grow(opj_arena_t *arena, size_t size);
+
+/*@}*/
+
+/*@}*/
+
+/* ----------------------------------------------------------------------- */
+
+static opj_arena_block_t* opj_arena_grow(opj_arena_t *arena, size_t size) {
+	opj_arena_block_t *block;
+	/* every block is as large as the ones before it together, so the count stays logarithmic */
+	size_t block_size = arena->capacity > size ? arena->capacity : size;
+	if (block_size < OPJ_ARENA_MIN_BLOCK) {
+		block_size = OPJ_ARENA_MIN_BLOCK;
+	}
+	if (block_size > (size_t) -1 - OPJ_ARENA_HEADER) {
+		return NULL;
+	}
+
+	block = (opj_arena_block_t*) opj_malloc(OPJ_ARENA_HEADER + block_size);
+	if (!block) {
+		return NULL;
+	}
+	block->size = block_size;
+	block->next = arena->blocks;
+	/* a reset arena starts again from one block holding its whole capacity */
+	arena->capacity = arena->blocks ? arena->capacity + block_size : block_size;
+	arena->blocks = block;
+	arena->used = 0;
+	return block;
+}
+
+/* ----------------------------------------------------------------------- */
+
+void* opj_arena_malloc(opj_arena_t *arena, size_t size) {
+	opj_arena_block_t *block = arena->blocks;
+	void *ptr;
+
+	if (size > (size_t) -1 - OPJ_ARENA_ALIGN) {
+		return NULL;
+	}
+	size = (size + OPJ_ARENA_ALIGN - 1) & ~(size_t) (OPJ_ARENA_ALIGN - 1);
+	if (!block || block->size - arena->used < size) {
+		block = opj_arena_grow(arena, size);
+		if (!block) {
+			return NULL;
+		}
+	}
+
+	ptr = (char*) block + OPJ_ARENA_HEADER + arena->used;
+	arena->used += size;
+	arena->last = ptr;
+	return ptr;
+}
+
+void* opj_arena_calloc(opj_arena_t *arena, size_t num, size_t size) {
+	void *ptr;
+
+	if (size && num > (size_t) -1 / size) {
+		return NULL;
+	}
+	ptr = opj_arena_malloc(arena, num * size);
+	if (ptr) {
+		memset(ptr, 0, num * size);
+	}
+	return ptr;
+}
+
+void* opj_arena_realloc(opj_arena_t *arena, void *ptr, size_t old_size, size_t size) {
+	void *grown;
+
+	if (!ptr) {
+		return opj_arena_malloc(arena, size);
+	}
+	if (ptr == arena->last && size <= (size_t) -1 - OPJ_ARENA_ALIGN) {
+		char *base = (char*) arena->blocks + OPJ_ARENA_HEADER;
+		size_t offset = (char*) ptr - base;
+		size_t aligned = (size + OPJ_ARENA_ALIGN - 1) & ~(size_t) (OPJ_ARENA_ALIGN - 1);
+		if (aligned <= arena->blocks->size - offset) {
+			arena->used = offset + aligned;
+			return ptr;
+		}
+	}
+
+	grown = opj_arena_malloc(arena, size);
+	if (grown) {
+		memcpy(grown, ptr, old_size < size ? old_size : size);
+	}
+	return grown;
+}
+
+void opj_arena_reset(opj_arena_t *arena) {
+	opj_arena_block_t *block = arena->blocks;
+
+	if (block && block->next) {
+		/* the next decode gets one block as large as all of them */
+		size_t capacity = arena->capacity;
+		opj_arena_free(arena);
+		arena->capacity = capacity;
+	}
+	arena->used = 0;
+	arena->last = NULL;
+}
+
+void opj_arena_free(opj_arena_t *arena) {
+	opj_arena_block_t *block = arena->blocks;
+
+	while (block) {
+		opj_arena_block_t *next = block->next;
+		opj_free(block);
+		block = next;
+	}
+	arena->blocks = NULL;
+	arena->used = 0;
+	arena->capacity = 0;
+	arena->last = NULL;
+}
@@ -0,0 +1,101 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __ARENA_H
+#define __ARENA_H
+/**
+@file arena.h
+@brief Implementation of a bump allocator (ARENA)
+
+The functions in ARENA.C hand out memory that lives as long as one decode. An
+allocation only moves a pointer within a large block taken from opj_malloc, and
+everything allocated is released at once by opj_arena_reset. The blocks are kept
+for the next decode, so a decompressor that is reused stops calling the system
+allocator once its arena has grown to the size of the codestreams it reads.
+An arena is not thread safe: each thread allocates from its own.
+*/
+
+/** @defgroup ARENA ARENA - Implementation of a bump allocator */
+/*@{*/
+
+/** Block of an arena, followed by the memory it hands out */
+typedef struct opj_arena_block opj_arena_block_t;
+
+/**
+Bump allocator, a zero filled structure is an empty arena
+*/
+typedef struct opj_arena {
+	/** blocks of the arena, the one being filled first */
+	opj_arena_block_t *blocks;
+	/** bytes used in the first block */
+	size_t used;
+	/** bytes held by all the blocks, the size of the block made after a reset */
+	size_t capacity;
+	/** last allocation, the only one that can grow in place */
+	void *last;
+} opj_arena_t;
+
+/** @name Exported functions */
+/*@{*/
+/* ----------------------------------------------------------------------- */
+/**
+Allocate an uninitialized memory block from an arena
+@param arena Arena to allocate from
+@param size Bytes to allocate
+@return Returns a pointer aligned to 16 bytes, or NULL if there is insufficient memory available
+*/
+void* opj_arena_malloc(opj_arena_t *arena, size_t size);
+/**
+Allocate a memory block with elements initialized to 0 from an arena
+@param arena Arena to allocate from
+@param num Blocks to allocate
+@param size Bytes per block to allocate
+@return Returns a pointer aligned to 16 bytes, or NULL if there is insufficient memory available
+*/
+void* opj_arena_calloc(opj_arena_t *arena, size_t num, size_t size);
+/**
+Resize a memory block of an arena. The last block allocated grows in place,
+any other one is copied and its old memory is only released by opj_arena_reset.
+@param arena Arena the block was allocated from
+@param ptr Block to resize, or NULL to allocate a new one
+@param old_size Current size of the block
+@param size New size of the block
+@return Returns the resized block, or NULL if there is insufficient memory available
+*/
+void* opj_arena_realloc(opj_arena_t *arena, void *ptr, size_t old_size, size_t size);
+/**
+Release everything allocated from an arena at once. The memory is kept for the
+next allocations, merged into a single block when the arena had to grow.
+@param arena Arena to reset
+*/
+void opj_arena_reset(opj_arena_t *arena);
+/**
+Release everything allocated from an arena and give its memory back
+@param arena Arena to empty, it can be used again afterwards
+*/
+void opj_arena_free(opj_arena_t *arena);
+/* ----------------------------------------------------------------------- */
+/*@}*/
+
+/*@}*/
+
+#endif /* __ARENA_H */
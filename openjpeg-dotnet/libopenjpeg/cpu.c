@@ -0,0 +1,156 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "opj_includes.h"
+#if defined(_MSC_VER) && defined(OPJ_KERNELS_SSE2)
+#include <intrin.h>
+#elif defined(OPJ_KERNELS_SSE2)
+#include <cpuid.h>
+#endif
+
+/** @defgroup CPU CPU - Detection of the processor features */
+/*@{*/
+
+/** Level the kernels run at, -1 until the first call of opj_cpu_level */
+static volatile int simd_level = -1;
+
+/** Names of the levels in the OPJ_SIMD environment variable */
+static const char *simd_names[] = { "scalar", "sse2", "avx2", "avx512" };
+
+/** @name Local static functions */
+/*@{*/
+
+/**
+Get the widest level supported by the processor, the operating system and the compiler
+*/
+static int opj_cpu_detect(void);
+/**
+Get the detected level, capped by the OPJ_SIMD environment variable
+*/
+static int opj_cpu_default(void);
+
+/*@}*/
+
+/*@}*/
+
+/* ----------------------------------------------------------------------- */
+
+#ifdef OPJ_KERNELS_SSE2
+static void opj_cpuid(unsigned int leaf, unsigned int subleaf, unsigned int regs[4]) {
+#ifdef _MSC_VER
+	__cpuidex((int*)regs, (int)leaf, (int)subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+#endif
+
+#ifdef OPJ_KERNELS_AVX2
+/* low word of the XCR0 register, the register states the operating system saves */
+static unsigned int opj_xgetbv(void) {
+#ifdef _MSC_VER
+	return (unsigned int)_xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a" (eax), "=d" (edx) : "c" (0));
+	return eax;
+#endif
+}
+#endif
+
+static int opj_cpu_detect(void) {
+	int level = OPJ_SIMD_SCALAR;
+#ifdef OPJ_KERNELS_SSE2
+	unsigned int regs[4];
+	unsigned int max_leaf;
+
+	opj_cpuid(0, 0, regs);
+	max_leaf = regs[0];
+	if (max_leaf < 1) {
+		return level;
+	}
+	opj_cpuid(1, 0, regs);
+	if (!(regs[3] & (1u << 26))) {
+		return level;
+	}
+	level = OPJ_SIMD_SSE2;
+#ifdef OPJ_KERNELS_AVX2
+	/* the wide registers are only usable if the operating system saves them (OSXSAVE) */
+	if (max_leaf >= 7 && (regs[2] & (1u << 27))) {
+		unsigned int xcr0 = opj_xgetbv();
+		opj_cpuid(7, 0, regs);
+		/* AVX2 needs the XMM and YMM states */
+		if ((regs[1] & (1u << 5)) && (xcr0 & 0x06) == 0x06) {
+			level = OPJ_SIMD_AVX2;
+#ifdef OPJ_KERNELS_AVX512
+			/* AVX-512F also needs the opmask and the upper ZMM states */
+			if ((regs[1] & (1u << 16)) && (xcr0 & 0xe6) == 0xe6) {
+				level = OPJ_SIMD_AVX512;
+			}
+#endif
+		}
+	}
+#endif
+#endif
+	return level;
+}
+
+static int opj_cpu_default(void) {
+	int level = opj_cpu_detect();
+	const char *env = getenv("OPJ_SIMD");
+	int i;
+
+	if (env != NULL) {
+		for (i = 0; i <= OPJ_SIMD_AVX512; i++) {
+			if (strcmp(env, simd_names[i]) == 0) {
+				level = int_min(level, i);
+			}
+		}
+	}
+	return level;
+}
+
+int opj_cpu_level(void) {
+	int level = simd_level;
+
+	if (level < 0) {
+		/* two threads racing here store the same value */
+		level = opj_cpu_default();
+		simd_level = level;
+	}
+	return level;
+}
+
+int OPJ_CALLCONV opj_get_simd_level(void) {
+	return opj_cpu_level();
+}
+
+int OPJ_CALLCONV opj_set_simd_level(int level) {
+	if (level < 0) {
+		level = opj_cpu_default();
+	} else {
+		level = int_min(level, opj_cpu_detect());
+	}
+	simd_level = level;
+	return level;
+}
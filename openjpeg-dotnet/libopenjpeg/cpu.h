@@ -0,0 +1,86 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __CPU_H
+#define __CPU_H
+/**
+@file cpu.h
+@brief Detection of the processor features and selection of the SIMD kernels (CPU)
+
+The functions in CPU.C find out once which instruction sets the processor and the
+operating system support. The DWT, MCT, TCD and T1 modules compile one version of
+their hot loops per instruction set level and call the one of opj_cpu_level through
+function pointers, so a single binary runs the widest kernels the host can execute.
+*/
+
+/** @defgroup CPU CPU - Detection of the processor features */
+/*@{*/
+
+/*
+Kernels of a level are only compiled if the compiler can generate them without the
+whole library being built for that instruction set: GCC 4.9 and clang through the
+target attribute, MSVC as soon as it knows the intrinsics.
+*/
+#if (defined(__x86_64__) || defined(__i386__)) && \
+	(defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define OPJ_KERNELS_SSE2
+#define OPJ_KERNELS_AVX2
+#define OPJ_KERNELS_AVX512
+#define OPJ_TARGET_SSE2 __attribute__((target("sse2")))
+#define OPJ_TARGET_AVX2 __attribute__((target("avx2")))
+#define OPJ_TARGET_AVX512 __attribute__((target("avx512f")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define OPJ_KERNELS_SSE2
+#if _MSC_VER >= 1700
+#define OPJ_KERNELS_AVX2
+#endif
+#if _MSC_VER >= 1911
+#define OPJ_KERNELS_AVX512
+#endif
+#define OPJ_TARGET_SSE2
+#define OPJ_TARGET_AVX2
+#define OPJ_TARGET_AVX512
+#endif
+
+#ifdef OPJ_KERNELS_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef OPJ_KERNELS_AVX2
+#include <immintrin.h>
+#endif
+
+/** @name Exported functions */
+/*@{*/
+/* ----------------------------------------------------------------------- */
+/**
+Get the instruction set level the kernels run at. The level is detected on first
+use and capped by the OPJ_SIMD environment variable (scalar, sse2, avx2 or avx512)
+or by opj_set_simd_level.
+@return Returns one of the OPJ_SIMD_LEVEL values
+*/
+int opj_cpu_level(void);
+/* ----------------------------------------------------------------------- */
+/*@}*/
+
+/*@}*/
+
+#endif /* __CPU_H */
@@ -31,10 +31,6 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-#ifdef __SSE__
-#include <xmmintrin.h>
-#endif
-
 #include "opj_includes.h"
 
 /** @defgroup DWT DWT - Implementation of a discrete wavelet transform */
@@ -64,6 +60,99 @@ typedef struct v4dwt_local {
 	int		cas ;
 } v4dwt_t ;
 
+#ifdef OPJ_KERNELS_AVX2
+typedef union {
+	float	f[8];
+} v8;
+
+typedef struct v8dwt_local {
+	v8*	wavelet ;
+	int		dn ;
+	int		sn ;
+	int		cas ;
+} v8dwt_t ;
+#endif
+
+#ifdef OPJ_KERNELS_AVX512
+typedef union {
+	float	f[16];
+} v16;
+
+typedef struct v16dwt_local {
+	v16*	wavelet ;
+	int		dn ;
+	int		sn ;
+	int		cas ;
+} v16dwt_t ;
+#endif
+
+/**
+Virtual function type for wavelet transform in 1-D 
+*/
+typedef void (*DWT1DFN)(dwt_t* v);
+
+/**
+Kernels of one instruction set level, see dwt_get_kernels
+*/
+typedef struct dwt_kernels {
+	/** inverse 5-3 transform of 4 adjacent columns */
+	void (*decode_v4)(dwt_t* restrict v, int* restrict a, int x);
+	/** forward 5-3 transform of 4 adjacent columns */
+	void (*encode_v4)(int* restrict mem, int* restrict a, int x, int dn, int sn, int cas);
+	/** inverse 9-7 transform of 4 signals */
+	void (*v4dwt_decode)(v4dwt_t* restrict dwt);
+	/** forward 9-7 transform of 4 signals */
+	void (*v4dwt_encode)(v4dwt_t* restrict dwt);
+	/** rounding of the forward 9-7 output to integers */
+	void (*round)(int* restrict ai, const float* restrict a, int n);
+	/** inverse 9-7 transform of a strip of rows and of a strip of columns */
+	opj_work_fn decode_real_h;
+	opj_work_fn decode_real_v;
+	/** size of one sample of the 9-7 scratch: 4, 8 or 16 floats */
+	size_t sample;
+} dwt_kernels_t;
+
+/**
+Rows or columns of a resolution level in one work item of the inverse transforms,
+a multiple of 16 so that the 9-7 groups of 4, 8 or 16 never straddle two items
+*/
+#define DWT_STRIP 32
+
+/**
+One level of the inverse 5-3 transform shared by the threads running it
+*/
+typedef struct dwt_decode_job {
+	int* tiledp;
+	/** width of the tile component */
+	int w;
+	/** size of the resolution level computed */
+	int rw, rh;
+	dwt_t h;
+	dwt_t v;
+	DWT1DFN dwt_1D;
+	const dwt_kernels_t* kernels;
+	/** scratch of each thread */
+	int* mem[OPJ_MAX_THREADS];
+} dwt_decode_job_t;
+
+/**
+One level of the inverse 9-7 transform shared by the threads running it
+*/
+typedef struct v4dwt_decode_job {
+	float* aj;
+	/** width of the tile component */
+	int w;
+	/** number of samples of the tile component */
+	int size;
+	/** size of the resolution level computed */
+	int rw, rh;
+	v4dwt_t h;
+	v4dwt_t v;
+	const dwt_kernels_t* kernels;
+	/** scratch of each thread, samples of 4, 8 or 16 floats depending on the kernel */
+	void* wavelet[OPJ_MAX_THREADS];
+} v4dwt_decode_job_t;
+
 static const float dwt_alpha =  1.586134342f; /*  12994 */
 static const float dwt_beta  =  0.052980118f; /*    434 */
 static const float dwt_gamma = -0.882911075f; /*  -7233 */
@@ -75,11 +164,6 @@ static const float c13318 = 1.625732422f;
 
 /*@}*/
 
-/**
-Virtual function type for wavelet transform in 1-D 
-*/
-typedef void (*DWT1DFN)(dwt_t* v);
-
 /** @name Local static functions */
 /*@{*/
 
@@ -108,9 +192,52 @@ Inverse 5-3 wavelet transform in 1-D
 */
 static void dwt_decode_1(dwt_t *v);
 /**
-Forward 9-7 wavelet transform in 1-D
+Inverse 5-3 wavelet transform in 1-D of 4 adjacent columns at once.
+The columns are read in place, v->mem receives 4 interleaved samples per row.
+@param v Lengths and parity of the columns, scratch of 4 * (sn + dn) integers
+@param a First sample of the leftmost column
+@param x Distance between two rows
+*/
+static void dwt_decode_v4_c(dwt_t* restrict v, int* restrict a, int x);
+#ifdef OPJ_KERNELS_SSE2
+static void dwt_decode_v4_sse2(dwt_t* restrict v, int* restrict a, int x);
+#endif
+/**
+Forward 5-3 wavelet transform in 1-D of 4 adjacent columns at once.
+The columns are copied to mem, transformed and written back deinterleaved.
+@param mem Scratch of 4 * (sn + dn) integers
+@param a First sample of the leftmost column
+@param x Distance between two rows
+@param dn Number of high pass samples
+@param sn Number of low pass samples
+@param cas Parity of the first sample
+*/
+static void dwt_encode_v4_c(int* restrict mem, int* restrict a, int x, int dn, int sn, int cas);
+#ifdef OPJ_KERNELS_SSE2
+static void dwt_encode_v4_sse2(int* restrict mem, int* restrict a, int x, int dn, int sn, int cas);
+#endif
+/**
+Forward 9-7 wavelet transform in 1-D of 4 signals at once, the inverse of v4dwt_decode.
+The samples are in natural order, low and high pass results are left interleaved.
+*/
+static void v4dwt_encode_c(v4dwt_t* restrict dwt);
+#ifdef OPJ_KERNELS_SSE2
+static void v4dwt_encode_sse(v4dwt_t* restrict dwt);
+#endif
+/**
+Round the output of the forward 9-7 transform, done in place, back to integers
+@param ai Integer samples
+@param a The same samples as floats
+@param n Number of samples
+*/
+static void dwt_round_c(int* restrict ai, const float* restrict a, int n);
+#ifdef OPJ_KERNELS_SSE2
+static void dwt_round_sse2(int* restrict ai, const float* restrict a, int n);
+#endif
+/**
+Get the kernels of the instruction set level given by opj_cpu_level
 */
-static void dwt_encode_1_real(int *a, int dn, int sn, int cas);
+static const dwt_kernels_t* dwt_get_kernels(void);
 /**
 Explicit calculation of the Quantization Stepsizes 
 */
@@ -118,7 +245,75 @@ static void dwt_encode_stepsize(int stepsize, int numbps, opj_stepsize_t *bandno
 /**
 Inverse wavelet transform in 2-D.
 */
-static void dwt_decode_tile(opj_tcd_tilecomp_t* tilec, int i, DWT1DFN fn);
+static void dwt_decode_tile(opj_tcd_tilecomp_t* tilec, int i, DWT1DFN fn, int num_threads, opj_tcd_scratch_t *scratch);
+/**
+Get the line buffer of a thread slot, grown to at least size bytes and kept for the next tiles
+@param scratch Scratch memory of the tile decoder
+@param slot Thread slot
+@param size Number of bytes needed
+@return Returns the 16 bytes aligned buffer, NULL if it can not be allocated
+*/
+static void* dwt_scratch_mem(opj_tcd_scratch_t *scratch, int slot, int size);
+/**
+Inverse 5-3 wavelet transform of a strip of rows of a dwt_decode_job_t
+@param user_data The dwt_decode_job_t
+@param index Index of the strip
+@param slot Thread slot, selects the scratch
+*/
+static void dwt_decode_h_job(void *user_data, int index, int slot);
+/**
+Inverse 5-3 wavelet transform of a strip of columns of a dwt_decode_job_t
+@param user_data The dwt_decode_job_t
+@param index Index of the strip
+@param slot Thread slot, selects the scratch
+*/
+static void dwt_decode_v_job(void *user_data, int index, int slot);
+/**
+Inverse 9-7 wavelet transform of a strip of rows of a v4dwt_decode_job_t
+@param user_data The v4dwt_decode_job_t
+@param index Index of the strip
+@param slot Thread slot, selects the scratch
+*/
+static void v4dwt_decode_h_job(void *user_data, int index, int slot);
+/**
+Inverse 9-7 wavelet transform of a strip of columns of a v4dwt_decode_job_t
+@param user_data The v4dwt_decode_job_t
+@param index Index of the strip
+@param slot Thread slot, selects the scratch
+*/
+static void v4dwt_decode_v_job(void *user_data, int index, int slot);
+#ifdef OPJ_KERNELS_AVX2
+/**
+Inverse 9-7 wavelet transform of a strip of rows of a v4dwt_decode_job_t, 8 rows at a time
+@param user_data The v4dwt_decode_job_t
+@param index Index of the strip
+@param slot Thread slot, selects the scratch
+*/
+static void v8dwt_decode_h_job(void *user_data, int index, int slot);
+/**
+Inverse 9-7 wavelet transform of a strip of columns of a v4dwt_decode_job_t, 8 columns at a time
+@param user_data The v4dwt_decode_job_t
+@param index Index of the strip
+@param slot Thread slot, selects the scratch
+*/
+static void v8dwt_decode_v_job(void *user_data, int index, int slot);
+#endif
+#ifdef OPJ_KERNELS_AVX512
+/**
+Inverse 9-7 wavelet transform of a strip of rows of a v4dwt_decode_job_t, 16 rows at a time
+@param user_data The v4dwt_decode_job_t
+@param index Index of the strip
+@param slot Thread slot, selects the scratch
+*/
+static void v16dwt_decode_h_job(void *user_data, int index, int slot);
+/**
+Inverse 9-7 wavelet transform of a strip of columns of a v4dwt_decode_job_t, 16 columns at a time
+@param user_data The v4dwt_decode_job_t
+@param index Index of the strip
+@param slot Thread slot, selects the scratch
+*/
+static void v16dwt_decode_v_job(void *user_data, int index, int slot);
+#endif
 
 /*@}*/
 
@@ -268,44 +463,6 @@ static void dwt_decode_1(dwt_t *v) {
 	dwt_decode_1_(v->mem, v->dn, v->sn, v->cas);
 }
 
-/* <summary>                             */
-/* Forward 9-7 wavelet transform in 1-D. */
-/* </summary>                            */
-static void dwt_encode_1_real(int *a, int dn, int sn, int cas) {
-	int i;
-	if (!cas) {
-		if ((dn > 0) || (sn > 1)) {	/* NEW :  CASE ONE ELEMENT */
-			for (i = 0; i < dn; i++)
-				D(i) -= fix_mul(S_(i) + S_(i + 1), 12993);
-			for (i = 0; i < sn; i++)
-				S(i) -= fix_mul(D_(i - 1) + D_(i), 434);
-			for (i = 0; i < dn; i++)
-				D(i) += fix_mul(S_(i) + S_(i + 1), 7233);
-			for (i = 0; i < sn; i++)
-				S(i) += fix_mul(D_(i - 1) + D_(i), 3633);
-			for (i = 0; i < dn; i++)
-				D(i) = fix_mul(D(i), 5038);	/*5038 */
-			for (i = 0; i < sn; i++)
-				S(i) = fix_mul(S(i), 6659);	/*6660 */
-		}
-	} else {
-		if ((sn > 0) || (dn > 1)) {	/* NEW :  CASE ONE ELEMENT */
-			for (i = 0; i < dn; i++)
-				S(i) -= fix_mul(DD_(i) + DD_(i - 1), 12993);
-			for (i = 0; i < sn; i++)
-				D(i) -= fix_mul(SS_(i) + SS_(i + 1), 434);
-			for (i = 0; i < dn; i++)
-				S(i) += fix_mul(DD_(i) + DD_(i - 1), 7233);
-			for (i = 0; i < sn; i++)
-				D(i) += fix_mul(SS_(i) + SS_(i + 1), 3633);
-			for (i = 0; i < dn; i++)
-				S(i) = fix_mul(S(i), 5038);	/*5038 */
-			for (i = 0; i < sn; i++)
-				D(i) = fix_mul(D(i), 6659);	/*6660 */
-		}
-	}
-}
-
 static void dwt_encode_stepsize(int stepsize, int numbps, opj_stepsize_t *bandno_stepsize) {
 	int p, n;
 	p = int_floorlog2(stepsize) - 13;
@@ -329,10 +486,13 @@ void dwt_encode(opj_tcd_tilecomp_t * tilec) {
 	int *aj = NULL;
 	int *bj = NULL;
 	int w, l;
+	const dwt_kernels_t* kernels = dwt_get_kernels();
 	
 	w = tilec->x1-tilec->x0;
 	l = tilec->numresolutions-1;
 	a = tilec->data;
+	/* one scratch for every level, large enough for 4 columns of the tile */
+	bj = (int*)opj_aligned_malloc(int_max(w, tilec->y1 - tilec->y0) * 4 * sizeof(int));
 	
 	for (i = 0; i < l; i++) {
 		int rw;			/* width of the resolution level computed                                                           */
@@ -353,34 +513,34 @@ void dwt_encode(opj_tcd_tilecomp_t * tilec) {
         
 		sn = rh1;
 		dn = rh - rh1;
-		bj = (int*)opj_malloc(rh * sizeof(int));
-		for (j = 0; j < rw; j++) {
+		for (j = 0; j + 4 <= rw; j += 4) {
+			kernels->encode_v4(bj, a + j, w, dn, sn, cas_col);
+		}
+		for (; j < rw; j++) {
 			aj = a + j;
 			for (k = 0; k < rh; k++)  bj[k] = aj[k*w];
 			dwt_encode_1(bj, dn, sn, cas_col);
 			dwt_deinterleave_v(bj, aj, dn, sn, w, cas_col);
 		}
-		opj_free(bj);
 		
 		sn = rw1;
 		dn = rw - rw1;
-		bj = (int*)opj_malloc(rw * sizeof(int));
 		for (j = 0; j < rh; j++) {
 			aj = a + j * w;
-			for (k = 0; k < rw; k++)  bj[k] = aj[k];
+			memcpy(bj, aj, rw * sizeof(int));
 			dwt_encode_1(bj, dn, sn, cas_row);
 			dwt_deinterleave_h(bj, aj, dn, sn, cas_row);
 		}
-		opj_free(bj);
 	}
+	opj_aligned_free(bj);
 }
 
 
 /* <summary>                            */
 /* Inverse 5-3 wavelet transform in 2-D. */
 /* </summary>                           */
-void dwt_decode(opj_tcd_tilecomp_t* tilec, int numres) {
-	dwt_decode_tile(tilec, numres, &dwt_decode_1);
+void dwt_decode(opj_tcd_tilecomp_t* tilec, int numres, int num_threads, opj_tcd_scratch_t *scratch) {
+	dwt_decode_tile(tilec, numres, &dwt_decode_1, num_threads, scratch);
 }
 
 
@@ -407,15 +567,26 @@ double dwt_getnorm(int level, int orient) {
 /* </summary>                            */
 
 void dwt_encode_real(opj_tcd_tilecomp_t * tilec) {
-	int i, j, k;
-	int *a = NULL;
-	int *aj = NULL;
-	int *bj = NULL;
-	int w, l;
+	int i, j, k, c;
+	float *a = NULL;
+	int *ai = NULL;
+	v4dwt_t v;
+	int w, h, l, n;
+	const dwt_kernels_t* kernels = dwt_get_kernels();
 	
 	w = tilec->x1-tilec->x0;
+	h = tilec->y1-tilec->y0;
 	l = tilec->numresolutions-1;
-	a = tilec->data;
+	n = w * h;
+	
+	/* the fixed point samples are transformed as floats in place, like the decoder does */
+	ai = tilec->data;
+	a = (float*) tilec->data;
+	for (k = 0; k < n; k++) {
+		a[k] = (float) ai[k];
+	}
+	/* one scratch for every level */
+	v.wavelet = (v4*) opj_aligned_malloc((int_max(w, h) + 5) * sizeof(v4));
 	
 	for (i = 0; i < l; i++) {
 		int rw;			/* width of the resolution level computed                                                     */
@@ -424,7 +595,6 @@ void dwt_encode_real(opj_tcd_tilecomp_t * tilec) {
 		int rh1;		/* height of the resolution level once lower than computed one                                */
 		int cas_col;	/* 0 = non inversion on horizontal filtering 1 = inversion between low-pass and high-pass filtering */
 		int cas_row;	/* 0 = non inversion on vertical filtering 1 = inversion between low-pass and high-pass filtering   */
-		int dn, sn;
 		
 		rw = tilec->resolutions[l - i].x1 - tilec->resolutions[l - i].x0;
 		rh = tilec->resolutions[l - i].y1 - tilec->resolutions[l - i].y0;
@@ -434,30 +604,79 @@ void dwt_encode_real(opj_tcd_tilecomp_t * tilec) {
 		cas_row = tilec->resolutions[l - i].x0 % 2;
 		cas_col = tilec->resolutions[l - i].y0 % 2;
 		
-		sn = rh1;
-		dn = rh - rh1;
-		bj = (int*)opj_malloc(rh * sizeof(int));
-		for (j = 0; j < rw; j++) {
-			aj = a + j;
-			for (k = 0; k < rh; k++)  bj[k] = aj[k*w];
-			dwt_encode_1_real(bj, dn, sn, cas_col);
-			dwt_deinterleave_v(bj, aj, dn, sn, w, cas_col);
+		/* columns, 4 at a time, each row of a group is one contiguous copy */
+		v.sn = rh1;
+		v.dn = rh - rh1;
+		v.cas = cas_col;
+		for (j = 0; j < rw; j += 4) {
+			int cols = int_min(4, rw - j);
+			float *aj = a + j;
+			if (cols < 4) {
+				memset(v.wavelet, 0, rh * sizeof(v4));
+			}
+			for (k = 0; k < rh; k++) {
+				memcpy(&v.wavelet[k], &aj[k*w], cols * sizeof(float));
+			}
+			kernels->v4dwt_encode(&v);
+			for (k = 0; k < v.sn; k++) {
+				memcpy(&aj[k*w], &v.wavelet[2*k + v.cas], cols * sizeof(float));
+			}
+			for (k = 0; k < v.dn; k++) {
+				memcpy(&aj[(v.sn + k)*w], &v.wavelet[2*k + 1 - v.cas], cols * sizeof(float));
+			}
 		}
-		opj_free(bj);
 		
-		sn = rw1;
-		dn = rw - rw1;
-		bj = (int*)opj_malloc(rw * sizeof(int));
-		for (j = 0; j < rh; j++) {
-			aj = a + j * w;
-			for (k = 0; k < rw; k++)  bj[k] = aj[k];
-			dwt_encode_1_real(bj, dn, sn, cas_row);
-			dwt_deinterleave_h(bj, aj, dn, sn, cas_row);
+		/* rows, 4 at a time */
+		v.sn = rw1;
+		v.dn = rw - rw1;
+		v.cas = cas_row;
+		for (j = 0; j < rh; j += 4) {
+			int rows = int_min(4, rh - j);
+			float *aj = a + j * w;
+			if (rows < 4) {
+				memset(v.wavelet, 0, rw * sizeof(v4));
+			}
+			for (k = 0; k < rw; k++) {
+				for (c = 0; c < rows; c++) {
+					v.wavelet[k].f[c] = aj[c*w + k];
+				}
+			}
+			kernels->v4dwt_encode(&v);
+			for (c = 0; c < rows; c++) {
+				for (k = 0; k < v.sn; k++) {
+					aj[c*w + k] = v.wavelet[2*k + v.cas].f[c];
+				}
+				for (k = 0; k < v.dn; k++) {
+					aj[c*w + v.sn + k] = v.wavelet[2*k + 1 - v.cas].f[c];
+				}
+			}
 		}
-		opj_free(bj);
+	}
+	opj_aligned_free(v.wavelet);
+	
+	/* back to fixed point, rounded to nearest */
+	kernels->round(ai, a, n);
+}
+
+
+static void dwt_round_c(int* restrict ai, const float* restrict a, int n) {
+	int k;
+	for (k = 0; k < n; k++) {
+		ai[k] = (int) lrintf(a[k]);
 	}
 }
 
+#ifdef OPJ_KERNELS_SSE2
+OPJ_TARGET_SSE2 static void dwt_round_sse2(int* restrict ai, const float* restrict a, int n) {
+	int k = 0;
+	for (; k + 4 <= n; k += 4) {
+		_mm_storeu_si128((__m128i*) &ai[k], _mm_cvtps_epi32(_mm_loadu_ps(&a[k])));
+	}
+	for (; k < n; k++) {
+		ai[k] = _mm_cvtss_si32(_mm_load_ss(&a[k]));
+	}
+}
+#endif
 
 /* <summary>                          */
 /* Get gain of 9-7 wavelet transform. */
@@ -496,6 +715,252 @@ void dwt_calc_explicit_stepsizes(opj_tccp_t * tccp, int prec) {
 }
 
 
+/* <summary>                                                   */
+/* Inverse 5-3 wavelet transform in 1-D of 4 adjacent columns.  */
+/* </summary>                                                  */
+static void dwt_decode_v4_c(dwt_t* restrict v, int* restrict a, int x) {
+	int* restrict mem = v->mem;
+	int* restrict low = a;
+	int* restrict high = a + v->sn * x;
+	int sn = v->sn;
+	int dn = v->dn;
+	int i, k;
+
+	/* same lifting steps and rounding as dwt_decode_1_, with the samples taken
+	   from the low and high pass halves instead of an interleaved copy */
+	if (!v->cas) {
+		if (!((dn > 0) || (sn > 1))) {
+			return;
+		}
+		for (i = 0; i < sn; i++) {
+			int* d0 = &high[int_clamp(i - 1, 0, dn - 1) * x];
+			int* d1 = &high[int_min(i, dn - 1) * x];
+			for (k = 0; k < 4; k++) {
+				mem[(2 * i) * 4 + k] = low[i * x + k] - ((d0[k] + d1[k] + 2) >> 2);
+			}
+		}
+		for (i = 0; i < dn; i++) {
+			int* s0 = &mem[(2 * int_min(i, sn - 1)) * 4];
+			int* s1 = &mem[(2 * int_min(i + 1, sn - 1)) * 4];
+			for (k = 0; k < 4; k++) {
+				mem[(2 * i + 1) * 4 + k] = high[i * x + k] + ((s0[k] + s1[k]) >> 1);
+			}
+		}
+	} else {
+		if (!sn && dn == 1) {
+			for (k = 0; k < 4; k++) {
+				a[k] /= 2;
+			}
+			return;
+		}
+		for (i = 0; i < sn; i++) {
+			int* s0 = &high[int_min(i, dn - 1) * x];
+			int* s1 = &high[int_min(i + 1, dn - 1) * x];
+			for (k = 0; k < 4; k++) {
+				mem[(2 * i + 1) * 4 + k] = low[i * x + k] - ((s0[k] + s1[k] + 2) >> 2);
+			}
+		}
+		for (i = 0; i < dn; i++) {
+			int* d0 = &mem[(2 * int_min(i, sn - 1) + 1) * 4];
+			int* d1 = &mem[(2 * int_clamp(i - 1, 0, sn - 1) + 1) * 4];
+			for (k = 0; k < 4; k++) {
+				mem[(2 * i) * 4 + k] = high[i * x + k] + ((d0[k] + d1[k]) >> 1);
+			}
+		}
+	}
+
+	for (i = 0; i < sn + dn; i++) {
+		memcpy(&a[i * x], &mem[i * 4], 4 * sizeof(int));
+	}
+}
+
+#ifdef OPJ_KERNELS_SSE2
+
+/* <summary>                                                   */
+/* Inverse 5-3 wavelet transform in 1-D of 4 adjacent columns.  */
+/* </summary>                                                  */
+OPJ_TARGET_SSE2 static void dwt_decode_v4_sse2(dwt_t* restrict v, int* restrict a, int x) {
+	int* restrict mem = v->mem;
+	int* restrict low = a;
+	int* restrict high = a + v->sn * x;
+	int sn = v->sn;
+	int dn = v->dn;
+	int i, k;
+	const __m128i two = _mm_set1_epi32(2);
+#define LOW(i) _mm_loadu_si128((const __m128i*) &low[(i) * x])
+#define HIGH(i) _mm_loadu_si128((const __m128i*) &high[(i) * x])
+#define OUT(i) _mm_loadu_si128((const __m128i*) &mem[(i) * 4])
+#define SET_OUT(i, val) _mm_storeu_si128((__m128i*) &mem[(i) * 4], (val))
+
+	/* same lifting steps and rounding as dwt_decode_1_, with the samples taken
+	   from the low and high pass halves instead of an interleaved copy */
+	if (!v->cas) {
+		if (!((dn > 0) || (sn > 1))) {
+			return;
+		}
+		for (i = 0; i < sn; i++) {
+			__m128i d = _mm_add_epi32(HIGH(int_clamp(i - 1, 0, dn - 1)), HIGH(int_min(i, dn - 1)));
+			SET_OUT(2 * i, _mm_sub_epi32(LOW(i), _mm_srai_epi32(_mm_add_epi32(d, two), 2)));
+		}
+		for (i = 0; i < dn; i++) {
+			__m128i s = _mm_add_epi32(OUT(2 * int_min(i, sn - 1)), OUT(2 * int_min(i + 1, sn - 1)));
+			SET_OUT(2 * i + 1, _mm_add_epi32(HIGH(i), _mm_srai_epi32(s, 1)));
+		}
+	} else {
+		if (!sn && dn == 1) {
+			for (k = 0; k < 4; k++) {
+				a[k] /= 2;
+			}
+			return;
+		}
+		for (i = 0; i < sn; i++) {
+			__m128i s = _mm_add_epi32(HIGH(int_min(i, dn - 1)), HIGH(int_min(i + 1, dn - 1)));
+			SET_OUT(2 * i + 1, _mm_sub_epi32(LOW(i), _mm_srai_epi32(_mm_add_epi32(s, two), 2)));
+		}
+		for (i = 0; i < dn; i++) {
+			__m128i d = _mm_add_epi32(OUT(2 * int_min(i, sn - 1) + 1), OUT(2 * int_clamp(i - 1, 0, sn - 1) + 1));
+			SET_OUT(2 * i, _mm_add_epi32(HIGH(i), _mm_srai_epi32(d, 1)));
+		}
+	}
+
+	for (i = 0; i < sn + dn; i++) {
+		memcpy(&a[i * x], &mem[i * 4], 4 * sizeof(int));
+	}
+#undef LOW
+#undef HIGH
+#undef OUT
+#undef SET_OUT
+}
+
+#endif
+
+/* <summary>                                                   */
+/* Forward 5-3 wavelet transform in 1-D of 4 adjacent columns.  */
+/* </summary>                                                  */
+static void dwt_encode_v4_c(int* restrict mem, int* restrict a, int x, int dn, int sn, int cas) {
+	int i, k;
+#define S4(i) (&mem[(2 * (i)) * 4])
+#define D4(i) (&mem[(1 + 2 * (i)) * 4])
+
+	for (i = 0; i < sn + dn; i++) {
+		memcpy(&mem[i * 4], &a[i * x], 4 * sizeof(int));
+	}
+
+	/* same lifting steps and rounding as dwt_encode_1 */
+	if (!cas) {
+		if ((dn > 0) || (sn > 1)) {
+			for (i = 0; i < dn; i++) {
+				int* s0 = S4(int_min(i, sn - 1));
+				int* s1 = S4(int_min(i + 1, sn - 1));
+				for (k = 0; k < 4; k++) {
+					D4(i)[k] -= (s0[k] + s1[k]) >> 1;
+				}
+			}
+			for (i = 0; i < sn; i++) {
+				int* d0 = D4(int_clamp(i - 1, 0, dn - 1));
+				int* d1 = D4(int_min(i, dn - 1));
+				for (k = 0; k < 4; k++) {
+					S4(i)[k] += (d0[k] + d1[k] + 2) >> 2;
+				}
+			}
+		}
+	} else {
+		if (!sn && dn == 1) {
+			for (k = 0; k < 4; k++) {
+				S4(0)[k] *= 2;
+			}
+		} else {
+			for (i = 0; i < dn; i++) {
+				int* d0 = D4(int_min(i, sn - 1));
+				int* d1 = D4(int_clamp(i - 1, 0, sn - 1));
+				for (k = 0; k < 4; k++) {
+					S4(i)[k] -= (d0[k] + d1[k]) >> 1;
+				}
+			}
+			for (i = 0; i < sn; i++) {
+				int* s0 = S4(int_min(i, dn - 1));
+				int* s1 = S4(int_min(i + 1, dn - 1));
+				for (k = 0; k < 4; k++) {
+					D4(i)[k] += (s0[k] + s1[k] + 2) >> 2;
+				}
+			}
+		}
+	}
+
+	for (i = 0; i < sn; i++) {
+		memcpy(&a[i * x], &mem[(2 * i + cas) * 4], 4 * sizeof(int));
+	}
+	for (i = 0; i < dn; i++) {
+		memcpy(&a[(sn + i) * x], &mem[(2 * i + 1 - cas) * 4], 4 * sizeof(int));
+	}
+#undef S4
+#undef D4
+}
+
+#ifdef OPJ_KERNELS_SSE2
+
+/* <summary>                                                   */
+/* Forward 5-3 wavelet transform in 1-D of 4 adjacent columns.  */
+/* </summary>                                                  */
+OPJ_TARGET_SSE2 static void dwt_encode_v4_sse2(int* restrict mem, int* restrict a, int x, int dn, int sn, int cas) {
+	int i, k;
+	const __m128i two = _mm_set1_epi32(2);
+#define SV(i) _mm_loadu_si128((const __m128i*) &mem[(2 * (i)) * 4])
+#define DV(i) _mm_loadu_si128((const __m128i*) &mem[(1 + 2 * (i)) * 4])
+#define SET_S(i, val) _mm_storeu_si128((__m128i*) &mem[(2 * (i)) * 4], (val))
+#define SET_D(i, val) _mm_storeu_si128((__m128i*) &mem[(1 + 2 * (i)) * 4], (val))
+#define S4(i) (&mem[(2 * (i)) * 4])
+#define D4(i) (&mem[(1 + 2 * (i)) * 4])
+
+	for (i = 0; i < sn + dn; i++) {
+		memcpy(&mem[i * 4], &a[i * x], 4 * sizeof(int));
+	}
+
+	/* same lifting steps and rounding as dwt_encode_1 */
+	if (!cas) {
+		if ((dn > 0) || (sn > 1)) {
+			for (i = 0; i < dn; i++) {
+				__m128i s = _mm_add_epi32(SV(int_min(i, sn - 1)), SV(int_min(i + 1, sn - 1)));
+				SET_D(i, _mm_sub_epi32(DV(i), _mm_srai_epi32(s, 1)));
+			}
+			for (i = 0; i < sn; i++) {
+				__m128i d = _mm_add_epi32(DV(int_clamp(i - 1, 0, dn - 1)), DV(int_min(i, dn - 1)));
+				SET_S(i, _mm_add_epi32(SV(i), _mm_srai_epi32(_mm_add_epi32(d, two), 2)));
+			}
+		}
+	} else {
+		if (!sn && dn == 1) {
+			for (k = 0; k < 4; k++) {
+				S4(0)[k] *= 2;
+			}
+		} else {
+			for (i = 0; i < dn; i++) {
+				__m128i d = _mm_add_epi32(DV(int_min(i, sn - 1)), DV(int_clamp(i - 1, 0, sn - 1)));
+				SET_S(i, _mm_sub_epi32(SV(i), _mm_srai_epi32(d, 1)));
+			}
+			for (i = 0; i < sn; i++) {
+				__m128i s = _mm_add_epi32(SV(int_min(i, dn - 1)), SV(int_min(i + 1, dn - 1)));
+				SET_D(i, _mm_add_epi32(DV(i), _mm_srai_epi32(_mm_add_epi32(s, two), 2)));
+			}
+		}
+	}
+
+	for (i = 0; i < sn; i++) {
+		memcpy(&a[i * x], &mem[(2 * i + cas) * 4], 4 * sizeof(int));
+	}
+	for (i = 0; i < dn; i++) {
+		memcpy(&a[(sn + i) * x], &mem[(2 * i + 1 - cas) * 4], 4 * sizeof(int));
+	}
+#undef SV
+#undef DV
+#undef SET_S
+#undef SET_D
+#undef S4
+#undef D4
+}
+
+#endif
+
 /* <summary>                             */
 /* Determine maximum computed resolution level for inverse wavelet transform */
 /* </summary>                            */
@@ -512,57 +977,97 @@ static int dwt_decode_max_resolution(opj_tcd_resolution_t* restrict r, int i) {
 	return mr ;
 }
 
+static void* dwt_scratch_mem(opj_tcd_scratch_t *scratch, int slot, int size) {
+	if (scratch->dwt_mem_size[slot] < size) {
+		opj_aligned_free(scratch->dwt_mem[slot]);
+		scratch->dwt_mem[slot] = opj_aligned_malloc(size);
+		scratch->dwt_mem_size[slot] = scratch->dwt_mem[slot] ? size : 0;
+	}
+	return scratch->dwt_mem[slot];
+}
 
 /* <summary>                            */
 /* Inverse wavelet transform in 2-D.     */
 /* </summary>                           */
-static void dwt_decode_tile(opj_tcd_tilecomp_t* tilec, int numres, DWT1DFN dwt_1D) {
-	dwt_t h;
-	dwt_t v;
+static void dwt_decode_tile(opj_tcd_tilecomp_t* tilec, int numres, DWT1DFN dwt_1D, int num_threads, opj_tcd_scratch_t *scratch) {
+	dwt_decode_job_t job;
+	int maxres, nslots, slot;
 
 	opj_tcd_resolution_t* tr = tilec->resolutions;
 
-	int rw = tr->x1 - tr->x0;	/* width of the resolution level computed */
-	int rh = tr->y1 - tr->y0;	/* height of the resolution level computed */
+	job.rw = tr->x1 - tr->x0;	/* width of the resolution level computed */
+	job.rh = tr->y1 - tr->y0;	/* height of the resolution level computed */
 
-	int w = tilec->x1 - tilec->x0;
+	job.w = tilec->x1 - tilec->x0;
+	job.tiledp = tilec->data;
+	job.dwt_1D = dwt_1D;
+	job.kernels = dwt_get_kernels();
 
-	h.mem = (int*)opj_aligned_malloc(dwt_decode_max_resolution(tr, numres) * sizeof(int));
-	v.mem = h.mem;
+	/* a job never has more slots than strips of the largest resolution */
+	maxres = dwt_decode_max_resolution(tr, numres);
+	nslots = opj_parallel_slots((maxres + DWT_STRIP - 1) / DWT_STRIP, num_threads);
+	for (slot = 0; slot < nslots; ++slot) {
+		/* room for the 4 columns of decode_v4 */
+		job.mem[slot] = (int*)dwt_scratch_mem(scratch, slot, maxres * 4 * sizeof(int));
+	}
 
 	while( --numres) {
-		int * restrict tiledp = tilec->data;
-		int j;
-
 		++tr;
-		h.sn = rw;
-		v.sn = rh;
+		job.h.sn = job.rw;
+		job.v.sn = job.rh;
 
-		rw = tr->x1 - tr->x0;
-		rh = tr->y1 - tr->y0;
+		job.rw = tr->x1 - tr->x0;
+		job.rh = tr->y1 - tr->y0;
 
-		h.dn = rw - h.sn;
-		h.cas = tr->x0 % 2;
+		job.h.dn = job.rw - job.h.sn;
+		job.h.cas = tr->x0 % 2;
 
-		for(j = 0; j < rh; ++j) {
-			dwt_interleave_h(&h, &tiledp[j*w]);
-			(dwt_1D)(&h);
-			memcpy(&tiledp[j*w], h.mem, rw * sizeof(int));
-		}
+		opj_parallel_for((job.rh + DWT_STRIP - 1) / DWT_STRIP, num_threads, dwt_decode_h_job, &job);
 
-		v.dn = rh - v.sn;
-		v.cas = tr->y0 % 2;
+		job.v.dn = job.rh - job.v.sn;
+		job.v.cas = tr->y0 % 2;
 
-		for(j = 0; j < rw; ++j){
-			int k;
-			dwt_interleave_v(&v, &tiledp[j], w);
-			(dwt_1D)(&v);
-			for(k = 0; k < rh; ++k) {
-				tiledp[k * w + j] = v.mem[k];
-			}
+		opj_parallel_for((job.rw + DWT_STRIP - 1) / DWT_STRIP, num_threads, dwt_decode_v_job, &job);
+	}
+}
+
+static void dwt_decode_h_job(void *user_data, int index, int slot) {
+	dwt_decode_job_t* job = (dwt_decode_job_t*) user_data;
+	int * restrict tiledp = job->tiledp;
+	int w = job->w;
+	int end = int_min(job->rh, (index + 1) * DWT_STRIP);
+	dwt_t h = job->h;
+	int j;
+
+	h.mem = job->mem[slot];
+	for(j = index * DWT_STRIP; j < end; ++j) {
+		dwt_interleave_h(&h, &tiledp[j*w]);
+		(job->dwt_1D)(&h);
+		memcpy(&tiledp[j*w], h.mem, job->rw * sizeof(int));
+	}
+}
+
+static void dwt_decode_v_job(void *user_data, int index, int slot) {
+	dwt_decode_job_t* job = (dwt_decode_job_t*) user_data;
+	int * restrict tiledp = job->tiledp;
+	int w = job->w;
+	int end = int_min(job->rw, (index + 1) * DWT_STRIP);
+	dwt_t v = job->v;
+	int j;
+
+	v.mem = job->mem[slot];
+	/* whole groups of 4 columns go through the multi-column transform */
+	for(j = index * DWT_STRIP; j + 4 <= end; j += 4){
+		job->kernels->decode_v4(&v, &tiledp[j], w);
+	}
+	for(; j < end; ++j){
+		int k;
+		dwt_interleave_v(&v, &tiledp[j], w);
+		(job->dwt_1D)(&v);
+		for(k = 0; k < job->rh; ++k) {
+			tiledp[k * w + j] = v.mem[k];
 		}
 	}
-	opj_aligned_free(h.mem);
 }
 
 static void v4dwt_interleave_h(v4dwt_t* restrict w, float* restrict a, int x, int size){
@@ -618,69 +1123,18 @@ static void v4dwt_interleave_v(v4dwt_t* restrict v , float* restrict a , int x){
 	}
 }
 
-#ifdef __SSE__
-
-static void v4dwt_decode_step1_sse(v4* w, int count, const __m128 c){
-	__m128* restrict vw = (__m128*) w;
+static void v4dwt_decode_step1(v4* w, int count, const float c){
+	float* restrict fw = (float*) w;
 	int i;
-	/* 4x unrolled loop */
-	for(i = 0; i < count >> 2; ++i){
-		*vw = _mm_mul_ps(*vw, c);
-		vw += 2;
-		*vw = _mm_mul_ps(*vw, c);
-		vw += 2;
-		*vw = _mm_mul_ps(*vw, c);
-		vw += 2;
-		*vw = _mm_mul_ps(*vw, c);
-		vw += 2;
-	}
-	count &= 3;
 	for(i = 0; i < count; ++i){
-		*vw = _mm_mul_ps(*vw, c);
-		vw += 2;
-	}
-}
-
-static void v4dwt_decode_step2_sse(v4* l, v4* w, int k, int m, __m128 c){
-	__m128* restrict vl = (__m128*) l;
-	__m128* restrict vw = (__m128*) w;
-	int i;
-	__m128 tmp1, tmp2, tmp3;
-	tmp1 = vl[0];
-	for(i = 0; i < m; ++i){
-		tmp2 = vw[-1];
-		tmp3 = vw[ 0];
-		vw[-1] = _mm_add_ps(tmp2, _mm_mul_ps(_mm_add_ps(tmp1, tmp3), c));
-		tmp1 = tmp3;
-		vw += 2;
-	}
-	vl = vw - 2;
-	if(m >= k){
-		return;
-	}
-	c = _mm_add_ps(c, c);
-	c = _mm_mul_ps(c, vl[0]);
-	for(; m < k; ++m){
-		__m128 tmp = vw[-1];
-		vw[-1] = _mm_add_ps(tmp, c);
-		vw += 2;
-	}
-}
-
-#else
-
-static void v4dwt_decode_step1(v4* w, int count, const float c){
-	float* restrict fw = (float*) w;
-	int i;
-	for(i = 0; i < count; ++i){
-		float tmp1 = fw[i*8    ];
-		float tmp2 = fw[i*8 + 1];
-		float tmp3 = fw[i*8 + 2];
-		float tmp4 = fw[i*8 + 3];
-		fw[i*8    ] = tmp1 * c;
-		fw[i*8 + 1] = tmp2 * c;
-		fw[i*8 + 2] = tmp3 * c;
-		fw[i*8 + 3] = tmp4 * c;
+		float tmp1 = fw[i*8    ];
+		float tmp2 = fw[i*8 + 1];
+		float tmp3 = fw[i*8 + 2];
+		float tmp4 = fw[i*8 + 3];
+		fw[i*8    ] = tmp1 * c;
+		fw[i*8 + 1] = tmp2 * c;
+		fw[i*8 + 2] = tmp3 * c;
+		fw[i*8 + 3] = tmp4 * c;
 	}
 }
 
@@ -732,12 +1186,61 @@ static void v4dwt_decode_step2(v4* l, v4* w, int k, int m, float c){
 	}
 }
 
+#ifdef OPJ_KERNELS_SSE2
+
+OPJ_TARGET_SSE2 static void v4dwt_decode_step1_sse(v4* w, int count, const __m128 c){
+	__m128* restrict vw = (__m128*) w;
+	int i;
+	/* 4x unrolled loop */
+	for(i = 0; i < count >> 2; ++i){
+		*vw = _mm_mul_ps(*vw, c);
+		vw += 2;
+		*vw = _mm_mul_ps(*vw, c);
+		vw += 2;
+		*vw = _mm_mul_ps(*vw, c);
+		vw += 2;
+		*vw = _mm_mul_ps(*vw, c);
+		vw += 2;
+	}
+	count &= 3;
+	for(i = 0; i < count; ++i){
+		*vw = _mm_mul_ps(*vw, c);
+		vw += 2;
+	}
+}
+
+OPJ_TARGET_SSE2 static void v4dwt_decode_step2_sse(v4* l, v4* w, int k, int m, __m128 c){
+	__m128* restrict vl = (__m128*) l;
+	__m128* restrict vw = (__m128*) w;
+	int i;
+	__m128 tmp1, tmp2, tmp3;
+	tmp1 = vl[0];
+	for(i = 0; i < m; ++i){
+		tmp2 = vw[-1];
+		tmp3 = vw[ 0];
+		vw[-1] = _mm_add_ps(tmp2, _mm_mul_ps(_mm_add_ps(tmp1, tmp3), c));
+		tmp1 = tmp3;
+		vw += 2;
+	}
+	vl = vw - 2;
+	if(m >= k){
+		return;
+	}
+	c = _mm_add_ps(c, c);
+	c = _mm_mul_ps(c, vl[0]);
+	for(; m < k; ++m){
+		__m128 tmp = vw[-1];
+		vw[-1] = _mm_add_ps(tmp, c);
+		vw += 2;
+	}
+}
+
 #endif
 
 /* <summary>                             */
 /* Inverse 9-7 wavelet transform in 1-D. */
 /* </summary>                            */
-static void v4dwt_decode(v4dwt_t* restrict dwt){
+static void v4dwt_decode_c(v4dwt_t* restrict dwt){
 	int a, b;
 	if(dwt->cas == 0) {
 		if(!((dwt->dn > 0) || (dwt->sn > 1))){
@@ -752,107 +1255,583 @@ static void v4dwt_decode(v4dwt_t* restrict dwt){
 		a = 1;
 		b = 0;
 	}
-#ifdef __SSE__
-	v4dwt_decode_step1_sse(dwt->wavelet+a, dwt->sn, _mm_set1_ps(K));
-	v4dwt_decode_step1_sse(dwt->wavelet+b, dwt->dn, _mm_set1_ps(c13318));
-	v4dwt_decode_step2_sse(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), _mm_set1_ps(dwt_delta));
-	v4dwt_decode_step2_sse(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, int_min(dwt->dn, dwt->sn-b), _mm_set1_ps(dwt_gamma));
-	v4dwt_decode_step2_sse(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), _mm_set1_ps(dwt_beta));
-	v4dwt_decode_step2_sse(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, int_min(dwt->dn, dwt->sn-b), _mm_set1_ps(dwt_alpha));
-#else
 	v4dwt_decode_step1(dwt->wavelet+a, dwt->sn, K);
 	v4dwt_decode_step1(dwt->wavelet+b, dwt->dn, c13318);
 	v4dwt_decode_step2(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), dwt_delta);
 	v4dwt_decode_step2(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, int_min(dwt->dn, dwt->sn-b), dwt_gamma);
 	v4dwt_decode_step2(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), dwt_beta);
 	v4dwt_decode_step2(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, int_min(dwt->dn, dwt->sn-b), dwt_alpha);
+}
+
+#ifdef OPJ_KERNELS_SSE2
+
+/* <summary>                             */
+/* Inverse 9-7 wavelet transform in 1-D. */
+/* </summary>                            */
+OPJ_TARGET_SSE2 static void v4dwt_decode_sse(v4dwt_t* restrict dwt){
+	int a, b;
+	if(dwt->cas == 0) {
+		if(!((dwt->dn > 0) || (dwt->sn > 1))){
+			return;
+		}
+		a = 0;
+		b = 1;
+	}else{
+		if(!((dwt->sn > 0) || (dwt->dn > 1))) {
+			return;
+		}
+		a = 1;
+		b = 0;
+	}
+	v4dwt_decode_step1_sse(dwt->wavelet+a, dwt->sn, _mm_set1_ps(K));
+	v4dwt_decode_step1_sse(dwt->wavelet+b, dwt->dn, _mm_set1_ps(c13318));
+	v4dwt_decode_step2_sse(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), _mm_set1_ps(dwt_delta));
+	v4dwt_decode_step2_sse(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, int_min(dwt->dn, dwt->sn-b), _mm_set1_ps(dwt_gamma));
+	v4dwt_decode_step2_sse(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), _mm_set1_ps(dwt_beta));
+	v4dwt_decode_step2_sse(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, int_min(dwt->dn, dwt->sn-b), _mm_set1_ps(dwt_alpha));
+}
+
 #endif
+
+/* <summary>                             */
+/* Forward 9-7 wavelet transform in 1-D. */
+/* </summary>                            */
+static void v4dwt_encode_c(v4dwt_t* restrict dwt){
+	int a, b;
+	if(dwt->cas == 0) {
+		if(!((dwt->dn > 0) || (dwt->sn > 1))){
+			return;
+		}
+		a = 0;
+		b = 1;
+	}else{
+		if(!((dwt->sn > 0) || (dwt->dn > 1))) {
+			return;
+		}
+		a = 1;
+		b = 0;
+	}
+	/* the lifting steps of v4dwt_decode in reverse order, then the inverse scaling */
+	v4dwt_decode_step2(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, int_min(dwt->dn, dwt->sn-b), -dwt_alpha);
+	v4dwt_decode_step2(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), -dwt_beta);
+	v4dwt_decode_step2(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, int_min(dwt->dn, dwt->sn-b), -dwt_gamma);
+	v4dwt_decode_step2(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), -dwt_delta);
+	v4dwt_decode_step1(dwt->wavelet+a, dwt->sn, 1.0f / K);
+	v4dwt_decode_step1(dwt->wavelet+b, dwt->dn, 1.0f / c13318);
 }
 
+#ifdef OPJ_KERNELS_SSE2
+
 /* <summary>                             */
-/* Inverse 9-7 wavelet transform in 2-D. */
+/* Forward 9-7 wavelet transform in 1-D. */
 /* </summary>                            */
-void dwt_decode_real(opj_tcd_tilecomp_t* restrict tilec, int numres){
-	v4dwt_t h;
-	v4dwt_t v;
+OPJ_TARGET_SSE2 static void v4dwt_encode_sse(v4dwt_t* restrict dwt){
+	int a, b;
+	if(dwt->cas == 0) {
+		if(!((dwt->dn > 0) || (dwt->sn > 1))){
+			return;
+		}
+		a = 0;
+		b = 1;
+	}else{
+		if(!((dwt->sn > 0) || (dwt->dn > 1))) {
+			return;
+		}
+		a = 1;
+		b = 0;
+	}
+	/* the lifting steps of v4dwt_decode in reverse order, then the inverse scaling */
+	v4dwt_decode_step2_sse(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, int_min(dwt->dn, dwt->sn-b), _mm_set1_ps(-dwt_alpha));
+	v4dwt_decode_step2_sse(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), _mm_set1_ps(-dwt_beta));
+	v4dwt_decode_step2_sse(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, int_min(dwt->dn, dwt->sn-b), _mm_set1_ps(-dwt_gamma));
+	v4dwt_decode_step2_sse(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), _mm_set1_ps(-dwt_delta));
+	v4dwt_decode_step1_sse(dwt->wavelet+a, dwt->sn, _mm_set1_ps(1.0f / K));
+	v4dwt_decode_step1_sse(dwt->wavelet+b, dwt->dn, _mm_set1_ps(1.0f / c13318));
+}
 
-	opj_tcd_resolution_t* res = tilec->resolutions;
+#endif
+
+#ifdef OPJ_KERNELS_AVX2
+
+OPJ_TARGET_AVX2 static void v8dwt_interleave_h(v8dwt_t* restrict w, float* restrict a, int x, int rows){
+	float* restrict bi = (float*) (w->wavelet + w->cas);
+	int count = w->sn;
+	int i, k, l;
+	for(k = 0; k < 2; ++k){
+		if (rows == 8) {
+			/* Fast code path */
+			for(i = 0; i < count; ++i){
+				for(l = 0; l < 8; ++l){
+					bi[i*16 + l] = a[i + l*x];
+				}
+			}
+		} else {
+			/* Slow code path, the lanes past the last row are cleared */
+			for(i = 0; i < count; ++i){
+				for(l = 0; l < rows; ++l){
+					bi[i*16 + l] = a[i + l*x];
+				}
+				for(; l < 8; ++l){
+					bi[i*16 + l] = 0;
+				}
+			}
+		}
+		bi = (float*) (w->wavelet + 1 - w->cas);
+		a += w->sn;
+		count = w->dn;
+	}
+}
 
-	int rw = res->x1 - res->x0;	/* width of the resolution level computed */
-	int rh = res->y1 - res->y0;	/* height of the resolution level computed */
+OPJ_TARGET_AVX2 static void v8dwt_interleave_v(v8dwt_t* restrict v , float* restrict a , int x, int cols){
+	v8* restrict bi = v->wavelet + v->cas;
+	int i;
+	for(i = 0; i < v->sn; ++i){
+		memcpy(&bi[i*2], &a[i*x], cols * sizeof(float));
+	}
+	a += v->sn * x;
+	bi = v->wavelet + 1 - v->cas;
+	for(i = 0; i < v->dn; ++i){
+		memcpy(&bi[i*2], &a[i*x], cols * sizeof(float));
+	}
+}
 
-	int w = tilec->x1 - tilec->x0;
+OPJ_TARGET_AVX2 static void v8dwt_decode_step1_avx(v8* w, int count, const __m256 c){
+	float* restrict fw = (float*) w;
+	int i;
+	for(i = 0; i < count; ++i){
+		_mm256_storeu_ps(fw + i*16, _mm256_mul_ps(_mm256_loadu_ps(fw + i*16), c));
+	}
+}
 
-	h.wavelet = (v4*) opj_aligned_malloc((dwt_decode_max_resolution(res, numres)+5) * sizeof(v4));
-	v.wavelet = h.wavelet;
+OPJ_TARGET_AVX2 static void v8dwt_decode_step2_avx(v8* l, v8* w, int k, int m, __m256 c){
+	float* restrict fl = (float*) l;
+	float* restrict fw = (float*) w;
+	int i;
+	__m256 tmp1, tmp2, tmp3;
+	tmp1 = _mm256_loadu_ps(fl);
+	for(i = 0; i < m; ++i){
+		tmp2 = _mm256_loadu_ps(fw - 8);
+		tmp3 = _mm256_loadu_ps(fw);
+		_mm256_storeu_ps(fw - 8, _mm256_add_ps(tmp2, _mm256_mul_ps(_mm256_add_ps(tmp1, tmp3), c)));
+		tmp1 = tmp3;
+		fw += 16;
+	}
+	if(m >= k){
+		return;
+	}
+	/* tmp1 holds the last sample read, or l when the loop did not run */
+	c = _mm256_add_ps(c, c);
+	c = _mm256_mul_ps(c, tmp1);
+	for(; m < k; ++m){
+		tmp2 = _mm256_loadu_ps(fw - 8);
+		_mm256_storeu_ps(fw - 8, _mm256_add_ps(tmp2, c));
+		fw += 16;
+	}
+}
 
-	while( --numres) {
-		float * restrict aj = (float*) tilec->data;
-		int bufsize = (tilec->x1 - tilec->x0) * (tilec->y1 - tilec->y0);
-		int j;
+/* <summary>                             */
+/* Inverse 9-7 wavelet transform in 1-D. */
+/* </summary>                            */
+OPJ_TARGET_AVX2 static void v8dwt_decode(v8dwt_t* restrict dwt){
+	int a, b;
+	if(dwt->cas == 0) {
+		if(!((dwt->dn > 0) || (dwt->sn > 1))){
+			return;
+		}
+		a = 0;
+		b = 1;
+	}else{
+		if(!((dwt->sn > 0) || (dwt->dn > 1))) {
+			return;
+		}
+		a = 1;
+		b = 0;
+	}
+	v8dwt_decode_step1_avx(dwt->wavelet+a, dwt->sn, _mm256_set1_ps(K));
+	v8dwt_decode_step1_avx(dwt->wavelet+b, dwt->dn, _mm256_set1_ps(c13318));
+	v8dwt_decode_step2_avx(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), _mm256_set1_ps(dwt_delta));
+	v8dwt_decode_step2_avx(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, int_min(dwt->dn, dwt->sn-b), _mm256_set1_ps(dwt_gamma));
+	v8dwt_decode_step2_avx(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), _mm256_set1_ps(dwt_beta));
+	v8dwt_decode_step2_avx(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, int_min(dwt->dn, dwt->sn-b), _mm256_set1_ps(dwt_alpha));
+}
 
-		h.sn = rw;
-		v.sn = rh;
+OPJ_TARGET_AVX2 static void v8dwt_decode_h_job(void *user_data, int index, int slot) {
+	v4dwt_decode_job_t* job = (v4dwt_decode_job_t*) user_data;
+	int w = job->w;
+	int rw = job->rw;
+	int first = index * DWT_STRIP;
+	int end = int_min(job->rh, first + DWT_STRIP);
+	float * restrict aj = job->aj + first * w;
+	v8dwt_t h;
+	int j;
+
+	h.wavelet = (v8*) job->wavelet[slot];
+	h.dn = job->h.dn;
+	h.sn = job->h.sn;
+	h.cas = job->h.cas;
+	for(j = first; j < end; j += 8){
+		int rows = int_min(8, end - j);
+		int k, l;
+		v8dwt_interleave_h(&h, aj, w, rows);
+		v8dwt_decode(&h);
+		for(k = rw; --k >= 0;){
+			for(l = 0; l < rows; ++l){
+				aj[k + w*l] = h.wavelet[k].f[l];
+			}
+		}
+		aj += w*8;
+	}
+}
 
-		++res;
+OPJ_TARGET_AVX2 static void v8dwt_decode_v_job(void *user_data, int index, int slot) {
+	v4dwt_decode_job_t* job = (v4dwt_decode_job_t*) user_data;
+	int w = job->w;
+	int rh = job->rh;
+	int first = index * DWT_STRIP;
+	int end = int_min(job->rw, first + DWT_STRIP);
+	float * restrict aj = job->aj + first;
+	v8dwt_t v;
+	int j;
+
+	v.wavelet = (v8*) job->wavelet[slot];
+	v.dn = job->v.dn;
+	v.sn = job->v.sn;
+	v.cas = job->v.cas;
+	for(j = first; j < end; j += 8){
+		int cols = int_min(8, end - j);
+		int k;
+		v8dwt_interleave_v(&v, aj, w, cols);
+		v8dwt_decode(&v);
+		for(k = 0; k < rh; ++k){
+			memcpy(&aj[k*w], &v.wavelet[k], cols * sizeof(float));
+		}
+		aj += 8;
+	}
+}
 
-		rw = res->x1 - res->x0;	/* width of the resolution level computed */
-		rh = res->y1 - res->y0;	/* height of the resolution level computed */
+#endif /* OPJ_KERNELS_AVX2 */
 
-		h.dn = rw - h.sn;
-		h.cas = res->x0 % 2;
+#ifdef OPJ_KERNELS_AVX512
 
-		for(j = rh; j > 3; j -= 4){
-			int k;
-			v4dwt_interleave_h(&h, aj, w, bufsize);
-			v4dwt_decode(&h);
-				for(k = rw; --k >= 0;){
-					aj[k    ] = h.wavelet[k].f[0];
-					aj[k+w  ] = h.wavelet[k].f[1];
-					aj[k+w*2] = h.wavelet[k].f[2];
-					aj[k+w*3] = h.wavelet[k].f[3];
+OPJ_TARGET_AVX512 static void v16dwt_interleave_h(v16dwt_t* restrict w, float* restrict a, int x, int rows){
+	float* restrict bi = (float*) (w->wavelet + w->cas);
+	int count = w->sn;
+	int i, k, l;
+	for(k = 0; k < 2; ++k){
+		if (rows == 16) {
+			/* Fast code path */
+			for(i = 0; i < count; ++i){
+				for(l = 0; l < 16; ++l){
+					bi[i*32 + l] = a[i + l*x];
+				}
+			}
+		} else {
+			/* Slow code path, the lanes past the last row are cleared */
+			for(i = 0; i < count; ++i){
+				for(l = 0; l < rows; ++l){
+					bi[i*32 + l] = a[i + l*x];
 				}
-			aj += w*4;
-			bufsize -= w*4;
-		}
-		if (rh & 0x03) {
-				int k;
-			j = rh & 0x03;
-			v4dwt_interleave_h(&h, aj, w, bufsize);
-			v4dwt_decode(&h);
-				for(k = rw; --k >= 0;){
-					switch(j) {
-						case 3: aj[k+w*2] = h.wavelet[k].f[2];
-						case 2: aj[k+w  ] = h.wavelet[k].f[1];
-						case 1: aj[k    ] = h.wavelet[k].f[0];
-					}
+				for(; l < 16; ++l){
+					bi[i*32 + l] = 0;
 				}
 			}
+		}
+		bi = (float*) (w->wavelet + 1 - w->cas);
+		a += w->sn;
+		count = w->dn;
+	}
+}
+
+OPJ_TARGET_AVX512 static void v16dwt_interleave_v(v16dwt_t* restrict v , float* restrict a , int x, int cols){
+	v16* restrict bi = v->wavelet + v->cas;
+	int i;
+	for(i = 0; i < v->sn; ++i){
+		memcpy(&bi[i*2], &a[i*x], cols * sizeof(float));
+	}
+	a += v->sn * x;
+	bi = v->wavelet + 1 - v->cas;
+	for(i = 0; i < v->dn; ++i){
+		memcpy(&bi[i*2], &a[i*x], cols * sizeof(float));
+	}
+}
+
+OPJ_TARGET_AVX512 static void v16dwt_decode_step1_avx512(v16* w, int count, const __m512 c){
+	float* restrict fw = (float*) w;
+	int i;
+	for(i = 0; i < count; ++i){
+		_mm512_storeu_ps(fw + i*32, _mm512_mul_ps(_mm512_loadu_ps(fw + i*32), c));
+	}
+}
+
+OPJ_TARGET_AVX512 static void v16dwt_decode_step2_avx512(v16* l, v16* w, int k, int m, __m512 c){
+	float* restrict fl = (float*) l;
+	float* restrict fw = (float*) w;
+	int i;
+	__m512 tmp1, tmp2, tmp3;
+	tmp1 = _mm512_loadu_ps(fl);
+	for(i = 0; i < m; ++i){
+		tmp2 = _mm512_loadu_ps(fw - 16);
+		tmp3 = _mm512_loadu_ps(fw);
+		_mm512_storeu_ps(fw - 16, _mm512_add_ps(tmp2, _mm512_mul_ps(_mm512_add_ps(tmp1, tmp3), c)));
+		tmp1 = tmp3;
+		fw += 32;
+	}
+	if(m >= k){
+		return;
+	}
+	/* tmp1 holds the last sample read, or l when the loop did not run */
+	c = _mm512_add_ps(c, c);
+	c = _mm512_mul_ps(c, tmp1);
+	for(; m < k; ++m){
+		tmp2 = _mm512_loadu_ps(fw - 16);
+		_mm512_storeu_ps(fw - 16, _mm512_add_ps(tmp2, c));
+		fw += 32;
+	}
+}
+
+/* <summary>                             */
+/* Inverse 9-7 wavelet transform in 1-D. */
+/* </summary>                            */
+OPJ_TARGET_AVX512 static void v16dwt_decode(v16dwt_t* restrict dwt){
+	int a, b;
+	if(dwt->cas == 0) {
+		if(!((dwt->dn > 0) || (dwt->sn > 1))){
+			return;
+		}
+		a = 0;
+		b = 1;
+	}else{
+		if(!((dwt->sn > 0) || (dwt->dn > 1))) {
+			return;
+		}
+		a = 1;
+		b = 0;
+	}
+	v16dwt_decode_step1_avx512(dwt->wavelet+a, dwt->sn, _mm512_set1_ps(K));
+	v16dwt_decode_step1_avx512(dwt->wavelet+b, dwt->dn, _mm512_set1_ps(c13318));
+	v16dwt_decode_step2_avx512(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), _mm512_set1_ps(dwt_delta));
+	v16dwt_decode_step2_avx512(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, int_min(dwt->dn, dwt->sn-b), _mm512_set1_ps(dwt_gamma));
+	v16dwt_decode_step2_avx512(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, int_min(dwt->sn, dwt->dn-a), _mm512_set1_ps(dwt_beta));
+	v16dwt_decode_step2_avx512(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, int_min(dwt->dn, dwt->sn-b), _mm512_set1_ps(dwt_alpha));
+}
+
+OPJ_TARGET_AVX512 static void v16dwt_decode_h_job(void *user_data, int index, int slot) {
+	v4dwt_decode_job_t* job = (v4dwt_decode_job_t*) user_data;
+	int w = job->w;
+	int rw = job->rw;
+	int first = index * DWT_STRIP;
+	int end = int_min(job->rh, first + DWT_STRIP);
+	float * restrict aj = job->aj + first * w;
+	v16dwt_t h;
+	int j;
+
+	h.wavelet = (v16*) job->wavelet[slot];
+	h.dn = job->h.dn;
+	h.sn = job->h.sn;
+	h.cas = job->h.cas;
+	for(j = first; j < end; j += 16){
+		int rows = int_min(16, end - j);
+		int k, l;
+		v16dwt_interleave_h(&h, aj, w, rows);
+		v16dwt_decode(&h);
+		for(k = rw; --k >= 0;){
+			for(l = 0; l < rows; ++l){
+				aj[k + w*l] = h.wavelet[k].f[l];
+			}
+		}
+		aj += w*16;
+	}
+}
+
+OPJ_TARGET_AVX512 static void v16dwt_decode_v_job(void *user_data, int index, int slot) {
+	v4dwt_decode_job_t* job = (v4dwt_decode_job_t*) user_data;
+	int w = job->w;
+	int rh = job->rh;
+	int first = index * DWT_STRIP;
+	int end = int_min(job->rw, first + DWT_STRIP);
+	float * restrict aj = job->aj + first;
+	v16dwt_t v;
+	int j;
+
+	v.wavelet = (v16*) job->wavelet[slot];
+	v.dn = job->v.dn;
+	v.sn = job->v.sn;
+	v.cas = job->v.cas;
+	for(j = first; j < end; j += 16){
+		int cols = int_min(16, end - j);
+		int k;
+		v16dwt_interleave_v(&v, aj, w, cols);
+		v16dwt_decode(&v);
+		for(k = 0; k < rh; ++k){
+			memcpy(&aj[k*w], &v.wavelet[k], cols * sizeof(float));
+		}
+		aj += 16;
+	}
+}
+
+#endif /* OPJ_KERNELS_AVX512 */
+
+/* <summary>                             */
+/* Inverse 9-7 wavelet transform in 2-D. */
+/* </summary>                            */
+void dwt_decode_real(opj_tcd_tilecomp_t* restrict tilec, int numres, int num_threads, opj_tcd_scratch_t *scratch){
+	v4dwt_decode_job_t job;
+	int maxres, nslots, slot;
+	const dwt_kernels_t* kernels = dwt_get_kernels();
+
+	opj_tcd_resolution_t* res = tilec->resolutions;
+
+	job.rw = res->x1 - res->x0;	/* width of the resolution level computed */
+	job.rh = res->y1 - res->y0;	/* height of the resolution level computed */
+
+	job.w = tilec->x1 - tilec->x0;
+	job.size = (tilec->x1 - tilec->x0) * (tilec->y1 - tilec->y0);
+	job.aj = (float*) tilec->data;
+	job.kernels = kernels;
+
+	/* a job never has more slots than strips of the largest resolution */
+	maxres = dwt_decode_max_resolution(res, numres);
+	nslots = opj_parallel_slots((maxres + DWT_STRIP - 1) / DWT_STRIP, num_threads);
+	for (slot = 0; slot < nslots; ++slot) {
+		job.wavelet[slot] = dwt_scratch_mem(scratch, slot, (maxres+5) * kernels->sample);
+	}
+
+	while( --numres) {
+		job.h.sn = job.rw;
+		job.v.sn = job.rh;
+
+		++res;
 
-		v.dn = rh - v.sn;
-		v.cas = res->y0 % 2;
+		job.rw = res->x1 - res->x0;	/* width of the resolution level computed */
+		job.rh = res->y1 - res->y0;	/* height of the resolution level computed */
 
-		aj = (float*) tilec->data;
-		for(j = rw; j > 3; j -= 4){
+		job.h.dn = job.rw - job.h.sn;
+		job.h.cas = res->x0 % 2;
+
+		opj_parallel_for((job.rh + DWT_STRIP - 1) / DWT_STRIP, num_threads, kernels->decode_real_h, &job);
+
+		job.v.dn = job.rh - job.v.sn;
+		job.v.cas = res->y0 % 2;
+
+		opj_parallel_for((job.rw + DWT_STRIP - 1) / DWT_STRIP, num_threads, kernels->decode_real_v, &job);
+	}
+}
+
+static void v4dwt_decode_h_job(void *user_data, int index, int slot) {
+	v4dwt_decode_job_t* job = (v4dwt_decode_job_t*) user_data;
+	int w = job->w;
+	int rw = job->rw;
+	int first = index * DWT_STRIP;
+	int rows = int_min(job->rh, first + DWT_STRIP) - first;
+	float * restrict aj = job->aj + first * w;
+	int bufsize = job->size - first * w;
+	v4dwt_t h = job->h;
+	int j;
+
+	h.wavelet = job->wavelet[slot];
+	for(j = rows; j > 3; j -= 4){
+		int k;
+		v4dwt_interleave_h(&h, aj, w, bufsize);
+		job->kernels->v4dwt_decode(&h);
+			for(k = rw; --k >= 0;){
+				aj[k    ] = h.wavelet[k].f[0];
+				aj[k+w  ] = h.wavelet[k].f[1];
+				aj[k+w*2] = h.wavelet[k].f[2];
+				aj[k+w*3] = h.wavelet[k].f[3];
+			}
+		aj += w*4;
+		bufsize -= w*4;
+	}
+	/* only the last strip has a partial group of rows */
+	if (rows & 0x03) {
 			int k;
-			v4dwt_interleave_v(&v, aj, w);
-			v4dwt_decode(&v);
-				for(k = 0; k < rh; ++k){
-					memcpy(&aj[k*w], &v.wavelet[k], 4 * sizeof(float));
-				}
-			aj += 4;
-		}
-		if (rw & 0x03){
-				int k;
-			j = rw & 0x03;
-			v4dwt_interleave_v(&v, aj, w);
-			v4dwt_decode(&v);
-				for(k = 0; k < rh; ++k){
-					memcpy(&aj[k*w], &v.wavelet[k], j * sizeof(float));
+		j = rows & 0x03;
+		v4dwt_interleave_h(&h, aj, w, bufsize);
+		job->kernels->v4dwt_decode(&h);
+			for(k = rw; --k >= 0;){
+				switch(j) {
+					case 3: aj[k+w*2] = h.wavelet[k].f[2];
+					case 2: aj[k+w  ] = h.wavelet[k].f[1];
+					case 1: aj[k    ] = h.wavelet[k].f[0];
 				}
 			}
-	}
+		}
+}
 
-	opj_aligned_free(h.wavelet);
+static void v4dwt_decode_v_job(void *user_data, int index, int slot) {
+	v4dwt_decode_job_t* job = (v4dwt_decode_job_t*) user_data;
+	int w = job->w;
+	int rh = job->rh;
+	int first = index * DWT_STRIP;
+	int cols = int_min(job->rw, first + DWT_STRIP) - first;
+	float * restrict aj = job->aj + first;
+	v4dwt_t v = job->v;
+	int j;
+
+	v.wavelet = job->wavelet[slot];
+	for(j = cols; j > 3; j -= 4){
+		int k;
+		v4dwt_interleave_v(&v, aj, w);
+		job->kernels->v4dwt_decode(&v);
+			for(k = 0; k < rh; ++k){
+				memcpy(&aj[k*w], &v.wavelet[k], 4 * sizeof(float));
+			}
+		aj += 4;
+	}
+	/* only the last strip has a partial group of columns */
+	if (cols & 0x03){
+			int k;
+		j = cols & 0x03;
+		v4dwt_interleave_v(&v, aj, w);
+		job->kernels->v4dwt_decode(&v);
+			for(k = 0; k < rh; ++k){
+				memcpy(&aj[k*w], &v.wavelet[k], j * sizeof(float));
+			}
+		}
 }
 
+static const dwt_kernels_t dwt_kernels_c = {
+	dwt_decode_v4_c, dwt_encode_v4_c, v4dwt_decode_c, v4dwt_encode_c, dwt_round_c,
+	v4dwt_decode_h_job, v4dwt_decode_v_job, sizeof(v4)
+};
+
+#ifdef OPJ_KERNELS_SSE2
+static const dwt_kernels_t dwt_kernels_sse2 = {
+	dwt_decode_v4_sse2, dwt_encode_v4_sse2, v4dwt_decode_sse, v4dwt_encode_sse, dwt_round_sse2,
+	v4dwt_decode_h_job, v4dwt_decode_v_job, sizeof(v4)
+};
+#endif
+
+/* the wider levels only have their own inverse 9-7 kernels so far */
+#ifdef OPJ_KERNELS_AVX2
+static const dwt_kernels_t dwt_kernels_avx2 = {
+	dwt_decode_v4_sse2, dwt_encode_v4_sse2, v4dwt_decode_sse, v4dwt_encode_sse, dwt_round_sse2,
+	v8dwt_decode_h_job, v8dwt_decode_v_job, sizeof(v8)
+};
+#endif
+
+#ifdef OPJ_KERNELS_AVX512
+static const dwt_kernels_t dwt_kernels_avx512 = {
+	dwt_decode_v4_sse2, dwt_encode_v4_sse2, v4dwt_decode_sse, v4dwt_encode_sse, dwt_round_sse2,
+	v16dwt_decode_h_job, v16dwt_decode_v_job, sizeof(v16)
+};
+#endif
+
+static const dwt_kernels_t* dwt_get_kernels(void) {
+	switch (opj_cpu_level()) {
+#ifdef OPJ_KERNELS_AVX512
+		case OPJ_SIMD_AVX512:
+			return &dwt_kernels_avx512;
+#endif
+#ifdef OPJ_KERNELS_AVX2
+		case OPJ_SIMD_AVX2:
+			return &dwt_kernels_avx2;
+#endif
+#ifdef OPJ_KERNELS_SSE2
+		case OPJ_SIMD_SSE2:
+			return &dwt_kernels_sse2;
+#endif
+		default:
+			return &dwt_kernels_c;
+	}
+}
@@ -31,7 +31,10 @@ opj_image_t* opj_image_create0(void) {
 	return image;
 }
 
-opj_image_t* OPJ_CALLCONV opj_image_create(int numcmpts, opj_image_cmptparm_t *cmptparms, OPJ_COLOR_SPACE clrspc) {
+/**
+Create an image and its components, with their data when alloc_data is set
+*/
+static opj_image_t* image_create(int numcmpts, opj_image_cmptparm_t *cmptparms, OPJ_COLOR_SPACE clrspc, opj_bool alloc_data) {
 	int compno;
 	opj_image_t *image = NULL;
 
@@ -58,6 +61,10 @@ opj_image_t* OPJ_CALLCONV opj_image_create(int numcmpts, opj_image_cmptparm_t *c
 			comp->prec = cmptparms[compno].prec;
 			comp->bpp = cmptparms[compno].bpp;
 			comp->sgnd = cmptparms[compno].sgnd;
+			comp->data = NULL;
+			if(!alloc_data) {
+				continue;
+			}
 			comp->data = (int*) opj_calloc(comp->w * comp->h, sizeof(int));
 			if(!comp->data) {
 				fprintf(stderr,"Unable to allocate memory for image.\n");
@@ -70,6 +77,14 @@ opj_image_t* OPJ_CALLCONV opj_image_create(int numcmpts, opj_image_cmptparm_t *c
 	return image;
 }
 
+opj_image_t* OPJ_CALLCONV opj_image_create(int numcmpts, opj_image_cmptparm_t *cmptparms, OPJ_COLOR_SPACE clrspc) {
+	return image_create(numcmpts, cmptparms, clrspc, OPJ_TRUE);
+}
+
+opj_image_t* OPJ_CALLCONV opj_image_create_header(int numcmpts, opj_image_cmptparm_t *cmptparms, OPJ_COLOR_SPACE clrspc) {
+	return image_create(numcmpts, cmptparms, clrspc, OPJ_FALSE);
+}
+
 void OPJ_CALLCONV opj_image_destroy(opj_image_t *image) {
 	int i;
 	if(image) {
@@ -198,7 +198,8 @@ Write the SOD marker (start of data)
 */
 static void j2k_write_sod(opj_j2k_t *j2k, void *tile_coder);
 /**
-Read the SOD marker (start of data)
+Read the SOD marker (start of data). The data of a tile read in one tile-part is not
+copied, it is decoded where it lies in the codestream.
 @param j2k J2K handle
 */
 static void j2k_read_sod(opj_j2k_t *j2k);
@@ -225,6 +226,20 @@ Read the EOC marker (end of codestream)
 */
 static void j2k_read_eoc(opj_j2k_t *j2k);
 /**
+Check that the (reduced) image fits in the interleaved output, whose pixels are
+written as the tiles are decoded
+@param j2k J2K handle, the components of its image are sized by tcd_malloc_decode
+@return Returns true if the output is planar or large enough
+*/
+static opj_bool j2k_check_output(opj_j2k_t *j2k);
+/**
+Free what the previous codestream left in a decompressor: its tile coding parameters
+and its tile data, all held by the arena. The decoding parameters, the tile decoder
+and the memory of the arena are kept.
+@param j2k J2K handle
+*/
+static void j2k_reset_decompress(opj_j2k_t *j2k);
+/**
 Read an unknown marker
 @param j2k J2K handle
 */
@@ -557,8 +572,9 @@ static void j2k_read_siz(opj_j2k_t *j2k) {
 	}
 #endif /* USE_JPWL */
 
-	cp->tcps = (opj_tcp_t*) opj_calloc(cp->tw * cp->th, sizeof(opj_tcp_t));
-	cp->tileno = (int*) opj_malloc(cp->tw * cp->th * sizeof(int));
+	/* everything sized by the main header lives until the next codestream, see j2k_reset_decompress */
+	cp->tcps = (opj_tcp_t*) opj_arena_calloc(&j2k->arena, cp->tw * cp->th, sizeof(opj_tcp_t));
+	cp->tileno = (int*) opj_arena_malloc(&j2k->arena, cp->tw * cp->th * sizeof(int));
 	cp->tileno_size = 0;
 	
 #ifdef USE_JPWL
@@ -587,12 +603,12 @@ static void j2k_read_siz(opj_j2k_t *j2k) {
 	cp->ppm_previous = 0;
 	cp->ppm_store = 0;
 
-	j2k->default_tcp->tccps = (opj_tccp_t*) opj_calloc(image->numcomps, sizeof(opj_tccp_t));
+	j2k->default_tcp->tccps = (opj_tccp_t*) opj_arena_calloc(&j2k->arena, image->numcomps, sizeof(opj_tccp_t));
 	for (i = 0; i < cp->tw * cp->th; i++) {
-		cp->tcps[i].tccps = (opj_tccp_t*) opj_malloc(image->numcomps * sizeof(opj_tccp_t));
+		cp->tcps[i].tccps = (opj_tccp_t*) opj_arena_malloc(&j2k->arena, image->numcomps * sizeof(opj_tccp_t));
 	}	
-	j2k->tile_data = (unsigned char**) opj_calloc(cp->tw * cp->th, sizeof(unsigned char*));
-	j2k->tile_len = (int*) opj_calloc(cp->tw * cp->th, sizeof(int));
+	j2k->tile_data = (unsigned char**) opj_arena_calloc(&j2k->arena, cp->tw * cp->th, sizeof(unsigned char*));
+	j2k->tile_len = (int*) opj_arena_calloc(&j2k->arena, cp->tw * cp->th, sizeof(int));
 	j2k->state = J2K_STATE_MH;
 
 	/* Index */
@@ -968,8 +984,6 @@ static void j2k_read_qcc(opj_j2k_t *j2k) {
 #ifdef USE_JPWL
 	if (j2k->cp->correct) {
 
-		static int backup_compno = 0;
-
 		/* compno is negative or larger than the number of components!!! */
 		if ((compno < 0) || (compno >= numcomp)) {
 			opj_event_msg(j2k->cinfo, EVT_ERROR,
@@ -980,14 +994,14 @@ static void j2k_read_qcc(opj_j2k_t *j2k) {
 				return;
 			}
 			/* we try to correct */
-			compno = backup_compno % numcomp;
+			compno = j2k->backup_compno % numcomp;
 			opj_event_msg(j2k->cinfo, EVT_WARNING, "- trying to adjust this\n"
 				"- setting component number to %d\n",
 				compno);
 		}
 
 		/* keep your private count of tiles */
-		backup_compno++;
+		j2k->backup_compno++;
 	};
 #endif /* USE_JPWL */
 
@@ -1145,11 +1159,11 @@ static void j2k_read_ppm(opj_j2k_t *j2k) {
 		}
 		j = cp->ppm_store;
 		if (Z_ppm == 0) {	/* First PPM marker */
-			cp->ppm_data = (unsigned char *) opj_malloc(N_ppm * sizeof(unsigned char));
+			cp->ppm_data = (unsigned char *) opj_arena_malloc(&j2k->arena, N_ppm * sizeof(unsigned char));
 			cp->ppm_data_first = cp->ppm_data;
 			cp->ppm_len = N_ppm;
 		} else {			/* NON-first PPM marker */
-			cp->ppm_data = (unsigned char *) opj_realloc(cp->ppm_data, (N_ppm +	cp->ppm_store) * sizeof(unsigned char));
+			cp->ppm_data = (unsigned char *) opj_arena_realloc(&j2k->arena, cp->ppm_data, cp->ppm_len, (N_ppm +	cp->ppm_store) * sizeof(unsigned char));
 
 #ifdef USE_JPWL
 			/* this memory allocation check could be done even in non-JPWL cases */
@@ -1193,12 +1207,12 @@ static void j2k_read_ppt(opj_j2k_t *j2k) {
 	Z_ppt = cio_read(cio, 1);
 	tcp->ppt = 1;
 	if (Z_ppt == 0) {		/* First PPT marker */
-		tcp->ppt_data = (unsigned char *) opj_malloc((len - 3) * sizeof(unsigned char));
+		tcp->ppt_data = (unsigned char *) opj_arena_malloc(&j2k->arena, (len - 3) * sizeof(unsigned char));
 		tcp->ppt_data_first = tcp->ppt_data;
 		tcp->ppt_store = 0;
 		tcp->ppt_len = len - 3;
 	} else {			/* NON-first PPT marker */
-		tcp->ppt_data =	(unsigned char *) opj_realloc(tcp->ppt_data, (len - 3 + tcp->ppt_store) * sizeof(unsigned char));
+		tcp->ppt_data =	(unsigned char *) opj_arena_realloc(&j2k->arena, tcp->ppt_data, tcp->ppt_len, (len - 3 + tcp->ppt_store) * sizeof(unsigned char));
 		tcp->ppt_data_first = tcp->ppt_data;
 		tcp->ppt_len = len - 3 + tcp->ppt_store;
 	}
@@ -1266,8 +1280,6 @@ static void j2k_read_sot(opj_j2k_t *j2k) {
 #ifdef USE_JPWL
 	if (j2k->cp->correct) {
 
-		static int backup_tileno = 0;
-
 		/* tileno is negative or larger than the number of tiles!!! */
 		if ((tileno < 0) || (tileno > (cp->tw * cp->th))) {
 			opj_event_msg(j2k->cinfo, EVT_ERROR,
@@ -1278,14 +1290,14 @@ static void j2k_read_sot(opj_j2k_t *j2k) {
 				return;
 			}
 			/* we try to correct */
-			tileno = backup_tileno;
+			tileno = j2k->backup_tileno;
 			opj_event_msg(j2k->cinfo, EVT_WARNING, "- trying to adjust this\n"
 				"- setting tile number to %d\n",
 				tileno);
 		}
 
 		/* keep your private count of tiles */
-		backup_tileno++;
+		j2k->backup_tileno++;
 	};
 #endif /* USE_JPWL */
 	
@@ -1456,7 +1468,7 @@ static void j2k_write_sod(opj_j2k_t *j2k, void *tile_coder) {
 }
 
 static void j2k_read_sod(opj_j2k_t *j2k) {
-	int len, truncate = 0, i;
+	int len, truncate = 0, avail;
 	unsigned char *data = NULL, *data_ptr = NULL;
 
 	opj_cio_t *cio = j2k->cio;
@@ -1478,11 +1490,27 @@ static void j2k_read_sod(opj_j2k_t *j2k) {
 	}	
 
 	data = j2k->tile_data[curtileno];
-	data = (unsigned char*) opj_realloc(data, (j2k->tile_len[curtileno] + len) * sizeof(unsigned char));
+	if (!data && !truncate && len >= 0) {
+		/* 
+		first tile-part of the tile: t2 only reads the tile data and copies every code-block 
+		out before the MQ decoder pads it, so the codestream itself can be decoded
+		*/
+		data = cio_getbp(cio);
+		cio_skip(cio, len);
+	} else {
+		/* the tile-parts are concatenated, a first one still in the codestream is copied too */
+		data = (unsigned char*) opj_arena_realloc(&j2k->arena, data, j2k->tile_len[curtileno], (j2k->tile_len[curtileno] + len) * sizeof(unsigned char));
 
-	data_ptr = data + j2k->tile_len[curtileno];
-	for (i = 0; i < len; i++) {
-		data_ptr[i] = cio_read(cio, 1);
+		data_ptr = data + j2k->tile_len[curtileno];
+		avail = len - truncate;
+		if (avail > 0) {
+			memcpy(data_ptr, cio_getbp(cio), avail);
+			cio_skip(cio, avail);
+		}
+		if (truncate) {
+			/* the byte past the end of a truncated codestream reads as 0 */
+			data_ptr[avail] = cio_read(cio, 1);
+		}
 	}
 
 	j2k->tile_len[curtileno] += len;
@@ -1553,42 +1581,40 @@ static void j2k_write_eoc(opj_j2k_t *j2k) {
 }
 
 static void j2k_read_eoc(opj_j2k_t *j2k) {
-	int i, tileno;
-	opj_bool success;
-
 	/* if packets should be decoded */
 	if (j2k->cp->limit_decoding != DECODE_ALL_BUT_PACKETS) {
-		opj_tcd_t *tcd = tcd_create(j2k->cinfo);
-		tcd_malloc_decode(tcd, j2k->image, j2k->cp);
-		for (i = 0; i < j2k->cp->tileno_size; i++) {
-			tcd_malloc_decode_tile(tcd, j2k->image, j2k->cp, i, j2k->cstr_info);
-			tileno = j2k->cp->tileno[i];
-			success = tcd_decode_tile(tcd, j2k->tile_data[tileno], j2k->tile_len[tileno], tileno, j2k->cstr_info);
-			opj_free(j2k->tile_data[tileno]);
-			j2k->tile_data[tileno] = NULL;
-			tcd_free_decode_tile(tcd, i);
-			if (success == OPJ_FALSE) {
-				j2k->state |= J2K_STATE_ERR;
-				break;
-			}
+		/* the tile decoder keeps its memory for the next codestream */
+		if (!j2k->tcd) {
+			j2k->tcd = tcd_create(j2k->cinfo);
 		}
-		tcd_free_decode(tcd);
-		tcd_destroy(tcd);
-	}
-	/* if packets should not be decoded  */
-	else {
-		for (i = 0; i < j2k->cp->tileno_size; i++) {
-			tileno = j2k->cp->tileno[i];
-			opj_free(j2k->tile_data[tileno]);
-			j2k->tile_data[tileno] = NULL;
+		/* the tiles are independent now that all their data has been read */
+		if (!j2k->tcd || !tcd_malloc_decode(j2k->tcd, j2k->image, j2k->cp) || !j2k_check_output(j2k) ||
+			!tcd_decode_tiles(j2k->tcd, j2k->tile_data, j2k->tile_len, j2k->cstr_info)) {
+			j2k->state |= J2K_STATE_ERR;
 		}
-	}	
+	}
+	/* the tile data stays in the arena until the next codestream */
 	if (j2k->state & J2K_STATE_ERR)
 		j2k->state = J2K_STATE_MT + J2K_STATE_ERR;
 	else
 		j2k->state = J2K_STATE_MT; 
 }
 
+static opj_bool j2k_check_output(opj_j2k_t *j2k) {
+	opj_cp_t *cp = j2k->cp;
+	opj_image_comp_t *comp = &j2k->image->comps[0];
+
+	if (cp->output_format == OUTPUT_PLANAR) {
+		return OPJ_TRUE;
+	}
+	/* tcd_write_interleaved checks that the other components have the same size */
+	if (!cp->output || cp->output_stride < comp->w * 4 || cp->output_height < comp->h) {
+		opj_event_msg(j2k->cinfo, EVT_ERROR, "Interleaved output too small for a %d x %d image\n", comp->w, comp->h);
+		return OPJ_FALSE;
+	}
+	return OPJ_TRUE;
+}
+
 typedef struct opj_dec_mstabent {
 	/** marker value */
 	int id;
@@ -1731,59 +1757,61 @@ opj_j2k_t* j2k_create_decompress(opj_common_ptr cinfo) {
 }
 
 void j2k_destroy_decompress(opj_j2k_t *j2k) {
-	int i = 0;
-
-	if(j2k->tile_len != NULL) {
-		opj_free(j2k->tile_len);
-	}
-	if(j2k->tile_data != NULL) {
-		opj_free(j2k->tile_data);
-	}
+	j2k_reset_decompress(j2k);
 	if(j2k->default_tcp != NULL) {
-		opj_tcp_t *default_tcp = j2k->default_tcp;
-		if(default_tcp->ppt_data_first != NULL) {
-			opj_free(default_tcp->ppt_data_first);
-		}
-		if(j2k->default_tcp->tccps != NULL) {
-			opj_free(j2k->default_tcp->tccps);
-		}
 		opj_free(j2k->default_tcp);
 	}
 	if(j2k->cp != NULL) {
-		opj_cp_t *cp = j2k->cp;
-		if(cp->tcps != NULL) {
-			for(i = 0; i < cp->tw * cp->th; i++) {
-				if(cp->tcps[i].ppt_data_first != NULL) {
-					opj_free(cp->tcps[i].ppt_data_first);
-				}
-				if(cp->tcps[i].tccps != NULL) {
-					opj_free(cp->tcps[i].tccps);
-				}
-			}
-			opj_free(cp->tcps);
-		}
-		if(cp->ppm_data_first != NULL) {
-			opj_free(cp->ppm_data_first);
-		}
-		if(cp->tileno != NULL) {
-			opj_free(cp->tileno);  
-		}
+		opj_free(j2k->cp);
+	}
+	if(j2k->tcd != NULL) {
+		tcd_free_decode(j2k->tcd);
+		tcd_destroy(j2k->tcd);
+	}
+	opj_arena_free(&j2k->arena);
+	opj_free(j2k);
+}
+
+static void j2k_reset_decompress(opj_j2k_t *j2k) {
+	opj_cp_t *cp = j2k->cp;
+
+	/* the tile data, the tile coding parameters and the packed packet headers go at once */
+	opj_arena_reset(&j2k->arena);
+	j2k->tile_data = NULL;
+	j2k->tile_len = NULL;
+	if(j2k->default_tcp != NULL) {
+		/* the main header of the next codestream starts from a blank COD and QCD */
+		memset(j2k->default_tcp, 0, sizeof(opj_tcp_t));
+	}
+	if(cp != NULL) {
+		cp->tcps = NULL;
+		cp->ppm_data = NULL;
+		cp->ppm_data_first = NULL;
+		cp->tileno = NULL;
+		cp->tileno_size = 0;
 		if(cp->comment != NULL) {
 			opj_free(cp->comment);
+			cp->comment = NULL;
 		}
-
-		opj_free(cp);
 	}
-	opj_free(j2k);
+#ifdef USE_JPWL
+	j2k->backup_tileno = 0;
+	j2k->backup_compno = 0;
+#endif /* USE_JPWL */
 }
 
 void j2k_setup_decoder(opj_j2k_t *j2k, opj_dparameters_t *parameters) {
 	if(j2k && parameters) {
-		/* create and initialize the coding parameters structure */
-		opj_cp_t *cp = (opj_cp_t*) opj_calloc(1, sizeof(opj_cp_t));
+		/* create and initialize the coding parameters structure, a handle set up again keeps it */
+		opj_cp_t *cp = j2k->cp ? j2k->cp : (opj_cp_t*) opj_calloc(1, sizeof(opj_cp_t));
 		cp->reduce = parameters->cp_reduce;	
 		cp->layer = parameters->cp_layer;
 		cp->limit_decoding = parameters->cp_limit_decoding;
+		cp->output_format = parameters->cp_output_format;
+		cp->output = parameters->cp_output;
+		cp->output_stride = parameters->cp_output_stride;
+		cp->output_height = parameters->cp_output_height;
+		cp->num_threads = parameters->cp_num_threads;
 
 #ifdef USE_JPWL
 		cp->correct = parameters->jpwl_correct;
@@ -1807,6 +1835,9 @@ opj_image_t* j2k_decode(opj_j2k_t *j2k, opj_cio_t *cio, opj_codestream_info_t *c
 	if (cstr_info)
 		memset(cstr_info, 0, sizeof(opj_codestream_info_t));
 
+	/* the handle may have decoded a codestream before */
+	j2k_reset_decompress(j2k);
+
 	/* create an empty image */
 	image = opj_image_create0();
 	j2k->image = image;
@@ -1876,8 +1907,10 @@ opj_image_t* j2k_decode(opj_j2k_t *j2k, opj_cio_t *cio, opj_codestream_info_t *c
 		if (e->handler) {
 			(*e->handler)(j2k);
 		}
-		if (j2k->state & J2K_STATE_ERR) 
-			return NULL;	
+		if (j2k->state & J2K_STATE_ERR) {
+			opj_image_destroy(image);
+			return NULL;
+		}
 
 		if (j2k->state == J2K_STATE_MT) {
 			break;
@@ -1910,6 +1943,9 @@ opj_image_t* j2k_decode_jpt_stream(opj_j2k_t *j2k, opj_cio_t *cio,  opj_codestre
 
 	j2k->cio = cio;
 
+	/* the handle may have decoded a codestream before */
+	j2k_reset_decompress(j2k);
+
 	/* create an empty image */
 	image = opj_image_create0();
 	j2k->image = image;
@@ -2042,6 +2078,10 @@ void j2k_setup_encoder(opj_j2k_t *j2k, opj_cparameters_t *parameters, opj_image_
 	cp->disto_alloc = parameters->cp_disto_alloc;
 	cp->fixed_alloc = parameters->cp_fixed_alloc;
 	cp->fixed_quality = parameters->cp_fixed_quality;
+	cp->num_threads = parameters->cp_num_threads;
+	cp->input_format = parameters->cp_input_format;
+	cp->input = parameters->cp_input;
+	cp->input_stride = parameters->cp_input_stride;
 
 	/* mod fixed_quality */
 	if(parameters->cp_matrice) {
@@ -2284,6 +2324,21 @@ opj_bool j2k_encode(opj_j2k_t *j2k, opj_cio_t *cio, opj_image_t *image, opj_code
 
 	cp = j2k->cp;
 
+	/* tcd_encode_tile reads the interleaved input as full size 8 bit pixels */
+	if (cp->input_format != OUTPUT_PLANAR) {
+		if (!cp->input || image->numcomps > 4 || cp->input_stride < (image->x1 - image->x0) * 4) {
+			opj_event_msg(j2k->cinfo, EVT_ERROR, "Interleaved input needs 1 to 4 components and a row of 4 bytes per pixel\n");
+			return OPJ_FALSE;
+		}
+		for (compno = 0; compno < image->numcomps; compno++) {
+			opj_image_comp_t *comp = &image->comps[compno];
+			if (comp->prec != 8 || comp->sgnd || comp->dx != 1 || comp->dy != 1) {
+				opj_event_msg(j2k->cinfo, EVT_ERROR, "Interleaved input needs unsigned 8 bit components the size of the image\n");
+				return OPJ_FALSE;
+			}
+		}
+	}
+
 	/* INDEX >> */
 	j2k->cstr_info = cstr_info;
 	if (cstr_info) {
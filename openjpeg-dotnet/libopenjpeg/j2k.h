@@ -228,6 +228,22 @@ typedef struct opj_cp {
 	int layer;
 	/** if == NO_LIMITATION, decode entire codestream; if == LIMIT_TO_MAIN_HEADER then only decode the main header */
 	OPJ_LIMIT_DECODING limit_decoding;
+	/** if != OUTPUT_PLANAR, the decoded tiles are written to output as 8 bit interleaved pixels */
+	OPJ_OUTPUT_FORMAT output_format;
+	/** destination of the interleaved pixels */
+	unsigned char *output;
+	/** number of bytes between two rows of output */
+	int output_stride;
+	/** number of rows of output */
+	int output_height;
+	/** if != OUTPUT_PLANAR, the tiles to encode are read from input as 8 bit interleaved pixels */
+	OPJ_OUTPUT_FORMAT input_format;
+	/** source of the interleaved pixels */
+	const unsigned char *input;
+	/** number of bytes between two rows of input */
+	int input_stride;
+	/** most threads decoding or encoding the image, 0 for one per processor */
+	int num_threads;
 	/** XTOsiz */
 	int tx0;
 	/** YTOsiz */
@@ -349,7 +365,7 @@ typedef struct opj_j2k {
 	it enables to make the right correction in position return by cio_tell
 	*/
 	int pos_correction;
-	/** array used to store the data of each tile */
+	/** array used to store the data of each tile, it points into the codestream when the tile is in one tile-part */
 	unsigned char **tile_data;
 	/** array used to store the length of each tile */
 	int *tile_len;
@@ -366,6 +382,22 @@ typedef struct opj_j2k {
 	opj_codestream_info_t *cstr_info;
 	/** pointer to the byte i/o stream */
 	opj_cio_t *cio;
+	/** 
+	decompression only : 
+	tile decoder, kept with its tiles and scratch memory from one codestream to the next
+	*/
+	struct opj_tcd *tcd;
+	/** 
+	decompression only : 
+	memory of the concatenated tile-parts and of the arrays sized by the main header, released by the next codestream
+	*/
+	opj_arena_t arena;
+#ifdef USE_JPWL
+	/** private count of the tiles read so far, used to recover a corrupted SOT tile number */
+	int backup_tileno;
+	/** private count of the QCC markers read so far, used to recover a corrupted component number */
+	int backup_compno;
+#endif /* USE_JPWL */
 } opj_j2k_t;
 
 /** @name Exported functions */
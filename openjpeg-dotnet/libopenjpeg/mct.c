@@ -29,12 +29,39 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-#ifdef __SSE__
-#include <xmmintrin.h>
-#endif
 
 #include "opj_includes.h"
 
+/** @defgroup MCT MCT - Implementation of a multi-component transform */
+/*@{*/
+
+/** @name Local data structures */
+/*@{*/
+
+/**
+Kernels of one instruction set level, see mct_get_kernels
+*/
+typedef struct mct_kernels {
+	void (*encode)(int* restrict c0, int* restrict c1, int* restrict c2, int n);
+	void (*decode)(int* restrict c0, int* restrict c1, int* restrict c2, int n);
+	void (*encode_real)(int* restrict c0, int* restrict c1, int* restrict c2, int n);
+	void (*decode_real)(float* restrict c0, float* restrict c1, float* restrict c2, int n);
+} mct_kernels_t;
+
+/*@}*/
+
+/** @name Local static functions */
+/*@{*/
+
+/**
+Get the kernels of the instruction set level given by opj_cpu_level
+*/
+static const mct_kernels_t* mct_get_kernels(void);
+
+/*@}*/
+
+/*@}*/
+
 /* <summary> */
 /* This table contains the norms of the basis function of the reversible MCT. */
 /* </summary> */
@@ -48,7 +75,7 @@ static const double mct_norms_real[3] = { 1.732, 1.805, 1.573 };
 /* <summary> */
 /* Foward reversible MCT. */
 /* </summary> */
-void mct_encode(
+static void mct_encode_c(
 		int* restrict c0,
 		int* restrict c1,
 		int* restrict c2,
@@ -71,7 +98,7 @@ void mct_encode(
 /* <summary> */
 /* Inverse reversible MCT. */
 /* </summary> */
-void mct_decode(
+static void mct_decode_c(
 		int* restrict c0,
 		int* restrict c1, 
 		int* restrict c2, 
@@ -91,17 +118,10 @@ void mct_decode(
 	}
 }
 
-/* <summary> */
-/* Get norm of basis function of reversible MCT. */
-/* </summary> */
-double mct_getnorm(int compno) {
-	return mct_norms[compno];
-}
-
 /* <summary> */
 /* Foward irreversible MCT. */
 /* </summary> */
-void mct_encode_real(
+static void mct_encode_real_c(
 		int* restrict c0,
 		int* restrict c1,
 		int* restrict c2,
@@ -124,14 +144,136 @@ void mct_encode_real(
 /* <summary> */
 /* Inverse irreversible MCT. */
 /* </summary> */
-void mct_decode_real(
+static void mct_decode_real_c(
+		float* restrict c0,
+		float* restrict c1,
+		float* restrict c2,
+		int n)
+{
+	int i;
+	for(i = 0; i < n; ++i) {
+		float y = c0[i];
+		float u = c1[i];
+		float v = c2[i];
+		float r = y + (v * 1.402f);
+		float g = y - (u * 0.34413f) - (v * (0.71414f));
+		float b = y + (u * 1.772f);
+		c0[i] = r;
+		c1[i] = g;
+		c2[i] = b;
+	}
+}
+
+#ifdef OPJ_KERNELS_SSE2
+
+/* <summary> */
+/* Low 32 bits of the products, _mm_mullo_epi32 is SSE4.1 only. */
+/* </summary> */
+OPJ_TARGET_SSE2 static INLINE __m128i mct_mullo_sse2(__m128i a, __m128i b) {
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(
+			_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+			_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+/* <summary> */
+/* fix_mul by a positive 13 bit constant. Writing a = hi * 8192 + lo */
+/* splits the 64 bit product into two that fit in 32 bits, with the */
+/* same rounding since hi * b * 8192 leaves the low 13 bits alone. */
+/* </summary> */
+OPJ_TARGET_SSE2 static INLINE __m128i mct_fix_mul_sse2(__m128i a, __m128i b) {
+	__m128i lo = _mm_and_si128(a, _mm_set1_epi32(0x1fff));
+	__m128i hi = _mm_srai_epi32(a, 13);
+	/* lo and b are below 2^15 with zero upper halves */
+	__m128i t = _mm_madd_epi16(lo, b);
+	t = _mm_add_epi32(t, _mm_and_si128(t, _mm_set1_epi32(4096)));
+	return _mm_add_epi32(mct_mullo_sse2(hi, b), _mm_srai_epi32(t, 13));
+}
+
+/* <summary> */
+/* Foward reversible MCT, 4 samples at a time. */
+/* </summary> */
+OPJ_TARGET_SSE2 static void mct_encode_sse2(
+		int* restrict c0,
+		int* restrict c1,
+		int* restrict c2,
+		int n)
+{
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i r = _mm_load_si128((__m128i*)(c0 + i));
+		__m128i g = _mm_load_si128((__m128i*)(c1 + i));
+		__m128i b = _mm_load_si128((__m128i*)(c2 + i));
+		__m128i y = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(r, b), _mm_slli_epi32(g, 1)), 2);
+		_mm_store_si128((__m128i*)(c0 + i), y);
+		_mm_store_si128((__m128i*)(c1 + i), _mm_sub_epi32(b, g));
+		_mm_store_si128((__m128i*)(c2 + i), _mm_sub_epi32(r, g));
+	}
+	mct_encode_c(c0 + i, c1 + i, c2 + i, n - i);
+}
+
+/* <summary> */
+/* Inverse reversible MCT, 4 samples at a time. Reduced decodes */
+/* run it per row, so the rows need not be 16 byte aligned. */
+/* </summary> */
+OPJ_TARGET_SSE2 static void mct_decode_sse2(
+		int* restrict c0,
+		int* restrict c1,
+		int* restrict c2,
+		int n)
+{
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i y = _mm_loadu_si128((__m128i*)(c0 + i));
+		__m128i u = _mm_loadu_si128((__m128i*)(c1 + i));
+		__m128i v = _mm_loadu_si128((__m128i*)(c2 + i));
+		__m128i g = _mm_sub_epi32(y, _mm_srai_epi32(_mm_add_epi32(u, v), 2));
+		_mm_storeu_si128((__m128i*)(c0 + i), _mm_add_epi32(v, g));
+		_mm_storeu_si128((__m128i*)(c1 + i), g);
+		_mm_storeu_si128((__m128i*)(c2 + i), _mm_add_epi32(u, g));
+	}
+	mct_decode_c(c0 + i, c1 + i, c2 + i, n - i);
+}
+
+/* <summary> */
+/* Foward irreversible MCT, 4 samples at a time. */
+/* </summary> */
+OPJ_TARGET_SSE2 static void mct_encode_real_sse2(
+		int* restrict c0,
+		int* restrict c1,
+		int* restrict c2,
+		int n)
+{
+	const __m128i yr = _mm_set1_epi32(2449), yg = _mm_set1_epi32(4809), yb = _mm_set1_epi32(934);
+	const __m128i ur = _mm_set1_epi32(1382), ug = _mm_set1_epi32(2714), ub = _mm_set1_epi32(4096);
+	const __m128i vg = _mm_set1_epi32(3430), vb = _mm_set1_epi32(666);
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i r = _mm_load_si128((__m128i*)(c0 + i));
+		__m128i g = _mm_load_si128((__m128i*)(c1 + i));
+		__m128i b = _mm_load_si128((__m128i*)(c2 + i));
+		__m128i y = _mm_add_epi32(_mm_add_epi32(mct_fix_mul_sse2(r, yr), mct_fix_mul_sse2(g, yg)), mct_fix_mul_sse2(b, yb));
+		__m128i u = _mm_sub_epi32(_mm_sub_epi32(mct_fix_mul_sse2(b, ub), mct_fix_mul_sse2(r, ur)), mct_fix_mul_sse2(g, ug));
+		__m128i v = _mm_sub_epi32(_mm_sub_epi32(mct_fix_mul_sse2(r, ub), mct_fix_mul_sse2(g, vg)), mct_fix_mul_sse2(b, vb));
+		_mm_store_si128((__m128i*)(c0 + i), y);
+		_mm_store_si128((__m128i*)(c1 + i), u);
+		_mm_store_si128((__m128i*)(c2 + i), v);
+	}
+	mct_encode_real_c(c0 + i, c1 + i, c2 + i, n - i);
+}
+
+/* <summary> */
+/* Inverse irreversible MCT, 4 samples at a time, unaligned as */
+/* mct_decode_sse2. */
+/* </summary> */
+OPJ_TARGET_SSE2 static void mct_decode_real_sse2(
 		float* restrict c0,
 		float* restrict c1,
 		float* restrict c2,
 		int n)
 {
 	int i;
-#ifdef __SSE__
 	__m128 vrv, vgu, vgv, vbu;
 	vrv = _mm_set1_ps(1.402f);
 	vgu = _mm_set1_ps(0.34413f);
@@ -141,47 +283,243 @@ void mct_decode_real(
 		__m128 vy, vu, vv;
 		__m128 vr, vg, vb;
 
-		vy = _mm_load_ps(c0);
-		vu = _mm_load_ps(c1);
-		vv = _mm_load_ps(c2);
+		vy = _mm_loadu_ps(c0);
+		vu = _mm_loadu_ps(c1);
+		vv = _mm_loadu_ps(c2);
 		vr = _mm_add_ps(vy, _mm_mul_ps(vv, vrv));
 		vg = _mm_sub_ps(_mm_sub_ps(vy, _mm_mul_ps(vu, vgu)), _mm_mul_ps(vv, vgv));
 		vb = _mm_add_ps(vy, _mm_mul_ps(vu, vbu));
-		_mm_store_ps(c0, vr);
-		_mm_store_ps(c1, vg);
-		_mm_store_ps(c2, vb);
+		_mm_storeu_ps(c0, vr);
+		_mm_storeu_ps(c1, vg);
+		_mm_storeu_ps(c2, vb);
 		c0 += 4;
 		c1 += 4;
 		c2 += 4;
 
-		vy = _mm_load_ps(c0);
-		vu = _mm_load_ps(c1);
-		vv = _mm_load_ps(c2);
+		vy = _mm_loadu_ps(c0);
+		vu = _mm_loadu_ps(c1);
+		vv = _mm_loadu_ps(c2);
 		vr = _mm_add_ps(vy, _mm_mul_ps(vv, vrv));
 		vg = _mm_sub_ps(_mm_sub_ps(vy, _mm_mul_ps(vu, vgu)), _mm_mul_ps(vv, vgv));
 		vb = _mm_add_ps(vy, _mm_mul_ps(vu, vbu));
-		_mm_store_ps(c0, vr);
-		_mm_store_ps(c1, vg);
-		_mm_store_ps(c2, vb);
+		_mm_storeu_ps(c0, vr);
+		_mm_storeu_ps(c1, vg);
+		_mm_storeu_ps(c2, vb);
 		c0 += 4;
 		c1 += 4;
 		c2 += 4;
 	}
-	n &= 7;
+	mct_decode_real_c(c0, c1, c2, n & 7);
+}
+
+#endif /* OPJ_KERNELS_SSE2 */
+
+#ifdef OPJ_KERNELS_AVX2
+
+/* <summary> */
+/* fix_mul by a positive 13 bit constant, see mct_fix_mul_sse2. */
+/* </summary> */
+OPJ_TARGET_AVX2 static INLINE __m256i mct_fix_mul_avx2(__m256i a, __m256i b) {
+	__m256i lo = _mm256_and_si256(a, _mm256_set1_epi32(0x1fff));
+	__m256i hi = _mm256_srai_epi32(a, 13);
+	__m256i t = _mm256_mullo_epi32(lo, b);
+	t = _mm256_add_epi32(t, _mm256_and_si256(t, _mm256_set1_epi32(4096)));
+	return _mm256_add_epi32(_mm256_mullo_epi32(hi, b), _mm256_srai_epi32(t, 13));
+}
+
+/* <summary> */
+/* Foward reversible MCT, 8 samples at a time. */
+/* </summary> */
+OPJ_TARGET_AVX2 static void mct_encode_avx2(
+		int* restrict c0,
+		int* restrict c1,
+		int* restrict c2,
+		int n)
+{
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i r = _mm256_loadu_si256((__m256i*)(c0 + i));
+		__m256i g = _mm256_loadu_si256((__m256i*)(c1 + i));
+		__m256i b = _mm256_loadu_si256((__m256i*)(c2 + i));
+		__m256i y = _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(r, b), _mm256_slli_epi32(g, 1)), 2);
+		_mm256_storeu_si256((__m256i*)(c0 + i), y);
+		_mm256_storeu_si256((__m256i*)(c1 + i), _mm256_sub_epi32(b, g));
+		_mm256_storeu_si256((__m256i*)(c2 + i), _mm256_sub_epi32(r, g));
+	}
+	mct_encode_c(c0 + i, c1 + i, c2 + i, n - i);
+}
+
+/* <summary> */
+/* Inverse reversible MCT, 8 samples at a time. */
+/* </summary> */
+OPJ_TARGET_AVX2 static void mct_decode_avx2(
+		int* restrict c0,
+		int* restrict c1,
+		int* restrict c2,
+		int n)
+{
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i y = _mm256_loadu_si256((__m256i*)(c0 + i));
+		__m256i u = _mm256_loadu_si256((__m256i*)(c1 + i));
+		__m256i v = _mm256_loadu_si256((__m256i*)(c2 + i));
+		__m256i g = _mm256_sub_epi32(y, _mm256_srai_epi32(_mm256_add_epi32(u, v), 2));
+		_mm256_storeu_si256((__m256i*)(c0 + i), _mm256_add_epi32(v, g));
+		_mm256_storeu_si256((__m256i*)(c1 + i), g);
+		_mm256_storeu_si256((__m256i*)(c2 + i), _mm256_add_epi32(u, g));
+	}
+	mct_decode_c(c0 + i, c1 + i, c2 + i, n - i);
+}
+
+/* <summary> */
+/* Foward irreversible MCT, 8 samples at a time. */
+/* </summary> */
+OPJ_TARGET_AVX2 static void mct_encode_real_avx2(
+		int* restrict c0,
+		int* restrict c1,
+		int* restrict c2,
+		int n)
+{
+	const __m256i yr = _mm256_set1_epi32(2449), yg = _mm256_set1_epi32(4809), yb = _mm256_set1_epi32(934);
+	const __m256i ur = _mm256_set1_epi32(1382), ug = _mm256_set1_epi32(2714), ub = _mm256_set1_epi32(4096);
+	const __m256i vg = _mm256_set1_epi32(3430), vb = _mm256_set1_epi32(666);
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i r = _mm256_loadu_si256((__m256i*)(c0 + i));
+		__m256i g = _mm256_loadu_si256((__m256i*)(c1 + i));
+		__m256i b = _mm256_loadu_si256((__m256i*)(c2 + i));
+		__m256i y = _mm256_add_epi32(_mm256_add_epi32(mct_fix_mul_avx2(r, yr), mct_fix_mul_avx2(g, yg)), mct_fix_mul_avx2(b, yb));
+		__m256i u = _mm256_sub_epi32(_mm256_sub_epi32(mct_fix_mul_avx2(b, ub), mct_fix_mul_avx2(r, ur)), mct_fix_mul_avx2(g, ug));
+		__m256i v = _mm256_sub_epi32(_mm256_sub_epi32(mct_fix_mul_avx2(r, ub), mct_fix_mul_avx2(g, vg)), mct_fix_mul_avx2(b, vb));
+		_mm256_storeu_si256((__m256i*)(c0 + i), y);
+		_mm256_storeu_si256((__m256i*)(c1 + i), u);
+		_mm256_storeu_si256((__m256i*)(c2 + i), v);
+	}
+	mct_encode_real_c(c0 + i, c1 + i, c2 + i, n - i);
+}
+
+/* <summary> */
+/* Inverse irreversible MCT, 8 samples at a time. */
+/* </summary> */
+OPJ_TARGET_AVX2 static void mct_decode_real_avx2(
+		float* restrict c0,
+		float* restrict c1,
+		float* restrict c2,
+		int n)
+{
+	const __m256 vrv = _mm256_set1_ps(1.402f);
+	const __m256 vgu = _mm256_set1_ps(0.34413f);
+	const __m256 vgv = _mm256_set1_ps(0.71414f);
+	const __m256 vbu = _mm256_set1_ps(1.772f);
+	int i;
+	/* the planes are only 16 byte aligned */
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256 vy = _mm256_loadu_ps(c0 + i);
+		__m256 vu = _mm256_loadu_ps(c1 + i);
+		__m256 vv = _mm256_loadu_ps(c2 + i);
+		_mm256_storeu_ps(c0 + i, _mm256_add_ps(vy, _mm256_mul_ps(vv, vrv)));
+		_mm256_storeu_ps(c1 + i, _mm256_sub_ps(_mm256_sub_ps(vy, _mm256_mul_ps(vu, vgu)), _mm256_mul_ps(vv, vgv)));
+		_mm256_storeu_ps(c2 + i, _mm256_add_ps(vy, _mm256_mul_ps(vu, vbu)));
+	}
+	mct_decode_real_c(c0 + i, c1 + i, c2 + i, n - i);
+}
+
+#endif /* OPJ_KERNELS_AVX2 */
+
+#ifdef OPJ_KERNELS_AVX512
+
+/* <summary> */
+/* Inverse irreversible MCT, 16 samples at a time. */
+/* </summary> */
+OPJ_TARGET_AVX512 static void mct_decode_real_avx512(
+		float* restrict c0,
+		float* restrict c1,
+		float* restrict c2,
+		int n)
+{
+	const __m512 vrv = _mm512_set1_ps(1.402f);
+	const __m512 vgu = _mm512_set1_ps(0.34413f);
+	const __m512 vgv = _mm512_set1_ps(0.71414f);
+	const __m512 vbu = _mm512_set1_ps(1.772f);
+	int i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m512 vy = _mm512_loadu_ps(c0 + i);
+		__m512 vu = _mm512_loadu_ps(c1 + i);
+		__m512 vv = _mm512_loadu_ps(c2 + i);
+		_mm512_storeu_ps(c0 + i, _mm512_add_ps(vy, _mm512_mul_ps(vv, vrv)));
+		_mm512_storeu_ps(c1 + i, _mm512_sub_ps(_mm512_sub_ps(vy, _mm512_mul_ps(vu, vgu)), _mm512_mul_ps(vv, vgv)));
+		_mm512_storeu_ps(c2 + i, _mm512_add_ps(vy, _mm512_mul_ps(vu, vbu)));
+	}
+	mct_decode_real_c(c0 + i, c1 + i, c2 + i, n - i);
+}
+
+#endif /* OPJ_KERNELS_AVX512 */
+
+static const mct_kernels_t mct_kernels_c = {
+	mct_encode_c, mct_decode_c, mct_encode_real_c, mct_decode_real_c
+};
+
+#ifdef OPJ_KERNELS_SSE2
+static const mct_kernels_t mct_kernels_sse2 = {
+	mct_encode_sse2, mct_decode_sse2, mct_encode_real_sse2, mct_decode_real_sse2
+};
 #endif
-	for(i = 0; i < n; ++i) {
-		float y = c0[i];
-		float u = c1[i];
-		float v = c2[i];
-		float r = y + (v * 1.402f);
-		float g = y - (u * 0.34413f) - (v * (0.71414f));
-		float b = y + (u * 1.772f);
-		c0[i] = r;
-		c1[i] = g;
-		c2[i] = b;
+
+#ifdef OPJ_KERNELS_AVX2
+static const mct_kernels_t mct_kernels_avx2 = {
+	mct_encode_avx2, mct_decode_avx2, mct_encode_real_avx2, mct_decode_real_avx2
+};
+#endif
+
+#ifdef OPJ_KERNELS_AVX512
+/* the integer transforms gain little from 16 lanes */
+static const mct_kernels_t mct_kernels_avx512 = {
+	mct_encode_avx2, mct_decode_avx2, mct_encode_real_avx2, mct_decode_real_avx512
+};
+#endif
+
+static const mct_kernels_t* mct_get_kernels(void) {
+	switch (opj_cpu_level()) {
+#ifdef OPJ_KERNELS_AVX512
+		case OPJ_SIMD_AVX512:
+			return &mct_kernels_avx512;
+#endif
+#ifdef OPJ_KERNELS_AVX2
+		case OPJ_SIMD_AVX2:
+			return &mct_kernels_avx2;
+#endif
+#ifdef OPJ_KERNELS_SSE2
+		case OPJ_SIMD_SSE2:
+			return &mct_kernels_sse2;
+#endif
+		default:
+			return &mct_kernels_c;
 	}
 }
 
+void mct_encode(int* c0, int* c1, int* c2, int n) {
+	mct_get_kernels()->encode(c0, c1, c2, n);
+}
+
+void mct_decode(int* c0, int* c1, int* c2, int n) {
+	mct_get_kernels()->decode(c0, c1, c2, n);
+}
+
+/* <summary> */
+/* Get norm of basis function of reversible MCT. */
+/* </summary> */
+double mct_getnorm(int compno) {
+	return mct_norms[compno];
+}
+
+void mct_encode_real(int* c0, int* c1, int* c2, int n) {
+	mct_get_kernels()->encode_real(c0, c1, c2, n);
+}
+
+void mct_decode_real(float* c0, float* c1, float* c2, int n) {
+	mct_get_kernels()->decode_real(c0, c1, c2, n);
+}
+
 /* <summary> */
 /* Get norm of basis function of irreversible MCT. */
 /* </summary> */
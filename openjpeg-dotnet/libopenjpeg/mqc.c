@@ -44,55 +44,19 @@ After a 0xff byte, the next byte must be smaller than 0x90.
 */
 static void mqc_byteout(opj_mqc_t *mqc);
 /**
-Renormalize mqc->a and mqc->c while encoding, so that mqc->a stays between 0x8000 and 0x10000
-@param mqc MQC handle
-*/
-static void mqc_renorme(opj_mqc_t *mqc);
-/**
-Encode the most probable symbol
-@param mqc MQC handle
-*/
-static void mqc_codemps(opj_mqc_t *mqc);
-/**
-Encode the most least symbol
-@param mqc MQC handle
-*/
-static void mqc_codelps(opj_mqc_t *mqc);
-/**
 Fill mqc->c with 1's for flushing
 @param mqc MQC handle
 */
 static void mqc_setbits(opj_mqc_t *mqc);
-/**
-FIXME: documentation ???
-@param mqc MQC handle
-@return 
-*/
-static INLINE int mqc_mpsexchange(opj_mqc_t *const mqc);
-/**
-FIXME: documentation ???
-@param mqc MQC handle
-@return 
-*/
-static INLINE int mqc_lpsexchange(opj_mqc_t *const mqc);
-/**
-Input a byte
-@param mqc MQC handle
-*/
-static INLINE void mqc_bytein(opj_mqc_t *const mqc);
-/**
-Renormalize mqc->a and mqc->c while decoding
-@param mqc MQC handle
-*/
-static INLINE void mqc_renormd(opj_mqc_t *const mqc);
 /*@}*/
 
 /*@}*/
 
 /* <summary> */
 /* This array defines all the possible states for a context. */
+/* It is never written to, so coders running on different threads can share it. */
 /* </summary> */
-static opj_mqc_state_t mqc_states[47 * 2] = {
+static const opj_mqc_state_t mqc_states[47 * 2] = {
 	{0x5601, 0, &mqc_states[2], &mqc_states[3]},
 	{0x5601, 1, &mqc_states[3], &mqc_states[2]},
 	{0x3401, 0, &mqc_states[4], &mqc_states[12]},
@@ -189,6 +153,12 @@ static opj_mqc_state_t mqc_states[47 * 2] = {
 	{0x5601, 1, &mqc_states[93], &mqc_states[93]},
 };
 
+/* <summary> */
+/* End of segment marker the decoder is left on by mqc_finish_dec. */
+/* The decoder only ever reads it, so it is shared by all the coders. */
+/* </summary> */
+static const unsigned char mqc_end_marker[MQC_SENTINEL_LEN] = {0xff, 0xff};
+
 /* 
 ==========================================================
    local functions
@@ -196,70 +166,10 @@ static opj_mqc_state_t mqc_states[47 * 2] = {
 */
 
 static void mqc_byteout(opj_mqc_t *mqc) {
-	if (*mqc->bp == 0xff) {
-		mqc->bp++;
-		*mqc->bp = mqc->c >> 20;
-		mqc->c &= 0xfffff;
-		mqc->ct = 7;
-	} else {
-		if ((mqc->c & 0x8000000) == 0) {	/* ((mqc->c&0x8000000)==0) CHANGE */
-			mqc->bp++;
-			*mqc->bp = mqc->c >> 19;
-			mqc->c &= 0x7ffff;
-			mqc->ct = 8;
-		} else {
-			(*mqc->bp)++;
-			if (*mqc->bp == 0xff) {
-				mqc->c &= 0x7ffffff;
-				mqc->bp++;
-				*mqc->bp = mqc->c >> 20;
-				mqc->c &= 0xfffff;
-				mqc->ct = 7;
-			} else {
-				mqc->bp++;
-				*mqc->bp = mqc->c >> 19;
-				mqc->c &= 0x7ffff;
-				mqc->ct = 8;
-			}
-		}
-	}
-}
-
-static void mqc_renorme(opj_mqc_t *mqc) {
-	do {
-		mqc->a <<= 1;
-		mqc->c <<= 1;
-		mqc->ct--;
-		if (mqc->ct == 0) {
-			mqc_byteout(mqc);
-		}
-	} while ((mqc->a & 0x8000) == 0);
-}
-
-static void mqc_codemps(opj_mqc_t *mqc) {
-	mqc->a -= (*mqc->curctx)->qeval;
-	if ((mqc->a & 0x8000) == 0) {
-		if (mqc->a < (*mqc->curctx)->qeval) {
-			mqc->a = (*mqc->curctx)->qeval;
-		} else {
-			mqc->c += (*mqc->curctx)->qeval;
-		}
-		*mqc->curctx = (*mqc->curctx)->nmps;
-		mqc_renorme(mqc);
-	} else {
-		mqc->c += (*mqc->curctx)->qeval;
-	}
-}
-
-static void mqc_codelps(opj_mqc_t *mqc) {
-	mqc->a -= (*mqc->curctx)->qeval;
-	if (mqc->a < (*mqc->curctx)->qeval) {
-		mqc->c += (*mqc->curctx)->qeval;
-	} else {
-		mqc->a = (*mqc->curctx)->qeval;
-	}
-	*mqc->curctx = (*mqc->curctx)->nlps;
-	mqc_renorme(mqc);
+	opj_mqc_enc_t enc;
+	mqc_enc_load(mqc, &enc);
+	mqc_enc_byteout(&enc);
+	mqc_enc_store(mqc, &enc);
 }
 
 static void mqc_setbits(opj_mqc_t *mqc) {
@@ -270,82 +180,6 @@ static void mqc_setbits(opj_mqc_t *mqc) {
 	}
 }
 
-static INLINE int mqc_mpsexchange(opj_mqc_t *const mqc) {
-	int d;
-	if (mqc->a < (*mqc->curctx)->qeval) {
-		d = 1 - (*mqc->curctx)->mps;
-		*mqc->curctx = (*mqc->curctx)->nlps;
-	} else {
-		d = (*mqc->curctx)->mps;
-		*mqc->curctx = (*mqc->curctx)->nmps;
-	}
-	
-	return d;
-}
-
-static INLINE int mqc_lpsexchange(opj_mqc_t *const mqc) {
-	int d;
-	if (mqc->a < (*mqc->curctx)->qeval) {
-		mqc->a = (*mqc->curctx)->qeval;
-		d = (*mqc->curctx)->mps;
-		*mqc->curctx = (*mqc->curctx)->nmps;
-	} else {
-		mqc->a = (*mqc->curctx)->qeval;
-		d = 1 - (*mqc->curctx)->mps;
-		*mqc->curctx = (*mqc->curctx)->nlps;
-	}
-	
-	return d;
-}
-
-#ifdef MQC_PERF_OPT
-static INLINE void mqc_bytein(opj_mqc_t *const mqc) {
-	unsigned int i = *((unsigned int *) mqc->bp);
-	mqc->c += i & 0xffff00;
-	mqc->ct = i & 0x0f;
-	mqc->bp += (i >> 2) & 0x04;
-}
-#else
-static void mqc_bytein(opj_mqc_t *const mqc) {
-	if (mqc->bp != mqc->end) {
-		unsigned int c;
-		if (mqc->bp + 1 != mqc->end) {
-			c = *(mqc->bp + 1);
-		} else {
-			c = 0xff;
-		}
-		if (*mqc->bp == 0xff) {
-			if (c > 0x8f) {
-				mqc->c += 0xff00;
-				mqc->ct = 8;
-			} else {
-				mqc->bp++;
-				mqc->c += c << 9;
-				mqc->ct = 7;
-			}
-		} else {
-			mqc->bp++;
-			mqc->c += c << 8;
-			mqc->ct = 8;
-		}
-	} else {
-		mqc->c += 0xff00;
-		mqc->ct = 8;
-	}
-}
-#endif
-
-static INLINE void mqc_renormd(opj_mqc_t *const mqc) {
-	do {
-		if (mqc->ct == 0) {
-			mqc_bytein(mqc);
-		}
-		mqc->a <<= 1;
-		mqc->c <<= 1;
-		mqc->ct--;
-	} while (mqc->a < 0x8000);
-}
-
 /* 
 ==========================================================
    MQ-Coder interface
@@ -354,19 +188,11 @@ static INLINE void mqc_renormd(opj_mqc_t *const mqc) {
 
 opj_mqc_t* mqc_create(void) {
 	opj_mqc_t *mqc = (opj_mqc_t*)opj_malloc(sizeof(opj_mqc_t));
-#ifdef MQC_PERF_OPT
-	mqc->buffer = NULL;
-#endif
 	return mqc;
 }
 
 void mqc_destroy(opj_mqc_t *mqc) {
 	if(mqc) {
-#ifdef MQC_PERF_OPT
-		if (mqc->buffer) {
-			opj_free(mqc->buffer);
-		}
-#endif
 		opj_free(mqc);
 	}
 }
@@ -388,11 +214,10 @@ void mqc_init_enc(opj_mqc_t *mqc, unsigned char *bp) {
 }
 
 void mqc_encode(opj_mqc_t *mqc, int d) {
-	if ((*mqc->curctx)->mps == d) {
-		mqc_codemps(mqc);
-	} else {
-		mqc_codelps(mqc);
-	}
+	opj_mqc_enc_t enc;
+	mqc_enc_load(mqc, &enc);
+	mqc_enc_encode(&enc, (int)(mqc->curctx - mqc->ctxs), d);
+	mqc_enc_store(mqc, &enc);
 }
 
 void mqc_flush(opj_mqc_t *mqc) {
@@ -416,17 +241,10 @@ void mqc_bypass_init_enc(opj_mqc_t *mqc) {
 }
 
 void mqc_bypass_enc(opj_mqc_t *mqc, int d) {
-	mqc->ct--;
-	mqc->c = mqc->c + (d << mqc->ct);
-	if (mqc->ct == 0) {
-		mqc->bp++;
-		*mqc->bp = mqc->c;
-		mqc->ct = 8;
-		if (*mqc->bp == 0xff) {
-			mqc->ct = 7;
-		}
-		mqc->c = 0;
-	}
+	opj_mqc_enc_t enc;
+	mqc_enc_load(mqc, &enc);
+	mqc_enc_bypass(&enc, d);
+	mqc_enc_store(mqc, &enc);
 }
 
 int mqc_bypass_flush_enc(opj_mqc_t *mqc) {
@@ -509,72 +327,36 @@ void mqc_segmark_enc(opj_mqc_t *mqc) {
 }
 
 void mqc_init_dec(opj_mqc_t *mqc, unsigned char *bp, int len) {
+	opj_mqc_dec_t dec;
 	mqc_setcurctx(mqc, 0);
 	mqc->start = bp;
 	mqc->end = bp + len;
 	mqc->bp = bp;
-	if (len==0) mqc->c = 0xff << 16;
-	else mqc->c = *mqc->bp << 16;
-
-#ifdef MQC_PERF_OPT
-	{
-		unsigned int c;
-		unsigned int *ip;
-		unsigned char *end = mqc->end - 1;
-		mqc->buffer = opj_realloc(mqc->buffer, (len + 1) * sizeof(unsigned int));
-		ip = (unsigned int *) mqc->buffer;
-
-		while (bp < end) {
-			c = *(bp + 1);
-			if (*bp == 0xff) {
-				if (c > 0x8f) {
-					break;
-				} else {
-					*ip = 0x00000017 | (c << 9);
-				}
-			} else {
-				*ip = 0x00000018 | (c << 8);
-			}
-			bp++;
-			ip++;
-		}
-
-		/* Handle last byte of data */
-		c = 0xff;
-		if (*bp == 0xff) {
-			*ip = 0x0000ff18;
-		} else {
-			bp++;
-			*ip = 0x00000018 | (c << 8);
-		}
-		ip++;
+	/* a 0xff followed by a byte above 0x8f is a marker, the decoder stops there */
+	memcpy(mqc->backup, mqc->end, MQC_SENTINEL_LEN);
+	memset(mqc->end, 0xff, MQC_SENTINEL_LEN);
+	mqc->c = *mqc->bp << 16;
+
+	mqc_dec_load(mqc, &dec);
+	mqc_dec_bytein(&dec);
+	dec.c <<= 7;
+	dec.ct -= 7;
+	dec.a = 0x8000;
+	mqc_dec_store(mqc, &dec);
+}
 
-		*ip = 0x0000ff08;
-		mqc->bp = mqc->buffer;
-	}
-#endif
-	mqc_bytein(mqc);
-	mqc->c <<= 7;
-	mqc->ct -= 7;
-	mqc->a = 0x8000;
+void mqc_finish_dec(opj_mqc_t *mqc) {
+	memcpy(mqc->end, mqc->backup, MQC_SENTINEL_LEN);
+	/* a pass decoded without a new mqc_init_dec only sees the end of the data */
+	mqc->bp = (unsigned char*) mqc_end_marker;
 }
 
 int mqc_decode(opj_mqc_t *const mqc) {
+	opj_mqc_dec_t dec;
 	int d;
-	mqc->a -= (*mqc->curctx)->qeval;
-	if ((mqc->c >> 16) < (*mqc->curctx)->qeval) {
-		d = mqc_lpsexchange(mqc);
-		mqc_renormd(mqc);
-	} else {
-		mqc->c -= (*mqc->curctx)->qeval << 16;
-		if ((mqc->a & 0x8000) == 0) {
-			d = mqc_mpsexchange(mqc);
-			mqc_renormd(mqc);
-		} else {
-			d = (*mqc->curctx)->mps;
-		}
-	}
-
+	mqc_dec_load(mqc, &dec);
+	d = mqc_dec_decode(&dec, (int)(mqc->curctx - mqc->ctxs));
+	mqc_dec_store(mqc, &dec);
 	return d;
 }
 
@@ -31,6 +31,9 @@
 
 #ifndef __MQC_H
 #define __MQC_H
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 /**
 @file mqc.h
 @brief Implementation of an MQ-Coder (MQC)
@@ -51,13 +54,19 @@ typedef struct opj_mqc_state {
 	/** the Most Probable Symbol (0 or 1) */
 	int mps;
 	/** next state if the next encoded symbol is the MPS */
-	struct opj_mqc_state *nmps;
+	const struct opj_mqc_state *nmps;
 	/** next state if the next encoded symbol is the LPS */
-	struct opj_mqc_state *nlps;
+	const struct opj_mqc_state *nlps;
 } opj_mqc_state_t;
 
 #define MQC_NUMCTXS 19
 
+/**
+Number of bytes the decoder overwrites past the end of a segment. The buffer a segment
+is read from must have that many bytes of slack after its last byte.
+*/
+#define MQC_SENTINEL_LEN 2
+
 /**
 MQ coder
 */
@@ -68,13 +77,38 @@ typedef struct opj_mqc {
 	unsigned char *bp;
 	unsigned char *start;
 	unsigned char *end;
-	opj_mqc_state_t *ctxs[MQC_NUMCTXS];
-	opj_mqc_state_t **curctx;
-#ifdef MQC_PERF_OPT
-	unsigned char *buffer;
-#endif
+	const opj_mqc_state_t *ctxs[MQC_NUMCTXS];
+	const opj_mqc_state_t **curctx;
+	/** bytes of the buffer hidden by the end of segment marker while decoding */
+	unsigned char backup[MQC_SENTINEL_LEN];
 } opj_mqc_t;
 
+/**
+Registers of the MQ decoder. A tier-1 pass copies them out of the opj_mqc_t with
+mqc_dec_load, decodes every symbol of the pass through a local copy, so that the
+compiler can keep A, C, CT and the byte pointer in registers, and writes them back
+with mqc_dec_store.
+*/
+typedef struct opj_mqc_dec {
+	unsigned int c;
+	unsigned int a;
+	unsigned int ct;
+	unsigned char *bp;
+	const opj_mqc_state_t **ctxs;
+} opj_mqc_dec_t;
+
+/**
+Registers of the MQ encoder, used by the tier-1 passes the same way as opj_mqc_dec_t
+through mqc_enc_load and mqc_enc_store
+*/
+typedef struct opj_mqc_enc {
+	unsigned int c;
+	unsigned int a;
+	unsigned int ct;
+	unsigned char *bp;
+	const opj_mqc_state_t **ctxs;
+} opj_mqc_enc_t;
+
 /** @name Exported functions */
 /*@{*/
 /* ----------------------------------------------------------------------- */
@@ -183,10 +217,17 @@ void mqc_segmark_enc(opj_mqc_t *mqc);
 Initialize the decoder
 @param mqc MQC handle
 @param bp Pointer to the start of the buffer from which the bytes will be read
-@param len Length of the input buffer
+@param len Length of the input buffer, which must be followed by MQC_SENTINEL_LEN bytes
+that stay overwritten until mqc_finish_dec
 */
 void mqc_init_dec(opj_mqc_t *mqc, unsigned char *bp, int len);
 /**
+Terminate the decoding of the segment set up by mqc_init_dec, putting back the
+bytes that the end of segment marker replaced
+@param mqc MQC handle
+*/
+void mqc_finish_dec(opj_mqc_t *mqc);
+/**
 Decode a symbol
 @param mqc MQC handle
 @return Returns the decoded symbol (0 or 1)
@@ -195,6 +236,232 @@ int mqc_decode(opj_mqc_t *const mqc);
 /* ----------------------------------------------------------------------- */
 /*@}*/
 
+/** @name Coder inline functions */
+/*@{*/
+/* ----------------------------------------------------------------------- */
+/**
+Count the shifts that bring A back to 0x8000 or above
+@param a Interval register, between 1 and 0x7fff
+@return Returns the number of shifts
+*/
+static INLINE unsigned int mqc_renorm_shift(unsigned int a) {
+#if defined(__GNUC__)
+	return __builtin_clz(a) - 16;
+#elif defined(_MSC_VER)
+	unsigned long msb;
+	_BitScanReverse(&msb, a);
+	return 15 - msb;
+#else
+	unsigned int n = 0;
+	do {
+		n++;
+	} while ((a << n) < 0x8000);
+	return n;
+#endif
+}
+/**
+Copy the decoder registers out of an MQC handle
+@param mqc MQC handle
+@param dec Local decoder registers
+*/
+static INLINE void mqc_dec_load(opj_mqc_t *mqc, opj_mqc_dec_t *dec) {
+	dec->c = mqc->c;
+	dec->a = mqc->a;
+	dec->ct = mqc->ct;
+	dec->bp = mqc->bp;
+	dec->ctxs = mqc->ctxs;
+}
+/**
+Write the decoder registers back to an MQC handle
+@param mqc MQC handle
+@param dec Local decoder registers
+*/
+static INLINE void mqc_dec_store(opj_mqc_t *mqc, const opj_mqc_dec_t *dec) {
+	mqc->c = dec->c;
+	mqc->a = dec->a;
+	mqc->ct = dec->ct;
+	mqc->bp = dec->bp;
+}
+/**
+Input a byte. mqc_init_dec ends the segment with 0xff 0xff, a marker the decoder
+never reads past, so there is no bounds check: at the end of the data the decoder
+keeps feeding 1's as the standard requires.
+@param dec Local decoder registers
+*/
+static INLINE void mqc_dec_bytein(opj_mqc_dec_t *dec) {
+	if (dec->bp[0] == 0xff) {
+		if (dec->bp[1] > 0x8f) {
+			dec->c += 0xff00;
+			dec->ct = 8;
+		} else {
+			dec->bp++;
+			dec->c += dec->bp[0] << 9;
+			dec->ct = 7;
+		}
+	} else {
+		dec->bp++;
+		dec->c += dec->bp[0] << 8;
+		dec->ct = 8;
+	}
+}
+/**
+Renormalize A and C after a symbol that left A below 0x8000. The number of shifts is
+counted once instead of shifting bit by bit, and bytes are read whenever CT runs out.
+@param dec Local decoder registers
+*/
+static INLINE void mqc_dec_renorm(opj_mqc_dec_t *dec) {
+	unsigned int n = mqc_renorm_shift(dec->a);
+	while (n > dec->ct) {
+		dec->a <<= dec->ct;
+		dec->c <<= dec->ct;
+		n -= dec->ct;
+		mqc_dec_bytein(dec);
+	}
+	dec->a <<= n;
+	dec->c <<= n;
+	dec->ct -= n;
+}
+/**
+Decode a symbol
+@param dec Local decoder registers
+@param ctxno Number that identifies the context
+@return Returns the decoded symbol (0 or 1)
+*/
+static INLINE int mqc_dec_decode(opj_mqc_dec_t *dec, int ctxno) {
+	const opj_mqc_state_t **curctx = &dec->ctxs[ctxno];
+	const opj_mqc_state_t *state = *curctx;
+	unsigned int qeval = state->qeval;
+	int lps;
+	dec->a -= qeval;
+	if ((dec->c >> 16) < qeval) {
+		/* LPS interval, the symbol is the MPS if the sub-intervals are exchanged */
+		lps = dec->a >= qeval;
+		dec->a = qeval;
+	} else {
+		dec->c -= qeval << 16;
+		if (dec->a & 0x8000) {
+			return state->mps;
+		}
+		/* MPS interval, exchanged with the LPS one if it became the smaller */
+		lps = dec->a < qeval;
+	}
+	*curctx = lps ? state->nlps : state->nmps;
+	mqc_dec_renorm(dec);
+	return state->mps ^ lps;
+}
+/**
+Copy the encoder registers out of an MQC handle
+@param mqc MQC handle
+@param enc Local encoder registers
+*/
+static INLINE void mqc_enc_load(opj_mqc_t *mqc, opj_mqc_enc_t *enc) {
+	enc->c = mqc->c;
+	enc->a = mqc->a;
+	enc->ct = mqc->ct;
+	enc->bp = mqc->bp;
+	enc->ctxs = mqc->ctxs;
+}
+/**
+Write the encoder registers back to an MQC handle
+@param mqc MQC handle
+@param enc Local encoder registers
+*/
+static INLINE void mqc_enc_store(opj_mqc_t *mqc, const opj_mqc_enc_t *enc) {
+	mqc->c = enc->c;
+	mqc->a = enc->a;
+	mqc->ct = enc->ct;
+	mqc->bp = enc->bp;
+}
+/**
+Output a byte, doing bit-stuffing if necessary.
+After a 0xff byte, the next byte must be smaller than 0x90, so only 7 bits are output.
+@param enc Local encoder registers
+*/
+static INLINE void mqc_enc_byteout(opj_mqc_enc_t *enc) {
+	if (enc->bp[0] != 0xff && (enc->c & 0x8000000)) {
+		/* propagate the carry into the byte already output */
+		enc->bp[0]++;
+		enc->c &= 0x7ffffff;
+	}
+	enc->bp++;
+	if (enc->bp[-1] == 0xff) {
+		enc->bp[0] = (unsigned char)(enc->c >> 20);
+		enc->c &= 0xfffff;
+		enc->ct = 7;
+	} else {
+		enc->bp[0] = (unsigned char)(enc->c >> 19);
+		enc->c &= 0x7ffff;
+		enc->ct = 8;
+	}
+}
+/**
+Renormalize A and C after a symbol that left A below 0x8000, outputting a byte
+each time CT runs out, so the bits of C go out 7 or 8 at a time
+@param enc Local encoder registers
+*/
+static INLINE void mqc_enc_renorm(opj_mqc_enc_t *enc) {
+	unsigned int n = mqc_renorm_shift(enc->a);
+	while (n >= enc->ct) {
+		enc->a <<= enc->ct;
+		enc->c <<= enc->ct;
+		n -= enc->ct;
+		mqc_enc_byteout(enc);
+	}
+	enc->a <<= n;
+	enc->c <<= n;
+	enc->ct -= n;
+}
+/**
+Encode a symbol
+@param enc Local encoder registers
+@param ctxno Number that identifies the context
+@param d The symbol to be encoded (0 or 1)
+*/
+static INLINE void mqc_enc_encode(opj_mqc_enc_t *enc, int ctxno, int d) {
+	const opj_mqc_state_t **curctx = &enc->ctxs[ctxno];
+	const opj_mqc_state_t *state = *curctx;
+	unsigned int qeval = state->qeval;
+	enc->a -= qeval;
+	if (state->mps == d) {
+		if (enc->a & 0x8000) {
+			enc->c += qeval;
+			return;
+		}
+		/* the MPS takes the larger of the two sub-intervals */
+		if (enc->a < qeval) {
+			enc->a = qeval;
+		} else {
+			enc->c += qeval;
+		}
+		*curctx = state->nmps;
+	} else {
+		if (enc->a < qeval) {
+			enc->c += qeval;
+		} else {
+			enc->a = qeval;
+		}
+		*curctx = state->nlps;
+	}
+	mqc_enc_renorm(enc);
+}
+/**
+BYPASS mode switch, coding operation
+@param enc Local encoder registers
+@param d The symbol to be encoded (0 or 1)
+*/
+static INLINE void mqc_enc_bypass(opj_mqc_enc_t *enc, int d) {
+	enc->ct--;
+	enc->c += d << enc->ct;
+	if (enc->ct == 0) {
+		enc->bp++;
+		enc->bp[0] = (unsigned char)enc->c;
+		enc->ct = enc->bp[0] == 0xff ? 7 : 8;
+		enc->c = 0;
+	}
+}
+/* ----------------------------------------------------------------------- */
+/*@}*/
+
 /*@}*/
 
 #endif /* __MQC_H */
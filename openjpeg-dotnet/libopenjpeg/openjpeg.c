@@ -122,6 +122,7 @@ void OPJ_CALLCONV opj_set_default_decoder_parameters(opj_dparameters_t *paramete
 		parameters->cp_layer = 0;
 		parameters->cp_reduce = 0;
 		parameters->cp_limit_decoding = NO_LIMITATION;
+		parameters->cp_num_threads = 1;
 
 		parameters->decod_format = -1;
 		parameters->cod_format = -1;
@@ -250,6 +251,7 @@ void OPJ_CALLCONV opj_set_default_encoder_parameters(opj_cparameters_t *paramete
 		parameters->cp_fixed_alloc = 0;
 		parameters->cp_fixed_quality = 0;
 		parameters->jpip_on = OPJ_FALSE;
+		parameters->cp_num_threads = 1;
 /* UniPG>> */
 #ifdef USE_JPWL
 		parameters->jpwl_epc_on = OPJ_FALSE;
@@ -151,9 +151,29 @@ Limit decoding to certain portions of the codestream.
 typedef enum LIMIT_DECODING {
 	NO_LIMITATION = 0,				  /**< No limitation for the decoding. The entire codestream will de decoded */
 	LIMIT_TO_MAIN_HEADER = 1,		/**< The decoding is limited to the Main Header */
-	DECODE_ALL_BUT_PACKETS = 2	/**< Decode everything except the JPEG 2000 packets */
+	DECODE_ALL_BUT_PACKETS = 2,	/**< Decode everything except the JPEG 2000 packets */
+	LIMIT_TO_PACKET_HEADERS = 3	/**< Only parse the packet headers, to index the codestream: no code-block data is copied and no tier-1, DWT or MCT is run */
 } OPJ_LIMIT_DECODING;
 
+/** 
+Where the decoder stores the decoded samples, or where the encoder reads the samples to encode. 
+*/
+typedef enum OUTPUT_FORMAT {
+	OUTPUT_PLANAR = 0,	/**< One plane of ints per component, in the components of the returned image */
+	OUTPUT_RGBA = 1,		/**< 8 bit interleaved red, green, blue and alpha in a caller supplied buffer */
+	OUTPUT_BGRA = 2			/**< 8 bit interleaved blue, green, red and alpha in a caller supplied buffer */
+} OPJ_OUTPUT_FORMAT;
+
+/** 
+Instruction sets the DWT, MCT, tier-1 and output kernels are run with, see opj_set_simd_level
+*/
+typedef enum SIMD_LEVEL {
+	OPJ_SIMD_SCALAR = 0,	/**< Plain C */
+	OPJ_SIMD_SSE2 = 1,		/**< SSE2, 4 floats or ints per instruction */
+	OPJ_SIMD_AVX2 = 2,		/**< AVX2, 8 floats or ints per instruction */
+	OPJ_SIMD_AVX512 = 3		/**< AVX-512F, 16 floats or ints per instruction */
+} OPJ_SIMD_LEVEL;
+
 /* 
 ==========================================================
    event manager typedef definitions
@@ -349,6 +369,26 @@ typedef struct opj_cparameters {
 	char tcp_mct;
 	/** Enable JPIP indexing*/
 	opj_bool jpip_on;
+	/** 
+	Most threads encoding one image, the code-blocks of a tile are encoded at the same time when this is not 1. 
+	The codestream is the same whatever the value. 
+	if == 1 (default), everything runs on the calling thread; 
+	if == 0, one thread per processor is used 
+	*/
+	int cp_num_threads;
+	/** 
+	Specify where the samples to encode come from. 
+	if == OUTPUT_PLANAR (default), they are read from the components of the image; 
+	if == OUTPUT_RGBA or OUTPUT_BGRA, they are read from cp_input as 8 bit interleaved pixels 
+	and the image, made with opj_image_create_header, needs no component data. This needs 1 to 4 
+	unsigned 8 bit components the size of the image: a single component is read from red, two 
+	from red and alpha. The DC level shift and the MCT are done while the pixels are read 
+	*/
+	OPJ_OUTPUT_FORMAT cp_input_format;
+	/** source of the interleaved pixels, cp_input_stride times the image height bytes */
+	const unsigned char *cp_input;
+	/** number of bytes between the starts of two rows of cp_input */
+	int cp_input_stride;
 } opj_cparameters_t;
 
 #define OPJ_DPARAMETERS_IGNORE_PCLR_CMAP_CDEF_FLAG	0x0001
@@ -402,9 +442,33 @@ typedef struct opj_dparameters {
 	Limiting the decoding to the main header makes it possible to extract the characteristics of the codestream
 	if == NO_LIMITATION, the entire codestream is decoded; 
 	if == LIMIT_TO_MAIN_HEADER, only the main header is decoded; 
+	if == LIMIT_TO_PACKET_HEADERS, the packet headers are parsed to fill the codestream index but no pixels are decoded; 
 	*/
 	OPJ_LIMIT_DECODING cp_limit_decoding;
 
+	/** 
+	Specify where the decoded samples go. 
+	if == OUTPUT_PLANAR, they are stored in the components of the returned image; 
+	if == OUTPUT_RGBA or OUTPUT_BGRA, they are written to cp_output as 8 bit interleaved pixels 
+	and the component data of the returned image is left NULL. This needs 1 to 4 unsigned 8 bit 
+	components of the same size: a gray component is copied to red, green and blue, a missing 
+	alpha is written as 255 and a fifth component is not output 
+	*/
+	OPJ_OUTPUT_FORMAT cp_output_format;
+	/** destination of the interleaved pixels, cp_output_stride times cp_output_height bytes */
+	unsigned char *cp_output;
+	/** number of bytes between the starts of two rows of cp_output */
+	int cp_output_stride;
+	/** number of rows of cp_output, no tile is decoded unless the (reduced) image fits in them */
+	int cp_output_height;
+
+	/** 
+	Most threads decoding one image, tiles and the code-blocks of a tile are decoded at the same time when this is not 1. 
+	if == 1 (default), everything runs on the calling thread; 
+	if == 0, one thread per processor is used 
+	*/
+	int cp_num_threads;
+
 	unsigned int flags;
 } opj_dparameters_t;
 
@@ -727,6 +791,27 @@ extern "C" {
 
 OPJ_API const char * OPJ_CALLCONV opj_version(void);
 
+/* 
+==========================================================
+   SIMD kernels selection
+==========================================================
+*/
+
+/**
+Get the instruction set the kernels run with. It is the widest level supported by both
+the processor and the compiler, unless the OPJ_SIMD environment variable (scalar, sse2,
+avx2 or avx512) or opj_set_simd_level asked for a lower one.
+@return returns one of the OPJ_SIMD_LEVEL values
+*/
+OPJ_API int OPJ_CALLCONV opj_get_simd_level(void);
+/**
+Run the kernels with a lower instruction set, to compare the levels. The selection is
+process wide and should not change while an image is being encoded or decoded.
+@param level One of the OPJ_SIMD_LEVEL values, or -1 to go back to the default level
+@return returns the level in effect, which is never above what the processor supports
+*/
+OPJ_API int OPJ_CALLCONV opj_set_simd_level(int level);
+
 /* 
 ==========================================================
    image functions definitions
@@ -742,6 +827,16 @@ Create an image
 */
 OPJ_API opj_image_t* OPJ_CALLCONV opj_image_create(int numcmpts, opj_image_cmptparm_t *cmptparms, OPJ_COLOR_SPACE clrspc);
 
+/**
+Create an image as opj_image_create does, without allocating the data of the components. 
+This is what an encoder reading interleaved pixels from cp_input needs.
+@param numcmpts number of components
+@param cmptparms components parameters
+@param clrspc image color space
+@return returns a new image structure if successful, returns NULL otherwise
+*/
+OPJ_API opj_image_t* OPJ_CALLCONV opj_image_create_header(int numcmpts, opj_image_cmptparm_t *cmptparms, OPJ_COLOR_SPACE clrspc);
+
 /**
 Deallocate any resources associated with an image
 @param image image to be destroyed
@@ -800,7 +895,11 @@ OPJ_API opj_event_mgr_t* OPJ_CALLCONV opj_set_event_mgr(opj_common_ptr cinfo, op
 ==========================================================
 */
 /**
-Creates a J2K/JPT/JP2 decompression structure
+Creates a J2K/JPT/JP2 decompression structure.
+A J2K or JPT decompressor can decode several codestreams one after the other, 
+opj_setup_decoder is called again before each of them. It keeps its tile structures 
+and scratch memory until opj_destroy_decompress, so that images of the same size 
+are decoded without allocating them again.
 @param format Decoder to select
 @return Returns a handle to a decompressor if successful, returns NULL otherwise
 */
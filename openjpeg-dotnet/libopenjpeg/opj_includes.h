@@ -104,8 +104,11 @@ static INLINE long lrintf(float f){
 }
 #endif
 
+/* before opj_malloc.h, the intrinsics headers use malloc */
+#include "cpu.h"
 #include "j2k_lib.h"
 #include "opj_malloc.h"
+#include "arena.h"
 #include "event.h"
 #include "bio.h"
 #include "cio.h"
@@ -120,6 +123,8 @@ static INLINE long lrintf(float f){
 #include "bio.h"
 #include "tgt.h"
 #include "pi.h"
+/* before tcd.h, the scratch memory is kept per thread */
+#include "thread.h"
 #include "tcd.h"
 #include "t1.h"
 #include "dwt.h"
@@ -128,10 +128,10 @@ Create a packet iterator for Decoder
 @param image Raw image for which the packets will be listed
 @param cp Coding parameters
 @param tileno Number that identifies the tile for which to list the packets
+@param arena Arena the packet iterator is taken from, it is released with the arena
 @return Returns a packet iterator that points to the first packet of the tile
-@see pi_destroy
 */
-opj_pi_iterator_t *pi_create_decode(opj_image_t * image, opj_cp_t * cp, int tileno);
+opj_pi_iterator_t *pi_create_decode(opj_image_t * image, opj_cp_t * cp, int tileno, opj_arena_t *arena);
 
 /**
 Destroy a packet iterator
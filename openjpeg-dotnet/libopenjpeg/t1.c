@@ -36,21 +36,106 @@
 /** @defgroup T1 T1 - Implementation of the tier-1 coding */
 /*@{*/
 
+/**
+A code-block to decode and where its coefficients go in the tile component
+*/
+typedef struct opj_t1_dec_cblk {
+	opj_tcd_cblk_dec_t *cblk;
+	opj_tcd_band_t *band;
+	/** position of the code-block in the tile component */
+	int x, y;
+} opj_t1_dec_cblk_t;
+
+/**
+Dequantization kernels of one instruction set level, see t1_get_kernels
+*/
+typedef struct opj_t1_kernels {
+	/** halve a row of reversible coefficients, rounding toward zero */
+	void (*dequant_int)(int* restrict dst, const int* restrict src, int n);
+	/** scale a row of irreversible coefficients by the step size of their band */
+	void (*dequant_real)(float* restrict dst, const int* restrict src, int n, float stepsize);
+} opj_t1_kernels_t;
+
+/**
+MQ decoding passes compiled for one band orientation and code-block style, see t1_dec_passes
+*/
+typedef struct opj_t1_dec_passes {
+	/** significance propagation pass */
+	void (*sigpass)(opj_t1_t *t1, int bpno);
+	/** magnitude refinement pass */
+	void (*refpass)(opj_t1_t *t1, int bpno);
+	/** clean-up pass, followed by a segmentation symbol if segsym is set */
+	void (*clnpass)(opj_t1_t *t1, int bpno, int segsym);
+} opj_t1_dec_passes_t;
+
+/**
+Code-blocks of one tile component shared by the threads decoding them
+*/
+typedef struct opj_t1_dec_job {
+	opj_t1_dec_cblk_t *cblks;
+	opj_tcd_tilecomp_t *tilec;
+	opj_tccp_t *tccp;
+	const opj_t1_kernels_t *kernels;
+	/** scratch of each thread, kept by the tile decoder, created on first use except the caller's one */
+	opj_t1_t **t1s;
+	/** set by a thread that could not allocate the memory of a code-block */
+	opj_bool failed[OPJ_MAX_THREADS];
+} opj_t1_dec_job_t;
+
+/**
+A code-block to encode and where its coefficients are in the tile component
+*/
+typedef struct opj_t1_enc_cblk {
+	opj_tcd_cblk_enc_t *cblk;
+	opj_tcd_band_t *band;
+	int compno;
+	int resno;
+	/** position of the code-block in the tile component */
+	int x, y;
+} opj_t1_enc_cblk_t;
+
+/**
+Code-blocks of one tile shared by the threads encoding them
+*/
+typedef struct opj_t1_enc_job {
+	opj_t1_enc_cblk_t *cblks;
+	opj_tcd_tile_t *tile;
+	opj_tcp_t *tcp;
+	/** scratch of each thread, created on first use except the caller's one */
+	opj_t1_t *t1s[OPJ_MAX_THREADS];
+} opj_t1_enc_job_t;
+
 /** @name Local static functions */
 /*@{*/
 
-static INLINE char t1_getctxno_zc(int f, int orient);
-static char t1_getctxno_sc(int f);
-static INLINE int t1_getctxno_mag(int f);
-static char t1_getspb(int f);
+static INLINE char t1_getctxno_zc(flag_t f, int orient);
+/**
+Get the index of the sign coding context and sign prediction of a sample in
+lut_ctxno_sc and lut_spb
+@param flagsp Flags of the stripe column of the sample
+@param ci Row of the sample in the stripe
+*/
+static INLINE int t1_getsgnidx(const flag_t *flagsp, int ci);
+static INLINE char t1_getctxno_sc(int lu);
+static INLINE int t1_getctxno_mag(flag_t f);
+static INLINE char t1_getspb(int lu);
 static short t1_getnmsedec_sig(int x, int bitpos);
 static short t1_getnmsedec_ref(int x, int bitpos);
-static void t1_updateflags(flag_t *flagsp, int s, int stride);
+/**
+Mark a sample as significant in the flags of its stripe column and of the columns around
+@param flagsp Flags of the stripe column of the sample
+@param ci Row of the sample in the stripe
+@param s Sign of the sample, 1 if negative
+@param stride Number of flags of a stripe
+@param vsc Whether the stripe above does not see the sample (vertically causal contexts)
+*/
+static INLINE void t1_updateflags(flag_t *flagsp, int ci, int s, int stride, int vsc);
 /**
 Encode significant pass
 */
-static void t1_enc_sigpass_step(
+static INLINE void t1_enc_sigpass_step(
 		opj_t1_t *t1,
+		opj_mqc_enc_t *enc,
 		flag_t *flagsp,
 		int *datap,
 		int orient,
@@ -58,6 +143,7 @@ static void t1_enc_sigpass_step(
 		int one,
 		int *nmsedec,
 		char type,
+		int ci,
 		int vsc);
 /**
 Decode significant pass
@@ -66,21 +152,17 @@ static INLINE void t1_dec_sigpass_step_raw(
 		opj_t1_t *t1,
 		flag_t *flagsp,
 		int *datap,
-		int orient,
 		int oneplushalf,
+		int ci,
 		int vsc);
 static INLINE void t1_dec_sigpass_step_mqc(
 		opj_t1_t *t1,
-		flag_t *flagsp,
-		int *datap,
-		int orient,
-		int oneplushalf);
-static INLINE void t1_dec_sigpass_step_mqc_vsc(
-		opj_t1_t *t1,
+		opj_mqc_dec_t *dec,
 		flag_t *flagsp,
 		int *datap,
 		int orient,
 		int oneplushalf,
+		int ci,
 		int vsc);
 /**
 Encode significant pass
@@ -98,28 +180,25 @@ Decode significant pass
 static void t1_dec_sigpass_raw(
 		opj_t1_t *t1,
 		int bpno,
-		int orient,
 		int cblksty);
-static void t1_dec_sigpass_mqc(
+static INLINE void t1_dec_sigpass_mqc(
 		opj_t1_t *t1,
 		int bpno,
-		int orient);
-static void t1_dec_sigpass_mqc_vsc(
-		opj_t1_t *t1,
-		int bpno,
-		int orient);
+		int orient,
+		int vsc);
 /**
 Encode refinement pass
 */
-static void t1_enc_refpass_step(
+static INLINE void t1_enc_refpass_step(
 		opj_t1_t *t1,
+		opj_mqc_enc_t *enc,
 		flag_t *flagsp,
 		int *datap,
 		int bpno,
 		int one,
 		int *nmsedec,
 		char type,
-		int vsc);
+		int ci);
 /**
 Decode refinement pass
 */
@@ -129,20 +208,15 @@ static INLINE void t1_dec_refpass_step_raw(
 		int *datap,
 		int poshalf,
 		int neghalf,
-		int vsc);
+		int ci);
 static INLINE void t1_dec_refpass_step_mqc(
 		opj_t1_t *t1,
-		flag_t *flagsp,
-		int *datap,
-		int poshalf,
-		int neghalf);
-static INLINE void t1_dec_refpass_step_mqc_vsc(
-		opj_t1_t *t1,
+		opj_mqc_dec_t *dec,
 		flag_t *flagsp,
 		int *datap,
 		int poshalf,
 		int neghalf,
-		int vsc);
+		int ci);
 
 /**
 Encode refinement pass
@@ -151,26 +225,22 @@ static void t1_enc_refpass(
 		opj_t1_t *t1,
 		int bpno,
 		int *nmsedec,
-		char type,
-		int cblksty);
+		char type);
 /**
 Decode refinement pass
 */
 static void t1_dec_refpass_raw(
-		opj_t1_t *t1,
-		int bpno,
-		int cblksty);
-static void t1_dec_refpass_mqc(
 		opj_t1_t *t1,
 		int bpno);
-static void t1_dec_refpass_mqc_vsc(
+static void t1_dec_refpass_mqc(
 		opj_t1_t *t1,
 		int bpno);
 /**
 Encode clean-up pass
 */
-static void t1_enc_clnpass_step(
+static INLINE void t1_enc_clnpass_step(
 		opj_t1_t *t1,
+		opj_mqc_enc_t *enc,
 		flag_t *flagsp,
 		int *datap,
 		int orient,
@@ -178,29 +248,27 @@ static void t1_enc_clnpass_step(
 		int one,
 		int *nmsedec,
 		int partial,
+		int ci,
 		int vsc);
 /**
 Decode clean-up pass
 */
-static void t1_dec_clnpass_step_partial(
-		opj_t1_t *t1,
-		flag_t *flagsp,
-		int *datap,
-		int orient,
-		int oneplushalf);
-static void t1_dec_clnpass_step(
+static INLINE void t1_dec_clnpass_step_partial(
 		opj_t1_t *t1,
+		opj_mqc_dec_t *dec,
 		flag_t *flagsp,
 		int *datap,
-		int orient,
-		int oneplushalf);
-static void t1_dec_clnpass_step_vsc(
+		int oneplushalf,
+		int ci,
+		int vsc);
+static INLINE void t1_dec_clnpass_step(
 		opj_t1_t *t1,
+		opj_mqc_dec_t *dec,
 		flag_t *flagsp,
 		int *datap,
 		int orient,
 		int oneplushalf,
-		int partial,
+		int ci,
 		int vsc);
 /**
 Encode clean-up pass
@@ -212,13 +280,18 @@ static void t1_enc_clnpass(
 		int *nmsedec,
 		int cblksty);
 /**
+Decode the segmentation symbol that ends a clean-up pass with SEGSYM
+*/
+static INLINE void t1_dec_segsym(opj_mqc_dec_t *dec);
+/**
 Decode clean-up pass
 */
-static void t1_dec_clnpass(
+static INLINE void t1_dec_clnpass_mqc(
 		opj_t1_t *t1,
 		int bpno,
 		int orient,
-		int cblksty);
+		int segsym,
+		int vsc);
 static double t1_getwmsedec(
 		int nmsedec,
 		int compno,
@@ -241,7 +314,6 @@ Encode 1 code-block
 @param cblksty Code-block style
 @param numcomps
 @param mct
-@param tile
 */
 static void t1_encode_cblk(
 		opj_t1_t *t1,
@@ -253,8 +325,7 @@ static void t1_encode_cblk(
 		double stepsize,
 		int cblksty,
 		int numcomps,
-		int mct,
-		opj_tcd_tile_t * tile);
+		int mct);
 /**
 Decode 1 code-block
 @param t1 T1 handle
@@ -262,13 +333,61 @@ Decode 1 code-block
 @param orient
 @param roishift Region of interest shifting value
 @param cblksty Code-block style
+@return Returns false if the buffers of the code-block could not be allocated
 */
-static void t1_decode_cblk(
+static opj_bool t1_decode_cblk(
 		opj_t1_t *t1,
 		opj_tcd_cblk_dec_t* cblk,
 		int orient,
 		int roishift,
 		int cblksty);
+/**
+Decode one code-block of a opj_t1_dec_job_t and dequantize it into the tile
+component, run on the thread pool
+@param user_data The opj_t1_dec_job_t
+@param index Index of the code-block in the job
+@param slot Thread slot, selects the T1 handle
+*/
+static void t1_decode_cblk_job(void *user_data, int index, int slot);
+/**
+Copy a row of decoded reversible coefficients to the tile component
+@param dst First sample of the row in the tile component
+@param src First coefficient of the row in the code-block
+@param n Number of coefficients
+*/
+static void t1_dequant_int_c(int* restrict dst, const int* restrict src, int n);
+/**
+Copy a row of decoded irreversible coefficients to the tile component as floats
+@param dst First sample of the row in the tile component
+@param src First coefficient of the row in the code-block
+@param n Number of coefficients
+@param stepsize Quantization step size of the band
+*/
+static void t1_dequant_real_c(float* restrict dst, const int* restrict src, int n, float stepsize);
+#ifdef OPJ_KERNELS_SSE2
+static void t1_dequant_int_sse2(int* restrict dst, const int* restrict src, int n);
+static void t1_dequant_real_sse2(float* restrict dst, const int* restrict src, int n, float stepsize);
+#endif
+#ifdef OPJ_KERNELS_AVX2
+static void t1_dequant_int_avx2(int* restrict dst, const int* restrict src, int n);
+static void t1_dequant_real_avx2(float* restrict dst, const int* restrict src, int n, float stepsize);
+#endif
+#ifdef OPJ_KERNELS_AVX512
+static void t1_dequant_int_avx512(int* restrict dst, const int* restrict src, int n);
+static void t1_dequant_real_avx512(float* restrict dst, const int* restrict src, int n, float stepsize);
+#endif
+/**
+Get the dequantization kernels of the instruction set level given by opj_cpu_level
+*/
+static const opj_t1_kernels_t* t1_get_kernels(void);
+/**
+Encode one code-block of a opj_t1_enc_job_t from the tile component, run on
+the thread pool
+@param user_data The opj_t1_enc_job_t
+@param index Index of the code-block in the job
+@param slot Thread slot, selects the T1 handle
+*/
+static void t1_encode_cblk_job(void *user_data, int index, int slot);
 
 /*@}*/
 
@@ -276,22 +395,37 @@ static void t1_decode_cblk(
 
 /* ----------------------------------------------------------------------- */
 
-static char t1_getctxno_zc(int f, int orient) {
-	return lut_ctxno_zc[(orient << 8) | (f & T1_SIG_OTH)];
+static char t1_getctxno_zc(flag_t f, int orient) {
+	return lut_ctxno_zc[(orient << 9) | (f & T1_SIGMA_NEIGHBOURS)];
 }
 
-static char t1_getctxno_sc(int f) {
-	return lut_ctxno_sc[(f & (T1_SIG_PRIM | T1_SGN)) >> 4];
+static int t1_getsgnidx(const flag_t *flagsp, int ci) {
+	flag_t f = flagsp[0] >> (3 * ci);
+	flag_t lu = f & (T1_SIGMA_1 | T1_SIGMA_3 | T1_SIGMA_5 | T1_SIGMA_7);
+
+	lu |= (flagsp[-1] >> (T1_CHI_THIS_I + 3 * ci)) & T1_LUT_SGN_W;
+	lu |= (flagsp[1] >> (T1_CHI_THIS_I - 2 + 3 * ci)) & T1_LUT_SGN_E;
+	if (ci == 0) {
+		lu |= (f >> (T1_CHI_0_I - 4)) & T1_LUT_SGN_N;
+	} else {
+		lu |= (f >> (T1_CHI_1_I - 3 - 4)) & T1_LUT_SGN_N;
+	}
+	lu |= (f >> (T1_CHI_2_I - 6)) & T1_LUT_SGN_S;
+	return (int)lu;
 }
 
-static int t1_getctxno_mag(int f) {
-	int tmp1 = (f & T1_SIG_OTH) ? T1_CTXNO_MAG + 1 : T1_CTXNO_MAG;
-	int tmp2 = (f & T1_REFINE) ? T1_CTXNO_MAG + 2 : tmp1;
+static char t1_getctxno_sc(int lu) {
+	return lut_ctxno_sc[lu];
+}
+
+static int t1_getctxno_mag(flag_t f) {
+	int tmp1 = (f & T1_SIGMA_NEIGHBOURS) ? T1_CTXNO_MAG + 1 : T1_CTXNO_MAG;
+	int tmp2 = (f & T1_MU_THIS) ? T1_CTXNO_MAG + 2 : tmp1;
 	return (tmp2);
 }
 
-static char t1_getspb(int f) {
-	return lut_spb[(f & (T1_SIG_PRIM | T1_SGN)) >> 4];
+static char t1_getspb(int lu) {
+	return lut_spb[lu];
 }
 
 static short t1_getnmsedec_sig(int x, int bitpos) {
@@ -310,32 +444,29 @@ static short t1_getnmsedec_ref(int x, int bitpos) {
     return lut_nmsedec_ref0[x & ((1 << T1_NMSEDEC_BITS) - 1)];
 }
 
-static void t1_updateflags(flag_t *flagsp, int s, int stride) {
-	flag_t *np = flagsp - stride;
-	flag_t *sp = flagsp + stride;
-
-	static const flag_t mod[] = {
-		T1_SIG_S, T1_SIG_S|T1_SGN_S,
-		T1_SIG_E, T1_SIG_E|T1_SGN_E,
-		T1_SIG_W, T1_SIG_W|T1_SGN_W,
-		T1_SIG_N, T1_SIG_N|T1_SGN_N
-	};
-
-	np[-1] |= T1_SIG_SE;
-	np[0]  |= mod[s];
-	np[1]  |= T1_SIG_SW;
-
-	flagsp[-1] |= mod[s+2];
-	flagsp[0]  |= T1_SIG;
-	flagsp[1]  |= mod[s+4];
-
-	sp[-1] |= T1_SIG_NE;
-	sp[0]  |= mod[s+6];
-	sp[1]  |= T1_SIG_NW;
+static void t1_updateflags(flag_t *flagsp, int ci, int s, int stride, int vsc) {
+	/* the rows above and below in the same stripe read the bits of this row */
+	flagsp[-1] |= T1_SIGMA_5 << (3 * ci);
+	flagsp[0]  |= (((flag_t)s << T1_CHI_THIS_I) | T1_SIGMA_THIS) << (3 * ci);
+	flagsp[1]  |= T1_SIGMA_3 << (3 * ci);
+
+	if (ci == 0 && !vsc) {
+		flag_t *np = flagsp - stride;
+		np[-1] |= T1_SIGMA_17;
+		np[0]  |= ((flag_t)s << T1_CHI_5_I) | T1_SIGMA_16;
+		np[1]  |= T1_SIGMA_15;
+	}
+	if (ci == 3) {
+		flag_t *sp = flagsp + stride;
+		sp[-1] |= T1_SIGMA_2;
+		sp[0]  |= ((flag_t)s << T1_CHI_0_I) | T1_SIGMA_1;
+		sp[1]  |= T1_SIGMA_0;
+	}
 }
 
-static void t1_enc_sigpass_step(
+static INLINE void t1_enc_sigpass_step(
 		opj_t1_t *t1,
+		opj_mqc_enc_t *enc,
 		flag_t *flagsp,
 		int *datap,
 		int orient,
@@ -343,33 +474,31 @@ static void t1_enc_sigpass_step(
 		int one,
 		int *nmsedec,
 		char type,
+		int ci,
 		int vsc)
 {
-	int v, flag;
-	
-	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
+	int v, lu;
+	flag_t flag = *flagsp >> (3 * ci);
 	
-	flag = vsc ? ((*flagsp) & (~(T1_SIG_S | T1_SIG_SE | T1_SIG_SW | T1_SGN_S))) : (*flagsp);
-	if ((flag & T1_SIG_OTH) && !(flag & (T1_SIG | T1_VISIT))) {
+	if ((flag & T1_SIGMA_NEIGHBOURS) && !(flag & (T1_SIGMA_THIS | T1_PI_THIS))) {
 		v = int_abs(*datap) & one ? 1 : 0;
-		mqc_setcurctx(mqc, t1_getctxno_zc(flag, orient));	/* ESSAI */
 		if (type == T1_TYPE_RAW) {	/* BYPASS/LAZY MODE */
-			mqc_bypass_enc(mqc, v);
+			mqc_enc_bypass(enc, v);
 		} else {
-			mqc_encode(mqc, v);
+			mqc_enc_encode(enc, t1_getctxno_zc(flag, orient), v);
 		}
 		if (v) {
 			v = *datap < 0 ? 1 : 0;
 			*nmsedec +=	t1_getnmsedec_sig(int_abs(*datap), bpno + T1_NMSEDEC_FRACBITS);
-			mqc_setcurctx(mqc, t1_getctxno_sc(flag));	/* ESSAI */
 			if (type == T1_TYPE_RAW) {	/* BYPASS/LAZY MODE */
-				mqc_bypass_enc(mqc, v);
+				mqc_enc_bypass(enc, v);
 			} else {
-				mqc_encode(mqc, v ^ t1_getspb(flag));
+				lu = t1_getsgnidx(flagsp, ci);
+				mqc_enc_encode(enc, t1_getctxno_sc(lu), v ^ t1_getspb(lu));
 			}
-			t1_updateflags(flagsp, v, t1->flags_stride);
+			t1_updateflags(flagsp, ci, v, t1->flags_stride, vsc);
 		}
-		*flagsp |= T1_VISIT;
+		*flagsp |= T1_PI_THIS << (3 * ci);
 	}
 }
 
@@ -377,72 +506,45 @@ static INLINE void t1_dec_sigpass_step_raw(
 		opj_t1_t *t1,
 		flag_t *flagsp,
 		int *datap,
-		int orient,
 		int oneplushalf,
+		int ci,
 		int vsc)
 {
-	int v, flag;
+	int v;
 	opj_raw_t *raw = t1->raw;	/* RAW component */
+	flag_t flag = *flagsp >> (3 * ci);
 	
-	OPJ_ARG_NOT_USED(orient);
-	
-	flag = vsc ? ((*flagsp) & (~(T1_SIG_S | T1_SIG_SE | T1_SIG_SW | T1_SGN_S))) : (*flagsp);
-	if ((flag & T1_SIG_OTH) && !(flag & (T1_SIG | T1_VISIT))) {
+	if ((flag & T1_SIGMA_NEIGHBOURS) && !(flag & (T1_SIGMA_THIS | T1_PI_THIS))) {
 			if (raw_decode(raw)) {
 				v = raw_decode(raw);	/* ESSAI */
 				*datap = v ? -oneplushalf : oneplushalf;
-				t1_updateflags(flagsp, v, t1->flags_stride);
+				t1_updateflags(flagsp, ci, v, t1->flags_stride, vsc);
 			}
-		*flagsp |= T1_VISIT;
+		*flagsp |= T1_PI_THIS << (3 * ci);
 	}
 }				/* VSC and  BYPASS by Antonin */
 
 static INLINE void t1_dec_sigpass_step_mqc(
 		opj_t1_t *t1,
-		flag_t *flagsp,
-		int *datap,
-		int orient,
-		int oneplushalf)
-{
-	int v, flag;
-	
-	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
-	
-	flag = *flagsp;
-	if ((flag & T1_SIG_OTH) && !(flag & (T1_SIG | T1_VISIT))) {
-			mqc_setcurctx(mqc, t1_getctxno_zc(flag, orient));
-			if (mqc_decode(mqc)) {
-				mqc_setcurctx(mqc, t1_getctxno_sc(flag));
-				v = mqc_decode(mqc) ^ t1_getspb(flag);
-				*datap = v ? -oneplushalf : oneplushalf;
-				t1_updateflags(flagsp, v, t1->flags_stride);
-			}
-		*flagsp |= T1_VISIT;
-	}
-}				/* VSC and  BYPASS by Antonin */
-
-static INLINE void t1_dec_sigpass_step_mqc_vsc(
-		opj_t1_t *t1,
+		opj_mqc_dec_t *dec,
 		flag_t *flagsp,
 		int *datap,
 		int orient,
 		int oneplushalf,
+		int ci,
 		int vsc)
 {
-	int v, flag;
-	
-	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
+	int v, lu;
+	flag_t flag = *flagsp >> (3 * ci);
 	
-	flag = vsc ? ((*flagsp) & (~(T1_SIG_S | T1_SIG_SE | T1_SIG_SW | T1_SGN_S))) : (*flagsp);
-	if ((flag & T1_SIG_OTH) && !(flag & (T1_SIG | T1_VISIT))) {
-		mqc_setcurctx(mqc, t1_getctxno_zc(flag, orient));
-		if (mqc_decode(mqc)) {
-			mqc_setcurctx(mqc, t1_getctxno_sc(flag));
-			v = mqc_decode(mqc) ^ t1_getspb(flag);
+	if ((flag & T1_SIGMA_NEIGHBOURS) && !(flag & (T1_SIGMA_THIS | T1_PI_THIS))) {
+		if (mqc_dec_decode(dec, t1_getctxno_zc(flag, orient))) {
+			lu = t1_getsgnidx(flagsp, ci);
+			v = mqc_dec_decode(dec, t1_getctxno_sc(lu)) ^ t1_getspb(lu);
 			*datap = v ? -oneplushalf : oneplushalf;
-			t1_updateflags(flagsp, v, t1->flags_stride);
+			t1_updateflags(flagsp, ci, v, t1->flags_stride, vsc);
 		}
-		*flagsp |= T1_VISIT;
+		*flagsp |= T1_PI_THIS << (3 * ci);
 	}
 }				/* VSC and  BYPASS by Antonin */
 
@@ -455,145 +557,136 @@ static void t1_enc_sigpass(
 		int cblksty)
 {
 	int i, j, k, one, vsc;
+	flag_t *flagsp = &t1->flags[t1->flags_stride + 1];
+	opj_mqc_enc_t enc;
 	*nmsedec = 0;
 	one = 1 << (bpno + T1_NMSEDEC_FRACBITS);
+	vsc = (cblksty & J2K_CCP_CBLKSTY_VSC) ? 1 : 0;
+	mqc_enc_load(t1->mqc, &enc);
 	for (k = 0; k < t1->h; k += 4) {
-		for (i = 0; i < t1->w; ++i) {
+		for (i = 0; i < t1->w; ++i, ++flagsp) {
+			/* nothing significant around the column */
+			if (*flagsp == 0) {
+				continue;
+			}
 			for (j = k; j < k + 4 && j < t1->h; ++j) {
-				vsc = ((cblksty & J2K_CCP_CBLKSTY_VSC) && (j == k + 3 || j == t1->h - 1)) ? 1 : 0;
 				t1_enc_sigpass_step(
 						t1,
-						&t1->flags[((j+1) * t1->flags_stride) + i + 1],
+						&enc,
+						flagsp,
 						&t1->data[(j * t1->w) + i],
 						orient,
 						bpno,
 						one,
 						nmsedec,
 						type,
+						j - k,
 						vsc);
 			}
 		}
+		flagsp += 2;
 	}
+	mqc_enc_store(t1->mqc, &enc);
 }
 
 static void t1_dec_sigpass_raw(
 		opj_t1_t *t1,
 		int bpno,
-		int orient,
 		int cblksty)
 {
 	int i, j, k, one, half, oneplushalf, vsc;
+	flag_t *flagsp = &t1->flags[t1->flags_stride + 1];
 	one = 1 << bpno;
 	half = one >> 1;
 	oneplushalf = one | half;
+	vsc = (cblksty & J2K_CCP_CBLKSTY_VSC) ? 1 : 0;
 	for (k = 0; k < t1->h; k += 4) {
-		for (i = 0; i < t1->w; ++i) {
+		for (i = 0; i < t1->w; ++i, ++flagsp) {
+			if (*flagsp == 0) {
+				continue;
+			}
 			for (j = k; j < k + 4 && j < t1->h; ++j) {
-				vsc = ((cblksty & J2K_CCP_CBLKSTY_VSC) && (j == k + 3 || j == t1->h - 1)) ? 1 : 0;
 				t1_dec_sigpass_step_raw(
 						t1,
-						&t1->flags[((j+1) * t1->flags_stride) + i + 1],
+						flagsp,
 						&t1->data[(j * t1->w) + i],
-						orient,
 						oneplushalf,
+						j - k,
 						vsc);
 			}
 		}
+		flagsp += 2;
 	}
 }				/* VSC and  BYPASS by Antonin */
 
-static void t1_dec_sigpass_mqc(
+static INLINE void t1_dec_sigpass_mqc(
 		opj_t1_t *t1,
 		int bpno,
-		int orient)
+		int orient,
+		int vsc)
 {
 	int i, j, k, one, half, oneplushalf;
 	int *data1 = t1->data;
-	flag_t *flags1 = &t1->flags[1];
+	flag_t *flagsp = &t1->flags[t1->flags_stride + 1];
+	opj_mqc_dec_t dec;
 	one = 1 << bpno;
 	half = one >> 1;
 	oneplushalf = one | half;
+	mqc_dec_load(t1->mqc, &dec);
 	for (k = 0; k < (t1->h & ~3); k += 4) {
-		for (i = 0; i < t1->w; ++i) {
+		for (i = 0; i < t1->w; ++i, ++flagsp) {
 			int *data2 = data1 + i;
-			flag_t *flags2 = flags1 + i;
-			flags2 += t1->flags_stride;
-			t1_dec_sigpass_step_mqc(t1, flags2, data2, orient, oneplushalf);
-			data2 += t1->w;
-			flags2 += t1->flags_stride;
-			t1_dec_sigpass_step_mqc(t1, flags2, data2, orient, oneplushalf);
+			if (*flagsp == 0) {
+				continue;
+			}
+			t1_dec_sigpass_step_mqc(t1, &dec, flagsp, data2, orient, oneplushalf, 0, vsc);
 			data2 += t1->w;
-			flags2 += t1->flags_stride;
-			t1_dec_sigpass_step_mqc(t1, flags2, data2, orient, oneplushalf);
+			t1_dec_sigpass_step_mqc(t1, &dec, flagsp, data2, orient, oneplushalf, 1, vsc);
 			data2 += t1->w;
-			flags2 += t1->flags_stride;
-			t1_dec_sigpass_step_mqc(t1, flags2, data2, orient, oneplushalf);
+			t1_dec_sigpass_step_mqc(t1, &dec, flagsp, data2, orient, oneplushalf, 2, vsc);
 			data2 += t1->w;
+			t1_dec_sigpass_step_mqc(t1, &dec, flagsp, data2, orient, oneplushalf, 3, vsc);
 		}
 		data1 += t1->w << 2;
-		flags1 += t1->flags_stride << 2;
-	}
-	for (i = 0; i < t1->w; ++i) {
-		int *data2 = data1 + i;
-		flag_t *flags2 = flags1 + i;
-		for (j = k; j < t1->h; ++j) {
-			flags2 += t1->flags_stride;
-			t1_dec_sigpass_step_mqc(t1, flags2, data2, orient, oneplushalf);
-			data2 += t1->w;
-		}
+		flagsp += 2;
 	}
-}				/* VSC and  BYPASS by Antonin */
-
-static void t1_dec_sigpass_mqc_vsc(
-		opj_t1_t *t1,
-		int bpno,
-		int orient)
-{
-	int i, j, k, one, half, oneplushalf, vsc;
-	one = 1 << bpno;
-	half = one >> 1;
-	oneplushalf = one | half;
-	for (k = 0; k < t1->h; k += 4) {
-		for (i = 0; i < t1->w; ++i) {
-			for (j = k; j < k + 4 && j < t1->h; ++j) {
-				vsc = (j == k + 3 || j == t1->h - 1) ? 1 : 0;
-				t1_dec_sigpass_step_mqc_vsc(
-						t1,
-						&t1->flags[((j+1) * t1->flags_stride) + i + 1],
-						&t1->data[(j * t1->w) + i],
-						orient,
-						oneplushalf,
-						vsc);
+	if (k < t1->h) {
+		for (i = 0; i < t1->w; ++i, ++flagsp) {
+			int *data2 = data1 + i;
+			for (j = 0; j < t1->h - k; ++j) {
+				t1_dec_sigpass_step_mqc(t1, &dec, flagsp, data2, orient, oneplushalf, j, vsc);
+				data2 += t1->w;
 			}
 		}
 	}
+	mqc_dec_store(t1->mqc, &dec);
 }				/* VSC and  BYPASS by Antonin */
 
-static void t1_enc_refpass_step(
+static INLINE void t1_enc_refpass_step(
 		opj_t1_t *t1,
+		opj_mqc_enc_t *enc,
 		flag_t *flagsp,
 		int *datap,
 		int bpno,
 		int one,
 		int *nmsedec,
 		char type,
-		int vsc)
+		int ci)
 {
-	int v, flag;
+	int v;
+	flag_t flag = *flagsp >> (3 * ci);
 	
-	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
+	OPJ_ARG_NOT_USED(t1);
 	
-	flag = vsc ? ((*flagsp) & (~(T1_SIG_S | T1_SIG_SE | T1_SIG_SW | T1_SGN_S))) : (*flagsp);
-	if ((flag & (T1_SIG | T1_VISIT)) == T1_SIG) {
+	if ((flag & (T1_SIGMA_THIS | T1_PI_THIS)) == T1_SIGMA_THIS) {
 		*nmsedec += t1_getnmsedec_ref(int_abs(*datap), bpno + T1_NMSEDEC_FRACBITS);
 		v = int_abs(*datap) & one ? 1 : 0;
-		mqc_setcurctx(mqc, t1_getctxno_mag(flag));	/* ESSAI */
 		if (type == T1_TYPE_RAW) {	/* BYPASS/LAZY MODE */
-			mqc_bypass_enc(mqc, v);
+			mqc_enc_bypass(enc, v);
 		} else {
-			mqc_encode(mqc, v);
+			mqc_enc_encode(enc, t1_getctxno_mag(flag), v);
 		}
-		*flagsp |= T1_REFINE;
+		*flagsp |= T1_MU_THIS << (3 * ci);
 	}
 }
 
@@ -603,61 +696,39 @@ static INLINE void t1_dec_refpass_step_raw(
 		int *datap,
 		int poshalf,
 		int neghalf,
-		int vsc)
+		int ci)
 {
-	int v, t, flag;
-	
+	int v, t;
 	opj_raw_t *raw = t1->raw;	/* RAW component */
+	flag_t flag = *flagsp >> (3 * ci);
 	
-	flag = vsc ? ((*flagsp) & (~(T1_SIG_S | T1_SIG_SE | T1_SIG_SW | T1_SGN_S))) : (*flagsp);
-	if ((flag & (T1_SIG | T1_VISIT)) == T1_SIG) {
+	if ((flag & (T1_SIGMA_THIS | T1_PI_THIS)) == T1_SIGMA_THIS) {
 			v = raw_decode(raw);
 		t = v ? poshalf : neghalf;
 		*datap += *datap < 0 ? -t : t;
-		*flagsp |= T1_REFINE;
+		*flagsp |= T1_MU_THIS << (3 * ci);
 	}
 }				/* VSC and  BYPASS by Antonin  */
 
 static INLINE void t1_dec_refpass_step_mqc(
 		opj_t1_t *t1,
-		flag_t *flagsp,
-		int *datap,
-		int poshalf,
-		int neghalf)
-{
-	int v, t, flag;
-	
-	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
-	
-	flag = *flagsp;
-	if ((flag & (T1_SIG | T1_VISIT)) == T1_SIG) {
-		mqc_setcurctx(mqc, t1_getctxno_mag(flag));	/* ESSAI */
-			v = mqc_decode(mqc);
-		t = v ? poshalf : neghalf;
-		*datap += *datap < 0 ? -t : t;
-		*flagsp |= T1_REFINE;
-		}
-}				/* VSC and  BYPASS by Antonin  */
-
-static INLINE void t1_dec_refpass_step_mqc_vsc(
-		opj_t1_t *t1,
+		opj_mqc_dec_t *dec,
 		flag_t *flagsp,
 		int *datap,
 		int poshalf,
 		int neghalf,
-		int vsc)
+		int ci)
 {
-	int v, t, flag;
+	int v, t;
+	flag_t flag = *flagsp >> (3 * ci);
 	
-	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
+	OPJ_ARG_NOT_USED(t1);
 	
-	flag = vsc ? ((*flagsp) & (~(T1_SIG_S | T1_SIG_SE | T1_SIG_SW | T1_SGN_S))) : (*flagsp);
-	if ((flag & (T1_SIG | T1_VISIT)) == T1_SIG) {
-		mqc_setcurctx(mqc, t1_getctxno_mag(flag));	/* ESSAI */
-		v = mqc_decode(mqc);
+	if ((flag & (T1_SIGMA_THIS | T1_PI_THIS)) == T1_SIGMA_THIS) {
+		v = mqc_dec_decode(dec, t1_getctxno_mag(flag));
 		t = v ? poshalf : neghalf;
 		*datap += *datap < 0 ? -t : t;
-		*flagsp |= T1_REFINE;
+		*flagsp |= T1_MU_THIS << (3 * ci);
 	}
 }				/* VSC and  BYPASS by Antonin  */
 
@@ -665,53 +736,63 @@ static void t1_enc_refpass(
 		opj_t1_t *t1,
 		int bpno,
 		int *nmsedec,
-		char type,
-		int cblksty)
+		char type)
 {
-	int i, j, k, one, vsc;
+	int i, j, k, one;
+	flag_t *flagsp = &t1->flags[t1->flags_stride + 1];
+	opj_mqc_enc_t enc;
 	*nmsedec = 0;
 	one = 1 << (bpno + T1_NMSEDEC_FRACBITS);
+	mqc_enc_load(t1->mqc, &enc);
 	for (k = 0; k < t1->h; k += 4) {
-		for (i = 0; i < t1->w; ++i) {
+		for (i = 0; i < t1->w; ++i, ++flagsp) {
+			/* no significant sample in the column */
+			if (!(*flagsp & (T1_SIGMA_4 | T1_SIGMA_7 | T1_SIGMA_10 | T1_SIGMA_13))) {
+				continue;
+			}
 			for (j = k; j < k + 4 && j < t1->h; ++j) {
-				vsc = ((cblksty & J2K_CCP_CBLKSTY_VSC) && (j == k + 3 || j == t1->h - 1)) ? 1 : 0;
 				t1_enc_refpass_step(
 						t1,
-						&t1->flags[((j+1) * t1->flags_stride) + i + 1],
+						&enc,
+						flagsp,
 						&t1->data[(j * t1->w) + i],
 						bpno,
 						one,
 						nmsedec,
 						type,
-						vsc);
+						j - k);
 			}
 		}
+		flagsp += 2;
 	}
+	mqc_enc_store(t1->mqc, &enc);
 }
 
 static void t1_dec_refpass_raw(
 		opj_t1_t *t1,
-		int bpno,
-		int cblksty)
+		int bpno)
 {
 	int i, j, k, one, poshalf, neghalf;
-	int vsc;
+	flag_t *flagsp = &t1->flags[t1->flags_stride + 1];
 	one = 1 << bpno;
 	poshalf = one >> 1;
 	neghalf = bpno > 0 ? -poshalf : -1;
 	for (k = 0; k < t1->h; k += 4) {
-		for (i = 0; i < t1->w; ++i) {
+		for (i = 0; i < t1->w; ++i, ++flagsp) {
+			if (!(*flagsp & (T1_SIGMA_4 | T1_SIGMA_7 | T1_SIGMA_10 | T1_SIGMA_13))) {
+				continue;
+			}
 			for (j = k; j < k + 4 && j < t1->h; ++j) {
-				vsc = ((cblksty & J2K_CCP_CBLKSTY_VSC) && (j == k + 3 || j == t1->h - 1)) ? 1 : 0;
 				t1_dec_refpass_step_raw(
 						t1,
-						&t1->flags[((j+1) * t1->flags_stride) + i + 1],
+						flagsp,
 						&t1->data[(j * t1->w) + i],
 						poshalf,
 						neghalf,
-						vsc);
+						j - k);
 			}
 		}
+		flagsp += 2;
 	}
 }				/* VSC and  BYPASS by Antonin */
 
@@ -721,68 +802,44 @@ static void t1_dec_refpass_mqc(
 {
 	int i, j, k, one, poshalf, neghalf;
 	int *data1 = t1->data;
-	flag_t *flags1 = &t1->flags[1];
+	flag_t *flagsp = &t1->flags[t1->flags_stride + 1];
+	opj_mqc_dec_t dec;
 	one = 1 << bpno;
 	poshalf = one >> 1;
 	neghalf = bpno > 0 ? -poshalf : -1;
+	mqc_dec_load(t1->mqc, &dec);
 	for (k = 0; k < (t1->h & ~3); k += 4) {
-		for (i = 0; i < t1->w; ++i) {
+		for (i = 0; i < t1->w; ++i, ++flagsp) {
 			int *data2 = data1 + i;
-			flag_t *flags2 = flags1 + i;
-			flags2 += t1->flags_stride;
-			t1_dec_refpass_step_mqc(t1, flags2, data2, poshalf, neghalf);
-			data2 += t1->w;
-			flags2 += t1->flags_stride;
-			t1_dec_refpass_step_mqc(t1, flags2, data2, poshalf, neghalf);
+			if (!(*flagsp & (T1_SIGMA_4 | T1_SIGMA_7 | T1_SIGMA_10 | T1_SIGMA_13))) {
+				continue;
+			}
+			t1_dec_refpass_step_mqc(t1, &dec, flagsp, data2, poshalf, neghalf, 0);
 			data2 += t1->w;
-			flags2 += t1->flags_stride;
-			t1_dec_refpass_step_mqc(t1, flags2, data2, poshalf, neghalf);
+			t1_dec_refpass_step_mqc(t1, &dec, flagsp, data2, poshalf, neghalf, 1);
 			data2 += t1->w;
-			flags2 += t1->flags_stride;
-			t1_dec_refpass_step_mqc(t1, flags2, data2, poshalf, neghalf);
+			t1_dec_refpass_step_mqc(t1, &dec, flagsp, data2, poshalf, neghalf, 2);
 			data2 += t1->w;
+			t1_dec_refpass_step_mqc(t1, &dec, flagsp, data2, poshalf, neghalf, 3);
 		}
 		data1 += t1->w << 2;
-		flags1 += t1->flags_stride << 2;
+		flagsp += 2;
 	}
-	for (i = 0; i < t1->w; ++i) {
-		int *data2 = data1 + i;
-		flag_t *flags2 = flags1 + i;
-		for (j = k; j < t1->h; ++j) {
-			flags2 += t1->flags_stride;
-			t1_dec_refpass_step_mqc(t1, flags2, data2, poshalf, neghalf);
-			data2 += t1->w;
-		}
-	}
-}				/* VSC and  BYPASS by Antonin */
-
-static void t1_dec_refpass_mqc_vsc(
-		opj_t1_t *t1,
-		int bpno)
-{
-	int i, j, k, one, poshalf, neghalf;
-	int vsc;
-	one = 1 << bpno;
-	poshalf = one >> 1;
-	neghalf = bpno > 0 ? -poshalf : -1;
-	for (k = 0; k < t1->h; k += 4) {
-		for (i = 0; i < t1->w; ++i) {
-			for (j = k; j < k + 4 && j < t1->h; ++j) {
-				vsc = ((j == k + 3 || j == t1->h - 1)) ? 1 : 0;
-				t1_dec_refpass_step_mqc_vsc(
-						t1,
-						&t1->flags[((j+1) * t1->flags_stride) + i + 1],
-						&t1->data[(j * t1->w) + i],
-						poshalf,
-						neghalf,
-						vsc);
+	if (k < t1->h) {
+		for (i = 0; i < t1->w; ++i, ++flagsp) {
+			int *data2 = data1 + i;
+			for (j = 0; j < t1->h - k; ++j) {
+				t1_dec_refpass_step_mqc(t1, &dec, flagsp, data2, poshalf, neghalf, j);
+				data2 += t1->w;
 			}
 		}
 	}
+	mqc_dec_store(t1->mqc, &dec);
 }				/* VSC and  BYPASS by Antonin */
 
-static void t1_enc_clnpass_step(
+static INLINE void t1_enc_clnpass_step(
 		opj_t1_t *t1,
+		opj_mqc_enc_t *enc,
 		flag_t *flagsp,
 		int *datap,
 		int orient,
@@ -790,105 +847,68 @@ static void t1_enc_clnpass_step(
 		int one,
 		int *nmsedec,
 		int partial,
+		int ci,
 		int vsc)
 {
-	int v, flag;
-	
-	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
+	int v, lu;
+	flag_t flag = *flagsp >> (3 * ci);
 	
-	flag = vsc ? ((*flagsp) & (~(T1_SIG_S | T1_SIG_SE | T1_SIG_SW | T1_SGN_S))) : (*flagsp);
 	if (partial) {
 		goto LABEL_PARTIAL;
 	}
-	if (!(*flagsp & (T1_SIG | T1_VISIT))) {
-		mqc_setcurctx(mqc, t1_getctxno_zc(flag, orient));
+	if (!(flag & (T1_SIGMA_THIS | T1_PI_THIS))) {
 		v = int_abs(*datap) & one ? 1 : 0;
-		mqc_encode(mqc, v);
+		mqc_enc_encode(enc, t1_getctxno_zc(flag, orient), v);
 		if (v) {
 LABEL_PARTIAL:
 			*nmsedec += t1_getnmsedec_sig(int_abs(*datap), bpno + T1_NMSEDEC_FRACBITS);
-			mqc_setcurctx(mqc, t1_getctxno_sc(flag));
 			v = *datap < 0 ? 1 : 0;
-			mqc_encode(mqc, v ^ t1_getspb(flag));
-			t1_updateflags(flagsp, v, t1->flags_stride);
+			lu = t1_getsgnidx(flagsp, ci);
+			mqc_enc_encode(enc, t1_getctxno_sc(lu), v ^ t1_getspb(lu));
+			t1_updateflags(flagsp, ci, v, t1->flags_stride, vsc);
 		}
 	}
-	*flagsp &= ~T1_VISIT;
 }
 
-static void t1_dec_clnpass_step_partial(
+static INLINE void t1_dec_clnpass_step_partial(
 		opj_t1_t *t1,
+		opj_mqc_dec_t *dec,
 		flag_t *flagsp,
 		int *datap,
-		int orient,
-		int oneplushalf)
+		int oneplushalf,
+		int ci,
+		int vsc)
 {
-	int v, flag;
-	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
-	
-	OPJ_ARG_NOT_USED(orient);
+	int v, lu;
 	
-	flag = *flagsp;
-	mqc_setcurctx(mqc, t1_getctxno_sc(flag));
-	v = mqc_decode(mqc) ^ t1_getspb(flag);
+	lu = t1_getsgnidx(flagsp, ci);
+	v = mqc_dec_decode(dec, t1_getctxno_sc(lu)) ^ t1_getspb(lu);
 	*datap = v ? -oneplushalf : oneplushalf;
-	t1_updateflags(flagsp, v, t1->flags_stride);
-	*flagsp &= ~T1_VISIT;
-}				/* VSC and  BYPASS by Antonin */
-
-static void t1_dec_clnpass_step(
-		opj_t1_t *t1,
-		flag_t *flagsp,
-		int *datap,
-		int orient,
-		int oneplushalf)
-{
-	int v, flag;
-	
-	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
-	
-	flag = *flagsp;
-	if (!(flag & (T1_SIG | T1_VISIT))) {
-		mqc_setcurctx(mqc, t1_getctxno_zc(flag, orient));
-		if (mqc_decode(mqc)) {
-			mqc_setcurctx(mqc, t1_getctxno_sc(flag));
-			v = mqc_decode(mqc) ^ t1_getspb(flag);
-			*datap = v ? -oneplushalf : oneplushalf;
-			t1_updateflags(flagsp, v, t1->flags_stride);
-		}
-	}
-	*flagsp &= ~T1_VISIT;
+	t1_updateflags(flagsp, ci, v, t1->flags_stride, vsc);
 }				/* VSC and  BYPASS by Antonin */
 
-static void t1_dec_clnpass_step_vsc(
+static INLINE void t1_dec_clnpass_step(
 		opj_t1_t *t1,
+		opj_mqc_dec_t *dec,
 		flag_t *flagsp,
 		int *datap,
 		int orient,
 		int oneplushalf,
-		int partial,
+		int ci,
 		int vsc)
 {
-	int v, flag;
+	int v, lu;
+	flag_t flag = *flagsp >> (3 * ci);
 	
-	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
-	
-	flag = vsc ? ((*flagsp) & (~(T1_SIG_S | T1_SIG_SE | T1_SIG_SW | T1_SGN_S))) : (*flagsp);
-	if (partial) {
-		goto LABEL_PARTIAL;
-	}
-	if (!(flag & (T1_SIG | T1_VISIT))) {
-		mqc_setcurctx(mqc, t1_getctxno_zc(flag, orient));
-		if (mqc_decode(mqc)) {
-LABEL_PARTIAL:
-			mqc_setcurctx(mqc, t1_getctxno_sc(flag));
-			v = mqc_decode(mqc) ^ t1_getspb(flag);
+	if (!(flag & (T1_SIGMA_THIS | T1_PI_THIS))) {
+		if (mqc_dec_decode(dec, t1_getctxno_zc(flag, orient))) {
+			lu = t1_getsgnidx(flagsp, ci);
+			v = mqc_dec_decode(dec, t1_getctxno_sc(lu)) ^ t1_getspb(lu);
 			*datap = v ? -oneplushalf : oneplushalf;
-			t1_updateflags(flagsp, v, t1->flags_stride);
+			t1_updateflags(flagsp, ci, v, t1->flags_stride, vsc);
 		}
 	}
-	*flagsp &= ~T1_VISIT;
-}
+}				/* VSC and  BYPASS by Antonin */
 
 static void t1_enc_clnpass(
 		opj_t1_t *t1,
@@ -898,186 +918,166 @@ static void t1_enc_clnpass(
 		int cblksty)
 {
 	int i, j, k, one, agg, runlen, vsc;
-	
-	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
+	flag_t *flagsp = &t1->flags[t1->flags_stride + 1];
+	opj_mqc_enc_t enc;
 	
 	*nmsedec = 0;
 	one = 1 << (bpno + T1_NMSEDEC_FRACBITS);
+	vsc = (cblksty & J2K_CCP_CBLKSTY_VSC) ? 1 : 0;
+	mqc_enc_load(t1->mqc, &enc);
 	for (k = 0; k < t1->h; k += 4) {
-		for (i = 0; i < t1->w; ++i) {
-			if (k + 3 < t1->h) {
-				if (cblksty & J2K_CCP_CBLKSTY_VSC) {
-					agg = !(MACRO_t1_flags(1 + k,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH)
-						|| MACRO_t1_flags(1 + k + 1,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH)
-						|| MACRO_t1_flags(1 + k + 2,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH)
-						|| (MACRO_t1_flags(1 + k + 3,1 + i) 
-						& (~(T1_SIG_S | T1_SIG_SE | T1_SIG_SW |	T1_SGN_S))) & (T1_SIG | T1_VISIT | T1_SIG_OTH));
-				} else {
-					agg = !(MACRO_t1_flags(1 + k,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH)
-						|| MACRO_t1_flags(1 + k + 1,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH)
-						|| MACRO_t1_flags(1 + k + 2,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH)
-						|| MACRO_t1_flags(1 + k + 3,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH));
-				}
-			} else {
-				agg = 0;
-			}
+		for (i = 0; i < t1->w; ++i, ++flagsp) {
+			/* a full column with nothing significant or visited in its neighbourhood */
+			agg = k + 3 < t1->h && *flagsp == 0;
 			if (agg) {
 				for (runlen = 0; runlen < 4; ++runlen) {
 					if (int_abs(t1->data[((k + runlen)*t1->w) + i]) & one)
 						break;
 				}
-				mqc_setcurctx(mqc, T1_CTXNO_AGG);
-				mqc_encode(mqc, runlen != 4);
+				mqc_enc_encode(&enc, T1_CTXNO_AGG, runlen != 4);
 				if (runlen == 4) {
 					continue;
 				}
-				mqc_setcurctx(mqc, T1_CTXNO_UNI);
-				mqc_encode(mqc, runlen >> 1);
-				mqc_encode(mqc, runlen & 1);
+				mqc_enc_encode(&enc, T1_CTXNO_UNI, runlen >> 1);
+				mqc_enc_encode(&enc, T1_CTXNO_UNI, runlen & 1);
 			} else {
 				runlen = 0;
 			}
 			for (j = k + runlen; j < k + 4 && j < t1->h; ++j) {
-				vsc = ((cblksty & J2K_CCP_CBLKSTY_VSC) && (j == k + 3 || j == t1->h - 1)) ? 1 : 0;
 				t1_enc_clnpass_step(
 						t1,
-						&t1->flags[((j+1) * t1->flags_stride) + i + 1],
+						&enc,
+						flagsp,
 						&t1->data[(j * t1->w) + i],
 						orient,
 						bpno,
 						one,
 						nmsedec,
 						agg && (j == k + runlen),
+						j - k,
 						vsc);
 			}
+			*flagsp &= ~(T1_PI_0 | T1_PI_1 | T1_PI_2 | T1_PI_3);
 		}
+		flagsp += 2;
 	}
+	mqc_enc_store(t1->mqc, &enc);
+}
+
+static INLINE void t1_dec_segsym(opj_mqc_dec_t *dec) {
+	int v = 0;
+	v = mqc_dec_decode(dec, T1_CTXNO_UNI);
+	v = (v << 1) | mqc_dec_decode(dec, T1_CTXNO_UNI);
+	v = (v << 1) | mqc_dec_decode(dec, T1_CTXNO_UNI);
+	v = (v << 1) | mqc_dec_decode(dec, T1_CTXNO_UNI);
+	/*
+	if (v!=0xa) {
+		opj_event_msg(t1->cinfo, EVT_WARNING, "Bad segmentation symbol %x\n", v);
+	} 
+	*/
 }
 
-static void t1_dec_clnpass(
+static INLINE void t1_dec_clnpass_mqc(
 		opj_t1_t *t1,
 		int bpno,
 		int orient,
-		int cblksty)
+		int segsym,
+		int vsc)
 {
-	int i, j, k, one, half, oneplushalf, agg, runlen, vsc;
-	int segsym = cblksty & J2K_CCP_CBLKSTY_SEGSYM;
-	
-	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
+	int i, j, k, one, half, oneplushalf, runlen;
+	int *data1 = t1->data;
+	flag_t *flagsp = &t1->flags[t1->flags_stride + 1];
+	opj_mqc_dec_t dec;
 	
 	one = 1 << bpno;
 	half = one >> 1;
 	oneplushalf = one | half;
-	if (cblksty & J2K_CCP_CBLKSTY_VSC) {
-	for (k = 0; k < t1->h; k += 4) {
-		for (i = 0; i < t1->w; ++i) {
-			if (k + 3 < t1->h) {
-					agg = !(MACRO_t1_flags(1 + k,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH)
-						|| MACRO_t1_flags(1 + k + 1,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH)
-						|| MACRO_t1_flags(1 + k + 2,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH)
-						|| (MACRO_t1_flags(1 + k + 3,1 + i) 
-						& (~(T1_SIG_S | T1_SIG_SE | T1_SIG_SW |	T1_SGN_S))) & (T1_SIG | T1_VISIT | T1_SIG_OTH));
-				} else {
-				agg = 0;
-			}
-			if (agg) {
-				mqc_setcurctx(mqc, T1_CTXNO_AGG);
-				if (!mqc_decode(mqc)) {
+	mqc_dec_load(t1->mqc, &dec);
+	for (k = 0; k < (t1->h & ~3); k += 4) {
+		for (i = 0; i < t1->w; ++i, ++flagsp) {
+			int *data2 = data1 + i;
+			if (*flagsp == 0) {
+				if (!mqc_dec_decode(&dec, T1_CTXNO_AGG)) {
 					continue;
 				}
-				mqc_setcurctx(mqc, T1_CTXNO_UNI);
-				runlen = mqc_decode(mqc);
-				runlen = (runlen << 1) | mqc_decode(mqc);
-			} else {
-				runlen = 0;
-			}
-			for (j = k + runlen; j < k + 4 && j < t1->h; ++j) {
-					vsc = (j == k + 3 || j == t1->h - 1) ? 1 : 0;
-					t1_dec_clnpass_step_vsc(
-						t1,
-						&t1->flags[((j+1) * t1->flags_stride) + i + 1],
-						&t1->data[(j * t1->w) + i],
-						orient,
-						oneplushalf,
-						agg && (j == k + runlen),
-						vsc);
-			}
-		}
-	}
-	} else {
-		int *data1 = t1->data;
-		flag_t *flags1 = &t1->flags[1];
-		for (k = 0; k < (t1->h & ~3); k += 4) {
-			for (i = 0; i < t1->w; ++i) {
-				int *data2 = data1 + i;
-				flag_t *flags2 = flags1 + i;
-				agg = !(MACRO_t1_flags(1 + k,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH)
-					|| MACRO_t1_flags(1 + k + 1,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH)
-					|| MACRO_t1_flags(1 + k + 2,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH)
-					|| MACRO_t1_flags(1 + k + 3,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH));
-				if (agg) {
-					mqc_setcurctx(mqc, T1_CTXNO_AGG);
-					if (!mqc_decode(mqc)) {
-						continue;
-					}
-					mqc_setcurctx(mqc, T1_CTXNO_UNI);
-					runlen = mqc_decode(mqc);
-					runlen = (runlen << 1) | mqc_decode(mqc);
-					flags2 += runlen * t1->flags_stride;
-					data2 += runlen * t1->w;
-					for (j = k + runlen; j < k + 4 && j < t1->h; ++j) {
-						flags2 += t1->flags_stride;
-						if (agg && (j == k + runlen)) {
-							t1_dec_clnpass_step_partial(t1, flags2, data2, orient, oneplushalf);
-						} else {
-							t1_dec_clnpass_step(t1, flags2, data2, orient, oneplushalf);
-						}
-						data2 += t1->w;
-					}
-				} else {
-					flags2 += t1->flags_stride;
-					t1_dec_clnpass_step(t1, flags2, data2, orient, oneplushalf);
-					data2 += t1->w;
-					flags2 += t1->flags_stride;
-					t1_dec_clnpass_step(t1, flags2, data2, orient, oneplushalf);
-					data2 += t1->w;
-					flags2 += t1->flags_stride;
-					t1_dec_clnpass_step(t1, flags2, data2, orient, oneplushalf);
-					data2 += t1->w;
-					flags2 += t1->flags_stride;
-					t1_dec_clnpass_step(t1, flags2, data2, orient, oneplushalf);
+				runlen = mqc_dec_decode(&dec, T1_CTXNO_UNI);
+				runlen = (runlen << 1) | mqc_dec_decode(&dec, T1_CTXNO_UNI);
+				data2 += runlen * t1->w;
+				t1_dec_clnpass_step_partial(t1, &dec, flagsp, data2, oneplushalf, runlen, vsc);
+				for (j = runlen + 1; j < 4; ++j) {
 					data2 += t1->w;
+					t1_dec_clnpass_step(t1, &dec, flagsp, data2, orient, oneplushalf, j, vsc);
 				}
+			} else {
+				t1_dec_clnpass_step(t1, &dec, flagsp, data2, orient, oneplushalf, 0, vsc);
+				data2 += t1->w;
+				t1_dec_clnpass_step(t1, &dec, flagsp, data2, orient, oneplushalf, 1, vsc);
+				data2 += t1->w;
+				t1_dec_clnpass_step(t1, &dec, flagsp, data2, orient, oneplushalf, 2, vsc);
+				data2 += t1->w;
+				t1_dec_clnpass_step(t1, &dec, flagsp, data2, orient, oneplushalf, 3, vsc);
 			}
-			data1 += t1->w << 2;
-			flags1 += t1->flags_stride << 2;
+			*flagsp &= ~(T1_PI_0 | T1_PI_1 | T1_PI_2 | T1_PI_3);
 		}
-		for (i = 0; i < t1->w; ++i) {
+		data1 += t1->w << 2;
+		flagsp += 2;
+	}
+	if (k < t1->h) {
+		for (i = 0; i < t1->w; ++i, ++flagsp) {
 			int *data2 = data1 + i;
-			flag_t *flags2 = flags1 + i;
-			for (j = k; j < t1->h; ++j) {
-				flags2 += t1->flags_stride;
-				t1_dec_clnpass_step(t1, flags2, data2, orient, oneplushalf);
+			for (j = 0; j < t1->h - k; ++j) {
+				t1_dec_clnpass_step(t1, &dec, flagsp, data2, orient, oneplushalf, j, vsc);
 				data2 += t1->w;
 			}
+			*flagsp &= ~(T1_PI_0 | T1_PI_1 | T1_PI_2 | T1_PI_3);
 		}
 	}
-
 	if (segsym) {
-		int v = 0;
-		mqc_setcurctx(mqc, T1_CTXNO_UNI);
-		v = mqc_decode(mqc);
-		v = (v << 1) | mqc_decode(mqc);
-		v = (v << 1) | mqc_decode(mqc);
-		v = (v << 1) | mqc_decode(mqc);
-		/*
-		if (v!=0xa) {
-			opj_event_msg(t1->cinfo, EVT_WARNING, "Bad segmentation symbol %x\n", v);
-		} 
-		*/
+		t1_dec_segsym(&dec);
 	}
+	mqc_dec_store(t1->mqc, &dec);
 }				/* VSC and  BYPASS by Antonin */
 
+/*
+The passes above are expanded once per orientation and VSC setting, so the context
+table of the orientation is a constant in each copy. LL and LH bands use the same
+zero coding contexts and share a copy. The refinement pass depends on neither.
+*/
+#define T1_DEC_PASSES(name, orient) \
+static void t1_dec_sigpass_##name(opj_t1_t *t1, int bpno) { \
+	t1_dec_sigpass_mqc(t1, bpno, orient, 0); \
+} \
+static void t1_dec_sigpass_vsc_##name(opj_t1_t *t1, int bpno) { \
+	t1_dec_sigpass_mqc(t1, bpno, orient, 1); \
+} \
+static void t1_dec_clnpass_##name(opj_t1_t *t1, int bpno, int segsym) { \
+	t1_dec_clnpass_mqc(t1, bpno, orient, segsym, 0); \
+} \
+static void t1_dec_clnpass_vsc_##name(opj_t1_t *t1, int bpno, int segsym) { \
+	t1_dec_clnpass_mqc(t1, bpno, orient, segsym, 1); \
+}
+
+T1_DEC_PASSES(ll, 0)
+T1_DEC_PASSES(hl, 1)
+T1_DEC_PASSES(hh, 3)
+
+/* <summary> */
+/* MQ decoding passes indexed by VSC and then by band orientation. */
+/* </summary> */
+static const opj_t1_dec_passes_t t1_dec_passes[2][4] = {
+	{
+		{t1_dec_sigpass_ll, t1_dec_refpass_mqc, t1_dec_clnpass_ll},
+		{t1_dec_sigpass_hl, t1_dec_refpass_mqc, t1_dec_clnpass_hl},
+		{t1_dec_sigpass_ll, t1_dec_refpass_mqc, t1_dec_clnpass_ll},
+		{t1_dec_sigpass_hh, t1_dec_refpass_mqc, t1_dec_clnpass_hh}
+	}, {
+		{t1_dec_sigpass_vsc_ll, t1_dec_refpass_mqc, t1_dec_clnpass_vsc_ll},
+		{t1_dec_sigpass_vsc_hl, t1_dec_refpass_mqc, t1_dec_clnpass_vsc_hl},
+		{t1_dec_sigpass_vsc_ll, t1_dec_refpass_mqc, t1_dec_clnpass_vsc_ll},
+		{t1_dec_sigpass_vsc_hh, t1_dec_refpass_mqc, t1_dec_clnpass_vsc_hh}
+	}
+};
+
 
 /** mod fixed_quality */
 static double t1_getwmsedec(
@@ -1123,8 +1123,9 @@ static opj_bool allocate_buffers(
 	}
 	memset(t1->data,0,datasize * sizeof(int));
 
+	/* a stripe of border flags above and below the code-block */
 	t1->flags_stride=w+2;
-	flagssize=t1->flags_stride * (h+2);
+	flagssize=t1->flags_stride * (((h+3)>>2)+2);
 
 	if(flagssize > t1->flagssize){
 		opj_aligned_free(t1->flags);
@@ -1153,8 +1154,7 @@ static void t1_encode_cblk(
 		double stepsize,
 		int cblksty,
 		int numcomps,
-		int mct,
-		opj_tcd_tile_t * tile)
+		int mct)
 {
 	double cumwmsedec = 0.0;
 
@@ -1193,7 +1193,7 @@ static void t1_encode_cblk(
 				t1_enc_sigpass(t1, bpno, orient, &nmsedec, type, cblksty);
 				break;
 			case 1:
-				t1_enc_refpass(t1, bpno, &nmsedec, type, cblksty);
+				t1_enc_refpass(t1, bpno, &nmsedec, type);
 				break;
 			case 2:
 				t1_enc_clnpass(t1, bpno, orient, &nmsedec, cblksty);
@@ -1206,7 +1206,8 @@ static void t1_encode_cblk(
 		/* fixed_quality */
 		tempwmsedec = t1_getwmsedec(nmsedec, compno, level, orient, bpno, qmfbid, stepsize, numcomps, mct);
 		cumwmsedec += tempwmsedec;
-		tile->distotile += tempwmsedec;
+		/* summed into tile->distotile in code-block order once every code-block is done */
+		pass->wmsedec = tempwmsedec;
 		
 		/* Code switch "RESTART" (i.e. TERMALL) */
 		if ((cblksty & J2K_CCP_CBLKSTY_TERMALL)	&& !((passtype == 2) && (bpno - 1 < 0))) {
@@ -1277,7 +1278,7 @@ static void t1_encode_cblk(
 	}
 }
 
-static void t1_decode_cblk(
+static opj_bool t1_decode_cblk(
 		opj_t1_t *t1,
 		opj_tcd_cblk_dec_t* cblk,
 		int orient,
@@ -1286,6 +1287,9 @@ static void t1_decode_cblk(
 {
 	opj_raw_t *raw = t1->raw;	/* RAW component */
 	opj_mqc_t *mqc = t1->mqc;	/* MQC component */
+	/* passes of the orientation and style of the code-block */
+	const opj_t1_dec_passes_t *passes = &t1_dec_passes[(cblksty & J2K_CCP_CBLKSTY_VSC) ? 1 : 0][orient];
+	int segsym = cblksty & J2K_CCP_CBLKSTY_SEGSYM;
 
 	int bpno, passtype;
 	int segno, passno;
@@ -1296,7 +1300,7 @@ static void t1_decode_cblk(
 				cblk->x1 - cblk->x0,
 				cblk->y1 - cblk->y0))
 	{
-		return;
+		return OPJ_FALSE;
 	}
 
 	bpno = roishift + cblk->numbps - 1;
@@ -1307,13 +1311,13 @@ static void t1_decode_cblk(
 	mqc_setstate(mqc, T1_CTXNO_AGG, 0, 3);
 	mqc_setstate(mqc, T1_CTXNO_ZC, 0, 4);
 	
-	for (segno = 0; segno < cblk->numsegs; ++segno) {
+	for (segno = 0; segno < cblk->real_num_segs; ++segno) {
 		opj_tcd_seg_t *seg = &cblk->segs[segno];
 		
 		/* BYPASS mode */
 		type = ((bpno <= (cblk->numbps - 1) - 4) && (passtype < 2) && (cblksty & J2K_CCP_CBLKSTY_LAZY)) ? T1_TYPE_RAW : T1_TYPE_MQ;
 		/* FIXME: slviewer gets here with a null pointer. Why? Partially downloaded and/or corrupt textures? */
-		if(seg->data == NULL){
+		if(seg->data == NULL || *seg->data == NULL){
 			continue;
 		}
 		if (type == T1_TYPE_RAW) {
@@ -1322,32 +1326,24 @@ static void t1_decode_cblk(
 			mqc_init_dec(mqc, (*seg->data) + seg->dataindex, seg->len);
 		}
 		
-		for (passno = 0; passno < seg->numpasses; ++passno) {
+		for (passno = 0; passno < seg->real_num_passes; ++passno) {
 			switch (passtype) {
 				case 0:
 					if (type == T1_TYPE_RAW) {
-						t1_dec_sigpass_raw(t1, bpno+1, orient, cblksty);
+						t1_dec_sigpass_raw(t1, bpno+1, cblksty);
 					} else {
-						if (cblksty & J2K_CCP_CBLKSTY_VSC) {
-							t1_dec_sigpass_mqc_vsc(t1, bpno+1, orient);
-						} else {
-							t1_dec_sigpass_mqc(t1, bpno+1, orient);
-						}
+						passes->sigpass(t1, bpno+1);
 					}
 					break;
 				case 1:
 					if (type == T1_TYPE_RAW) {
-						t1_dec_refpass_raw(t1, bpno+1, cblksty);
+						t1_dec_refpass_raw(t1, bpno+1);
 					} else {
-						if (cblksty & J2K_CCP_CBLKSTY_VSC) {
-							t1_dec_refpass_mqc_vsc(t1, bpno+1);
-						} else {
-							t1_dec_refpass_mqc(t1, bpno+1);
-						}
+						passes->refpass(t1, bpno+1);
 					}
 					break;
 				case 2:
-					t1_dec_clnpass(t1, bpno+1, orient, cblksty);
+					passes->clnpass(t1, bpno+1, segsym);
 					break;
 			}
 			
@@ -1362,7 +1358,12 @@ static void t1_decode_cblk(
 				bpno--;
 			}
 		}
+		if (type == T1_TYPE_MQ) {
+			mqc_finish_dec(mqc);
+		}
 	}
+
+	return OPJ_TRUE;
 }
 
 /* ----------------------------------------------------------------------- */
@@ -1399,186 +1400,434 @@ void t1_destroy(opj_t1_t *t1) {
 void t1_encode_cblks(
 		opj_t1_t *t1,
 		opj_tcd_tile_t *tile,
-		opj_tcp_t *tcp)
+		opj_tcp_t *tcp,
+		int num_threads)
 {
+	opj_t1_enc_job_t job;
 	int compno, resno, bandno, precno, cblkno;
+	int count = 0, slot, i, passno;
 
 	tile->distotile = 0;		/* fixed_quality */
 
 	for (compno = 0; compno < tile->numcomps; ++compno) {
 		opj_tcd_tilecomp_t* tilec = &tile->comps[compno];
-		opj_tccp_t* tccp = &tcp->tccps[compno];
-		int tile_w = tilec->x1 - tilec->x0;
+		for (resno = 0; resno < tilec->numresolutions; ++resno) {
+			opj_tcd_resolution_t *res = &tilec->resolutions[resno];
+			for (bandno = 0; bandno < res->numbands; ++bandno) {
+				opj_tcd_band_t* band = &res->bands[bandno];
+				for (precno = 0; precno < res->pw * res->ph; ++precno) {
+					count += band->precincts[precno].cw * band->precincts[precno].ch;
+				}
+			}
+		}
+	}
+	if (count == 0) {
+		return;
+	}
+
+	job.cblks = (opj_t1_enc_cblk_t*) opj_malloc(count * sizeof(opj_t1_enc_cblk_t));
+	if (!job.cblks) {
+		return;
+	}
+	job.tile = tile;
+	job.tcp = tcp;
+	memset(job.t1s, 0, sizeof(job.t1s));
+	job.t1s[0] = t1;
+
+	count = 0;
+	for (compno = 0; compno < tile->numcomps; ++compno) {
+		opj_tcd_tilecomp_t* tilec = &tile->comps[compno];
 
 		for (resno = 0; resno < tilec->numresolutions; ++resno) {
 			opj_tcd_resolution_t *res = &tilec->resolutions[resno];
 
 			for (bandno = 0; bandno < res->numbands; ++bandno) {
-				opj_tcd_band_t* restrict band = &res->bands[bandno];
-        int bandconst = 8192 * 8192 / ((int) floor(band->stepsize * 8192));
+				opj_tcd_band_t* band = &res->bands[bandno];
 
 				for (precno = 0; precno < res->pw * res->ph; ++precno) {
 					opj_tcd_precinct_t *prc = &band->precincts[precno];
 
 					for (cblkno = 0; cblkno < prc->cw * prc->ch; ++cblkno) {
+						opj_t1_enc_cblk_t* item = &job.cblks[count++];
 						opj_tcd_cblk_enc_t* cblk = &prc->cblks.enc[cblkno];
-						int* restrict datap;
-						int* restrict tiledp;
-						int cblk_w;
-						int cblk_h;
-						int i, j;
-
-						int x = cblk->x0 - band->x0;
-						int y = cblk->y0 - band->y0;
+
+						item->cblk = cblk;
+						item->band = band;
+						item->compno = compno;
+						item->resno = resno;
+						item->x = cblk->x0 - band->x0;
+						item->y = cblk->y0 - band->y0;
 						if (band->bandno & 1) {
 							opj_tcd_resolution_t *pres = &tilec->resolutions[resno - 1];
-							x += pres->x1 - pres->x0;
+							item->x += pres->x1 - pres->x0;
 						}
 						if (band->bandno & 2) {
 							opj_tcd_resolution_t *pres = &tilec->resolutions[resno - 1];
-							y += pres->y1 - pres->y0;
-						}
-
-						if(!allocate_buffers(
-									t1,
-									cblk->x1 - cblk->x0,
-									cblk->y1 - cblk->y0))
-						{
-							return;
-						}
-
-						datap=t1->data;
-						cblk_w = t1->w;
-						cblk_h = t1->h;
-
-						tiledp=&tilec->data[(y * tile_w) + x];
-						if (tccp->qmfbid == 1) {
-							for (j = 0; j < cblk_h; ++j) {
-								for (i = 0; i < cblk_w; ++i) {
-									int tmp = tiledp[(j * tile_w) + i];
-									datap[(j * cblk_w) + i] = tmp << T1_NMSEDEC_FRACBITS;
-								}
-							}
-						} else {		/* if (tccp->qmfbid == 0) */
-							for (j = 0; j < cblk_h; ++j) {
-								for (i = 0; i < cblk_w; ++i) {
-									int tmp = tiledp[(j * tile_w) + i];
-									datap[(j * cblk_w) + i] =
-										fix_mul(
-										tmp,
-										bandconst) >> (11 - T1_NMSEDEC_FRACBITS);
-								}
-							}
+							item->y += pres->y1 - pres->y0;
 						}
-
-						t1_encode_cblk(
-								t1,
-								cblk,
-								band->bandno,
-								compno,
-								tilec->numresolutions - 1 - resno,
-								tccp->qmfbid,
-								band->stepsize,
-								tccp->cblksty,
-								tile->numcomps,
-								tcp->mct,
-								tile);
-
+						/* a code-block that fails to allocate keeps no pass */
+						cblk->totalpasses = 0;
 					} /* cblkno */
 				} /* precno */
 			} /* bandno */
 		} /* resno  */
 	} /* compno  */
+
+	opj_parallel_for(count, num_threads, t1_encode_cblk_job, &job);
+
+	/* same order of additions as a serial encode, so the rate allocation and the codestream do not depend on the threads */
+	for (i = 0; i < count; ++i) {
+		opj_tcd_cblk_enc_t* cblk = job.cblks[i].cblk;
+		for (passno = 0; passno < cblk->totalpasses; ++passno) {
+			tile->distotile += cblk->passes[passno].wmsedec;
+		}
+	}
+
+	for (slot = 1; slot < OPJ_MAX_THREADS; ++slot) {
+		t1_destroy(job.t1s[slot]);
+	}
+	opj_free(job.cblks);
 }
 
-void t1_decode_cblks(
-		opj_t1_t* t1,
+static void t1_encode_cblk_job(void *user_data, int index, int slot) {
+	opj_t1_enc_job_t *job = (opj_t1_enc_job_t*) user_data;
+	opj_t1_enc_cblk_t *item = &job->cblks[index];
+	opj_tcd_tile_t *tile = job->tile;
+	opj_tcd_tilecomp_t* tilec = &tile->comps[item->compno];
+	opj_tccp_t* tccp = &job->tcp->tccps[item->compno];
+	opj_tcd_band_t* band = item->band;
+	opj_tcd_cblk_enc_t* cblk = item->cblk;
+	opj_t1_t* t1 = job->t1s[slot];
+	int tile_w = tilec->x1 - tilec->x0;
+	int bandconst = 8192 * 8192 / ((int) floor(band->stepsize * 8192));
+	int* restrict datap;
+	int* restrict tiledp;
+	int cblk_w;
+	int cblk_h;
+	int i, j;
+
+	/* slots are never shared by two running items, so the scratch needs no lock */
+	if (!t1) {
+		t1 = job->t1s[slot] = t1_create(job->t1s[0]->cinfo);
+		if (!t1) {
+			return;
+		}
+	}
+
+	if(!allocate_buffers(
+				t1,
+				cblk->x1 - cblk->x0,
+				cblk->y1 - cblk->y0))
+	{
+		return;
+	}
+
+	datap=t1->data;
+	cblk_w = t1->w;
+	cblk_h = t1->h;
+
+	tiledp=&tilec->data[(item->y * tile_w) + item->x];
+	if (tccp->qmfbid == 1) {
+		for (j = 0; j < cblk_h; ++j) {
+			for (i = 0; i < cblk_w; ++i) {
+				int tmp = tiledp[(j * tile_w) + i];
+				datap[(j * cblk_w) + i] = tmp << T1_NMSEDEC_FRACBITS;
+			}
+		}
+	} else {		/* if (tccp->qmfbid == 0) */
+		for (j = 0; j < cblk_h; ++j) {
+			for (i = 0; i < cblk_w; ++i) {
+				int tmp = tiledp[(j * tile_w) + i];
+				datap[(j * cblk_w) + i] =
+					fix_mul(
+					tmp,
+					bandconst) >> (11 - T1_NMSEDEC_FRACBITS);
+			}
+		}
+	}
+
+	t1_encode_cblk(
+			t1,
+			cblk,
+			band->bandno,
+			item->compno,
+			tilec->numresolutions - 1 - item->resno,
+			tccp->qmfbid,
+			band->stepsize,
+			tccp->cblksty,
+			tile->numcomps,
+			job->tcp->mct);
+}
+
+opj_bool t1_decode_cblks(
+		opj_tcd_scratch_t* scratch,
 		opj_tcd_tilecomp_t* tilec,
-		opj_tccp_t* tccp)
+		opj_tccp_t* tccp,
+		int num_threads)
 {
-	int resno, bandno, precno, cblkno;
+	opj_t1_dec_job_t job;
+	int resno, bandno, precno, cblkno, slot;
+	int count = 0;
 
-	int tile_w = tilec->x1 - tilec->x0;
+	/* code-blocks of the resolutions discarded by cp_reduce are never read by the DWT */
+	for (resno = 0; resno < tilec->minimum_num_resolutions; ++resno) {
+		opj_tcd_resolution_t* res = &tilec->resolutions[resno];
+		for (bandno = 0; bandno < res->numbands; ++bandno) {
+			opj_tcd_band_t* band = &res->bands[bandno];
+			for (precno = 0; precno < res->pw * res->ph; ++precno) {
+				count += band->precincts[precno].cw * band->precincts[precno].ch;
+			}
+		}
+	}
+	if (count == 0) {
+		return OPJ_TRUE;
+	}
 
-	for (resno = 0; resno < tilec->numresolutions; ++resno) {
+	/* the list is kept for the next tile component */
+	if (count > scratch->cblks_size) {
+		opj_free(scratch->cblks);
+		scratch->cblks = opj_malloc(count * sizeof(opj_t1_dec_cblk_t));
+		scratch->cblks_size = scratch->cblks ? count : 0;
+		if (!scratch->cblks) {
+			return OPJ_FALSE;
+		}
+	}
+	job.cblks = (opj_t1_dec_cblk_t*) scratch->cblks;
+	job.tilec = tilec;
+	job.tccp = tccp;
+	job.kernels = t1_get_kernels();
+	job.t1s = scratch->t1s;
+	memset(job.failed, 0, sizeof(job.failed));
+
+	count = 0;
+	for (resno = 0; resno < tilec->minimum_num_resolutions; ++resno) {
 		opj_tcd_resolution_t* res = &tilec->resolutions[resno];
 
 		for (bandno = 0; bandno < res->numbands; ++bandno) {
-			opj_tcd_band_t* restrict band = &res->bands[bandno];
+			opj_tcd_band_t* band = &res->bands[bandno];
 
 			for (precno = 0; precno < res->pw * res->ph; ++precno) {
 				opj_tcd_precinct_t* precinct = &band->precincts[precno];
 
 				for (cblkno = 0; cblkno < precinct->cw * precinct->ch; ++cblkno) {
+					opj_t1_dec_cblk_t* item = &job.cblks[count++];
 					opj_tcd_cblk_dec_t* cblk = &precinct->cblks.dec[cblkno];
-					int* restrict datap;
-					int cblk_w, cblk_h;
-					int x, y;
-					int i, j;
-
-					t1_decode_cblk(
-							t1,
-							cblk,
-							band->bandno,
-							tccp->roishift,
-							tccp->cblksty);
-
-					x = cblk->x0 - band->x0;
-					y = cblk->y0 - band->y0;
+
+					item->cblk = cblk;
+					item->band = band;
+					item->x = cblk->x0 - band->x0;
+					item->y = cblk->y0 - band->y0;
 					if (band->bandno & 1) {
 						opj_tcd_resolution_t* pres = &tilec->resolutions[resno - 1];
-						x += pres->x1 - pres->x0;
+						item->x += pres->x1 - pres->x0;
 					}
 					if (band->bandno & 2) {
 						opj_tcd_resolution_t* pres = &tilec->resolutions[resno - 1];
-						y += pres->y1 - pres->y0;
-					}
-
-					datap=t1->data;
-					cblk_w = t1->w;
-					cblk_h = t1->h;
-
-					if (tccp->roishift) {
-						int thresh = 1 << tccp->roishift;
-						for (j = 0; j < cblk_h; ++j) {
-							for (i = 0; i < cblk_w; ++i) {
-								int val = datap[(j * cblk_w) + i];
-								int mag = abs(val);
-								if (mag >= thresh) {
-									mag >>= tccp->roishift;
-									datap[(j * cblk_w) + i] = val < 0 ? -mag : mag;
-								}
-							}
-						}
-					}
-
-					if (tccp->qmfbid == 1) {
-						int* restrict tiledp = &tilec->data[(y * tile_w) + x];
-						for (j = 0; j < cblk_h; ++j) {
-							for (i = 0; i < cblk_w; ++i) {
-								int tmp = datap[(j * cblk_w) + i];
-								((int*)tiledp)[(j * tile_w) + i] = tmp / 2;
-							}
-						}
-					} else {		/* if (tccp->qmfbid == 0) */
-						float* restrict tiledp = (float*) &tilec->data[(y * tile_w) + x];
-						for (j = 0; j < cblk_h; ++j) {
-							float* restrict tiledp2 = tiledp;
-							for (i = 0; i < cblk_w; ++i) {
-								float tmp = *datap * band->stepsize;
-								*tiledp2 = tmp;
-								datap++;
-								tiledp2++;
-							}
-							tiledp += tile_w;
-						}
+						item->y += pres->y1 - pres->y0;
 					}
-					opj_free(cblk->data);
-					opj_free(cblk->segs);
 				} /* cblkno */
-				opj_free(precinct->cblks.dec);
 			} /* precno */
 		} /* bandno */
 	} /* resno */
+
+	opj_parallel_for(count, num_threads, t1_decode_cblk_job, &job);
+
+	for (slot = 0; slot < OPJ_MAX_THREADS; ++slot) {
+		if (job.failed[slot]) {
+			return OPJ_FALSE;
+		}
+	}
+	return OPJ_TRUE;
 }
 
+static void t1_dequant_int_c(int* restrict dst, const int* restrict src, int n) {
+	int i;
+	for (i = 0; i < n; ++i) {
+		dst[i] = src[i] / 2;
+	}
+}
+
+static void t1_dequant_real_c(float* restrict dst, const int* restrict src, int n, float stepsize) {
+	int i;
+	for (i = 0; i < n; ++i) {
+		dst[i] = src[i] * stepsize;
+	}
+}
+
+/* x / 2 rounds toward zero: add the sign bit before the arithmetic shift */
+
+#ifdef OPJ_KERNELS_SSE2
+
+OPJ_TARGET_SSE2 static void t1_dequant_int_sse2(int* restrict dst, const int* restrict src, int n) {
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(src + i));
+		x = _mm_srai_epi32(_mm_add_epi32(x, _mm_srli_epi32(x, 31)), 1);
+		_mm_storeu_si128((__m128i*)(dst + i), x);
+	}
+	t1_dequant_int_c(dst + i, src + i, n - i);
+}
+
+OPJ_TARGET_SSE2 static void t1_dequant_real_sse2(float* restrict dst, const int* restrict src, int n, float stepsize) {
+	const __m128 step = _mm_set1_ps(stepsize);
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128 x = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(src + i)));
+		_mm_storeu_ps(dst + i, _mm_mul_ps(x, step));
+	}
+	t1_dequant_real_c(dst + i, src + i, n - i, stepsize);
+}
+
+#endif /* OPJ_KERNELS_SSE2 */
+
+#ifdef OPJ_KERNELS_AVX2
+
+OPJ_TARGET_AVX2 static void t1_dequant_int_avx2(int* restrict dst, const int* restrict src, int n) {
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(src + i));
+		x = _mm256_srai_epi32(_mm256_add_epi32(x, _mm256_srli_epi32(x, 31)), 1);
+		_mm256_storeu_si256((__m256i*)(dst + i), x);
+	}
+	t1_dequant_int_c(dst + i, src + i, n - i);
+}
+
+OPJ_TARGET_AVX2 static void t1_dequant_real_avx2(float* restrict dst, const int* restrict src, int n, float stepsize) {
+	const __m256 step = _mm256_set1_ps(stepsize);
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256 x = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(src + i)));
+		_mm256_storeu_ps(dst + i, _mm256_mul_ps(x, step));
+	}
+	t1_dequant_real_c(dst + i, src + i, n - i, stepsize);
+}
+
+#endif /* OPJ_KERNELS_AVX2 */
+
+#ifdef OPJ_KERNELS_AVX512
+
+OPJ_TARGET_AVX512 static void t1_dequant_int_avx512(int* restrict dst, const int* restrict src, int n) {
+	int i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m512i x = _mm512_loadu_si512((const void*)(src + i));
+		x = _mm512_srai_epi32(_mm512_add_epi32(x, _mm512_srli_epi32(x, 31)), 1);
+		_mm512_storeu_si512((void*)(dst + i), x);
+	}
+	t1_dequant_int_c(dst + i, src + i, n - i);
+}
+
+OPJ_TARGET_AVX512 static void t1_dequant_real_avx512(float* restrict dst, const int* restrict src, int n, float stepsize) {
+	const __m512 step = _mm512_set1_ps(stepsize);
+	int i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m512 x = _mm512_cvtepi32_ps(_mm512_loadu_si512((const void*)(src + i)));
+		_mm512_storeu_ps(dst + i, _mm512_mul_ps(x, step));
+	}
+	t1_dequant_real_c(dst + i, src + i, n - i, stepsize);
+}
+
+#endif /* OPJ_KERNELS_AVX512 */
+
+static const opj_t1_kernels_t t1_kernels_c = {
+	t1_dequant_int_c, t1_dequant_real_c
+};
+
+#ifdef OPJ_KERNELS_SSE2
+static const opj_t1_kernels_t t1_kernels_sse2 = {
+	t1_dequant_int_sse2, t1_dequant_real_sse2
+};
+#endif
+
+#ifdef OPJ_KERNELS_AVX2
+static const opj_t1_kernels_t t1_kernels_avx2 = {
+	t1_dequant_int_avx2, t1_dequant_real_avx2
+};
+#endif
+
+#ifdef OPJ_KERNELS_AVX512
+static const opj_t1_kernels_t t1_kernels_avx512 = {
+	t1_dequant_int_avx512, t1_dequant_real_avx512
+};
+#endif
+
+static const opj_t1_kernels_t* t1_get_kernels(void) {
+	switch (opj_cpu_level()) {
+#ifdef OPJ_KERNELS_AVX512
+		case OPJ_SIMD_AVX512:
+			return &t1_kernels_avx512;
+#endif
+#ifdef OPJ_KERNELS_AVX2
+		case OPJ_SIMD_AVX2:
+			return &t1_kernels_avx2;
+#endif
+#ifdef OPJ_KERNELS_SSE2
+		case OPJ_SIMD_SSE2:
+			return &t1_kernels_sse2;
+#endif
+		default:
+			return &t1_kernels_c;
+	}
+}
+
+static void t1_decode_cblk_job(void *user_data, int index, int slot) {
+	opj_t1_dec_job_t *job = (opj_t1_dec_job_t*) user_data;
+	opj_t1_dec_cblk_t *item = &job->cblks[index];
+	opj_tcd_tilecomp_t* tilec = job->tilec;
+	opj_tccp_t* tccp = job->tccp;
+	opj_tcd_band_t* band = item->band;
+	opj_t1_t* t1 = job->t1s[slot];
+	int tile_w = tilec->x1 - tilec->x0;
+	int* restrict datap;
+	int cblk_w, cblk_h;
+	int i, j;
+
+	/* slots are never shared by two running items, so the scratch needs no lock */
+	if (!t1) {
+		t1 = job->t1s[slot] = t1_create(job->t1s[0]->cinfo);
+		if (!t1) {
+			job->failed[slot] = OPJ_TRUE;
+			return;
+		}
+	}
+
+	if (!t1_decode_cblk(
+			t1,
+			item->cblk,
+			band->bandno,
+			tccp->roishift,
+			tccp->cblksty)) {
+		job->failed[slot] = OPJ_TRUE;
+		return;
+	}
+
+	datap=t1->data;
+	cblk_w = t1->w;
+	cblk_h = t1->h;
+
+	if (tccp->roishift) {
+		int thresh = 1 << tccp->roishift;
+		for (j = 0; j < cblk_h; ++j) {
+			for (i = 0; i < cblk_w; ++i) {
+				int val = datap[(j * cblk_w) + i];
+				int mag = abs(val);
+				if (mag >= thresh) {
+					mag >>= tccp->roishift;
+					datap[(j * cblk_w) + i] = val < 0 ? -mag : mag;
+				}
+			}
+		}
+	}
+
+	/* code-blocks cover disjoint areas of the tile component */
+	if (tccp->qmfbid == 1) {
+		int* restrict tiledp = &tilec->data[(item->y * tile_w) + item->x];
+		for (j = 0; j < cblk_h; ++j) {
+			job->kernels->dequant_int(&tiledp[j * tile_w], &datap[j * cblk_w], cblk_w);
+		}
+	} else {		/* if (tccp->qmfbid == 0) */
+		float* restrict tiledp = (float*) &tilec->data[(item->y * tile_w) + item->x];
+		for (j = 0; j < cblk_h; ++j) {
+			job->kernels->dequant_real(&tiledp[j * tile_w], &datap[j * cblk_w], cblk_w, band->stepsize);
+		}
+	}
+}
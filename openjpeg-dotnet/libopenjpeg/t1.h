@@ -44,26 +44,71 @@ in T1.C are used by some function in TCD.C.
 /* ----------------------------------------------------------------------- */
 #define T1_NMSEDEC_BITS 7
 
-#define T1_SIG_NE 0x0001	/**< Context orientation : North-East direction */
-#define T1_SIG_SE 0x0002	/**< Context orientation : South-East direction */
-#define T1_SIG_SW 0x0004	/**< Context orientation : South-West direction */
-#define T1_SIG_NW 0x0008	/**< Context orientation : North-West direction */
-#define T1_SIG_N 0x0010		/**< Context orientation : North direction */
-#define T1_SIG_E 0x0020		/**< Context orientation : East direction */
-#define T1_SIG_S 0x0040		/**< Context orientation : South direction */
-#define T1_SIG_W 0x0080		/**< Context orientation : West direction */
-#define T1_SIG_OTH (T1_SIG_N|T1_SIG_NE|T1_SIG_E|T1_SIG_SE|T1_SIG_S|T1_SIG_SW|T1_SIG_W|T1_SIG_NW)
-#define T1_SIG_PRIM (T1_SIG_N|T1_SIG_E|T1_SIG_S|T1_SIG_W)
-
-#define T1_SGN_N 0x0100
-#define T1_SGN_E 0x0200
-#define T1_SGN_S 0x0400
-#define T1_SGN_W 0x0800
-#define T1_SGN (T1_SGN_N|T1_SGN_E|T1_SGN_S|T1_SGN_W)
-
-#define T1_SIG 0x1000
-#define T1_REFINE 0x2000
-#define T1_VISIT 0x4000
+/*
+The flags of a code-block are kept per stripe column: a flag_t holds the state of the
+four samples of one column of a stripe and the significance of their neighbours, so
+the context of a sample is found with a few shifts of one word. Bits 0 to 17 are the
+significance of the 3x6 neighbourhood of the column, one row after the other from the
+row above the stripe to the row below it, each row from west to east. The sign,
+refinement and visit bits of the four rows follow, three bits apart like the rows of
+the neighbourhood, so that shifting a word right by 3*ci brings the bits of row ci to
+the positions of row 0. Bits 18 and 31 hold the signs of the samples above and below
+the stripe.
+*/
+#define T1_SIGMA_0 (1U << 0)	/**< North-west of row 0 is significant */
+#define T1_SIGMA_1 (1U << 1)	/**< North of row 0 is significant */
+#define T1_SIGMA_2 (1U << 2)	/**< North-east of row 0 is significant */
+#define T1_SIGMA_3 (1U << 3)	/**< West of row 0 is significant */
+#define T1_SIGMA_4 (1U << 4)	/**< Row 0 is significant */
+#define T1_SIGMA_5 (1U << 5)	/**< East of row 0 is significant */
+#define T1_SIGMA_6 (1U << 6)
+#define T1_SIGMA_7 (1U << 7)
+#define T1_SIGMA_8 (1U << 8)
+#define T1_SIGMA_9 (1U << 9)
+#define T1_SIGMA_10 (1U << 10)
+#define T1_SIGMA_11 (1U << 11)
+#define T1_SIGMA_12 (1U << 12)
+#define T1_SIGMA_13 (1U << 13)
+#define T1_SIGMA_14 (1U << 14)
+#define T1_SIGMA_15 (1U << 15)	/**< South-west of row 3 is significant */
+#define T1_SIGMA_16 (1U << 16)	/**< South of row 3 is significant */
+#define T1_SIGMA_17 (1U << 17)	/**< South-east of row 3 is significant */
+
+#define T1_CHI_0 (1U << 18)	/**< North of row 0 is negative */
+#define T1_CHI_0_I 18
+#define T1_CHI_1 (1U << 19)	/**< Row 0 is negative */
+#define T1_CHI_1_I 19
+#define T1_MU_0 (1U << 20)	/**< Row 0 has been refined */
+#define T1_PI_0 (1U << 21)	/**< Row 0 has been visited by the current bit-plane */
+#define T1_CHI_2 (1U << 22)
+#define T1_CHI_2_I 22
+#define T1_MU_1 (1U << 23)
+#define T1_PI_1 (1U << 24)
+#define T1_CHI_3 (1U << 25)
+#define T1_MU_2 (1U << 26)
+#define T1_PI_2 (1U << 27)
+#define T1_CHI_4 (1U << 28)
+#define T1_MU_3 (1U << 29)
+#define T1_PI_3 (1U << 30)
+#define T1_CHI_5 (1U << 31)	/**< South of row 3 is negative */
+#define T1_CHI_5_I 31
+
+#define T1_SIGMA_NEIGHBOURS (T1_SIGMA_0|T1_SIGMA_1|T1_SIGMA_2|T1_SIGMA_3|T1_SIGMA_5|T1_SIGMA_6|T1_SIGMA_7|T1_SIGMA_8)
+#define T1_SIGMA_THIS T1_SIGMA_4
+#define T1_CHI_THIS T1_CHI_1
+#define T1_CHI_THIS_I T1_CHI_1_I
+#define T1_MU_THIS T1_MU_0
+#define T1_PI_THIS T1_PI_0
+
+/* index of lut_ctxno_sc and lut_spb, see t1_getsgnidx */
+#define T1_LUT_SGN_W (1U << 0)
+#define T1_LUT_SIG_N (1U << 1)
+#define T1_LUT_SGN_E (1U << 2)
+#define T1_LUT_SIG_W (1U << 3)
+#define T1_LUT_SGN_N (1U << 4)
+#define T1_LUT_SIG_E (1U << 5)
+#define T1_LUT_SGN_S (1U << 6)
+#define T1_LUT_SIG_S (1U << 7)
 
 #define T1_NUMCTXS_ZC 9
 #define T1_NUMCTXS_SC 5
@@ -85,7 +130,10 @@ in T1.C are used by some function in TCD.C.
 
 /* ----------------------------------------------------------------------- */
 
-typedef short flag_t;
+/**
+State of the four samples of a stripe column, see T1_SIGMA_0
+*/
+typedef unsigned int flag_t;
 
 /**
 Tier-1 coding (coding of code-block coefficients)
@@ -105,11 +153,10 @@ typedef struct opj_t1 {
 	int h;
 	int datasize;
 	int flagssize;
+	/** number of flags of a stripe, one per column and one on each side */
 	int flags_stride;
 } opj_t1_t;
 
-#define MACRO_t1_flags(x,y) t1->flags[((x)*(t1->flags_stride))+(y)]
-
 /** @name Exported functions */
 /*@{*/
 /* ----------------------------------------------------------------------- */
@@ -130,15 +177,21 @@ Encode the code-blocks of a tile
 @param t1 T1 handle
 @param tile The tile to encode
 @param tcp Tile coding parameters
+@param num_threads Most threads encoding code-blocks at the same time, 0 for
+one per processor. The codestream does not depend on it
 */
-void t1_encode_cblks(opj_t1_t *t1, opj_tcd_tile_t *tile, opj_tcp_t *tcp);
+void t1_encode_cblks(opj_t1_t *t1, opj_tcd_tile_t *tile, opj_tcp_t *tcp, int num_threads);
 /**
 Decode the code-blocks of a tile
-@param t1 T1 handle
+@param scratch Scratch memory of the tile decoder, scratch->t1s[0] must be set. The
+T1 handles of the other threads are created in it on first use and kept
 @param tilec The tile to decode
 @param tccp Tile coding parameters
+@param num_threads Most threads decoding code-blocks at the same time, 0 for
+one per processor
+@return Returns false if the memory of a code-block or of a thread could not be allocated
 */
-void t1_decode_cblks(opj_t1_t* t1, opj_tcd_tilecomp_t* tilec, opj_tccp_t* tccp);
+opj_bool t1_decode_cblks(opj_tcd_scratch_t* scratch, opj_tcd_tilecomp_t* tilec, opj_tccp_t* tccp, int num_threads);
 /* ----------------------------------------------------------------------- */
 /*@}*/
 
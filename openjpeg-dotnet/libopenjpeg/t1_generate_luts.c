@@ -36,9 +36,9 @@
 static int t1_init_ctxno_zc(int f, int orient) {
 	int h, v, d, n, t, hv;
 	n = 0;
-	h = ((f & T1_SIG_W) != 0) + ((f & T1_SIG_E) != 0);
-	v = ((f & T1_SIG_N) != 0) + ((f & T1_SIG_S) != 0);
-	d = ((f & T1_SIG_NW) != 0) + ((f & T1_SIG_NE) != 0) + ((f & T1_SIG_SE) != 0) + ((f & T1_SIG_SW) != 0);
+	h = ((f & T1_SIGMA_3) != 0) + ((f & T1_SIGMA_5) != 0);
+	v = ((f & T1_SIGMA_1) != 0) + ((f & T1_SIGMA_7) != 0);
+	d = ((f & T1_SIGMA_0) != 0) + ((f & T1_SIGMA_2) != 0) + ((f & T1_SIGMA_8) != 0) + ((f & T1_SIGMA_6) != 0);
 
 	switch (orient) {
 		case 2:
@@ -109,19 +109,19 @@ static int t1_init_ctxno_sc(int f) {
 	int hc, vc, n;
 	n = 0;
 
-	hc = int_min(((f & (T1_SIG_E | T1_SGN_E)) ==
-				T1_SIG_E) + ((f & (T1_SIG_W | T1_SGN_W)) == T1_SIG_W),
-			1) - int_min(((f & (T1_SIG_E | T1_SGN_E)) ==
-					(T1_SIG_E | T1_SGN_E)) +
-				((f & (T1_SIG_W | T1_SGN_W)) ==
-				 (T1_SIG_W | T1_SGN_W)), 1);
+	hc = int_min(((f & (T1_LUT_SIG_E | T1_LUT_SGN_E)) ==
+				T1_LUT_SIG_E) + ((f & (T1_LUT_SIG_W | T1_LUT_SGN_W)) == T1_LUT_SIG_W),
+			1) - int_min(((f & (T1_LUT_SIG_E | T1_LUT_SGN_E)) ==
+					(T1_LUT_SIG_E | T1_LUT_SGN_E)) +
+				((f & (T1_LUT_SIG_W | T1_LUT_SGN_W)) ==
+				 (T1_LUT_SIG_W | T1_LUT_SGN_W)), 1);
 
-	vc = int_min(((f & (T1_SIG_N | T1_SGN_N)) ==
-				T1_SIG_N) + ((f & (T1_SIG_S | T1_SGN_S)) == T1_SIG_S),
-			1) - int_min(((f & (T1_SIG_N | T1_SGN_N)) ==
-					(T1_SIG_N | T1_SGN_N)) +
-				((f & (T1_SIG_S | T1_SGN_S)) ==
-				 (T1_SIG_S | T1_SGN_S)), 1);
+	vc = int_min(((f & (T1_LUT_SIG_N | T1_LUT_SGN_N)) ==
+				T1_LUT_SIG_N) + ((f & (T1_LUT_SIG_S | T1_LUT_SGN_S)) == T1_LUT_SIG_S),
+			1) - int_min(((f & (T1_LUT_SIG_N | T1_LUT_SGN_N)) ==
+					(T1_LUT_SIG_N | T1_LUT_SGN_N)) +
+				((f & (T1_LUT_SIG_S | T1_LUT_SGN_S)) ==
+				 (T1_LUT_SIG_S | T1_LUT_SGN_S)), 1);
 
 	if (hc < 0) {
 		hc = -hc;
@@ -149,19 +149,19 @@ static int t1_init_ctxno_sc(int f) {
 static int t1_init_spb(int f) {
 	int hc, vc, n;
 
-	hc = int_min(((f & (T1_SIG_E | T1_SGN_E)) ==
-				T1_SIG_E) + ((f & (T1_SIG_W | T1_SGN_W)) == T1_SIG_W),
-			1) - int_min(((f & (T1_SIG_E | T1_SGN_E)) ==
-					(T1_SIG_E | T1_SGN_E)) +
-				((f & (T1_SIG_W | T1_SGN_W)) ==
-				 (T1_SIG_W | T1_SGN_W)), 1);
+	hc = int_min(((f & (T1_LUT_SIG_E | T1_LUT_SGN_E)) ==
+				T1_LUT_SIG_E) + ((f & (T1_LUT_SIG_W | T1_LUT_SGN_W)) == T1_LUT_SIG_W),
+			1) - int_min(((f & (T1_LUT_SIG_E | T1_LUT_SGN_E)) ==
+					(T1_LUT_SIG_E | T1_LUT_SGN_E)) +
+				((f & (T1_LUT_SIG_W | T1_LUT_SGN_W)) ==
+				 (T1_LUT_SIG_W | T1_LUT_SGN_W)), 1);
 
-	vc = int_min(((f & (T1_SIG_N | T1_SGN_N)) ==
-				T1_SIG_N) + ((f & (T1_SIG_S | T1_SGN_S)) == T1_SIG_S),
-			1) - int_min(((f & (T1_SIG_N | T1_SGN_N)) ==
-					(T1_SIG_N | T1_SGN_N)) +
-				((f & (T1_SIG_S | T1_SGN_S)) ==
-				 (T1_SIG_S | T1_SGN_S)), 1);
+	vc = int_min(((f & (T1_LUT_SIG_N | T1_LUT_SGN_N)) ==
+				T1_LUT_SIG_N) + ((f & (T1_LUT_SIG_S | T1_LUT_SGN_S)) == T1_LUT_SIG_S),
+			1) - int_min(((f & (T1_LUT_SIG_N | T1_LUT_SGN_N)) ==
+					(T1_LUT_SIG_N | T1_LUT_SGN_N)) +
+				((f & (T1_LUT_SIG_S | T1_LUT_SGN_S)) ==
+				 (T1_LUT_SIG_S | T1_LUT_SGN_S)), 1);
 
 	if (!hc && !vc)
 		n = 0;
@@ -186,7 +186,7 @@ int main(){
 	int i, j;
 	double u, v, t;
 
-	int lut_ctxno_zc[1024];
+	int lut_ctxno_zc[2048];
 	int lut_nmsedec_sig[1 << T1_NMSEDEC_BITS];
 	int lut_nmsedec_sig0[1 << T1_NMSEDEC_BITS];
 	int lut_nmsedec_ref[1 << T1_NMSEDEC_BITS];
@@ -196,42 +196,42 @@ int main(){
 
 	// lut_ctxno_zc
 	for (j = 0; j < 4; ++j) {
-		for (i = 0; i < 256; ++i) {
+		for (i = 0; i < 512; ++i) {
 			int orient = j;
 			if (orient == 2) {
 				orient = 1;
 			} else if (orient == 1) {
 				orient = 2;
 			}
-			lut_ctxno_zc[(orient << 8) | i] = t1_init_ctxno_zc(i, j);
+			lut_ctxno_zc[(orient << 9) | i] = t1_init_ctxno_zc(i, j);
 		}
 	}
 
-	printf("static char lut_ctxno_zc[1024] = {\n  ");
-	for (i = 0; i < 1023; ++i) {
+	printf("static char lut_ctxno_zc[2048] = {\n  ");
+	for (i = 0; i < 2047; ++i) {
 		printf("%i, ", lut_ctxno_zc[i]);
 		if(!((i+1)&0x1f))
 			printf("\n  ");
 	}
-	printf("%i\n};\n\n", lut_ctxno_zc[1023]);
+	printf("%i\n};\n\n", lut_ctxno_zc[2047]);
 
 	// lut_ctxno_sc
 	printf("static char lut_ctxno_sc[256] = {\n  ");
 	for (i = 0; i < 255; ++i) {
-		printf("0x%x, ", t1_init_ctxno_sc(i << 4));
+		printf("0x%x, ", t1_init_ctxno_sc(i));
 		if(!((i+1)&0xf))
 			printf("\n  ");
 	}
-	printf("0x%x\n};\n\n", t1_init_ctxno_sc(255 << 4));
+	printf("0x%x\n};\n\n", t1_init_ctxno_sc(255));
 
 	// lut_spb
 	printf("static char lut_spb[256] = {\n  ");
 	for (i = 0; i < 255; ++i) {
-		printf("%i, ", t1_init_spb(i << 4));
+		printf("%i, ", t1_init_spb(i));
 		if(!((i+1)&0x1f))
 			printf("\n  ");
 	}
-	printf("%i\n};\n\n", t1_init_spb(255 << 4));
+	printf("%i\n};\n\n", t1_init_spb(255));
 
 	/* FIXME FIXME FIXME */
 	/* fprintf(stdout,"nmsedec luts:\n"); */
@@ -59,12 +59,14 @@ Encode a packet of a tile to a destination buffer
 */
 static int t2_encode_packet(opj_tcd_tile_t *tile, opj_tcp_t *tcp, opj_pi_iterator_t *pi, unsigned char *dest, int len, opj_codestream_info_t *cstr_info, int tileno);
 /**
+Initialize a new segment of a code-block, the segments array only grows so that it is kept from one image to the next
 @param cblk
 @param index
 @param cblksty
 @param first
+@return Returns false if the segments array can not be grown
 */
-static void t2_init_seg(opj_tcd_cblk_dec_t* cblk, int index, int cblksty, int first);
+static opj_bool t2_init_seg(opj_tcd_cblk_dec_t* cblk, int index, int cblksty, int first);
 /**
 Decode a packet of a tile from a source buffer
 @param t2 T2 handle
@@ -296,13 +298,21 @@ static int t2_encode_packet(opj_tcd_tile_t * tile, opj_tcp_t * tcp, opj_pi_itera
 	return (c - dest);
 }
 
-static void t2_init_seg(opj_tcd_cblk_dec_t* cblk, int index, int cblksty, int first) {
+static opj_bool t2_init_seg(opj_tcd_cblk_dec_t* cblk, int index, int cblksty, int first) {
 	opj_tcd_seg_t* seg;
-	cblk->segs = (opj_tcd_seg_t*) opj_realloc(cblk->segs, (index + 1) * sizeof(opj_tcd_seg_t));
+	if (index >= cblk->segs_size) {
+		seg = (opj_tcd_seg_t*) opj_realloc(cblk->segs, (index + 1) * sizeof(opj_tcd_seg_t));
+		if (!seg) {
+			return OPJ_FALSE;
+		}
+		cblk->segs = seg;
+		cblk->segs_size = index + 1;
+	}
 	seg = &cblk->segs[index];
 	seg->data = NULL;
 	seg->dataindex = 0;
 	seg->numpasses = 0;
+	seg->real_num_passes = 0;
 	seg->len = 0;
 	if (cblksty & J2K_CCP_CBLKSTY_TERMALL) {
 		seg->maxpasses = 1;
@@ -316,6 +326,7 @@ static void t2_init_seg(opj_tcd_cblk_dec_t* cblk, int index, int cblksty, int fi
 	} else {
 		seg->maxpasses = 109;
 	}
+	return OPJ_TRUE;
 }
 
 static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_tile_t *tile, 
@@ -332,10 +343,20 @@ static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_t
 
 	opj_tcd_resolution_t* res = &tile->comps[compno].resolutions[resno];
 
+	/* 
+	a packet of a layer beyond cp_layer is only parsed to keep the tag trees
+	and segment counts in step, tier-1 never sees its passes
+	*/
+	int skip_layer = cp->layer != 0 && layno >= cp->layer;
+	/* the code-block data is only kept if tier-1 is going to decode it */
+	int keep_data = !skip_layer && cp->limit_decoding != LIMIT_TO_PACKET_HEADERS &&
+		resno < tile->comps[compno].minimum_num_resolutions;
+
 	unsigned char *hd = NULL;
 	int present;
 	
-	opj_bio_t *bio = NULL;	/* BIO component */
+	opj_bio_t bio_dec;	/* BIO component, a packet header is read at once */
+	opj_bio_t *bio = &bio_dec;
 	
 	if (layno == 0) {
 		for (bandno = 0; bandno < res->numbands; bandno++) {
@@ -349,6 +370,7 @@ static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_t
 			for (cblkno = 0; cblkno < prc->cw * prc->ch; cblkno++) {
 				opj_tcd_cblk_dec_t* cblk = &prc->cblks.dec[cblkno];
 				cblk->numsegs = 0;
+				cblk->real_num_segs = 0;
 			}
 		}
 	}
@@ -372,8 +394,6 @@ static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_t
 	step 2: Return to codestream for decoding 
 	*/
 
-	bio = bio_create();
-	
 	if (cp->ppm == 1) {		/* PPM */
 		hd = cp->ppm_data;
 		bio_init_dec(bio, hd, cp->ppm_len);
@@ -390,7 +410,6 @@ static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_t
 	if (!present) {
 		bio_inalign(bio);
 		hd += bio_numbytes(bio);
-		bio_destroy(bio);
 		
 		/* EPH markers */
 		
@@ -462,12 +481,16 @@ static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_t
 			cblk->numlenbits += increment;
 			segno = 0;
 			if (!cblk->numsegs) {
-				t2_init_seg(cblk, segno, tcp->tccps[compno].cblksty, 1);
+				if (!t2_init_seg(cblk, segno, tcp->tccps[compno].cblksty, 1)) {
+					return -999;
+				}
 			} else {
 				segno = cblk->numsegs - 1;
 				if (cblk->segs[segno].numpasses == cblk->segs[segno].maxpasses) {
 					++segno;
-					t2_init_seg(cblk, segno, tcp->tccps[compno].cblksty, 0);
+					if (!t2_init_seg(cblk, segno, tcp->tccps[compno].cblksty, 0)) {
+						return -999;
+					}
 				}
 			}
 			n = cblk->numnewpasses;
@@ -478,19 +501,19 @@ static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_t
 				n -= cblk->segs[segno].numnewpasses;
 				if (n > 0) {
 					++segno;
-					t2_init_seg(cblk, segno, tcp->tccps[compno].cblksty, 0);
+					if (!t2_init_seg(cblk, segno, tcp->tccps[compno].cblksty, 0)) {
+						return -999;
+					}
 				}
 			} while (n > 0);
 		}
 	}
 	
 	if (bio_inalign(bio)) {
-		bio_destroy(bio);
 		return -999;
 	}
 	
 	hd += bio_numbytes(bio);
-	bio_destroy(bio);
 	
 	/* EPH markers */
 	if (tcp->csty & J2K_CP_CSTY_EPH) {
@@ -568,15 +591,30 @@ static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_t
 
 #endif /* USE_JPWL */
 				
-				cblk->data = (unsigned char*) opj_realloc(cblk->data, (cblk->len + seg->newlen) * sizeof(unsigned char));
-				memcpy(cblk->data + cblk->len, c, seg->newlen);
+				/* skipped segments are measured but not copied */
+				if (keep_data) {
+					/* the MQ decoder overwrites the bytes following a segment */
+					int size = cblk->len + seg->newlen + MQC_SENTINEL_LEN;
+					if (size > cblk->data_size) {
+						unsigned char *data = (unsigned char*) opj_realloc(cblk->data, size * sizeof(unsigned char));
+						if (!data) {
+							return -999;
+						}
+						cblk->data = data;
+						cblk->data_size = size;
+					}
+					memcpy(cblk->data + cblk->len, c, seg->newlen);
+				}
 				if (seg->numpasses == 0) {
 					seg->data = &cblk->data;
 					seg->dataindex = cblk->len;
 				}
 				c += seg->newlen;
-				cblk->len += seg->newlen;
-				seg->len += seg->newlen;
+				if (!skip_layer) {
+					cblk->len += seg->newlen;
+					seg->len += seg->newlen;
+					seg->real_num_passes += seg->numnewpasses;
+				}
 				seg->numpasses += seg->numnewpasses;
 				cblk->numnewpasses -= seg->numnewpasses;
 				if (cblk->numnewpasses > 0) {
@@ -584,6 +622,9 @@ static int t2_decode_packet(opj_t2_t* t2, unsigned char *src, int len, opj_tcd_t
 					cblk->numsegs++;
 				}
 			} while (cblk->numnewpasses > 0);
+			if (!skip_layer) {
+				cblk->real_num_segs = cblk->numsegs;
+			}
 		}
 	}
 	
@@ -693,8 +734,8 @@ int t2_decode_packets(opj_t2_t *t2, unsigned char *src, int len, int tileno, opj
 	opj_image_t *image = t2->image;
 	opj_cp_t *cp = t2->cp;
 	
-	/* create a packet iterator */
-	pi = pi_create_decode(image, cp, tileno);
+	/* create a packet iterator, released with the arena */
+	pi = pi_create_decode(image, cp, tileno, t2->arena);
 	if(!pi) {
 		/* TODO: throw an error */
 		return -999;
@@ -704,22 +745,29 @@ int t2_decode_packets(opj_t2_t *t2, unsigned char *src, int len, int tileno, opj
 	
 	for (pino = 0; pino <= cp->tcps[tileno].numpocs; pino++) {
 		while (pi_next(&pi[pino])) {
-			if ((cp->layer==0) || (cp->layer>=((pi[pino].layno)+1))) {
-				opj_packet_info_t *pack_info;
-				if (cstr_info)
-					pack_info = &cstr_info->tile[tileno].packet[cstr_info->packno];
-				else
-					pack_info = NULL;
-				e = t2_decode_packet(t2, c, src + len - c, tile, &cp->tcps[tileno], &pi[pino], pack_info);
-			} else {
-				e = 0;
+			opj_packet_info_t *pack_info;
+			int skip_layer = cp->layer != 0 && pi[pino].layno >= cp->layer;
+
+			/* 
+			in the last progression of a layer-major order every remaining packet
+			is beyond cp_layer too, so there is nothing left worth parsing
+			*/
+			if (skip_layer && pino == cp->tcps[tileno].numpocs && pi[pino].poc.prg == LRCP) {
+				break;
 			}
+
+			if (cstr_info)
+				pack_info = &cstr_info->tile[tileno].packet[cstr_info->packno];
+			else
+				pack_info = NULL;
+			/* packets beyond cp_layer are still parsed to find where the next one starts */
+			e = t2_decode_packet(t2, c, src + len - c, tile, &cp->tcps[tileno], &pi[pino], pack_info);
 			if(e == -999) return -999;
-			/* progression in resolution */
-			image->comps[pi[pino].compno].resno_decoded =	
-				(e > 0) ? 
-				int_max(pi[pino].resno, image->comps[pi[pino].compno].resno_decoded) 
-				: image->comps[pi[pino].compno].resno_decoded;
+			/* progression in resolution, folded into the image by tcd once the tile is done */
+			tile->comps[pi[pino].compno].resno_decoded =	
+				(e > 0 && !skip_layer) ? 
+				int_max(pi[pino].resno, tile->comps[pi[pino].compno].resno_decoded) 
+				: tile->comps[pi[pino].compno].resno_decoded;
 			n++;
 
 			/* INDEX >> */
@@ -758,9 +806,6 @@ int t2_decode_packets(opj_t2_t *t2, unsigned char *src, int len, int tileno, opj
 	}
 	/* << INDEX */
 
-	/* don't forget to release pi */
-	pi_destroy(pi, cp, tileno);
-	
 	if (e == -999) {
 		return e;
 	}
@@ -770,19 +815,20 @@ int t2_decode_packets(opj_t2_t *t2, unsigned char *src, int len, int tileno, opj
 
 /* ----------------------------------------------------------------------- */
 
-opj_t2_t* t2_create(opj_common_ptr cinfo, opj_image_t *image, opj_cp_t *cp) {
+opj_t2_t* t2_create(opj_common_ptr cinfo, opj_image_t *image, opj_cp_t *cp, opj_arena_t *arena) {
 	/* create the tcd structure */
-	opj_t2_t *t2 = (opj_t2_t*)opj_malloc(sizeof(opj_t2_t));
+	opj_t2_t *t2 = arena ? (opj_t2_t*)opj_arena_malloc(arena, sizeof(opj_t2_t)) : (opj_t2_t*)opj_malloc(sizeof(opj_t2_t));
 	if(!t2) return NULL;
 	t2->cinfo = cinfo;
 	t2->image = image;
 	t2->cp = cp;
+	t2->arena = arena;
 
 	return t2;
 }
 
 void t2_destroy(opj_t2_t *t2) {
-	if(t2) {
+	if(t2 && !t2->arena) {
 		opj_free(t2);
 	}
 }
@@ -50,6 +50,8 @@ typedef struct opj_t2 {
 	opj_image_t *image;
 	/** pointer to the image coding parameters */
 	opj_cp_t *cp;
+	/** Decoding: arena the handle and the packet iterators are taken from, NULL when encoding */
+	opj_arena_t *arena;
 } opj_t2_t;
 
 /** @name Exported functions */
@@ -88,11 +90,12 @@ Create a T2 handle
 @param cinfo Codec context info
 @param image Source or destination image
 @param cp Image coding parameters
+@param arena Decoding: arena the handle and its packet iterators are taken from. NULL when encoding
 @return Returns a new T2 handle if successful, returns NULL otherwise
 */
-opj_t2_t* t2_create(opj_common_ptr cinfo, opj_image_t *image, opj_cp_t *cp);
+opj_t2_t* t2_create(opj_common_ptr cinfo, opj_image_t *image, opj_cp_t *cp, opj_arena_t *arena);
 /**
-Destroy a T2 handle
+Destroy a T2 handle, a handle taken from an arena is released with it
 @param t2 T2 handle to destroy
 */
 void t2_destroy(opj_t2_t *t2);
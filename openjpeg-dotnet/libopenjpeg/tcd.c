@@ -32,6 +32,174 @@
 
 #include "opj_includes.h"
 
+/**
+Tiles decoded by tcd_decode_tiles
+*/
+typedef struct opj_tcd_decode_job {
+	opj_tcd_t *tcd;
+	unsigned char **tile_data;
+	int *tile_len;
+	/** result of each tile, in codestream order */
+	opj_bool *success;
+} opj_tcd_decode_job_t;
+
+/**
+Input and output kernels of one instruction set level, see tcd_get_kernels
+*/
+typedef struct tcd_kernels {
+	/** DC level shift and clamp of a row of reversible samples to the planar output */
+	void (*output_int)(int* restrict dst, const int* restrict src, int n, int adjust, int min, int max);
+	/** rounding, DC level shift and clamp of a row of irreversible samples to the planar output */
+	void (*output_real)(int* restrict dst, const float* restrict src, int n, int adjust, int min, int max);
+	/** one row of pixels of tcd_write_interleaved */
+	void (*interleave)(unsigned char* restrict dst, const int* const* row, const int* chan, const int* pos, const int* real, int w);
+	/** one row of pixels of tcd_read_interleaved */
+	void (*deinterleave)(int* const* row, const unsigned char* restrict src, const int* pos, int numcomps, int real, int mct, int w);
+} tcd_kernels_t;
+
+/** @name Local static functions */
+/*@{*/
+
+/**
+Write a decoded tile to the interleaved 8 bit output of the decoder. The DC level shift, 
+the rounding of irreversible samples, the clamp and the narrowing are done in a single pass, 
+so the samples never go through the components of the image.
+@param tcd TCD handle
+@param tcp Coding parameters of the tile
+@param tile Tile after the inverse DWT and MCT
+@return Returns false if the components cannot be written as interleaved 8 bit pixels
+*/
+static opj_bool tcd_write_interleaved(opj_tcd_t *tcd, opj_tcp_t *tcp, opj_tcd_tile_t *tile);
+/**
+Read a tile to encode from the interleaved 8 bit input of the encoder. The DC level shift, 
+the scaling of irreversible samples and the forward MCT are done in a single pass, so the 
+samples never go through the components of the image. j2k_encode has checked the components.
+@param tcd TCD handle
+@param tcp Coding parameters of the tile
+@param tile Tile to fill, before the forward DWT
+*/
+static void tcd_read_interleaved(opj_tcd_t *tcd, opj_tcp_t *tcp, opj_tcd_tile_t *tile);
+/**
+Write a row of a tile component to the planar output: DC level shift and clamp to the
+range of the image component
+@param dst First sample of the row in the image component
+@param src First sample of the row in the tile component
+@param n Number of samples
+@param adjust DC level shift
+@param min Smallest value of the image component
+@param max Largest value of the image component
+*/
+static void tcd_output_int_c(int* restrict dst, const int* restrict src, int n, int adjust, int min, int max);
+/**
+Write a row of a tile component to the planar output as tcd_output_int_c does, the
+samples are floats rounded to nearest first
+*/
+static void tcd_output_real_c(int* restrict dst, const float* restrict src, int n, int adjust, int min, int max);
+/**
+Write a row of 8 bit RGBA or BGRA pixels
+@param dst First pixel of the row
+@param row First sample of the row in the component read for red, green, blue and alpha
+@param chan Component read for red, green, blue and alpha, -1 for an opaque alpha
+@param pos Byte of the output pixel each of them goes to
+@param real Whether each of them holds irreversible float samples
+@param w Number of pixels
+*/
+static void tcd_interleave_c(unsigned char* restrict dst, const int* const* row, const int* chan, const int* pos, const int* real, int w);
+/**
+Read a row of 8 bit RGBA or BGRA pixels into the tile components, with the results of 
+mct_encode or mct_encode_real when mct is set
+@param row First sample of the row in each tile component
+@param src First pixel of the row
+@param pos Byte of the input pixel each component is read from
+@param numcomps Number of components
+@param real Whether the samples are scaled for the irreversible transforms
+@param mct Whether the first three components go through the forward MCT
+@param w Number of pixels
+*/
+static void tcd_deinterleave_c(int* const* row, const unsigned char* restrict src, const int* pos, int numcomps, int real, int mct, int w);
+#ifdef OPJ_KERNELS_SSE2
+static void tcd_output_int_sse2(int* restrict dst, const int* restrict src, int n, int adjust, int min, int max);
+static void tcd_output_real_sse2(int* restrict dst, const float* restrict src, int n, int adjust, int min, int max);
+static void tcd_interleave_sse2(unsigned char* restrict dst, const int* const* row, const int* chan, const int* pos, const int* real, int w);
+static void tcd_deinterleave_sse2(int* const* row, const unsigned char* restrict src, const int* pos, int numcomps, int real, int mct, int w);
+#endif
+#ifdef OPJ_KERNELS_AVX2
+static void tcd_output_int_avx2(int* restrict dst, const int* restrict src, int n, int adjust, int min, int max);
+static void tcd_output_real_avx2(int* restrict dst, const float* restrict src, int n, int adjust, int min, int max);
+static void tcd_interleave_avx2(unsigned char* restrict dst, const int* const* row, const int* chan, const int* pos, const int* real, int w);
+static void tcd_deinterleave_avx2(int* const* row, const unsigned char* restrict src, const int* pos, int numcomps, int real, int mct, int w);
+#endif
+/**
+Get the output kernels of the instruction set level given by opj_cpu_level
+*/
+static const tcd_kernels_t* tcd_get_kernels(void);
+/**
+Read the packets of a tile (tier-2), the first half of tcd_decode_tile. Only the tile 
+and its part of the codestream index are written.
+@param tcd TCD handle
+@param src Source buffer
+@param len Length of source buffer
+@param tileno Number that identifies the tile
+@param cstr_info Codestream information structure
+@param scratch Scratch memory of the thread decoding the tile, its arena is reset
+@return Returns false if the tile data ends early
+*/
+static opj_bool tcd_t2_decode_tile(opj_tcd_t *tcd, unsigned char *src, int len, int tileno, opj_codestream_info_t *cstr_info, opj_tcd_scratch_t *scratch);
+/**
+Choose the resolution each component of a tile is reconstructed at. This depends on the 
+tiles read before, so it is done in codestream order.
+@param tcd TCD handle
+@param tileno Number that identifies the tile
+@return Returns false if cp_reduce removes every resolution of the tile
+*/
+static opj_bool tcd_set_resno_decoded(opj_tcd_t *tcd, int tileno);
+/**
+Decode the code-blocks of a tile, apply the inverse transforms and write the tile to the 
+image; the second half of tcd_decode_tile. Tiles cover disjoint parts of the image, so 
+several can run at the same time.
+@param tcd TCD handle
+@param tileno Number that identifies the tile
+@param scratch Scratch memory of the thread decoding the tile
+@return Returns false if the tile cannot be written
+*/
+static opj_bool tcd_t1_decode_tile(opj_tcd_t *tcd, int tileno, opj_tcd_scratch_t *scratch);
+/**
+Get the scratch memory of a thread slot of tcd_decode_tiles, created on first use
+@param tcd TCD handle
+@param slot Thread slot
+@return Returns NULL if it cannot be allocated
+*/
+static opj_tcd_scratch_t* tcd_get_scratch(opj_tcd_t *tcd, int slot);
+/**
+Make room for count elements in an array the decoder keeps from one codestream to the
+next. The elements already there keep their content, the new ones are zeroed.
+@param array Array to grow
+@param size Number of elements allocated, updated
+@param count Number of elements needed
+@param elem_size Size of an element
+@return Returns false if the array cannot be grown, it is then left as it was
+*/
+static opj_bool tcd_reserve(void **array, int *size, int count, size_t elem_size);
+/**
+Get a tag tree of numleafsh x numleafsv leaves. tree is returned if it has that size,
+otherwise it is replaced.
+@param tree Tree of the previous codestream, or NULL
+@param numleafsh Width of the tree
+@param numleafsv Height of the tree
+@return Returns NULL if the tree has no leaves or cannot be allocated
+*/
+static opj_tgt_tree_t* tcd_reuse_tgt(opj_tgt_tree_t *tree, int numleafsh, int numleafsv);
+/**
+Allocate a tile and read its packets, run on the thread pool by tcd_decode_tiles
+*/
+static void tcd_t2_decode_job(void *user_data, int index, int slot);
+/**
+Reconstruct a tile, run on the thread pool by tcd_decode_tiles
+*/
+static void tcd_t1_decode_job(void *user_data, int index, int slot);
+
+/*@}*/
+
 void tcd_dump(FILE *fd, opj_tcd_t *tcd, opj_tcd_image_t * img) {
 	int tileno, compno, resno, bandno, precno;/*, cblkno;*/
 
@@ -106,6 +274,11 @@ opj_tcd_t* tcd_create(opj_common_ptr cinfo) {
 		opj_free(tcd);
 		return NULL;
 	}
+	tcd->tcd_image->tiles = NULL;
+	tcd->tcd_image->tiles_size = 0;
+	memset(tcd->scratch, 0, sizeof(tcd->scratch));
+	tcd->tile_success = NULL;
+	tcd->tile_success_size = 0;
 
 	return tcd;
 }
@@ -607,14 +780,17 @@ void tcd_init_encode(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp, int cur
 	/* tcd_dump(stdout, tcd, &tcd->tcd_image); */
 }
 
-void tcd_malloc_decode(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp) {
+opj_bool tcd_malloc_decode(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp) {
 	int i, j, tileno, p, q;
 	unsigned int x0 = 0, y0 = 0, x1 = 0, y1 = 0, w, h;
 
 	tcd->image = image;
+	tcd->cp = cp;
 	tcd->tcd_image->tw = cp->tw;
 	tcd->tcd_image->th = cp->th;
-	tcd->tcd_image->tiles = (opj_tcd_tile_t *) opj_malloc(cp->tw * cp->th * sizeof(opj_tcd_tile_t));
+	if (!tcd_reserve((void**) &tcd->tcd_image->tiles, &tcd->tcd_image->tiles_size, cp->tw * cp->th, sizeof(opj_tcd_tile_t))) {
+		return OPJ_FALSE;
+	}
 
 	/* 
 	Allocate place to store the decoded data = final image
@@ -625,9 +801,11 @@ void tcd_malloc_decode(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp) {
 		opj_tcd_tile_t *tile;
 		
 		tileno = cp->tileno[j];		
-		tile = &(tcd->tcd_image->tiles[cp->tileno[tileno]]);		
+		tile = &(tcd->tcd_image->tiles[tileno]);		
+		if (!tcd_reserve((void**) &tile->comps, &tile->comps_size, image->numcomps, sizeof(opj_tcd_tilecomp_t))) {
+			return OPJ_FALSE;
+		}
 		tile->numcomps = image->numcomps;
-		tile->comps = (opj_tcd_tilecomp_t*) opj_calloc(image->numcomps, sizeof(opj_tcd_tilecomp_t));
 	}
 
 	for (i = 0; i < image->numcomps; i++) {
@@ -639,7 +817,7 @@ void tcd_malloc_decode(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp) {
 			
 			tileno = cp->tileno[j];
 			
-			tile = &(tcd->tcd_image->tiles[cp->tileno[tileno]]);
+			tile = &(tcd->tcd_image->tiles[tileno]);
 			tilec = &tile->comps[i];
 			
 			p = tileno % cp->tw;	/* si numerotation matricielle .. */
@@ -670,17 +848,17 @@ void tcd_malloc_decode(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp) {
 		image->comps[i].x0 = x0;
 		image->comps[i].y0 = y0;
 	}
+	return OPJ_TRUE;
 }
 
-void tcd_malloc_decode_tile(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp, int tileno, opj_codestream_info_t *cstr_info) {
+opj_bool tcd_malloc_decode_tile(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp, int tileno, opj_codestream_info_t *cstr_info) {
 	int compno, resno, bandno, precno, cblkno;
 	opj_tcp_t *tcp;
 	opj_tcd_tile_t *tile;
 
 	OPJ_ARG_NOT_USED(cstr_info);
 
-	tcd->cp = cp;
-	
+	/* tcd->cp is set by tcd_malloc_decode, tiles may be allocated from several threads */
 	tcp = &(cp->tcps[cp->tileno[tileno]]);
 	tile = &(tcd->tcd_image->tiles[cp->tileno[tileno]]);
 	
@@ -697,7 +875,12 @@ void tcd_malloc_decode_tile(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp,
 		tilec->y1 = int_ceildiv(tile->y1, image->comps[compno].dy);
 
 		tilec->numresolutions = tccp->numresolutions;
-		tilec->resolutions = (opj_tcd_resolution_t *) opj_malloc(tilec->numresolutions * sizeof(opj_tcd_resolution_t));
+		/* j2k_read_cox already rejects a reduce factor that removes every resolution */
+		tilec->minimum_num_resolutions = int_max(tccp->numresolutions - cp->reduce, 1);
+		if (!tcd_reserve((void**) &tilec->resolutions, &tilec->resolutions_size, tilec->numresolutions, sizeof(opj_tcd_resolution_t))) {
+			tile->numcomps = 0;
+			return OPJ_FALSE;
+		}
 		
 		for (resno = 0; resno < tilec->numresolutions; resno++) {
 			int pdx, pdy;
@@ -783,7 +966,9 @@ void tcd_malloc_decode_tile(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp,
 				band->stepsize = (float)(((1.0 + ss->mant / 2048.0) * pow(2.0, numbps - ss->expn)) * 0.5);
 				band->numbps = ss->expn + tccp->numgbits - 1;	/* WHY -1 ? */
 				
-				band->precincts = (opj_tcd_precinct_t *) opj_malloc(res->pw * res->ph * sizeof(opj_tcd_precinct_t));
+				if (!tcd_reserve((void**) &band->precincts, &band->precincts_size, res->pw * res->ph, sizeof(opj_tcd_precinct_t))) {
+					break;
+				}
 				
 				for (precno = 0; precno < res->pw * res->ph; precno++) {
 					int tlcblkxstart, tlcblkystart, brcblkxend, brcblkyend;
@@ -806,10 +991,13 @@ void tcd_malloc_decode_tile(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp,
 					prc->cw = (brcblkxend - tlcblkxstart) >> cblkwidthexpn;
 					prc->ch = (brcblkyend - tlcblkystart) >> cblkheightexpn;
 
-					prc->cblks.dec = (opj_tcd_cblk_dec_t*) opj_malloc(prc->cw * prc->ch * sizeof(opj_tcd_cblk_dec_t));
-
-					prc->incltree = tgt_create(prc->cw, prc->ch);
-					prc->imsbtree = tgt_create(prc->cw, prc->ch);
+					/* t2 resets the trees before the first packet of the precinct */
+					prc->incltree = tcd_reuse_tgt(prc->incltree, prc->cw, prc->ch);
+					prc->imsbtree = tcd_reuse_tgt(prc->imsbtree, prc->cw, prc->ch);
+					if (!tcd_reserve((void**) &prc->cblks.dec, &prc->cblks_size, prc->cw * prc->ch, sizeof(opj_tcd_cblk_dec_t)) ||
+						(prc->cw * prc->ch != 0 && (!prc->incltree || !prc->imsbtree))) {
+						break;
+					}
 					
 					for (cblkno = 0; cblkno < prc->cw * prc->ch; cblkno++) {
 						int cblkxstart = tlcblkxstart + (cblkno % prc->cw) * (1 << cblkwidthexpn);
@@ -817,21 +1005,78 @@ void tcd_malloc_decode_tile(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp,
 						int cblkxend = cblkxstart + (1 << cblkwidthexpn);
 						int cblkyend = cblkystart + (1 << cblkheightexpn);					
 
+						/* data and segs keep the buffers of the previous codestream */
 						opj_tcd_cblk_dec_t* cblk = &prc->cblks.dec[cblkno];
-						cblk->data = NULL;
-						cblk->segs = NULL;
 						/* code-block size (global) */
 						cblk->x0 = int_max(cblkxstart, prc->x0);
 						cblk->y0 = int_max(cblkystart, prc->y0);
 						cblk->x1 = int_min(cblkxend, prc->x1);
 						cblk->y1 = int_min(cblkyend, prc->y1);
 						cblk->numsegs = 0;
+						cblk->real_num_segs = 0;
 					}
 				} /* precno */
+				if (precno < res->pw * res->ph) {
+					break;
+				}
 			} /* bandno */
+			if (bandno < res->numbands) {
+				break;
+			}
 		} /* resno */
+		if (resno < tilec->numresolutions) {
+			/* out of memory, nothing may walk the half built tile */
+			tile->numcomps = 0;
+			return OPJ_FALSE;
+		}
 	} /* compno */
 	/* tcd_dump(stdout, tcd, &tcd->tcd_image); */
+	return OPJ_TRUE;
+}
+
+static opj_bool tcd_reserve(void **array, int *size, int count, size_t elem_size) {
+	void *grown;
+
+	if (count <= *size) {
+		return OPJ_TRUE;
+	}
+	grown = opj_realloc(*array, count * elem_size);
+	if (!grown) {
+		return OPJ_FALSE;
+	}
+	memset((char*) grown + *size * elem_size, 0, (count - *size) * elem_size);
+	*array = grown;
+	*size = count;
+	return OPJ_TRUE;
+}
+
+static opj_tcd_scratch_t* tcd_get_scratch(opj_tcd_t *tcd, int slot) {
+	opj_tcd_scratch_t *scratch = tcd->scratch[slot];
+
+	if (!scratch) {
+		scratch = (opj_tcd_scratch_t*) opj_calloc(1, sizeof(opj_tcd_scratch_t));
+		if (!scratch) {
+			return NULL;
+		}
+		/* t1_decode_cblks creates the handles of the other threads from this one */
+		scratch->t1s[0] = t1_create(tcd->cinfo);
+		if (!scratch->t1s[0]) {
+			opj_free(scratch);
+			return NULL;
+		}
+		tcd->scratch[slot] = scratch;
+	}
+	return scratch;
+}
+
+static opj_tgt_tree_t* tcd_reuse_tgt(opj_tgt_tree_t *tree, int numleafsh, int numleafsv) {
+	if (tree && tree->numleafsh == numleafsh && tree->numleafsv == numleafsv) {
+		return tree;
+	}
+	if (tree) {
+		tgt_destroy(tree);
+	}
+	return numleafsh * numleafsv != 0 ? tgt_create(numleafsh, numleafsv) : NULL;
 }
 
 void tcd_makelayer_fixed(opj_tcd_t *tcd, int layno, int final) {
@@ -1094,7 +1339,7 @@ opj_bool tcd_rateallocate(opj_tcd_t *tcd, unsigned char *dest, int len, opj_code
 		  -q xx,yy,zz,0	  (fixed_quality == 1 and distoratio == 0)
 		  ==> possible to have some lossy layers and the last layer for sure lossless */
 		if ( ((cp->disto_alloc==1) && (tcd_tcp->rates[layno]>0)) || ((cp->fixed_quality==1) && (tcd_tcp->distoratio[layno]>0))) {
-			opj_t2_t *t2 = t2_create(tcd->cinfo, tcd->image, cp);
+			opj_t2_t *t2 = t2_create(tcd->cinfo, tcd->image, cp, NULL);
 			double thresh = 0;
 
 			for (i = 0; i < 128; i++) {
@@ -1211,45 +1456,50 @@ int tcd_encode_tile(opj_tcd_t *tcd, int tileno, unsigned char *dest, int len, op
 		
 		/*---------------TILE-------------------*/
 		
-		for (compno = 0; compno < tile->numcomps; compno++) {
-			int x, y;
+		if (cp->input_format != OUTPUT_PLANAR) {
+			/* the MCT is done as the pixels are read */
+			tcd_read_interleaved(tcd, tcd_tcp, tile);
+		} else {
+			for (compno = 0; compno < tile->numcomps; compno++) {
+				int x, y;
 			
-			int adjust = image->comps[compno].sgnd ? 0 : 1 << (image->comps[compno].prec - 1);
-			int offset_x = int_ceildiv(image->x0, image->comps[compno].dx);
-			int offset_y = int_ceildiv(image->y0, image->comps[compno].dy);
+				int adjust = image->comps[compno].sgnd ? 0 : 1 << (image->comps[compno].prec - 1);
+				int offset_x = int_ceildiv(image->x0, image->comps[compno].dx);
+				int offset_y = int_ceildiv(image->y0, image->comps[compno].dy);
 			
-			opj_tcd_tilecomp_t *tilec = &tile->comps[compno];
-			int tw = tilec->x1 - tilec->x0;
-			int w = int_ceildiv(image->x1 - image->x0, image->comps[compno].dx);
+				opj_tcd_tilecomp_t *tilec = &tile->comps[compno];
+				int tw = tilec->x1 - tilec->x0;
+				int w = int_ceildiv(image->x1 - image->x0, image->comps[compno].dx);
 			
-			/* extract tile data */
+				/* extract tile data */
 			
-			if (tcd_tcp->tccps[compno].qmfbid == 1) {
-				for (y = tilec->y0; y < tilec->y1; y++) {
-					/* start of the src tile scanline */
-					int *data = &image->comps[compno].data[(tilec->x0 - offset_x) + (y - offset_y) * w];
-					/* start of the dst tile scanline */
-					int *tile_data = &tilec->data[(y - tilec->y0) * tw];
-					for (x = tilec->x0; x < tilec->x1; x++) {
-						*tile_data++ = *data++ - adjust;
-					}
-				}
-			} else if (tcd_tcp->tccps[compno].qmfbid == 0) {
-				for (y = tilec->y0; y < tilec->y1; y++) {
-					/* start of the src tile scanline */
-					int *data = &image->comps[compno].data[(tilec->x0 - offset_x) + (y - offset_y) * w];
-					/* start of the dst tile scanline */
-					int *tile_data = &tilec->data[(y - tilec->y0) * tw];
-					for (x = tilec->x0; x < tilec->x1; x++) {
-						*tile_data++ = (*data++ - adjust) << 11;
+				if (tcd_tcp->tccps[compno].qmfbid == 1) {
+					for (y = tilec->y0; y < tilec->y1; y++) {
+						/* start of the src tile scanline */
+						int *data = &image->comps[compno].data[(tilec->x0 - offset_x) + (y - offset_y) * w];
+						/* start of the dst tile scanline */
+						int *tile_data = &tilec->data[(y - tilec->y0) * tw];
+						for (x = tilec->x0; x < tilec->x1; x++) {
+							*tile_data++ = *data++ - adjust;
+						}
 					}
+				} else if (tcd_tcp->tccps[compno].qmfbid == 0) {
+					for (y = tilec->y0; y < tilec->y1; y++) {
+						/* start of the src tile scanline */
+						int *data = &image->comps[compno].data[(tilec->x0 - offset_x) + (y - offset_y) * w];
+						/* start of the dst tile scanline */
+						int *tile_data = &tilec->data[(y - tilec->y0) * tw];
+						for (x = tilec->x0; x < tilec->x1; x++) {
+							*tile_data++ = (*data++ - adjust) << 11;
+						}
 					
+					}
 				}
 			}
 		}
 		
 		/*----------------MCT-------------------*/
-		if (tcd_tcp->mct) {
+		if (tcd_tcp->mct && cp->input_format == OUTPUT_PLANAR) {
 			int samples = (tile->comps[0].x1 - tile->comps[0].x0) * (tile->comps[0].y1 - tile->comps[0].y0);
 			if (tcd_tcp->tccps[0].qmfbid == 0) {
 				mct_encode_real(tile->comps[0].data, tile->comps[1].data, tile->comps[2].data, samples);
@@ -1271,7 +1521,7 @@ int tcd_encode_tile(opj_tcd_t *tcd, int tileno, unsigned char *dest, int len, op
 		
 		/*------------------TIER1-----------------*/
 		t1 = t1_create(tcd->cinfo);
-		t1_encode_cblks(t1, tile, tcd_tcp);
+		t1_encode_cblks(t1, tile, tcd_tcp, tcd->cp->num_threads);
 		t1_destroy(t1);
 		
 		/*-----------RATE-ALLOCATE------------------*/
@@ -1295,7 +1545,7 @@ int tcd_encode_tile(opj_tcd_t *tcd, int tileno, unsigned char *dest, int len, op
 		cstr_info->index_write = 1;
 	}
 
-	t2 = t2_create(tcd->cinfo, image, cp);
+	t2 = t2_create(tcd->cinfo, image, cp, NULL);
 	l = t2_encode_packets(t2,tileno, tile, tcd_tcp->numlayers, dest, len, cstr_info,tcd->tp_num,tcd->tp_pos,tcd->cur_pino,FINAL_PASS,tcd->cur_totnum_tp);
 	t2_destroy(t2);
 	
@@ -1316,22 +1566,406 @@ int tcd_encode_tile(opj_tcd_t *tcd, int tileno, unsigned char *dest, int len, op
 	return l;
 }
 
-opj_bool tcd_decode_tile(opj_tcd_t *tcd, unsigned char *src, int len, int tileno, opj_codestream_info_t *cstr_info) {
+static void tcd_output_int_c(int* restrict dst, const int* restrict src, int n, int adjust, int min, int max) {
+	int i;
+	for (i = 0; i < n; ++i) {
+		dst[i] = int_clamp(src[i] + adjust, min, max);
+	}
+}
+
+static void tcd_output_real_c(int* restrict dst, const float* restrict src, int n, int adjust, int min, int max) {
+	int i;
+	for (i = 0; i < n; ++i) {
+		int v = lrintf(src[i]);
+		dst[i] = int_clamp(v + adjust, min, max);
+	}
+}
+
+static void tcd_interleave_c(unsigned char* restrict dst, const int* const* row, const int* chan, const int* pos, const int* real, int w) {
+	int i, c;
+	for (i = 0; i < w; ++i) {
+		for (c = 0; c < 4; c++) {
+			int v = 255;
+			if (chan[c] >= 0) {
+				v = real[c] ? lrintf(((const float*)row[c])[i]) : row[c][i];
+				v = int_clamp(v + 128, 0, 255);
+			}
+			dst[i * 4 + pos[c]] = (unsigned char) v;
+		}
+	}
+}
+
+static void tcd_deinterleave_c(int* const* row, const unsigned char* restrict src, const int* pos, int numcomps, int real, int mct, int w) {
+	int shift = real ? 11 : 0;
+	int i, c;
+	for (c = 0; c < numcomps; c++) {
+		for (i = 0; i < w; ++i) {
+			row[c][i] = (src[i * 4 + pos[c]] - 128) << shift;
+		}
+	}
+	/* the row is still in the cache */
+	if (mct) {
+		if (real) {
+			mct_encode_real(row[0], row[1], row[2], w);
+		} else {
+			mct_encode(row[0], row[1], row[2], w);
+		}
+	}
+}
+
+#ifdef OPJ_KERNELS_SSE2
+
+/* SSE2 has no 32 bit min and max */
+#define tcd_clamp_sse2(x, vmin, vmax) \
+	(x = _mm_or_si128(_mm_and_si128(_mm_cmplt_epi32(x, vmin), vmin), _mm_andnot_si128(_mm_cmplt_epi32(x, vmin), x)), \
+	 x = _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi32(x, vmax), vmax), _mm_andnot_si128(_mm_cmpgt_epi32(x, vmax), x)))
+
+OPJ_TARGET_SSE2 static void tcd_output_int_sse2(int* restrict dst, const int* restrict src, int n, int adjust, int min, int max) {
+	const __m128i vadjust = _mm_set1_epi32(adjust);
+	const __m128i vmin = _mm_set1_epi32(min);
+	const __m128i vmax = _mm_set1_epi32(max);
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i x = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(src + i)), vadjust);
+		tcd_clamp_sse2(x, vmin, vmax);
+		_mm_storeu_si128((__m128i*)(dst + i), x);
+	}
+	tcd_output_int_c(dst + i, src + i, n - i, adjust, min, max);
+}
+
+OPJ_TARGET_SSE2 static void tcd_output_real_sse2(int* restrict dst, const float* restrict src, int n, int adjust, int min, int max) {
+	const __m128i vadjust = _mm_set1_epi32(adjust);
+	const __m128i vmin = _mm_set1_epi32(min);
+	const __m128i vmax = _mm_set1_epi32(max);
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i x = _mm_add_epi32(_mm_cvtps_epi32(_mm_loadu_ps(src + i)), vadjust);
+		tcd_clamp_sse2(x, vmin, vmax);
+		_mm_storeu_si128((__m128i*)(dst + i), x);
+	}
+	tcd_output_real_c(dst + i, src + i, n - i, adjust, min, max);
+}
+
+#undef tcd_clamp_sse2
+
+OPJ_TARGET_SSE2 static void tcd_interleave_sse2(unsigned char* restrict dst, const int* const* row, const int* chan, const int* pos, const int* real, int w) {
+	const __m128i adjust = _mm_set1_epi32(128);
+	const __m128i opaque = _mm_set1_epi32(255);
+	const int* rest[4];
+	int i, c;
+	for (i = 0; i + 4 <= w; i += 4) {
+		__m128i v[4], px;
+		for (c = 0; c < 4; c++) {
+			__m128i x;
+			if (chan[c] < 0) {
+				x = opaque;
+			} else if (real[c]) {
+				x = _mm_add_epi32(_mm_cvtps_epi32(_mm_loadu_ps((const float*)row[c] + i)), adjust);
+			} else {
+				x = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(row[c] + i)), adjust);
+			}
+			v[pos[c]] = x;
+		}
+		/* saturating packs clamp to [0, 255], then transpose the 4x4 bytes into pixels */
+		px = _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3]));
+		px = _mm_unpacklo_epi16(
+				_mm_unpacklo_epi8(px, _mm_srli_si128(px, 4)),
+				_mm_unpacklo_epi8(_mm_srli_si128(px, 8), _mm_srli_si128(px, 12)));
+		_mm_storeu_si128((__m128i*)(dst + i * 4), px);
+	}
+	for (c = 0; c < 4; c++) {
+		rest[c] = row[c] + i;
+	}
+	tcd_interleave_c(dst + i * 4, rest, chan, pos, real, w - i);
+}
+
+/* fix_mul(s << 11, k) of samples s that fit in 16 bits, as mct_encode_real does it: the 
+   product s * k fits in 32 bits and the rounding bit of fix_mul is its bit 1. The upper 
+   half of k is zero, so that of s does not matter to the 16 bit multiply-add. */
+OPJ_TARGET_SSE2 static INLINE __m128i tcd_fix_mul_sse2(__m128i s, __m128i k) {
+	__m128i p = _mm_madd_epi16(s, k);
+	return _mm_srai_epi32(_mm_add_epi32(p, _mm_and_si128(p, _mm_set1_epi32(2))), 2);
+}
+
+OPJ_TARGET_SSE2 static void tcd_deinterleave_sse2(int* const* row, const unsigned char* restrict src, const int* pos, int numcomps, int real, int mct, int w) {
+	const __m128i mask = _mm_set1_epi32(0xff);
+	const __m128i adjust = _mm_set1_epi32(128);
+	int* rest[4];
+	int i, c;
+	for (i = 0; i + 4 <= w; i += 4) {
+		__m128i px = _mm_loadu_si128((const __m128i*)(src + i * 4));
+		__m128i v[4];
+		int scaled = 0;
+		for (c = 0; c < numcomps; c++) {
+			v[c] = _mm_sub_epi32(_mm_and_si128(_mm_srl_epi32(px, _mm_cvtsi32_si128(pos[c] * 8)), mask), adjust);
+		}
+		if (mct && real) {
+			__m128i r = v[0], g = v[1], b = v[2];
+			v[0] = _mm_add_epi32(_mm_add_epi32(
+					tcd_fix_mul_sse2(r, _mm_set1_epi32(2449)), tcd_fix_mul_sse2(g, _mm_set1_epi32(4809))),
+					tcd_fix_mul_sse2(b, _mm_set1_epi32(934)));
+			v[1] = _mm_sub_epi32(_mm_sub_epi32(
+					_mm_slli_epi32(b, 10), tcd_fix_mul_sse2(r, _mm_set1_epi32(1382))),
+					tcd_fix_mul_sse2(g, _mm_set1_epi32(2714)));
+			v[2] = _mm_sub_epi32(_mm_sub_epi32(
+					_mm_slli_epi32(r, 10), tcd_fix_mul_sse2(g, _mm_set1_epi32(3430))),
+					tcd_fix_mul_sse2(b, _mm_set1_epi32(666)));
+			scaled = 3;
+		} else if (mct) {
+			__m128i r = v[0], g = v[1], b = v[2];
+			v[0] = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(r, b), _mm_slli_epi32(g, 1)), 2);
+			v[1] = _mm_sub_epi32(b, g);
+			v[2] = _mm_sub_epi32(r, g);
+		}
+		for (c = 0; c < numcomps; c++) {
+			if (real && c >= scaled) {
+				v[c] = _mm_slli_epi32(v[c], 11);
+			}
+			_mm_storeu_si128((__m128i*)(row[c] + i), v[c]);
+		}
+	}
+	for (c = 0; c < numcomps; c++) {
+		rest[c] = row[c] + i;
+	}
+	tcd_deinterleave_c(rest, src + i * 4, pos, numcomps, real, mct, w - i);
+}
+
+#endif /* OPJ_KERNELS_SSE2 */
+
+#ifdef OPJ_KERNELS_AVX2
+
+OPJ_TARGET_AVX2 static void tcd_output_int_avx2(int* restrict dst, const int* restrict src, int n, int adjust, int min, int max) {
+	const __m256i vadjust = _mm256_set1_epi32(adjust);
+	const __m256i vmin = _mm256_set1_epi32(min);
+	const __m256i vmax = _mm256_set1_epi32(max);
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i x = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(src + i)), vadjust);
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_min_epi32(_mm256_max_epi32(x, vmin), vmax));
+	}
+	tcd_output_int_c(dst + i, src + i, n - i, adjust, min, max);
+}
+
+OPJ_TARGET_AVX2 static void tcd_output_real_avx2(int* restrict dst, const float* restrict src, int n, int adjust, int min, int max) {
+	const __m256i vadjust = _mm256_set1_epi32(adjust);
+	const __m256i vmin = _mm256_set1_epi32(min);
+	const __m256i vmax = _mm256_set1_epi32(max);
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i x = _mm256_add_epi32(_mm256_cvtps_epi32(_mm256_loadu_ps(src + i)), vadjust);
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_min_epi32(_mm256_max_epi32(x, vmin), vmax));
+	}
+	tcd_output_real_c(dst + i, src + i, n - i, adjust, min, max);
+}
+
+OPJ_TARGET_AVX2 static void tcd_interleave_avx2(unsigned char* restrict dst, const int* const* row, const int* chan, const int* pos, const int* real, int w) {
+	const __m256i adjust = _mm256_set1_epi32(128);
+	const __m256i opaque = _mm256_set1_epi32(255);
+	/* gathers byte k of each of the 4 channels, within each 128 bit lane */
+	const __m256i transpose = _mm256_setr_epi8(
+			0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+			0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+	const int* rest[4];
+	int i, c;
+	for (i = 0; i + 8 <= w; i += 8) {
+		__m256i v[4], px;
+		for (c = 0; c < 4; c++) {
+			__m256i x;
+			if (chan[c] < 0) {
+				x = opaque;
+			} else if (real[c]) {
+				x = _mm256_add_epi32(_mm256_cvtps_epi32(_mm256_loadu_ps((const float*)row[c] + i)), adjust);
+			} else {
+				x = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(row[c] + i)), adjust);
+			}
+			v[pos[c]] = x;
+		}
+		/* the packs work within lanes: the low lane holds the channels of pixels 0 to 3
+		   in the layout of tcd_interleave_sse2, the high lane those of pixels 4 to 7 */
+		px = _mm256_packus_epi16(_mm256_packs_epi32(v[0], v[1]), _mm256_packs_epi32(v[2], v[3]));
+		_mm256_storeu_si256((__m256i*)(dst + i * 4), _mm256_shuffle_epi8(px, transpose));
+	}
+	for (c = 0; c < 4; c++) {
+		rest[c] = row[c] + i;
+	}
+	tcd_interleave_sse2(dst + i * 4, rest, chan, pos, real, w - i);
+}
+
+/* fix_mul(s << 11, k), see tcd_fix_mul_sse2 */
+OPJ_TARGET_AVX2 static INLINE __m256i tcd_fix_mul_avx2(__m256i s, __m256i k) {
+	__m256i p = _mm256_madd_epi16(s, k);
+	return _mm256_srai_epi32(_mm256_add_epi32(p, _mm256_and_si256(p, _mm256_set1_epi32(2))), 2);
+}
+
+OPJ_TARGET_AVX2 static void tcd_deinterleave_avx2(int* const* row, const unsigned char* restrict src, const int* pos, int numcomps, int real, int mct, int w) {
+	const __m256i mask = _mm256_set1_epi32(0xff);
+	const __m256i adjust = _mm256_set1_epi32(128);
+	int* rest[4];
+	int i, c;
+	for (i = 0; i + 8 <= w; i += 8) {
+		__m256i px = _mm256_loadu_si256((const __m256i*)(src + i * 4));
+		__m256i v[4];
+		int scaled = 0;
+		for (c = 0; c < numcomps; c++) {
+			v[c] = _mm256_sub_epi32(_mm256_and_si256(_mm256_srl_epi32(px, _mm_cvtsi32_si128(pos[c] * 8)), mask), adjust);
+		}
+		if (mct && real) {
+			__m256i r = v[0], g = v[1], b = v[2];
+			v[0] = _mm256_add_epi32(_mm256_add_epi32(
+					tcd_fix_mul_avx2(r, _mm256_set1_epi32(2449)), tcd_fix_mul_avx2(g, _mm256_set1_epi32(4809))),
+					tcd_fix_mul_avx2(b, _mm256_set1_epi32(934)));
+			v[1] = _mm256_sub_epi32(_mm256_sub_epi32(
+					_mm256_slli_epi32(b, 10), tcd_fix_mul_avx2(r, _mm256_set1_epi32(1382))),
+					tcd_fix_mul_avx2(g, _mm256_set1_epi32(2714)));
+			v[2] = _mm256_sub_epi32(_mm256_sub_epi32(
+					_mm256_slli_epi32(r, 10), tcd_fix_mul_avx2(g, _mm256_set1_epi32(3430))),
+					tcd_fix_mul_avx2(b, _mm256_set1_epi32(666)));
+			scaled = 3;
+		} else if (mct) {
+			__m256i r = v[0], g = v[1], b = v[2];
+			v[0] = _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(r, b), _mm256_slli_epi32(g, 1)), 2);
+			v[1] = _mm256_sub_epi32(b, g);
+			v[2] = _mm256_sub_epi32(r, g);
+		}
+		for (c = 0; c < numcomps; c++) {
+			if (real && c >= scaled) {
+				v[c] = _mm256_slli_epi32(v[c], 11);
+			}
+			_mm256_storeu_si256((__m256i*)(row[c] + i), v[c]);
+		}
+	}
+	for (c = 0; c < numcomps; c++) {
+		rest[c] = row[c] + i;
+	}
+	tcd_deinterleave_sse2(rest, src + i * 4, pos, numcomps, real, mct, w - i);
+}
+
+#endif /* OPJ_KERNELS_AVX2 */
+
+static const tcd_kernels_t tcd_kernels_c = {
+	tcd_output_int_c, tcd_output_real_c, tcd_interleave_c, tcd_deinterleave_c
+};
+
+#ifdef OPJ_KERNELS_SSE2
+static const tcd_kernels_t tcd_kernels_sse2 = {
+	tcd_output_int_sse2, tcd_output_real_sse2, tcd_interleave_sse2, tcd_deinterleave_sse2
+};
+#endif
+
+#ifdef OPJ_KERNELS_AVX2
+static const tcd_kernels_t tcd_kernels_avx2 = {
+	tcd_output_int_avx2, tcd_output_real_avx2, tcd_interleave_avx2, tcd_deinterleave_avx2
+};
+#endif
+
+static const tcd_kernels_t* tcd_get_kernels(void) {
+	/* the AVX-512 level runs the AVX2 kernels, a row is rarely long enough for more */
+	switch (opj_cpu_level()) {
+#ifdef OPJ_KERNELS_AVX2
+		case OPJ_SIMD_AVX512:
+		case OPJ_SIMD_AVX2:
+			return &tcd_kernels_avx2;
+#endif
+#ifdef OPJ_KERNELS_SSE2
+		case OPJ_SIMD_SSE2:
+			return &tcd_kernels_sse2;
+#endif
+		default:
+			return &tcd_kernels_c;
+	}
+}
+
+static opj_bool tcd_write_interleaved(opj_tcd_t *tcd, opj_tcp_t *tcp, opj_tcd_tile_t *tile) {
+	opj_cp_t *cp = tcd->cp;
+	opj_image_comp_t *imagec = &tcd->image->comps[0];
+	opj_tcd_resolution_t *res = &tile->comps[0].resolutions[tile->comps[0].resno_decoded];
+	int numcomps = int_min(tcd->image->numcomps, 4);
+	int w = res->x1 - res->x0;
+	int h = res->y1 - res->y0;
+	int offset_x = int_ceildivpow2(imagec->x0, imagec->factor);
+	int offset_y = int_ceildivpow2(imagec->y0, imagec->factor);
+	/* component read for red, green, blue and alpha, -1 for an opaque alpha */
+	int chan[4];
+	/* byte of the output pixel each of them goes to */
+	int pos[4];
+	const int *src[4];
+	int real[4];
+	int tw[4];
+	int c, j;
+	const tcd_kernels_t* kernels = tcd_get_kernels();
+
+	for (c = 0; c < numcomps; c++) {
+		opj_image_comp_t *comp = &tcd->image->comps[c];
+		opj_tcd_resolution_t *cres = &tile->comps[c].resolutions[tile->comps[c].resno_decoded];
+		if (comp->prec != 8 || comp->sgnd || cres->x0 != res->x0 || cres->y0 != res->y0 ||
+				cres->x1 != res->x1 || cres->y1 != res->y1) {
+			opj_event_msg(tcd->cinfo, EVT_ERROR, "Interleaved output needs unsigned 8 bit components of the same size\n");
+			return OPJ_FALSE;
+		}
+	}
+
+	chan[0] = 0;
+	chan[1] = numcomps >= 3 ? 1 : 0;
+	chan[2] = numcomps >= 3 ? 2 : 0;
+	chan[3] = numcomps == 2 ? 1 : (numcomps == 4 ? 3 : -1);
+	pos[0] = cp->output_format == OUTPUT_BGRA ? 2 : 0;
+	pos[1] = 1;
+	pos[2] = cp->output_format == OUTPUT_BGRA ? 0 : 2;
+	pos[3] = 3;
+	for (c = 0; c < 4; c++) {
+		int compno = chan[c] < 0 ? 0 : chan[c];
+		src[c] = tile->comps[compno].data;
+		real[c] = tcp->tccps[compno].qmfbid != 1;
+		tw[c] = tile->comps[compno].x1 - tile->comps[compno].x0;
+	}
+
+	for (j = 0; j < h; ++j) {
+		unsigned char *dst = cp->output + (res->y0 - offset_y + j) * cp->output_stride + (res->x0 - offset_x) * 4;
+		const int *row[4];
+		for (c = 0; c < 4; c++) {
+			row[c] = src[c] + j * tw[c];
+		}
+		kernels->interleave(dst, row, chan, pos, real, w);
+	}
+
+	return OPJ_TRUE;
+}
+
+static void tcd_read_interleaved(opj_tcd_t *tcd, opj_tcp_t *tcp, opj_tcd_tile_t *tile) {
+	opj_cp_t *cp = tcd->cp;
+	opj_image_t *image = tcd->image;
+	opj_tcd_tilecomp_t *tilec = &tile->comps[0];
+	int numcomps = tile->numcomps;
+	int real = tcp->tccps[0].qmfbid == 0;
+	int mct = tcp->mct && numcomps >= 3;
+	int tw = tilec->x1 - tilec->x0;
+	int th = tilec->y1 - tilec->y0;
+	/* byte of the input pixel each component is read from */
+	int pos[4];
+	int *row[4];
+	int c, j;
+	const tcd_kernels_t* kernels = tcd_get_kernels();
+
+	pos[0] = cp->input_format == OUTPUT_BGRA ? 2 : 0;
+	pos[1] = numcomps == 2 ? 3 : 1;
+	pos[2] = cp->input_format == OUTPUT_BGRA ? 0 : 2;
+	pos[3] = 3;
+
+	for (j = 0; j < th; ++j) {
+		const unsigned char *src = cp->input + (tilec->y0 - image->y0 + j) * cp->input_stride + (tilec->x0 - image->x0) * 4;
+		for (c = 0; c < numcomps; c++) {
+			row[c] = tile->comps[c].data + j * tw;
+		}
+		kernels->deinterleave(row, src, pos, numcomps, real, mct, tw);
+	}
+}
+
+static opj_bool tcd_t2_decode_tile(opj_tcd_t *tcd, unsigned char *src, int len, int tileno, opj_codestream_info_t *cstr_info, opj_tcd_scratch_t *scratch) {
 	int l;
 	int compno;
-	int eof = 0;
-	double tile_time, t1_time, dwt_time;
-	opj_tcd_tile_t *tile = NULL;
-
-	opj_t1_t *t1 = NULL;		/* T1 component */
+	opj_tcd_tile_t *tile = &(tcd->tcd_image->tiles[tileno]);
 	opj_t2_t *t2 = NULL;		/* T2 component */
-	
-	tcd->tcd_tileno = tileno;
-	tcd->tcd_tile = &(tcd->tcd_image->tiles[tileno]);
-	tcd->tcp = &(tcd->cp->tcps[tileno]);
-	tile = tcd->tcd_tile;
-	
-	tile_time = opj_clock();	/* time needed to decode a tile */
+
 	opj_event_msg(tcd->cinfo, EVT_INFO, "tile %d of %d\n", tileno + 1, tcd->cp->tw * tcd->cp->th);
 
 	/* INDEX >>  */
@@ -1363,26 +1997,95 @@ opj_bool tcd_decode_tile(opj_tcd_t *tcd, unsigned char *src, int len, int tileno
 	
 	/*--------------TIER2------------------*/
 	
-	t2 = t2_create(tcd->cinfo, tcd->image, tcd->cp);
+	for (compno = 0; compno < tile->numcomps; compno++) {
+		tile->comps[compno].resno_decoded = 0;
+	}
+
+	if (!scratch) {
+		return OPJ_FALSE;
+	}
+	/* the packet iterators of the previous tile of this thread are not needed any more */
+	opj_arena_reset(&scratch->arena);
+	t2 = t2_create(tcd->cinfo, tcd->image, tcd->cp, &scratch->arena);
+	if (!t2) {
+		return OPJ_FALSE;
+	}
 	l = t2_decode_packets(t2, src, len, tileno, tile, cstr_info);
 	t2_destroy(t2);
 
 	if (l == -999) {
-		eof = 1;
 		opj_event_msg(tcd->cinfo, EVT_ERROR, "tcd_decode: incomplete bistream\n");
+		return OPJ_FALSE;
 	}
-	
+	return OPJ_TRUE;
+}
+
+static opj_bool tcd_set_resno_decoded(opj_tcd_t *tcd, int tileno) {
+	int compno;
+	opj_tcd_tile_t *tile = &(tcd->tcd_image->tiles[tileno]);
+
+	for (compno = 0; compno < tile->numcomps; compno++) {
+		opj_tcd_tilecomp_t *tilec = &tile->comps[compno];
+		opj_image_comp_t *imagec = &tcd->image->comps[compno];
+
+		imagec->resno_decoded = int_max(imagec->resno_decoded, tilec->resno_decoded);
+		if (tcd->cp->reduce != 0) {
+			imagec->resno_decoded = tilec->numresolutions - tcd->cp->reduce - 1;
+			if (imagec->resno_decoded < 0) {				
+				opj_event_msg(tcd->cinfo, EVT_ERROR, "Error decoding tile. The number of resolutions to remove [%d+1] is higher than the number "
+					" of resolutions in the original codestream [%d]\nModify the cp_reduce parameter.\n", tcd->cp->reduce, tilec->numresolutions);
+				return OPJ_FALSE;
+			}
+		}
+		tilec->resno_decoded = imagec->resno_decoded;
+	}
+	return OPJ_TRUE;
+}
+
+static opj_bool tcd_t1_decode_tile(opj_tcd_t *tcd, int tileno, opj_tcd_scratch_t *scratch) {
+	int compno, size;
+	double t1_time, dwt_time;
+	opj_tcd_tile_t *tile = &(tcd->tcd_image->tiles[tileno]);
+	opj_tcp_t *tcp = &(tcd->cp->tcps[tileno]);
+
+	/* a tile that could not be allocated has no component */
+	if (!scratch || tile->numcomps == 0) {
+		return OPJ_FALSE;
+	}
+
+	/* 
+	the components share one buffer kept for the next tile. The +3 is headroom required 
+	by the vectorized DWT, each component starts 16 byte aligned 
+	*/
+	size = 0;
+	for (compno = 0; compno < tile->numcomps; ++compno) {
+		opj_tcd_tilecomp_t* tilec = &tile->comps[compno];
+		size += ((tilec->x1 - tilec->x0) * (tilec->y1 - tilec->y0) + 3 + 3) & ~3;
+	}
+	if (size > scratch->data_size) {
+		opj_aligned_free(scratch->data);
+		scratch->data = (int*) opj_aligned_malloc(size * sizeof(int));
+		scratch->data_size = scratch->data ? size : 0;
+		if (!scratch->data) {
+			return OPJ_FALSE;
+		}
+	}
+	size = 0;
+	for (compno = 0; compno < tile->numcomps; ++compno) {
+		opj_tcd_tilecomp_t* tilec = &tile->comps[compno];
+		tilec->data = scratch->data + size;
+		size += ((tilec->x1 - tilec->x0) * (tilec->y1 - tilec->y0) + 3 + 3) & ~3;
+	}
+
 	/*------------------TIER1-----------------*/
 	
 	t1_time = opj_clock();	/* time needed to decode a tile */
-	t1 = t1_create(tcd->cinfo);
 	for (compno = 0; compno < tile->numcomps; ++compno) {
 		opj_tcd_tilecomp_t* tilec = &tile->comps[compno];
-		/* The +3 is headroom required by the vectorized DWT */
-		tilec->data = (int*) opj_aligned_malloc((((tilec->x1 - tilec->x0) * (tilec->y1 - tilec->y0))+3) * sizeof(int));
-		t1_decode_cblks(t1, tilec, &tcd->tcp->tccps[compno]);
+		if (!t1_decode_cblks(scratch, tilec, &tcp->tccps[compno], tcd->cp->num_threads)) {
+			return OPJ_FALSE;
+		}
 	}
-	t1_destroy(t1);
 	t1_time = opj_clock() - t1_time;
 	opj_event_msg(tcd->cinfo, EVT_INFO, "- tiers-1 took %f s\n", t1_time);
 	
@@ -1391,24 +2094,13 @@ opj_bool tcd_decode_tile(opj_tcd_t *tcd, unsigned char *src, int len, int tileno
 	dwt_time = opj_clock();	/* time needed to decode a tile */
 	for (compno = 0; compno < tile->numcomps; compno++) {
 		opj_tcd_tilecomp_t *tilec = &tile->comps[compno];
-		int numres2decode;
+		int numres2decode = tilec->resno_decoded + 1;
 
-		if (tcd->cp->reduce != 0) {
-			tcd->image->comps[compno].resno_decoded =
-				tile->comps[compno].numresolutions - tcd->cp->reduce - 1;
-			if (tcd->image->comps[compno].resno_decoded < 0) {				
-				opj_event_msg(tcd->cinfo, EVT_ERROR, "Error decoding tile. The number of resolutions to remove [%d+1] is higher than the number "
-					" of resolutions in the original codestream [%d]\nModify the cp_reduce parameter.\n", tcd->cp->reduce, tile->comps[compno].numresolutions);
-				return OPJ_FALSE;
-			}
-		}
-
-		numres2decode = tcd->image->comps[compno].resno_decoded + 1;
 		if(numres2decode > 0){
-			if (tcd->tcp->tccps[compno].qmfbid == 1) {
-				dwt_decode(tilec, numres2decode);
+			if (tcp->tccps[compno].qmfbid == 1) {
+				dwt_decode(tilec, numres2decode, tcd->cp->num_threads, scratch);
 			} else {
-				dwt_decode_real(tilec, numres2decode);
+				dwt_decode_real(tilec, numres2decode, tcd->cp->num_threads, scratch);
 			}
 		}
 	}
@@ -1417,22 +2109,36 @@ opj_bool tcd_decode_tile(opj_tcd_t *tcd, unsigned char *src, int len, int tileno
 
 	/*----------------MCT-------------------*/
 
-	if (tcd->tcp->mct) {
-		int n = (tile->comps[0].x1 - tile->comps[0].x0) * (tile->comps[0].y1 - tile->comps[0].y0);
+	if (tcp->mct) {
+		/* only the decoded resolution was written, at the top left of the tile-component */
+		opj_tcd_tilecomp_t *tilec = &tile->comps[0];
+		opj_tcd_resolution_t *res = &tilec->resolutions[tilec->resno_decoded];
+		int tw = tilec->x1 - tilec->x0;
+		int n = res->x1 - res->x0;
+		int rows = res->y1 - res->y0;
+		int j;
+
+		if (n == tw) {
+			/* nothing discarded, the rows are contiguous */
+			n *= rows;
+			rows = 1;
+		}
 
 		if (tile->numcomps >= 3 ){
-			if (tcd->tcp->tccps[0].qmfbid == 1) {
-				mct_decode(
-						tile->comps[0].data,
-						tile->comps[1].data,
-						tile->comps[2].data,
-						n);
-			} else {
-				mct_decode_real(
-						(float*)tile->comps[0].data,
-						(float*)tile->comps[1].data,
-						(float*)tile->comps[2].data,
-						n);
+			for (j = 0; j < rows; ++j) {
+				if (tcp->tccps[0].qmfbid == 1) {
+					mct_decode(
+							tile->comps[0].data + j * tw,
+							tile->comps[1].data + j * tw,
+							tile->comps[2].data + j * tw,
+							n);
+				} else {
+					mct_decode_real(
+							(float*)tile->comps[0].data + j * tw,
+							(float*)tile->comps[1].data + j * tw,
+							(float*)tile->comps[2].data + j * tw,
+							n);
+				}
 			}
 		} else{
 			opj_event_msg(tcd->cinfo, EVT_WARNING,"Number of components (%d) is inconsistent with a MCT. Skip the MCT step.\n",tile->numcomps);
@@ -1441,43 +2147,68 @@ opj_bool tcd_decode_tile(opj_tcd_t *tcd, unsigned char *src, int len, int tileno
 
 	/*---------------TILE-------------------*/
 
-	for (compno = 0; compno < tile->numcomps; ++compno) {
-		opj_tcd_tilecomp_t* tilec = &tile->comps[compno];
-		opj_image_comp_t* imagec = &tcd->image->comps[compno];
-		opj_tcd_resolution_t* res = &tilec->resolutions[imagec->resno_decoded];
-		int adjust = imagec->sgnd ? 0 : 1 << (imagec->prec - 1);
-		int min = imagec->sgnd ? -(1 << (imagec->prec - 1)) : 0;
-		int max = imagec->sgnd ?  (1 << (imagec->prec - 1)) - 1 : (1 << imagec->prec) - 1;
+	if (tcd->cp->output_format != OUTPUT_PLANAR) {
+		opj_bool written = tcd_write_interleaved(tcd, tcp, tile);
+		for (compno = 0; compno < tile->numcomps; ++compno) {
+			tile->comps[compno].data = NULL;
+		}
+		if (!written) {
+			return OPJ_FALSE;
+		}
+	} else {
+		const tcd_kernels_t* kernels = tcd_get_kernels();
+		for (compno = 0; compno < tile->numcomps; ++compno) {
+			opj_tcd_tilecomp_t* tilec = &tile->comps[compno];
+			opj_image_comp_t* imagec = &tcd->image->comps[compno];
+			opj_tcd_resolution_t* res = &tilec->resolutions[tilec->resno_decoded];
+			int adjust = imagec->sgnd ? 0 : 1 << (imagec->prec - 1);
+			int min = imagec->sgnd ? -(1 << (imagec->prec - 1)) : 0;
+			int max = imagec->sgnd ?  (1 << (imagec->prec - 1)) - 1 : (1 << imagec->prec) - 1;
 
-		int tw = tilec->x1 - tilec->x0;
-		int w = imagec->w;
+			int tw = tilec->x1 - tilec->x0;
+			int w = imagec->w;
 
-		int offset_x = int_ceildivpow2(imagec->x0, imagec->factor);
-		int offset_y = int_ceildivpow2(imagec->y0, imagec->factor);
+			int offset_x = int_ceildivpow2(imagec->x0, imagec->factor);
+			int offset_y = int_ceildivpow2(imagec->y0, imagec->factor);
 
-		int i, j;
-		if(!imagec->data){
-			imagec->data = (int*) opj_malloc(imagec->w * imagec->h * sizeof(int));
-		}
-		if(tcd->tcp->tccps[compno].qmfbid == 1) {
-			for(j = res->y0; j < res->y1; ++j) {
-				for(i = res->x0; i < res->x1; ++i) {
-					int v = tilec->data[i - res->x0 + (j - res->y0) * tw];
-					v += adjust;
-					imagec->data[(i - offset_x) + (j - offset_y) * w] = int_clamp(v, min, max);
-				}
+			int j;
+			if(!imagec->data){
+				imagec->data = (int*) opj_malloc(imagec->w * imagec->h * sizeof(int));
 			}
-		}else{
 			for(j = res->y0; j < res->y1; ++j) {
-				for(i = res->x0; i < res->x1; ++i) {
-					float tmp = ((float*)tilec->data)[i - res->x0 + (j - res->y0) * tw];
-					int v = lrintf(tmp);
-					v += adjust;
-					imagec->data[(i - offset_x) + (j - offset_y) * w] = int_clamp(v, min, max);
+				int* dst = &imagec->data[(res->x0 - offset_x) + (j - offset_y) * w];
+				int* src = &tilec->data[(j - res->y0) * tw];
+				if(tcp->tccps[compno].qmfbid == 1) {
+					kernels->output_int(dst, src, res->x1 - res->x0, adjust, min, max);
+				} else {
+					kernels->output_real(dst, (const float*) src, res->x1 - res->x0, adjust, min, max);
 				}
 			}
+			tilec->data = NULL;
 		}
-		opj_aligned_free(tilec->data);
+	}
+
+	return OPJ_TRUE;
+}
+
+opj_bool tcd_decode_tile(opj_tcd_t *tcd, unsigned char *src, int len, int tileno, opj_codestream_info_t *cstr_info) {
+	opj_bool eof;
+	double tile_time;
+
+	tcd->tcd_tileno = tileno;
+	tcd->tcd_tile = &(tcd->tcd_image->tiles[tileno]);
+	tcd->tcp = &(tcd->cp->tcps[tileno]);
+	
+	tile_time = opj_clock();	/* time needed to decode a tile */
+	eof = !tcd_t2_decode_tile(tcd, src, len, tileno, cstr_info, tcd_get_scratch(tcd, 0));
+
+	/* only the packet headers were wanted, the index is complete */
+	if (tcd->cp->limit_decoding == LIMIT_TO_PACKET_HEADERS) {
+		return eof ? OPJ_FALSE : OPJ_TRUE;
+	}
+
+	if (!tcd_set_resno_decoded(tcd, tileno) || !tcd_t1_decode_tile(tcd, tileno, tcd_get_scratch(tcd, 0))) {
+		return OPJ_FALSE;
 	}
 
 	tile_time = opj_clock() - tile_time;	/* time needed to decode a tile */
@@ -1490,9 +2221,129 @@ opj_bool tcd_decode_tile(opj_tcd_t *tcd, unsigned char *src, int len, int tileno
 	return OPJ_TRUE;
 }
 
+static void tcd_t2_decode_job(void *user_data, int index, int slot) {
+	opj_tcd_decode_job_t *job = (opj_tcd_decode_job_t*) user_data;
+	opj_cp_t *cp = job->tcd->cp;
+	int tileno = cp->tileno[index];
+
+	job->success[index] = tcd_malloc_decode_tile(job->tcd, job->tcd->image, cp, index, NULL) &&
+		tcd_t2_decode_tile(job->tcd, job->tile_data[tileno], job->tile_len[tileno], tileno, NULL, tcd_get_scratch(job->tcd, slot));
+}
+
+static void tcd_t1_decode_job(void *user_data, int index, int slot) {
+	opj_tcd_decode_job_t *job = (opj_tcd_decode_job_t*) user_data;
+	int tileno = job->tcd->cp->tileno[index];
+
+	/* slots are never shared by two running tiles, so the scratch needs no lock */
+	if (!tcd_t1_decode_tile(job->tcd, tileno, tcd_get_scratch(job->tcd, slot))) {
+		job->success[index] = OPJ_FALSE;
+	}
+}
+
+opj_bool tcd_decode_tiles(opj_tcd_t *tcd, unsigned char **tile_data, int *tile_len, opj_codestream_info_t *cstr_info) {
+	opj_cp_t *cp = tcd->cp;
+	opj_tcd_decode_job_t job;
+	opj_bool success = OPJ_TRUE;
+	int i, count, compno;
+
+	/* the codestream index and the PPM packet headers are filled and read tile after tile */
+	if (cstr_info || cp->ppm || opj_parallel_slots(cp->tileno_size, cp->num_threads) == 1) {
+		for (i = 0; i < cp->tileno_size && success; i++) {
+			int tileno = cp->tileno[i];
+			success = tcd_malloc_decode_tile(tcd, tcd->image, cp, i, cstr_info) &&
+				tcd_decode_tile(tcd, tile_data[tileno], tile_len[tileno], tileno, cstr_info);
+		}
+		return success;
+	}
+
+	if (!tcd_reserve((void**) &tcd->tile_success, &tcd->tile_success_size, cp->tileno_size, sizeof(opj_bool))) {
+		return OPJ_FALSE;
+	}
+	job.tcd = tcd;
+	job.tile_data = tile_data;
+	job.tile_len = tile_len;
+	job.success = tcd->tile_success;
+
+	/* tier-2 of every tile */
+	opj_parallel_for(cp->tileno_size, cp->num_threads, tcd_t2_decode_job, &job);
+
+	/* only the packet headers were wanted, as in tcd_decode_tile: t2 kept no code-block data */
+	if (cp->limit_decoding == LIMIT_TO_PACKET_HEADERS) {
+		for (i = 0; i < cp->tileno_size && success; i++) {
+			success = job.success[i];
+		}
+		return success;
+	}
+
+	/* 
+	a tile is reconstructed at the highest resolution found in it or in the tiles before it,
+	and the serial decoder stops after the first tile that fails: replay both in order 
+	*/
+	for (count = 0; count < cp->tileno_size; count++) {
+		if (!tcd_set_resno_decoded(tcd, cp->tileno[count])) {
+			success = OPJ_FALSE;
+			break;
+		}
+		if (!job.success[count]) {
+			success = OPJ_FALSE;
+			count++;
+			break;
+		}
+	}
+
+	/* the image components are filled by several tiles at once */
+	if (cp->output_format == OUTPUT_PLANAR) {
+		for (compno = 0; compno < tcd->image->numcomps; compno++) {
+			opj_image_comp_t *imagec = &tcd->image->comps[compno];
+			if (!imagec->data) {
+				imagec->data = (int*) opj_malloc(imagec->w * imagec->h * sizeof(int));
+				/* the tiles would all allocate it again at the same time */
+				if (!imagec->data) {
+					return OPJ_FALSE;
+				}
+			}
+		}
+	}
+
+	/* tier-1, inverse transforms and output of the tiles kept */
+	opj_parallel_for(count, cp->num_threads, tcd_t1_decode_job, &job);
+	for (i = 0; i < count; i++) {
+		success = success && job.success[i];
+	}
+
+	return success;
+}
+
 void tcd_free_decode(opj_tcd_t *tcd) {
+	int tileno, slot;
 	opj_tcd_image_t *tcd_image = tcd->tcd_image;	
+
+	for (tileno = 0; tileno < tcd_image->tiles_size; tileno++) {
+		tcd_free_decode_tile(tcd, tileno);
+	}
 	opj_free(tcd_image->tiles);
+	tcd_image->tiles = NULL;
+	tcd_image->tiles_size = 0;
+
+	for (slot = 0; slot < OPJ_MAX_THREADS; slot++) {
+		opj_tcd_scratch_t *scratch = tcd->scratch[slot];
+		int i;
+		if (!scratch) {
+			continue;
+		}
+		for (i = 0; i < OPJ_MAX_THREADS; i++) {
+			t1_destroy(scratch->t1s[i]);
+			opj_aligned_free(scratch->dwt_mem[i]);
+		}
+		opj_free(scratch->cblks);
+		opj_aligned_free(scratch->data);
+		opj_arena_free(&scratch->arena);
+		opj_free(scratch);
+		tcd->scratch[slot] = NULL;
+	}
+	opj_free(tcd->tile_success);
+	tcd->tile_success = NULL;
+	tcd->tile_success_size = 0;
 }
 
 void tcd_free_decode_tile(opj_tcd_t *tcd, int tileno) {
@@ -1500,15 +2351,23 @@ void tcd_free_decode_tile(opj_tcd_t *tcd, int tileno) {
 
 	opj_tcd_image_t *tcd_image = tcd->tcd_image;
 
+	/* everything allocated is freed, the sizes may be larger than the last codestream used */
 	opj_tcd_tile_t *tile = &tcd_image->tiles[tileno];
-	for (compno = 0; compno < tile->numcomps; compno++) {
+	for (compno = 0; compno < tile->comps_size; compno++) {
 		opj_tcd_tilecomp_t *tilec = &tile->comps[compno];
-		for (resno = 0; resno < tilec->numresolutions; resno++) {
+		for (resno = 0; resno < tilec->resolutions_size; resno++) {
 			opj_tcd_resolution_t *res = &tilec->resolutions[resno];
-			for (bandno = 0; bandno < res->numbands; bandno++) {
+			for (bandno = 0; bandno < 3; bandno++) {
 				opj_tcd_band_t *band = &res->bands[bandno];
-				for (precno = 0; precno < res->ph * res->pw; precno++) {
+				for (precno = 0; precno < band->precincts_size; precno++) {
 					opj_tcd_precinct_t *prec = &band->precincts[precno];
+					int cblkno;
+					for (cblkno = 0; cblkno < prec->cblks_size; cblkno++) {
+						opj_tcd_cblk_dec_t *cblk = &prec->cblks.dec[cblkno];
+						opj_free(cblk->data);
+						opj_free(cblk->segs);
+					}
+					opj_free(prec->cblks.dec);
 					if (prec->imsbtree != NULL) tgt_destroy(prec->imsbtree);
 					if (prec->incltree != NULL) tgt_destroy(prec->incltree);
 				}
@@ -1518,6 +2377,9 @@ void tcd_free_decode_tile(opj_tcd_t *tcd, int tileno) {
 		opj_free(tilec->resolutions);
 	}
 	opj_free(tile->comps);
+	tile->comps = NULL;
+	tile->comps_size = 0;
+	tile->numcomps = 0;
 }
 
 
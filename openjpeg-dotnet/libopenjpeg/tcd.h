@@ -48,6 +48,7 @@ typedef struct opj_tcd_seg {
   unsigned char** data;
   int dataindex;
   int numpasses;
+  int real_num_passes;	/* number of passes whose data was kept, the others belong to layers beyond cp_layer */
   int len;
   int maxpasses;
   int numnewpasses;
@@ -60,6 +61,7 @@ FIXME: documentation
 typedef struct opj_tcd_pass {
   int rate;
   double distortiondec;
+  double wmsedec;		/* distortion decrease of this pass alone */
   int term, len;
 } opj_tcd_pass_t;
 
@@ -97,6 +99,9 @@ typedef struct opj_tcd_cblk_dec {
   int len;			/* length */
   int numnewpasses;		/* number of pass added to the code-blocks */
   int numsegs;			/* number of segments */
+  int real_num_segs;		/* number of segments holding data tier-1 may decode */
+  int data_size;		/* number of bytes allocated for data, kept from one codestream to the next */
+  int segs_size;		/* number of segments allocated */
 } opj_tcd_cblk_dec_t;
 
 /**
@@ -111,6 +116,7 @@ typedef struct opj_tcd_precinct {
   } cblks;
   opj_tgt_tree_t *incltree;		/* inclusion tree */
   opj_tgt_tree_t *imsbtree;		/* IMSB tree */
+  int cblks_size;		/* number of decoded code-blocks allocated */
 } opj_tcd_precinct_t;
 
 /**
@@ -120,6 +126,7 @@ typedef struct opj_tcd_band {
   int x0, y0, x1, y1;		/* dimension of the subband : left upper corner (x0, y0) right low corner (x1,y1) */
   int bandno;
   opj_tcd_precinct_t *precincts;	/* precinct information */
+  int precincts_size;		/* number of precincts allocated by the decoder */
   int numbps;
   float stepsize;
 } opj_tcd_band_t;
@@ -140,7 +147,10 @@ FIXME: documentation
 typedef struct opj_tcd_tilecomp {
   int x0, y0, x1, y1;		/* dimension of component : left upper corner (x0, y0) right low corner (x1,y1) */
   int numresolutions;		/* number of resolutions level */
+  int minimum_num_resolutions;	/* number of resolutions level to decode, the others are discarded by cp_reduce */
+  int resno_decoded;		/* highest resolution tier-2 found data for, then the one the tile is reconstructed at */
   opj_tcd_resolution_t *resolutions;	/* resolutions information */
+  int resolutions_size;		/* number of resolutions allocated by the decoder */
   int *data;			/* data of the component */
   int numpix;			/* add fixed_quality */
 } opj_tcd_tilecomp_t;
@@ -152,6 +162,7 @@ typedef struct opj_tcd_tile {
   int x0, y0, x1, y1;		/* dimension of the tile : left upper corner (x0, y0) right low corner (x1,y1) */
   int numcomps;			/* number of components in tile */
   opj_tcd_tilecomp_t *comps;	/* Components information */
+  int comps_size;		/* number of components allocated by the decoder */
   int numpix;			/* add fixed_quality */
   double distotile;		/* add fixed_quality */
   double distolayer[100];	/* add fixed_quality */
@@ -165,8 +176,32 @@ FIXME: documentation
 typedef struct opj_tcd_image {
   int tw, th;			/* number of tiles in width and heigth */
   opj_tcd_tile_t *tiles;		/* Tiles information */
+  int tiles_size;		/* number of tiles allocated by the decoder */
 } opj_tcd_image_t;
 
+/**
+Scratch memory of the tile decoder. One is used by each tile decoded at a time and
+kept by the TCD handle from one tile and one codestream to the next.
+*/
+typedef struct opj_tcd_scratch {
+	/** T1 handle of each thread decoding code-blocks, created on first use */
+	struct opj_t1 *t1s[OPJ_MAX_THREADS];
+	/** code-block list of t1_decode_cblks */
+	void *cblks;
+	/** number of code-blocks cblks has room for */
+	int cblks_size;
+	/** line buffer of each thread of the inverse DWT */
+	void *dwt_mem[OPJ_MAX_THREADS];
+	/** size of each line buffer in bytes */
+	int dwt_mem_size[OPJ_MAX_THREADS];
+	/** samples of every component of the tile */
+	int *data;
+	/** number of samples data has room for */
+	int data_size;
+	/** memory of the tier-2 decoding of one tile, released when the next tile starts */
+	opj_arena_t arena;
+} opj_tcd_scratch_t;
+
 /**
 Tile coder/decoder
 */
@@ -198,6 +233,12 @@ typedef struct opj_tcd {
 	int tcd_tileno;
 	/** Time taken to encode a tile*/
 	double encoding_time;
+	/** scratch memory of the decoder, one per tile decoded at the same time */
+	opj_tcd_scratch_t *scratch[OPJ_MAX_THREADS];
+	/** outcome of each tile decoded in parallel */
+	opj_bool *tile_success;
+	/** number of tiles tile_success has room for */
+	int tile_success_size;
 } opj_tcd_t;
 
 /** @name Exported functions */
@@ -241,13 +282,25 @@ Initialize the tile coder (reuses the memory allocated by tcd_malloc_encode)
 */
 void tcd_init_encode(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp, int curtileno);
 /**
-Initialize the tile decoder
+Initialize the tile decoder. The tiles of the previous codestream decoded with the
+handle are kept, so the memory is only allocated again if this one needs more.
 @param tcd TCD handle
 @param image Raw image
 @param cp Coding parameters
+@return Returns false if the tiles cannot be allocated
 */
-void tcd_malloc_decode(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp);
-void tcd_malloc_decode_tile(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp, int tileno, opj_codestream_info_t *cstr_info);
+opj_bool tcd_malloc_decode(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp);
+/**
+Allocate one tile for decoding, reusing the resolutions, precincts, code-blocks and
+tag trees already allocated for it
+@param tcd TCD handle
+@param image Raw image
+@param cp Coding parameters
+@param tileno Position of the tile in the codestream, an index in cp->tileno
+@param cstr_info Codestream information structure
+@return Returns false if the tile cannot be allocated, it is then left without components
+*/
+opj_bool tcd_malloc_decode_tile(opj_tcd_t *tcd, opj_image_t * image, opj_cp_t * cp, int tileno, opj_codestream_info_t *cstr_info);
 void tcd_makelayer_fixed(opj_tcd_t *tcd, int layno, int final);
 void tcd_rateallocate_fixed(opj_tcd_t *tcd);
 void tcd_makelayer(opj_tcd_t *tcd, int layno, double thresh, int final);
@@ -272,10 +325,26 @@ Decode a tile from a buffer into a raw image
 */
 opj_bool tcd_decode_tile(opj_tcd_t *tcd, unsigned char *src, int len, int tileno, opj_codestream_info_t *cstr_info);
 /**
-Free the memory allocated for decoding
+Decode every tile of the codestream into the image.
+Tiles are decoded at the same time on cp->num_threads threads; the result is the same
+as calling tcd_decode_tile on each of them in codestream order.
+@param tcd TCD handle, set up by tcd_malloc_decode
+@param tile_data Source buffer of each tile
+@param tile_len Length of the source buffer of each tile
+@param cstr_info Codestream information structure
+@return Returns false if a tile failed to decode
+*/
+opj_bool tcd_decode_tiles(opj_tcd_t *tcd, unsigned char **tile_data, int *tile_len, opj_codestream_info_t *cstr_info);
+/**
+Free the memory kept for decoding: the tiles and the scratch memory
 @param tcd TCD handle
 */
 void tcd_free_decode(opj_tcd_t *tcd);
+/**
+Free the memory kept for decoding one tile
+@param tcd TCD handle
+@param tileno Number that identifies the tile
+*/
 void tcd_free_decode_tile(opj_tcd_t *tcd, int tileno);
 
 /* ----------------------------------------------------------------------- */
@@ -0,0 +1,361 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif /* _WIN32 */
+#include "opj_includes.h"
+
+/** @defgroup THREAD THREAD - Implementation of a work-stealing thread pool */
+/*@{*/
+
+/* ----------------------------------------------------------------------- */
+
+#ifdef _WIN32
+typedef CRITICAL_SECTION opj_mutex_t;
+typedef CONDITION_VARIABLE opj_cond_t;
+typedef LONGLONG opj_range_t;
+#define opj_mutex_init(m) InitializeCriticalSection(m)
+#define opj_mutex_lock(m) EnterCriticalSection(m)
+#define opj_mutex_unlock(m) LeaveCriticalSection(m)
+#define opj_cond_init(c) InitializeConditionVariable(c)
+#define opj_cond_wait(c, m) SleepConditionVariableCS((c), (m), INFINITE)
+#define opj_cond_broadcast(c) WakeAllConditionVariable(c)
+#define opj_cas_int(p, o, n) (InterlockedCompareExchange((volatile LONG*)(p), (n), (o)) == (o))
+#define opj_cas_range(p, o, n) (InterlockedCompareExchange64((p), (n), (o)) == (o))
+#define opj_load_range(p) InterlockedCompareExchange64((p), 0, 0)
+#define opj_yield() SwitchToThread()
+#else
+typedef pthread_mutex_t opj_mutex_t;
+typedef pthread_cond_t opj_cond_t;
+typedef long long opj_range_t;
+#define opj_mutex_init(m) pthread_mutex_init((m), NULL)
+#define opj_mutex_lock(m) pthread_mutex_lock(m)
+#define opj_mutex_unlock(m) pthread_mutex_unlock(m)
+#define opj_cond_init(c) pthread_cond_init((c), NULL)
+#define opj_cond_wait(c, m) pthread_cond_wait((c), (m))
+#define opj_cond_broadcast(c) pthread_cond_broadcast(c)
+#define opj_cas_int(p, o, n) __sync_bool_compare_and_swap((p), (o), (n))
+#define opj_cas_range(p, o, n) __sync_bool_compare_and_swap((p), (o), (n))
+#define opj_load_range(p) __sync_val_compare_and_swap((p), 0, 0)
+#define opj_yield() sched_yield()
+#endif /* _WIN32 */
+
+/**
+Work items not yet started by one thread of a job. Begin and end are packed in
+one 64 bit word so the owner taking an item from the front and a thief taking
+the back half always see a consistent range. Padded to a cache line.
+*/
+typedef struct opj_slot_range {
+	volatile opj_range_t range;
+	char pad[64 - sizeof(opj_range_t)];
+} opj_slot_range_t;
+
+/**
+A running opj_parallel_for call, lives on the stack of the calling thread
+*/
+typedef struct opj_job {
+	opj_work_fn fn;
+	void *user_data;
+	/** number of threads the items were split between */
+	int nslots;
+	/** slots handed out so far, the calling thread has slot 0 */
+	int joined;
+	/** threads still working on the job */
+	int running;
+	/** next job waiting for threads */
+	struct opj_job *next;
+	opj_slot_range_t ranges[OPJ_MAX_THREADS];
+} opj_job_t;
+
+/**
+Process wide worker threads, started on first use and never stopped
+*/
+typedef struct opj_pool {
+	opj_mutex_t mutex;
+	/** signalled when a job is queued */
+	opj_cond_t work;
+	/** signalled when a thread leaves a job */
+	opj_cond_t done;
+	/** jobs with slots left, most recent first so nested jobs finish early */
+	opj_job_t *jobs;
+} opj_pool_t;
+
+static opj_pool_t pool;
+/** 0 = not started, 1 = starting, 2 = running */
+static volatile int pool_state = 0;
+
+/** @name Local static functions */
+/*@{*/
+/**
+Get the number of processors, or the OPJ_NUM_THREADS environment variable if
+set, capped at OPJ_MAX_THREADS
+*/
+static int opj_num_cpus(void);
+/**
+Start the worker threads once
+*/
+static void opj_pool_start(void);
+/**
+Run items of a job until none are left, stealing from other threads
+@param job Job to work on
+@param slot Slot of the calling thread
+*/
+static void opj_job_run(opj_job_t *job, int slot);
+/**
+Move the back half of the largest range of a job into an empty slot
+@param job Job to steal from
+@param slot Slot receiving the work
+@return Returns false if no work is left in the job
+*/
+static opj_bool opj_job_steal(opj_job_t *job, int slot);
+/*@}*/
+
+/*@}*/
+
+/* ----------------------------------------------------------------------- */
+
+static INLINE opj_range_t opj_range_pack(int begin, int end) {
+	return ((opj_range_t)end << 32) | (unsigned int)begin;
+}
+
+static INLINE int opj_range_begin(opj_range_t range) {
+	return (int)(range & 0xffffffff);
+}
+
+static INLINE int opj_range_end(opj_range_t range) {
+	return (int)(range >> 32);
+}
+
+static int opj_num_cpus(void) {
+	static int num_cpus = 0;
+	int n = num_cpus;
+
+	if (n == 0) {
+		const char *env = getenv("OPJ_NUM_THREADS");
+		if (env != NULL && atoi(env) > 0) {
+			n = atoi(env);
+		} else {
+#ifdef _WIN32
+			SYSTEM_INFO info;
+			GetSystemInfo(&info);
+			n = (int)info.dwNumberOfProcessors;
+#else
+			n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		}
+		n = int_clamp(n, 1, OPJ_MAX_THREADS);
+		num_cpus = n;
+	}
+	return n;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI opj_worker(LPVOID arg) {
+#else
+static void* opj_worker(void *arg) {
+#endif
+	(void)arg;
+	opj_mutex_lock(&pool.mutex);
+	for (;;) {
+		opj_job_t *job = pool.jobs;
+		int slot;
+
+		if (job == NULL) {
+			opj_cond_wait(&pool.work, &pool.mutex);
+			continue;
+		}
+
+		slot = job->joined++;
+		if (job->joined == job->nslots) {
+			pool.jobs = job->next;
+		}
+		job->running++;
+		opj_mutex_unlock(&pool.mutex);
+
+		opj_job_run(job, slot);
+
+		opj_mutex_lock(&pool.mutex);
+		if (--job->running == 0) {
+			opj_cond_broadcast(&pool.done);
+		}
+	}
+#ifndef _WIN32
+	return NULL;
+#endif
+}
+
+static void opj_pool_start(void) {
+	int i;
+
+	if (pool_state == 2) {
+		return;
+	}
+	if (!opj_cas_int(&pool_state, 0, 1)) {
+		/* another thread is starting the pool */
+		while (!opj_cas_int(&pool_state, 2, 2)) {
+			opj_yield();
+		}
+		return;
+	}
+
+	opj_mutex_init(&pool.mutex);
+	opj_cond_init(&pool.work);
+	opj_cond_init(&pool.done);
+	pool.jobs = NULL;
+
+	/* the thread calling opj_parallel_for is the last one */
+	for (i = 1; i < opj_num_cpus(); i++) {
+#ifdef _WIN32
+		HANDLE thread = CreateThread(NULL, 0, opj_worker, NULL, 0, NULL);
+		if (thread == NULL) {
+			break;
+		}
+		CloseHandle(thread);
+#else
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, opj_worker, NULL) != 0) {
+			break;
+		}
+		pthread_detach(thread);
+#endif
+	}
+
+	opj_cas_int(&pool_state, 1, 2);
+}
+
+static opj_bool opj_job_steal(opj_job_t *job, int slot) {
+	for (;;) {
+		opj_range_t range = 0;
+		int i, victim = -1, most = 0;
+		int begin, end, mid;
+
+		for (i = 0; i < job->nslots; i++) {
+			opj_range_t r = opj_load_range(&job->ranges[i].range);
+			int left = opj_range_end(r) - opj_range_begin(r);
+			if (left > most) {
+				most = left;
+				victim = i;
+				range = r;
+			}
+		}
+		if (victim < 0) {
+			return OPJ_FALSE;
+		}
+
+		begin = opj_range_begin(range);
+		end = opj_range_end(range);
+		mid = begin + (end - begin) / 2;
+		if (opj_cas_range(&job->ranges[victim].range, range, opj_range_pack(begin, mid))) {
+			/* nobody steals from an empty range, so this only races with stale readers */
+			opj_range_t own;
+			do {
+				own = opj_load_range(&job->ranges[slot].range);
+			} while (!opj_cas_range(&job->ranges[slot].range, own, opj_range_pack(mid, end)));
+			return OPJ_TRUE;
+		}
+	}
+}
+
+static void opj_job_run(opj_job_t *job, int slot) {
+	volatile opj_range_t *own = &job->ranges[slot].range;
+
+	do {
+		for (;;) {
+			opj_range_t range = opj_load_range(own);
+			int begin = opj_range_begin(range);
+			if (begin >= opj_range_end(range)) {
+				break;
+			}
+			if (opj_cas_range(own, range, opj_range_pack(begin + 1, opj_range_end(range)))) {
+				job->fn(job->user_data, begin, slot);
+			}
+		}
+	} while (opj_job_steal(job, slot));
+}
+
+/* ----------------------------------------------------------------------- */
+
+int opj_parallel_slots(int count, int max_threads) {
+	int n = opj_num_cpus();
+
+	if (max_threads > 0 && max_threads < n) {
+		n = max_threads;
+	}
+	if (count < n) {
+		n = count;
+	}
+	return int_max(n, 1);
+}
+
+void opj_parallel_for(int count, int max_threads, opj_work_fn fn, void *user_data) {
+	opj_job_t job;
+	opj_job_t **link;
+	int i;
+
+	job.nslots = opj_parallel_slots(count, max_threads);
+	if (job.nslots == 1) {
+		for (i = 0; i < count; i++) {
+			fn(user_data, i, 0);
+		}
+		return;
+	}
+
+	opj_pool_start();
+
+	job.fn = fn;
+	job.user_data = user_data;
+	for (i = 0; i < job.nslots; i++) {
+		job.ranges[i].range = opj_range_pack(
+			(int)((long long)count * i / job.nslots),
+			(int)((long long)count * (i + 1) / job.nslots));
+	}
+	job.joined = 1;
+	job.running = 1;
+
+	opj_mutex_lock(&pool.mutex);
+	job.next = pool.jobs;
+	pool.jobs = &job;
+	opj_cond_broadcast(&pool.work);
+	opj_mutex_unlock(&pool.mutex);
+
+	opj_job_run(&job, 0);
+
+	/* stop handing out slots, then wait for the threads still busy with an item */
+	opj_mutex_lock(&pool.mutex);
+	for (link = &pool.jobs; *link != NULL; link = &(*link)->next) {
+		if (*link == &job) {
+			*link = job.next;
+			break;
+		}
+	}
+	job.running--;
+	while (job.running > 0) {
+		opj_cond_wait(&pool.done, &pool.mutex);
+	}
+	opj_mutex_unlock(&pool.mutex);
+}
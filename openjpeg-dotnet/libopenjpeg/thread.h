@@ -0,0 +1,78 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __THREAD_H
+#define __THREAD_H
+/**
+@file thread.h
+@brief Implementation of a work-stealing thread pool (THREAD)
+
+The functions in THREAD.C run independent work items on a process wide pool of
+worker threads. The items of a job are split into one contiguous range per
+participating thread; a thread that runs out of work steals half of the largest
+range left. The calling thread always takes part, so jobs may be nested: a work
+item can start its own job and the idle workers will help with it.
+*/
+
+/** @defgroup THREAD THREAD - Implementation of a work-stealing thread pool */
+/*@{*/
+
+/** Largest number of threads taking part in one job */
+#define OPJ_MAX_THREADS 64
+
+/**
+Work item callback
+@param user_data Pointer given to opj_parallel_for
+@param index Index of the work item, from 0 to count - 1
+@param slot Index of the thread running the item within this job, from 0 to
+the value returned by opj_parallel_slots - 1. Two items running at the same
+time never share a slot, so it can select per-thread scratch memory
+*/
+typedef void (*opj_work_fn)(void *user_data, int index, int slot);
+
+/** @name Exported functions */
+/*@{*/
+/* ----------------------------------------------------------------------- */
+/**
+Get the number of threads a job of count items would run on
+@param count Number of work items
+@param max_threads Upper bound on the number of threads, 0 for no limit
+@return Returns the number of slots, at least 1
+*/
+int opj_parallel_slots(int count, int max_threads);
+/**
+Run fn on every index from 0 to count - 1 and wait for all of them to finish.
+The pool is started on first use with one thread per processor, or as many
+as the OPJ_NUM_THREADS environment variable asks for.
+@param count Number of work items
+@param max_threads Upper bound on the number of threads, 0 for no limit and 1
+to run every item on the calling thread
+@param fn Work item callback
+@param user_data Passed to every call of fn
+*/
+void opj_parallel_for(int count, int max_threads, opj_work_fn fn, void *user_data);
+/* ----------------------------------------------------------------------- */
+/*@}*/
+
+/*@}*/
+
+#endif /* __THREAD_H */
@@ -0,0 +1,143 @@
+/*
+ * Decodes a multi-tile codestream in full and then again with only its packet
+ * headers, on the same decompressor and with several threads, as an indexer
+ * reusing a decoder does. No pixels may be written by the second decode.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "openjpeg.h"
+
+#define WIDTH 256
+#define HEIGHT 192
+#define NUM_COMPS 3
+
+static void error_callback(const char *msg, void *client_data) {
+	(void)client_data;
+	fprintf(stderr, "[ERROR] %s", msg);
+}
+
+static int encode(unsigned char **buffer) {
+	opj_cparameters_t parameters;
+	opj_image_cmptparm_t cmptparm[NUM_COMPS];
+	opj_event_mgr_t event_mgr;
+	opj_image_t *image;
+	opj_cinfo_t *cinfo;
+	opj_cio_t *cio;
+	int compno, i, len = 0;
+
+	memset(cmptparm, 0, sizeof(cmptparm));
+	for (compno = 0; compno < NUM_COMPS; compno++) {
+		cmptparm[compno].dx = 1;
+		cmptparm[compno].dy = 1;
+		cmptparm[compno].w = WIDTH;
+		cmptparm[compno].h = HEIGHT;
+		cmptparm[compno].prec = 8;
+		cmptparm[compno].bpp = 8;
+	}
+	image = opj_image_create(NUM_COMPS, cmptparm, CLRSPC_SRGB);
+	image->x1 = WIDTH;
+	image->y1 = HEIGHT;
+	for (compno = 0; compno < NUM_COMPS; compno++) {
+		for (i = 0; i < WIDTH * HEIGHT; i++) {
+			image->comps[compno].data[i] = ((i % WIDTH) * 3 + (i / WIDTH) * 5 + compno * 40) & 255;
+		}
+	}
+
+	opj_set_default_encoder_parameters(&parameters);
+	parameters.irreversible = 1;
+	parameters.tcp_mct = 1;
+	parameters.tcp_numlayers = 2;
+	parameters.tcp_rates[0] = 40;
+	parameters.tcp_rates[1] = 10;
+	parameters.cp_disto_alloc = 1;
+	parameters.tile_size_on = OPJ_TRUE;
+	parameters.cp_tdx = 64;
+	parameters.cp_tdy = 64;
+
+	memset(&event_mgr, 0, sizeof(opj_event_mgr_t));
+	event_mgr.error_handler = error_callback;
+
+	cinfo = opj_create_compress(CODEC_J2K);
+	opj_set_event_mgr((opj_common_ptr)cinfo, &event_mgr, NULL);
+	opj_setup_encoder(cinfo, &parameters, image);
+	cio = opj_cio_open((opj_common_ptr)cinfo, NULL, 0);
+	if (opj_encode(cinfo, cio, image, NULL)) {
+		len = cio_tell(cio);
+		*buffer = (unsigned char*) malloc(len);
+		memcpy(*buffer, cio->buffer, len);
+	}
+	opj_cio_close(cio);
+	opj_destroy_compress(cinfo);
+	opj_image_destroy(image);
+
+	return len;
+}
+
+static opj_image_t* decode(opj_dinfo_t *dinfo, OPJ_LIMIT_DECODING limit, unsigned char *buffer, int len) {
+	opj_dparameters_t parameters;
+	opj_cio_t *cio;
+	opj_image_t *image;
+
+	opj_set_default_decoder_parameters(&parameters);
+	parameters.cp_limit_decoding = limit;
+	parameters.cp_num_threads = 0;
+	opj_setup_decoder(dinfo, &parameters);
+
+	cio = opj_cio_open((opj_common_ptr)dinfo, buffer, len);
+	image = opj_decode(dinfo, cio);
+	opj_cio_close(cio);
+
+	return image;
+}
+
+int main(void) {
+	opj_event_mgr_t event_mgr;
+	opj_dinfo_t *dinfo;
+	opj_image_t *image;
+	unsigned char *buffer = NULL;
+	int compno, len, failed = 0;
+
+	/* one slot per tile column at least, whatever the machine */
+	setenv("OPJ_NUM_THREADS", "4", 1);
+
+	len = encode(&buffer);
+	if (!len) {
+		fprintf(stderr, "encoding failed\n");
+		return 1;
+	}
+
+	memset(&event_mgr, 0, sizeof(opj_event_mgr_t));
+	event_mgr.error_handler = error_callback;
+	dinfo = opj_create_decompress(CODEC_J2K);
+	opj_set_event_mgr((opj_common_ptr)dinfo, &event_mgr, NULL);
+
+	image = decode(dinfo, NO_LIMITATION, buffer, len);
+	if (!image) {
+		fprintf(stderr, "full decode failed\n");
+		failed = 1;
+	} else {
+		opj_image_destroy(image);
+	}
+
+	image = decode(dinfo, LIMIT_TO_PACKET_HEADERS, buffer, len);
+	if (!image) {
+		fprintf(stderr, "packet header decode failed\n");
+		failed = 1;
+	} else {
+		for (compno = 0; compno < image->numcomps; compno++) {
+			if (image->comps[compno].data) {
+				fprintf(stderr, "packet header decode wrote component %d\n", compno);
+				failed = 1;
+			}
+		}
+		opj_image_destroy(image);
+	}
+
+	opj_destroy_decompress(dinfo);
+	free(buffer);
+
+	printf("packet_headers: %s\n", failed ? "FAILED" : "passed");
+	return failed;
+}